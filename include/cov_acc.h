@@ -0,0 +1,53 @@
+#pragma once
+
+#include "lin_alg_config.h"
+#include "vec.h"
+#include "mat.h"
+
+/*
+ * Streaming column statistics of a row stream: count, mean and covariance.
+ * Row blocks are folded in with Chan et al.'s pairwise update: each block is centered
+ * at its own mean, its scatter matrix is added with one SYRK, and the mean shift enters
+ * as a rank-one correction. Accumulators of disjoint parts of the data (e.g. one per
+ * worker thread) can be merged the same way. An accumulator is not thread-safe itself.
+ */
+
+/**
+ * cov_acc - Covariance accumulator of d columns.
+ *
+ * - n: Number of rows seen.
+ * - mean: Running column means, d elements.
+ * - m2: Scatter matrix sum (x - mean) (*) (x - mean), d x d, symmetric.
+ * - buf: Scratch for the centered block; grows to the largest block.
+ */
+typedef struct cov_acc
+{
+    IND_TYP n;
+    vec mean;
+    mat m2;
+    mat buf;
+} cov_acc;
+
+#define cov_acc_NULL ((const cov_acc){.n = 0, .mean = vec_NULL, .m2 = mat_NULL, .buf = mat_NULL})
+
+cov_acc *cov_acc_construct(cov_acc *acc, IND_TYP d);
+
+void cov_acc_destruct(cov_acc *acc);
+
+// Forgets all the rows seen
+cov_acc *cov_acc_reset(cov_acc *acc);
+
+// Adds the rows of blk (b x d)
+cov_acc *cov_acc_update(cov_acc *acc, const mat *blk);
+
+// Adds the rows seen by oth; oth is left unchanged
+cov_acc *cov_acc_merge(cov_acc *acc, const cov_acc *oth);
+
+// mean = column means; acc->n > 0
+vec *cov_acc_mean(const cov_acc *acc, vec *mean);
+
+// var = column variances m2_jj / (n - ddof); acc->n > ddof
+vec *cov_acc_var(const cov_acc *acc, vec *var, IND_TYP ddof);
+
+// cov = m2 / (n - ddof), d x d; ddof = 1 gives the unbiased sample covariance; acc->n > ddof
+mat *cov_acc_cov(const cov_acc *acc, mat *cov, IND_TYP ddof);
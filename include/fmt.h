@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "lin_alg_config.h"
+#include "vec.h"
+#include "mat.h"
+
+/*
+ * Text formatting of vec and mat: [a,b,c] and [[a,b],\n [c,d]].
+ * Output is produced in one pass with a built-in float-to-text routine (%g style) and
+ * written incrementally: bounded into a caller buffer (snprintf semantics) or streamed
+ * through a small stack buffer to a FILE * or a file descriptor.
+ */
+
+// Output size enough for any fmt_fld result
+#define FMT_FLD_MAX 32
+
+/**
+ * fmt_spec - Formatting options.
+ *
+ * - prec: Significant digits, 1 to 17.
+ * - edge: Summarized mode when > 0: only the first and last edge elements (rows and columns
+ *   of a mat) of a longer dimension are printed, the rest is replaced by "...".
+ */
+typedef struct fmt_spec
+{
+    int prec;
+    IND_TYP edge;
+} fmt_spec;
+
+#define fmt_spec_DEFAULT ((const fmt_spec){.prec = 6, .edge = 0})
+
+// Writes x like "%.<prec>g" into out (at least FMT_FLD_MAX chars); returns the length.
+// Same text as printf: digits come from scaled integer arithmetic, or from snprintf where
+// that cannot round exactly (values near halfway between two outputs, prec above 15).
+size_t fmt_fld(char *out, FLD_TYP x, int prec);
+
+// Formats v into str of size bytes, truncated and always terminated (size > 0); returns the
+// full length of the text, so the output was truncated if the result is >= size
+size_t vec_to_strn(const vec *v, char *str, size_t size, const fmt_spec *spec);
+
+// Writes v to the stream f / the file descriptor fd; returns the bytes written, -1 on error
+IND_TYP vec_fprint(FILE *f, const vec *v, const fmt_spec *spec);
+
+IND_TYP vec_dprint(int fd, const vec *v, const fmt_spec *spec);
+
+// Same as vec_to_strn for a mat; a mat_NULL gives "mat_NULL\n"
+size_t mat_to_strn(const mat *m, char *str, size_t size, const fmt_spec *spec);
+
+IND_TYP mat_fprint(FILE *f, const mat *m, const fmt_spec *spec);
+
+IND_TYP mat_dprint(int fd, const mat *m, const fmt_spec *spec);
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "lin_alg_config.h"
+#include "vec.h"
+#include "mat.h"
+
+/*
+ * Matrix-free iterative solvers for A x = b: CG (A symmetric positive definite),
+ * restarted GMRES and BiCGSTAB (general A).
+ * A and the optional preconditioner M ~ A^-1 are given as operators. All the work
+ * vectors live in a preallocated iter_ws; the solvers allocate nothing.
+ * x holds the initial guess on entry and the solution on return.
+ * The solvers return the number of iterations done, or -1 if ||b - A x|| <= tol * ||b||
+ * was not reached within max_iter; *res_norm (may be NULL) gets the final relative residual.
+ */
+
+// out = op(in); out and in never overlap
+typedef void (*iter_apply)(vec *out, const vec *in, void *ctx);
+
+/**
+ * iter_op - Linear operator.
+ *
+ * - apply: Computes out = op(in).
+ * - ctx: Passed through to apply.
+ */
+typedef struct iter_op
+{
+    iter_apply apply;
+    void *ctx;
+} iter_op;
+
+#define iter_op_NONE ((const iter_op){.apply = NULL, .ctx = NULL})
+
+/**
+ * iter_param - Solver parameters.
+ *
+ * - tol: Relative residual tolerance.
+ * - max_iter: Maximum number of iterations (operator applications for GMRES).
+ * - prec: Preconditioner; iter_op_NONE for none. BiCGSTAB and GMRES apply it on the right.
+ */
+typedef struct iter_param
+{
+    FLT_TYP tol;
+    IND_TYP max_iter;
+    iter_op prec;
+} iter_param;
+
+/**
+ * iter_ws - Preallocated solver workspace.
+ *
+ * - vs: Work vectors stored as rows; d2 is the problem size.
+ * - h: GMRES Hessenberg matrix, (restart + 1) x restart; mat_NULL if restart is 0.
+ * - givens: GMRES rotation cosines, sines, residual and solution, 4 * (restart + 1) elements.
+ * - restart: GMRES Krylov subspace size.
+ */
+typedef struct iter_ws
+{
+    mat vs;
+    mat h;
+    FLD_TYP *givens;
+    IND_TYP restart;
+} iter_ws;
+
+#define iter_ws_NULL ((const iter_ws){.vs = mat_NULL, .h = mat_NULL, .givens = NULL, .restart = 0})
+
+// Allocates a workspace for problems of size d; restart is the GMRES Krylov size (0 if unused)
+iter_ws *iter_ws_construct(iter_ws *ws, IND_TYP d, IND_TYP restart);
+
+void iter_ws_destruct(iter_ws *ws);
+
+// iter_apply with ctx a const mat *: out = ctx @ in
+void iter_apply_mat(vec *out, const vec *in, void *m);
+
+// iter_apply with ctx a const vec * of inverted diagonal entries: out = ctx * in (Jacobi)
+void iter_apply_diag(vec *out, const vec *in, void *inv_diag);
+
+IND_TYP iter_cg(vec *x, iter_op a, const vec *b, const iter_param *prm, iter_ws *ws, FLT_TYP *res_norm);
+
+IND_TYP iter_gmres(vec *x, iter_op a, const vec *b, const iter_param *prm, iter_ws *ws, FLT_TYP *res_norm);
+
+IND_TYP iter_bicgstab(vec *x, iter_op a, const vec *b, const iter_param *prm, iter_ws *ws, FLT_TYP *res_norm);
@@ -3,5 +3,19 @@
 #include "vec.h"
 #include "mat.h"
 #include "vec_mat.h"
+#include "optim.h"
+#include "mat_solve.h"
+#include "iter_solve.h"
+#include "mat_svd.h"
+#include "cov_acc.h"
+#include "mat_knn.h"
+#include "vec_sort.h"
+#include "fmt.h"
+#include "mat_io.h"
+#include "mat_arch.h"
+#include "mat_zip.h"
+#include "mat_delta.h"
+#include "mat_ring.h"
+#include "vec_small.h"
 
 #include "slice.h"
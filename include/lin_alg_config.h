@@ -30,4 +30,9 @@
 #define IND_TYP int64_t
 #define IND_MAX INT64_MAX
 #define IND_MIN INT64_MIN
-#endif 
+#endif
+
+// Minimum number of elements for which native kernels run multi-threaded
+#ifndef PAR_MIN_SIZE
+#define PAR_MIN_SIZE 32768
+#endif
\ No newline at end of file
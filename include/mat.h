@@ -31,6 +31,9 @@ mat *mat_view(mat *m, const mat *src, IND_TYP offset, IND_TYP d1, IND_TYP d2);
 
 mat *mat_view_new(const mat *src, IND_TYP offset, IND_TYP d1, IND_TYP d2);
 
+// Constructs dst as a copy-on-write clone of src, as vec_clone
+mat *mat_clone(mat *dst, const mat *src);
+
 void mat_destruct(mat *m);
 
 mat *mat_new(IND_TYP d1, IND_TYP d2);
@@ -39,6 +42,11 @@ void mat_del(mat *m);
 
 mat *mat_assign(mat *m_dst, const mat *m_src);
 
+// Appends the rows of rows (may be m itself) below m, as vec_push_back: m is either mat_NULL
+// (then constructed as a copy of rows) or ends its RESIZABLE payload. Returns m, NULL on
+// failure (m unchanged).
+mat *mat_append_rows(mat *m, const mat *rows);
+
 mat *mat_fill_zero(mat *m);
 
 mat *mat_fill_rnd(mat *m, FLD_TYP (*rnd)(void));
@@ -77,7 +85,11 @@ FLT_TYP mat_norm_2(const mat *m);
 
 FLD_TYP mat_sum(const mat *m);
 
+// Same as vec_is_close on all the elements; false for different shapes
 bool mat_is_close(const mat *m_1, const mat *m_2, FLD_TYP eps);
+
+// Same as vec_allclose on all the elements; false for different shapes
+bool mat_allclose(const mat *m_1, const mat *m_2, FLD_TYP atol, FLD_TYP rtol);
 // mat *mat_fill(mat *m, FLD_TYP value);
 // mat *mat_diag_init(mat *m, const vec *v);
 
@@ -88,9 +100,38 @@ mat *mat_update(mat *trg, FLD_TYP alpha, const mat *m_right);
 FLD_TYP *mat_at(const mat *m, IND_TYP i, IND_TYP j);
 // Replace trg at specified row i and below with src and returns nbr of rows replaced
 IND_TYP mat_insert(mat *trg, const mat *src, IND_TYP row_i);
+// Marks the payload blocks under m dirty when its payload is tracked (see payload_track)
+static inline void mat_mark_dirty(const mat *m)
+{
+    payload_mark(m->pyl, m->offset, m->offset + m->size);
+}
+// Readies m for writing, as vec_touch
+static inline mat *mat_touch(mat *m)
+{
+    if (m->pyl->cow_ref && !payload_own(m->pyl))
+        return NULL;
+    mat_mark_dirty(m);
+    return m;
+}
 
 size_t mat_serial_size(const mat *m);
 // Returns the pointer to the first byte just after the last written byte to byte_arr
 uint8_t *mat_serialize(const mat *m, uint8_t *byte_arr);
 // Returns the pointer to the first byte just after the last read byte from byte_arr
 const uint8_t *mat_deserialize(mat *m, const uint8_t *byte_arr);
+
+/*
+ * Scaled dot-product attention: out = softmax(scale * q @ k^T) @ v (softmax over rows).
+ * q: Lq x dk, k: Lk x dk, v: Lk x dv, out: Lq x dv.
+ * If causal, query i attends to keys j <= i + Lk - Lq.
+ * K/V are streamed in tiles with an online softmax; the Lq x Lk scores are never stored.
+ * Returns NULL (out partly written) if a tile workspace could not be allocated.
+ */
+mat *mat_attention(mat *out, const mat *q, const mat *k, const mat *v, FLD_TYP scale, bool causal);
+
+/*
+ * Multi-head form of mat_attention: each row of q, k (v, out) is the concatenation
+ * of n_heads vectors of size dk (dv). Heads and query blocks run on separate threads.
+ */
+mat *mat_attention_heads(mat *out, const mat *q, const mat *k, const mat *v, IND_TYP n_heads,
+                         FLD_TYP scale, bool causal);
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "lin_alg_config.h"
+#include "vec.h"
+#include "mat.h"
+
+/*
+ * Archive of named vec and mat tensors, for checkpoints.
+ * Layout: a 64-byte header, an index of fixed-size records sorted by name (name, shape,
+ * dtype, data offset and size, checksum), then one data block per tensor, each starting at a
+ * multiple of ARCH_ALIGN. Tensors are written in parallel in ARCH_BLK pieces. Reading
+ * loads the index only; a tensor is found by binary search and mapped on demand, so a
+ * partial load touches only the pages of the tensors used.
+ * The checksum hashes the data in ARCH_BLK pieces (4-lane multiply-xor over 64-bit words,
+ * folded in order), so it is computed in parallel too. Little-endian hosts only.
+ */
+
+#define ARCH_ALIGN 64
+#define ARCH_NAME_MAX 64
+#ifndef ARCH_BLK
+#define ARCH_BLK (1 << 20)
+#endif
+
+/**
+ * arch_rec - Index record of one tensor, as stored in the file (128 bytes).
+ *
+ * - name: NUL-terminated, at most ARCH_NAME_MAX - 1 characters.
+ * - ndim: 1 for a vec, 2 for a mat; shape[ndim] its dimensions.
+ * - dtype: Element type code of the FLD_TYP of the writer.
+ * - offset, bytes: Position and size of the data in the file.
+ */
+typedef struct arch_rec
+{
+    char name[ARCH_NAME_MAX];
+    uint32_t ndim;
+    uint32_t dtype;
+    int64_t shape[2];
+    uint64_t offset;
+    uint64_t bytes;
+    uint64_t checksum;
+    uint8_t reserved[16];
+} arch_rec;
+
+/**
+ * arch_w - Archive writer: tensors registered by name, written at once by arch_w_save.
+ * Only the data pointers are kept, the tensors must stay alive until then.
+ */
+typedef struct arch_w
+{
+    IND_TYP n;
+    IND_TYP cap;
+    arch_rec *recs;
+    const FLD_TYP **arrs;
+    IND_TYP *steps;
+} arch_w;
+
+#define arch_w_NULL ((const arch_w){.n = 0, .cap = 0, .recs = NULL, .arrs = NULL, .steps = NULL})
+
+arch_w *arch_w_construct(arch_w *w);
+
+void arch_w_destruct(arch_w *w);
+
+// Registers v (may be strided) / m under name
+arch_w *arch_w_add_vec(arch_w *w, const char *name, const vec *v);
+
+arch_w *arch_w_add_mat(arch_w *w, const char *name, const mat *m);
+
+// Writes the registered tensors to path; returns the file size, -1 on error (duplicate names)
+IND_TYP arch_w_save(const arch_w *w, const char *path);
+
+/**
+ * arch - Archive opened for reading: its index and the open file.
+ */
+typedef struct arch
+{
+    int fd;
+    IND_TYP n;
+    arch_rec *recs;
+} arch;
+
+#define arch_NULL ((const arch){.fd = -1, .n = 0, .recs = NULL})
+
+// Reads the header and index of the archive at path; NULL (a is arch_NULL) on error
+arch *arch_open(arch *a, const char *path);
+
+void arch_close(arch *a);
+
+// Index record of name, NULL if absent
+const arch_rec *arch_find(const arch *a, const char *name);
+
+/*
+ * Constructs v / m over a private mapping of the data of name (payload_FLG_MMAP, see
+ * payload_map). With verify set, the data is read once and checked against its checksum.
+ * NULL (v / m is NULL) if name is absent, of another kind or dtype, or fails verification.
+ */
+vec *arch_load_vec(vec *v, const arch *a, const char *name, bool verify);
+
+mat *arch_load_mat(mat *m, const arch *a, const char *name, bool verify);
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lin_alg_config.h"
+#include "vec.h"
+#include "mat.h"
+
+/*
+ * Incremental (delta) checkpoints of vec and mat.
+ * A delta holds the elements written since the last clean: the dirty blocks of the payload
+ * (see payload_track) clipped to the vec / mat. A payload without tracking counts as all
+ * dirty, so its delta is a full copy.
+ * Layout: size_t serial size, the dims as in vec_serialize / mat_serialize, the IND_TYP run
+ * count, one (start, length) IND_TYP pair per run of element indexes (ascending, disjoint),
+ * then the elements of the runs in order.
+ */
+
+// Serial size of the delta of v / m
+size_t vec_serial_delta_size(const vec *v);
+
+size_t mat_serial_delta_size(const mat *m);
+
+// Writes the delta of v (may be strided) / m into byte_arr; returns the end of the written bytes
+uint8_t *vec_serialize_delta(const vec *v, uint8_t *byte_arr);
+
+uint8_t *mat_serialize_delta(const mat *m, uint8_t *byte_arr);
+
+// Replays a delta onto v / m of the same dims; returns the end of the read bytes, NULL (v / m
+// unchanged) if the dims differ or the delta is malformed. The written blocks are marked dirty.
+const uint8_t *vec_apply_delta(vec *v, const uint8_t *byte_arr);
+
+const uint8_t *mat_apply_delta(mat *m, const uint8_t *byte_arr);
+
+// Marks the payload blocks lying wholly under v / m clean; blocks shared with elements outside
+// v / m stay dirty, so for a strided v only blocks of one element are cleaned
+void vec_clean(vec *v);
+
+void mat_clean(mat *m);
+
+// Writes the delta of v / m at the current position of fd, then cleans v / m as vec_clean;
+// returns the bytes written, -1 on error (v / m left dirty)
+IND_TYP vec_write_delta_fd(int fd, vec *v);
+
+IND_TYP mat_write_delta_fd(int fd, mat *m);
+
+// Constructs v / m from the base file (written by vec_write_fd / mat_write_fd), then replays
+// the delta files in order; a delta file may hold several deltas back to back.
+// Returns NULL (v / m is NULL) on error.
+vec *vec_load_delta(vec *v, const char *base, const char *const deltas[], int n_delta);
+
+mat *mat_load_delta(mat *m, const char *base, const char *const deltas[], int n_delta);
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "lin_alg_config.h"
+#include "vec.h"
+#include "mat.h"
+
+/*
+ * Loading and storing matrices.
+ * Text input is memory-mapped and cut into chunks at line boundaries; the chunks are counted
+ * and then parsed in parallel, straight into the payload of the result. Numbers with at
+ * most 19 significant digits and a decimal exponent within +-22 are converted exactly by
+ * a fast path, all others fall back to strtod.
+ */
+
+/**
+ * txt_schema - Layout of a text matrix.
+ *
+ * - skip_rows: Header lines skipped at the start of the file.
+ * - cols: Indices of the fields loaded, in output order (may repeat); NULL for all fields.
+ * - n_cols: Length of cols.
+ */
+typedef struct txt_schema
+{
+    IND_TYP skip_rows;
+    const IND_TYP *cols;
+    IND_TYP n_cols;
+} txt_schema;
+
+#define txt_schema_DEFAULT ((const txt_schema){.skip_rows = 0, .cols = NULL, .n_cols = 0})
+
+/*
+ * Constructs m from the text file at path: one row per line, fields separated by delim
+ * (' ' for any run of spaces and tabs). Blank lines are skipped, '\r' line ends accepted.
+ * All rows must have the field count of the first one. schema may be NULL.
+ * Returns NULL (m is mat_NULL) if the file cannot be read, is empty or is malformed.
+ */
+mat *mat_load_text(mat *m, const char *path, char delim, const txt_schema *schema);
+
+/*
+ * NumPy .npy files (format versions 1 to 3), C or Fortran order, dtype matching FLD_TYP
+ * ("<f4", "<f8", "<c8" or "<c16"; little-endian host). vec maps to shape (n,), mat to
+ * (d1, d2). Other dtypes and dimensions are rejected.
+ * With map set, a C-order file whose data offset is a multiple of NPY_ALIGN is not read:
+ * the payload wraps a private (copy-on-write) mapping of the data, flagged
+ * payload_FLG_PREALLOC | payload_FLG_MMAP and unmapped with the last reference. Pages
+ * are read on first access and writes never reach the file. Otherwise the data is read
+ * into a new payload.
+ */
+
+// Data offset alignment of written .npy files and of zero-copy loads
+#define NPY_ALIGN 64
+
+// Constructs v / m from the .npy file at path; returns NULL (v / m is NULL) on error
+vec *vec_load_npy(vec *v, const char *path, bool map);
+
+mat *mat_load_npy(mat *m, const char *path, bool map);
+
+// Writes v (may be strided) / m to path as .npy; returns the bytes written, -1 on error
+IND_TYP vec_save_npy(const vec *v, const char *path);
+
+IND_TYP mat_save_npy(const mat *m, const char *path);
+
+/*
+ * Streaming serialization in the vec_serialize / mat_serialize layout, without a staging
+ * buffer of the serial size: contiguous data goes out with the header in one writev and is
+ * read straight into the payload of the result; strided views are gathered into IO_CHUNK
+ * pieces. If fd is opened with O_DIRECT, its position must be a multiple of IO_DIRECT_ALIGN
+ * and all transfers go through an aligned IO_CHUNK buffer; the file is truncated to the
+ * end of the data after writing.
+ */
+
+#ifndef IO_CHUNK
+#define IO_CHUNK (4 << 20)
+#endif
+#define IO_DIRECT_ALIGN 4096
+
+// Writes v / m at the current position of fd; returns the bytes written, -1 on error
+IND_TYP vec_write_fd(int fd, const vec *v);
+
+IND_TYP mat_write_fd(int fd, const mat *m);
+
+// Constructs v / m from the current position of fd; returns NULL (v / m is NULL) on error
+vec *vec_read_fd(vec *v, int fd);
+
+mat *mat_read_fd(mat *m, int fd);
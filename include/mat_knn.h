@@ -0,0 +1,42 @@
+#pragma once
+
+#include "lin_alg_config.h"
+#include "vec.h"
+#include "mat.h"
+
+/*
+ * Pairwise distances between the rows of two matrices and brute-force k-nearest-neighbour
+ * search. Distances use the GEMM identity ||a - b||^2 = ||a||^2 + ||b||^2 - 2 a.b, so the
+ * squared row norms can be computed once and cached for a fixed base matrix.
+ */
+
+// Tile sizes of mat_knn: query rows x base rows per distance tile
+#ifndef KNN_BLK_Q
+#define KNN_BLK_Q 64
+#endif
+#ifndef KNN_BLK_B
+#define KNN_BLK_B 512
+#endif
+
+// result[i] = ||m[i]||^2 : squared norms of the rows of m
+vec *mat_row_sqnorms(vec *result, const mat *m);
+
+// result[i][j] = ||a[i] - b[j]||^2, a->d1 x b->d1; a_sqn and b_sqn are the cached
+// squared row norms (mat_row_sqnorms), each may be NULL to compute it
+mat *mat_pairwise_sqdist(mat *result, const mat *a, const mat *b, const vec *a_sqn, const vec *b_sqn);
+
+// result[i][j] = a[i].b[j] / (||a[i]|| ||b[j]||), 0 for zero rows; a_sqn and b_sqn as above
+mat *mat_pairwise_cosine(mat *result, const mat *a, const mat *b, const vec *a_sqn, const vec *b_sqn);
+
+/*
+ * For each row of query, the k nearest rows of base (Euclidean), nearest first:
+ * out_idx (query->d1 x k, row-major) gets base row indices and out_dist (query->d1 x k,
+ * may be NULL) the squared distances. base_sqn caches the squared row norms of base
+ * (may be NULL). k <= base->d1.
+ * The base is scanned in KNN_BLK_Q x KNN_BLK_B distance tiles kept in per-thread buffers,
+ * with a bounded max-heap per query row; the full distance matrix is never formed.
+ * Threads split the query blocks and, when there are few of them, the base blocks too.
+ * Returns out_idx, NULL if a buffer could not be allocated.
+ */
+IND_TYP *mat_knn(IND_TYP *out_idx, mat *out_dist, const mat *query, const mat *base, const vec *base_sqn,
+                 IND_TYP k);
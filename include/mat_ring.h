@@ -0,0 +1,64 @@
+#pragma once
+
+#include "lin_alg_config.h"
+#include "vec.h"
+#include "mat.h"
+
+/*
+ * Ring buffer of the last cap rows of a row stream (a sliding window).
+ * A push overwrites the oldest row in place: O(d), no row moves. The window, oldest row first,
+ * lies in the buffer as at most two contiguous row blocks (see mat_ring_segments); the kernels
+ * below run on each block, so the window is never copied.
+ */
+
+/**
+ * mat_ring - Sliding window of up to buf.d1 rows of buf.d2 columns.
+ *
+ * - buf: The storage, cap x d.
+ * - head: Row of buf holding the oldest row of the window.
+ * - n: Number of rows in the window, <= cap.
+ */
+typedef struct mat_ring
+{
+    mat buf;
+    IND_TYP head;
+    IND_TYP n;
+} mat_ring;
+
+#define mat_ring_NULL ((const mat_ring){.buf = mat_NULL, .head = 0, .n = 0})
+
+mat_ring *mat_ring_construct(mat_ring *r, IND_TYP cap, IND_TYP d);
+
+void mat_ring_destruct(mat_ring *r);
+
+// Empties the window
+mat_ring *mat_ring_reset(mat_ring *r);
+
+// Pushes row (d elements) as the newest row; the oldest one is dropped if the window is full.
+// NULL (window unchanged) if a copy-on-write buf could not be given an own array.
+mat_ring *mat_ring_push(mat_ring *r, const vec *row);
+
+// Pushes the rows of blk (b x d) in order, as b calls of mat_ring_push
+mat_ring *mat_ring_push_rows(mat_ring *r, const mat *blk);
+
+// Gives vec corresponding to row i of the window (0 the oldest, -1 the newest); payload is shared
+vec *mat_ring_row_at(mat_ring *r, vec *row, IND_TYP i);
+
+// Makes seg[0] and seg[1] views (payload shared) of the window rows in order: the oldest rows
+// up to the end of buf, then the rest from its start; returns the number of views made (0 to 2)
+int mat_ring_segments(const mat_ring *r, mat seg[2]);
+
+// Copies the window, oldest row first, into dst (n x d)
+mat *mat_ring_window(mat *dst, const mat_ring *r);
+
+// result = window @ v_right; result->d == r->n
+vec *mat_ring_dot_vec(vec *result, const mat_ring *r, const vec *v_right);
+
+// result = v_left @ window; v_left->d == r->n, result->d == d
+vec *vec_dot_mat_ring(vec *result, const vec *v_left, const mat_ring *r);
+
+// result[j] = sum_i window[i][j]; result->d == d
+vec *mat_ring_col_sum(vec *result, const mat_ring *r);
+
+// Sum of the elements of the window
+FLD_TYP mat_ring_sum(const mat_ring *r);
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "lin_alg_config.h"
+#include "mat.h"
+
+/*
+ * Dense factorizations and solvers (LAPACK, blocked).
+ * A factorization object shares the payload of the factorized mat and overwrites it
+ * with the factors; no copy of the matrix is made. Call *_destruct at the end of its
+ * lifetime to release the shared payload and the auxiliary arrays.
+ * Constructors return NULL (and leave the object NULL) when the factorization fails,
+ * i.e. a singular matrix for LU, a not positive definite one for Cholesky.
+ */
+
+/**
+ * mat_lu - LU factorization with partial pivoting: A = P L U.
+ *
+ * - lu: L (unit diagonal, below) and U (on and above the diagonal); shares A's payload.
+ * - piv: Row pivot indices (1-based, LAPACK convention), d1 elements.
+ */
+typedef struct mat_lu
+{
+    mat lu;
+    IND_TYP *piv;
+} mat_lu;
+
+#define mat_lu_NULL ((const mat_lu){.lu = mat_NULL, .piv = NULL})
+
+/**
+ * mat_cholesky - Cholesky factorization of a symmetric positive definite A = L L^T.
+ *
+ * - l: L in the lower triangle; shares A's payload. The upper triangle is left untouched.
+ */
+typedef struct mat_cholesky
+{
+    mat l;
+} mat_cholesky;
+
+#define mat_cholesky_NULL ((const mat_cholesky){.l = mat_NULL})
+
+/**
+ * mat_qr - Householder QR factorization A = Q R of a d1 x d2 matrix.
+ *
+ * - qr: R on and above the diagonal, Householder vectors below it; shares A's payload.
+ * - tau: Householder scalars, min(d1, d2) elements.
+ */
+typedef struct mat_qr
+{
+    mat qr;
+    FLD_TYP *tau;
+} mat_qr;
+
+#define mat_qr_NULL ((const mat_qr){.qr = mat_NULL, .tau = NULL})
+
+// Factorizes the square matrix a in place; a is overwritten by L and U
+mat_lu *mat_lu_construct(mat_lu *f, mat *a);
+
+void mat_lu_destruct(mat_lu *f);
+
+// Solves A X = B in place for all the columns of b (d1 x nrhs); b is overwritten by X
+mat *mat_lu_solve(const mat_lu *f, mat *b);
+
+// Factorizes the symmetric positive definite matrix a in place (lower triangle is used)
+mat_cholesky *mat_cholesky_construct(mat_cholesky *f, mat *a);
+
+void mat_cholesky_destruct(mat_cholesky *f);
+
+// Solves A X = B in place for all the columns of b (d1 x nrhs); b is overwritten by X
+mat *mat_cholesky_solve(const mat_cholesky *f, mat *b);
+
+// Factorizes a (d1 x d2) in place
+mat_qr *mat_qr_construct(mat_qr *f, mat *a);
+
+void mat_qr_destruct(mat_qr *f);
+
+// Least-squares solution x (d2 x nrhs) of min ||A x - b|| for b (d1 x nrhs); needs d1 >= d2
+mat *mat_qr_solve(const mat_qr *f, mat *x, const mat *b);
+
+// Forms the thin Q (d1 x min(d1, d2)) with orthonormal columns into q
+mat *mat_qr_q(const mat_qr *f, mat *q);
+
+// x = A^-1 b for square a (d x d), b and x (d x nrhs); a and b are left unchanged; x may be b
+mat *mat_solve(mat *x, const mat *a, const mat *b);
+
+// Least-squares x = argmin ||a x - b|| for a (m x n, m >= n), b (m x nrhs), x (n x nrhs)
+mat *mat_lstsq(mat *x, const mat *a, const mat *b);
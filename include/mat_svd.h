@@ -0,0 +1,37 @@
+#pragma once
+
+#include "lin_alg_config.h"
+#include "vec.h"
+#include "mat.h"
+
+/*
+ * Randomized truncated SVD and PCA (Halko, Martinsson, Tropp) of tall m x n matrices.
+ * The right singular subspace is found by subspace iteration on A^T A, so A is only
+ * touched through row-block products and never has to be resident: the *_stream
+ * variants read it block by block, power_iters + 2 passes in total. All work arrays
+ * are n x (k + oversample) or smaller.
+ * Larger oversample (typically 5..10) and power_iters (1..3) trade time for accuracy
+ * when the singular values decay slowly.
+ */
+
+// Returns row block i of A (n columns, any number of rows) or NULL past the last block.
+// Blocks are requested in order from 0 on every pass; the returned mat must remain
+// valid until the next call.
+typedef const mat *(*mat_blk_src)(IND_TYP i, void *ctx);
+
+// Top k singular triplets of a (m x n): s (k) descending, vt (k x n) with orthonormal rows,
+// u (m x k) if not NULL; a ~ u diag(s) vt
+mat *mat_rsvd(mat *u, vec *s, mat *vt, const mat *a, IND_TYP k, IND_TYP oversample, IND_TYP power_iters);
+
+// mat_rsvd of the row-block stream src; returns the number of rows m, or -1 on failure.
+// The left vectors of a block are block @ vt^T / s.
+IND_TYP mat_rsvd_stream(vec *s, mat *vt, mat_blk_src src, void *ctx, IND_TYP n,
+                        IND_TYP k, IND_TYP oversample, IND_TYP power_iters);
+
+// Top k principal components of the rows of a: comps (k x n), variances var (k) descending,
+// and the column means mean (n, may be NULL). Centering is implicit; a is not modified.
+mat *mat_pca(mat *comps, vec *var, vec *mean, const mat *a, IND_TYP k, IND_TYP oversample, IND_TYP power_iters);
+
+// mat_pca of the row-block stream src; returns the number of rows m, or -1 on failure
+IND_TYP mat_pca_stream(mat *comps, vec *var, vec *mean, mat_blk_src src, void *ctx, IND_TYP n,
+                       IND_TYP k, IND_TYP oversample, IND_TYP power_iters);
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lin_alg_config.h"
+#include "vec.h"
+#include "mat.h"
+
+/*
+ * Compressed serialization of vec and mat.
+ * Layout: size_t serial size, the dims as in vec_serialize / mat_serialize, the uint32
+ * chunk count and one uint32 compressed size per chunk, then the chunks. The data is cut
+ * into chunks of ZIP_CHUNK bytes; each chunk is byte-shuffled (byte k of every element
+ * together, which groups the sign and exponent bytes) and coded with a built-in LZ77 codec
+ * (LZ4-style sequences, 64 KiB window). Chunks that do not shrink are stored as they are
+ * (size flag ZIP_STORED). Chunks are coded and decoded in parallel; decoding unshuffles
+ * straight into the payload of the result.
+ */
+
+// Raw bytes per chunk, a multiple of sizeof(FLD_TYP), at most 64 KiB
+#ifndef ZIP_CHUNK
+#define ZIP_CHUNK (1 << 16)
+#endif
+#define ZIP_STORED 0x80000000u
+
+// Upper bound of the compressed serial size of v / m
+size_t vec_serial_zip_bound(const vec *v);
+
+size_t mat_serial_zip_bound(const mat *m);
+
+// Writes v (may be strided) / m compressed into byte_arr of at least the bound size;
+// returns the end of the written bytes (the serial size is stored at the start), NULL if out of memory
+uint8_t *vec_serialize_zip(const vec *v, uint8_t *byte_arr);
+
+uint8_t *mat_serialize_zip(const mat *m, uint8_t *byte_arr);
+
+// Constructs v / m from compressed bytes; returns the end of the read bytes, NULL (v / m is
+// NULL) if they are malformed
+const uint8_t *vec_deserialize_zip(vec *v, const uint8_t *byte_arr);
+
+const uint8_t *mat_deserialize_zip(mat *m, const uint8_t *byte_arr);
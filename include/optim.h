@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "lin_alg_config.h"
+#include "vec.h"
+#include "mat.h"
+
+/**
+ * optim_adam - Adam / AdamW hyper-parameters.
+ *
+ * - lr: Learning rate.
+ * - beta_1, beta_2: Decay rates of the first and second moment estimates.
+ * - eps: Term added to the denominator for numerical stability.
+ * - weight_decay: L2 penalty for Adam (added to the gradient),
+ *   decoupled decay for AdamW (applied to the parameter); 0 disables it.
+ */
+typedef struct optim_adam
+{
+    FLD_TYP lr;
+    FLD_TYP beta_1;
+    FLD_TYP beta_2;
+    FLD_TYP eps;
+    FLD_TYP weight_decay;
+} optim_adam;
+
+#define optim_ADAM_DEFAULT ((const optim_adam){.lr = 1e-3, .beta_1 = 0.9, .beta_2 = 0.999, .eps = 1e-8, .weight_decay = 0})
+
+/*
+ * All the kernels below update the parameter and its optimizer state in a single
+ * pass over the payloads; no temporaries are allocated. Tensors with at least
+ * PAR_MIN_SIZE elements are processed by multiple threads.
+ * The *_multi variants take n tensors at once; small tensors are spread over threads. They
+ * return false, updating nothing, if a copy-on-write payload could not be given its own array.
+ */
+
+// velocity = momentum * velocity + grad; param -= lr * velocity
+vec *vec_sgd_momentum(vec *param, vec *velocity, const vec *grad, FLD_TYP lr, FLD_TYP momentum);
+
+mat *mat_sgd_momentum(mat *param, mat *velocity, const mat *grad, FLD_TYP lr, FLD_TYP momentum);
+
+bool vec_sgd_momentum_multi(vec *params[], vec *velocities[], const vec *grads[], IND_TYP n,
+                            FLD_TYP lr, FLD_TYP momentum);
+
+bool mat_sgd_momentum_multi(mat *params[], mat *velocities[], const mat *grads[], IND_TYP n,
+                            FLD_TYP lr, FLD_TYP momentum);
+
+/*
+ * Adam step t (t >= 1, bias corrected):
+ * g' = grad + weight_decay * param
+ * m_1 = beta_1 * m_1 + (1 - beta_1) * g'
+ * m_2 = beta_2 * m_2 + (1 - beta_2) * g'^2
+ * param -= lr * (m_1 / (1 - beta_1^t)) / (sqrt(m_2 / (1 - beta_2^t)) + eps)
+ */
+vec *vec_adam(vec *param, vec *m_1, vec *m_2, const vec *grad, const optim_adam *hp, IND_TYP t);
+
+mat *mat_adam(mat *param, mat *m_1, mat *m_2, const mat *grad, const optim_adam *hp, IND_TYP t);
+
+bool vec_adam_multi(vec *params[], vec *m_1s[], vec *m_2s[], const vec *grads[], IND_TYP n,
+                    const optim_adam *hp, IND_TYP t);
+
+bool mat_adam_multi(mat *params[], mat *m_1s[], mat *m_2s[], const mat *grads[], IND_TYP n,
+                    const optim_adam *hp, IND_TYP t);
+
+// Same as Adam with decoupled weight decay: param *= 1 - lr * weight_decay before the Adam update
+vec *vec_adamw(vec *param, vec *m_1, vec *m_2, const vec *grad, const optim_adam *hp, IND_TYP t);
+
+mat *mat_adamw(mat *param, mat *m_1, mat *m_2, const mat *grad, const optim_adam *hp, IND_TYP t);
+
+bool vec_adamw_multi(vec *params[], vec *m_1s[], vec *m_2s[], const vec *grads[], IND_TYP n,
+                     const optim_adam *hp, IND_TYP t);
+
+bool mat_adamw_multi(mat *params[], mat *m_1s[], mat *m_2s[], const mat *grads[], IND_TYP n,
+                     const optim_adam *hp, IND_TYP t);
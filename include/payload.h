@@ -11,22 +11,33 @@
  *
  * This structure represents a payload, which contains:
  * - size: The number of elements in the payload.
+ * - cap: The number of elements arr has room for (>= size); growing up to it does not reallocate.
  * - arr: A pointer to the array holding the payload data.
  * - ref_count: A reference count for shared payloads.
  * - flags: Flags indicating properties of the payload.
+ * - dirty: Dirty-block bits when tracking is on (see payload_track), NULL otherwise.
+ * - blk_shift: log2 of the number of elements per tracked block.
+ * - cow_ref: Count of the payloads sharing arr copy-on-write (see payload_cow), NULL if none;
+ *   updated atomically.
  */
 typedef struct payload
 {
     FLD_TYP *arr;
     size_t size;
+    size_t cap;
     int ref_count;
     uint32_t flags;
+    uint64_t *dirty;
+    unsigned blk_shift;
+    int *cow_ref;
 } payload;
 
 #define payload_FLG_NEW 1u
 #define payload_FLG_PREALLOC 2u
 #define payload_FLG_RESIZABLE 4u
 #define payload_FLG_SHRINKABLE 8u
+// arr lies in a private memory mapping (with PREALLOC): unmapped instead of freed
+#define payload_FLG_MMAP 16u
 
 /**
  * payload_NULL - Null payload constant.
@@ -35,7 +46,8 @@ typedef struct payload
  * initialize payloads or compare against null payloads. It has a
  * size of 0, null pointer for the array, ref count of 0, and no flags set.
  */
-#define payload_NULL ((const payload){.size = 0, .arr = NULL, .ref_count = 0, .flags = 0u})
+#define payload_NULL ((const payload){.size = 0, .cap = 0, .arr = NULL, .ref_count = 0, .flags = 0u, .dirty = NULL, .blk_shift = 0, \
+                                      .cow_ref = NULL})
 
 /**
  * Checks if the given payload is valid.
@@ -81,6 +93,47 @@ payload *payload_new(size_t size);
 
 payload *payload_prealloc(payload *pyl, FLD_TYP *arr, size_t size);
 
+/**
+ * Allocates a new payload over a private (copy-on-write) memory mapping of a file.
+ *
+ * Maps size elements of the open file fd starting at byte offset; offset must be a multiple
+ * of sizeof(FLD_TYP). Pages are read on first access and writes never reach the file.
+ * The payload has the NEW, PREALLOC and MMAP flags set and is unmapped when released.
+ *
+ * @param fd Open file descriptor; may be closed afterwards.
+ * @param offset Byte offset of the first element in the file.
+ * @param size The number of elements to map.
+ * @return A pointer to the new payload, NULL on failure.
+ */
+payload *payload_map(int fd, size_t offset, size_t size);
+
+/**
+ * Allocates a new payload sharing the array of src copy-on-write.
+ *
+ * Unlike payload_share, which hands out the same (mutable) payload, this makes a second payload
+ * over the same elements; whichever of them is written first through payload_own (which the
+ * mutating vec_* / mat_* kernels call) gets its own copy of the array, so the other keeps the
+ * old values. The array is freed by the last payload holding it. The new payload has the NEW
+ * flag set, its reference count is 1 and it is not tracked (see payload_track).
+ * The shared count is atomic, so the payloads sharing an array may be written, cloned and
+ * released on different threads; each single payload is still used by one thread at a time.
+ *
+ * @param src Pointer to the payload to share.
+ * @return A pointer to the new payload, NULL on failure.
+ */
+payload *payload_cow(payload *src);
+
+/**
+ * Gives pyl its own array if it shares one copy-on-write; a no-op otherwise.
+ *
+ * Must be called before writing to the elements of pyl; views of pyl (payload_share) follow it
+ * to the new array.
+ *
+ * @param pyl Pointer to the payload.
+ * @return true on success, false if the copy could not be allocated.
+ */
+bool payload_own(payload *pyl);
+
 /**
  * Increases the reference count of the given payload by 1.
  *
@@ -103,14 +156,27 @@ void payload_release(payload *pyl);
 /**
  * Resizes the given payload to the new size.
  *
- * Reallocates the internal data array to the given size.
+ * Growing within the capacity only sets the size; past it, the array is moved to a new 64-byte
+ * aligned one with at least twice the capacity, so a run of small growths costs amortized O(1)
+ * per element. Shrinking keeps the capacity. The elements past the old size are garbage.
+ * The payload must be RESIZABLE, and SHRINKABLE to shrink; views of it (payload_share) follow
+ * it to the new array. A copy-on-write payload gets its own array first (see payload_own).
  *
  * @param pyl Pointer to the payload to resize.
  * @param new_size The new size to resize the payload to.
- * @return A pointer to the resized payload.
+ * @return A pointer to the resized payload, NULL on failure (pyl unchanged).
  */
 payload *payload_resize(payload *pyl, size_t new_size);
 
+/**
+ * Makes room for at least cap elements in the given RESIZABLE payload, without changing its size.
+ *
+ * @param pyl Pointer to the payload.
+ * @param cap The number of elements to make room for.
+ * @return A pointer to the payload, NULL on failure (pyl unchanged).
+ */
+payload *payload_reserve(payload *pyl, size_t cap);
+
 /**
  * Copies a region of the source payload into the destination payload.
  *
@@ -133,4 +199,56 @@ static inline FLD_TYP *payload_at(payload *pyl, IND_TYP i)
 {
     assert(i >= 0 && (size_t)i < pyl->size);
     return pyl->arr + i;
-}
\ No newline at end of file
+}
+
+/**
+ * Starts dirty-block tracking on the given payload.
+ *
+ * The payload is cut into blocks of blk_bytes bytes (a power of two, at least sizeof(FLD_TYP);
+ * 4 KiB and 64 KiB are typical) and one bit per block records whether it was written since the
+ * last payload_clean. All blocks start clean. The mutating vec_* / mat_* kernels mark the
+ * blocks they write; code writing through vec_at / mat_at / raw pointers must call
+ * payload_mark (or vec_mark_dirty / mat_mark_dirty) itself.
+ *
+ * @param pyl Pointer to the payload to track.
+ * @param blk_bytes Block size in bytes.
+ * @return true on success (also if already tracked with the same block size), false otherwise.
+ */
+bool payload_track(payload *pyl, size_t blk_bytes);
+
+/**
+ * Stops dirty-block tracking and frees the block bits.
+ *
+ * @param pyl Pointer to the payload.
+ */
+void payload_untrack(payload *pyl);
+
+static inline size_t payload_n_blk(const payload *pyl)
+{
+    return ((pyl->size - 1) >> pyl->blk_shift) + 1;
+}
+
+static inline bool payload_blk_dirty(const payload *pyl, size_t blk)
+{
+    return (pyl->dirty[blk >> 6] >> (blk & 63)) & 1u;
+}
+
+void payload_mark_range(payload *pyl, size_t begin, size_t end);
+
+/**
+ * Marks the blocks holding elements [begin, end) dirty; a no-op if pyl is not tracked.
+ */
+static inline void payload_mark(payload *pyl, size_t begin, size_t end)
+{
+    if (pyl->dirty && begin < end)
+        payload_mark_range(pyl, begin, end);
+}
+
+/**
+ * Marks every block touching elements [begin, end) clean, e.g. after a delta of them was saved.
+ * Blocks shared with data outside the range are cleaned as well.
+ */
+void payload_clean(payload *pyl, size_t begin, size_t end);
+
+// Number of dirty blocks
+size_t payload_n_dirty(const payload *pyl);
@@ -67,6 +67,34 @@ vec *vec_construct(vec *v, IND_TYP d);
  */
 vec *vec_construct_prealloc(vec *v, payload *pyl, IND_TYP offset, IND_TYP d, IND_TYP step);
 
+// Largest d of a vec with inline storage (vec_inl)
+#ifndef VEC_INL_MAX
+#define VEC_INL_MAX 32
+#endif
+
+/**
+ * vec_inl - Storage of a short vec inside the struct: its elements and payload, no heap.
+ *
+ * v is a plain vec over buf through pyl (see payload_prealloc), so the whole vec_* API applies
+ * to &s.v. Since v points into the struct, a vec_inl must not be moved or copied while in use,
+ * and views and clones of v must not outlive it. It is not resizable. On the heap, allocate it
+ * with aligned_alloc (buf is 64-byte aligned).
+ */
+typedef struct vec_inl
+{
+    _Alignas(64) FLD_TYP buf[VEC_INL_MAX];
+    payload pyl;
+    vec v;
+} vec_inl;
+
+/**
+ * Constructs s->v of dimension d (0 < d <= VEC_INL_MAX) over the inline storage of s.
+ * Content of the elements is garbage. vec_destruct(&s->v) ends it; nothing is freed.
+ *
+ * @return &s->v, which is vec_NULL if d is out of range.
+ */
+vec *vec_inl_construct(vec_inl *s, IND_TYP d);
+
 /*
  * Frees v->pyl->arr and sets *v = vec_NULL.
  * Should be called on v's that are constructed by vec_construct*.
@@ -118,6 +146,28 @@ vec *vec_view(vec *view, const vec *src, IND_TYP start, IND_TYP stop, IND_TYP st
 
 vec *vec_new_view(const vec *src, IND_TYP start, IND_TYP stop, IND_TYP step);
 
+/**
+ * Constructs dst as a copy-on-write clone of src (releasing its old payload).
+ *
+ * dst gets a new payload over the same elements as src (see payload_cow); no element is copied
+ * until dst or src (or a view of either) is written, and then only the written payload.
+ * Cheap snapshots: dst keeps the values of src at the time of the call.
+ */
+vec *vec_clone(vec *dst, const vec *src);
+
+/**
+ * Appends x to v, growing its payload (see payload_resize): amortized O(1) per call.
+ *
+ * v is either vec_NULL (then constructed with d = 1) or ends its RESIZABLE payload with step 1;
+ * views of the payload stay valid.
+ *
+ * @return v, NULL on failure (v unchanged).
+ */
+vec *vec_push_back(vec *v, FLD_TYP x);
+
+// Appends the elements of src (may be strided, or v itself) to v, as vec_push_back
+vec *vec_append(vec *v, const vec *src);
+
 // v_dst = v_src : copies src->pyl->arr to dst->pyl->arr; dimensions must be the same.
 vec *vec_assign(vec *v_dst, const vec *v_src);
 
@@ -140,11 +190,17 @@ vec *vec_fill_altimp(vec *v, FLD_TYP value);
 */
 
 // Gives string representation of vec v; be sure str_buff is big enough.
+// See fmt.h for bounded and streaming output.
 char *vec_to_str(const vec *v, char *str_buff);
 
 // Checks closeness of two vectors by comparing norm(v_1-v_2) and (norm(v_1)+norm(v_2))/2 * eps.
+// Single fused pass, no allocation.
 bool vec_is_close(const vec *v_1, const vec *v_2, FLD_TYP eps);
 
+// Element-wise |v_1[i] - v_2[i]| <= atol + rtol * |v_2[i]| for all i; NaNs are never close.
+// Stops at the first chunk with a far element.
+bool vec_allclose(const vec *v_1, const vec *v_2, FLD_TYP atol, FLD_TYP rtol);
+
 // result = v_left + v_right
 vec *vec_add(vec *result, const vec *v_left, const vec *v_right);
 // result = v_left - v_right
@@ -171,6 +227,13 @@ vec *vec_scale(vec *v, FLD_TYP scale);
 vec *vec_update(vec *v_dst, FLD_TYP alpha, const vec *v_right);
 // v_left @ v_right : @ = dot product
 FLD_TYP vec_dot(const vec *v_left, const vec *v_right);
+// v_dst = alpha * v_right + beta * v_dst
+vec *vec_axpby(vec *v_dst, FLD_TYP alpha, const vec *v_right, FLD_TYP beta);
+// v_dst += alpha * v_right and returns v_dst @ v_dot in the same pass; v_dot may be v_dst.
+// NaN if v_dst could not be written (see vec_touch)
+FLD_TYP vec_update_dot(vec *v_dst, FLD_TYP alpha, const vec *v_right, const vec *v_dot);
+// *dot_1 = v @ v_1 and *dot_2 = v @ v_2 in one pass over v
+void vec_dot_pair(const vec *v, const vec *v_1, const vec *v_2, FLD_TYP *dot_1, FLD_TYP *dot_2);
 // Euclidean norm of v : sqrt(sum_i v->pyl->arr[i]^2)
 FLT_TYP vec_norm_2(const vec *v);
 // Sum of absolute values of v->pyl->arr
@@ -194,8 +257,8 @@ vec *vec_apply(vec *v, FLD_TYP (*map)(FLD_TYP));
 
 // result = exp(v)
 vec *vec_exp(vec *result, const vec *v);
-// reslut = ln(v)
-// vec *vec_ln(vec *result, const vec *v);
+// result = ln(v)
+vec *vec_ln(vec *result, const vec *v);
 // result = log2(v)
 vec *vec_log2(vec *result, const vec *v);
 // result = 1 / v (element-wise inversion)
@@ -218,6 +281,28 @@ FLD_TYP vec_max(const vec* v);
 IND_TYP vec_argmax(const vec* v);
 // Gives a pointer to v->pyl->arr[i]; i can be negative
 FLD_TYP *vec_at(const vec *v, IND_TYP i);
+// Marks the payload blocks under v dirty when its payload is tracked (see payload_track)
+static inline void vec_mark_dirty(const vec *v)
+{
+    if (!v->pyl->dirty)
+        return;
+    const IND_TYP end = v->offset + (v->d - 1) * v->step;
+    if (v->step > 0)
+        payload_mark(v->pyl, v->offset, end + 1);
+    else
+        payload_mark(v->pyl, end, v->offset + 1);
+}
+// Readies v for writing: gives its payload an own array if it is shared copy-on-write (see
+// vec_clone) and marks v dirty. The mutating vec_* / mat_* kernels call it on their outputs;
+// call it before writing through vec_at or raw pointers. Returns NULL (v still shared) if the
+// array could not be allocated; the kernels then return NULL without writing.
+static inline vec *vec_touch(vec *v)
+{
+    if (v->pyl->cow_ref && !payload_own(v->pyl))
+        return NULL;
+    vec_mark_dirty(v);
+    return v;
+}
 // Gives the serial size of vector v
 size_t vec_serial_size(const vec *v);
 // Returns the pointer to the first byte just after the last written byte to byte_arr
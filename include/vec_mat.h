@@ -17,10 +17,81 @@ mat *vec_outer(mat *result, const vec *v_left, const vec *v_right);
 // target += alpha * v_left (*) v_right : (*) = outer product
 mat *mat_update_outer(mat *target, FLD_TYP alpha, const vec *v_left, const vec *v_right);
 
+// target += alpha * sum_b m_left[b] (*) m_right[b] = alpha * m_left^T @ m_right
+// Rank-B update of all B row pairs with one GEMM; m_left->d1 == m_right->d1 == B
+mat *mat_update_outer_batch(mat *target, FLD_TYP alpha, const mat *m_left, const mat *m_right);
+
+// target += alpha * m^T @ m : symmetric rank-B update (SYRK); target is m->d2 x m->d2
+// and assumed symmetric; its upper triangle is updated and mirrored into the lower one
+mat *mat_update_gram(mat *target, FLD_TYP alpha, const mat *m);
+
 // Give vec corresponing to row i; payload is shared
 vec *mat_row_at(mat *m, vec *row, IND_TYP i);
 
 // Give vec corresponing to column j; payload is shared
 vec *mat_column_at(mat *m, vec *col, IND_TYP j);
 
+// result[i][j] = m[i][j] + v[j] : v is broadcast along rows; v->d == m->d2
+mat *mat_add_row_vec(mat *result, const mat *m, const vec *v);
+
+// result[i][j] = m[i][j] * v[j] : v is broadcast along rows; v->d == m->d2
+mat *mat_mul_row_vec(mat *result, const mat *m, const vec *v);
+
+// result[i][j] = m[i][j] + v[i] : v is broadcast along columns; v->d == m->d1
+mat *mat_add_col_vec(mat *result, const mat *m, const vec *v);
+
+// result[i][j] = m[i][j] * v[i] : v is broadcast along columns; v->d == m->d1
+mat *mat_mul_col_vec(mat *result, const mat *m, const vec *v);
+
+// m[i][j] += v[j]
+mat *mat_addto_row_vec(mat *m, const vec *v);
+
+// m[i][j] *= v[j]
+mat *mat_mulby_row_vec(mat *m, const vec *v);
+
+// m[i][j] += v[i]
+mat *mat_addto_col_vec(mat *m, const vec *v);
+
+// m[i][j] *= v[i]
+mat *mat_mulby_col_vec(mat *m, const vec *v);
+
+/*
+ * Row-wise softmax cross-entropy of a batch with numerically stable log-sum-exp.
+ * labels holds a target distribution per row (e.g. one-hot), same shape as logits.
+ * loss[i] = -sum_j labels[i][j] * log(softmax(logits[i])[j]); loss may be NULL.
+ * grad = d loss[i] / d logits[i] = softmax(logits[i]) * sum_j labels[i][j] - labels[i];
+ * grad may be NULL or alias logits. Returns the mean of loss over the rows, NaN if loss or grad
+ * could not be written (see vec_touch).
+ */
+FLD_TYP mat_softmax_xent(vec *loss, mat *grad, const mat *logits, const mat *labels);
+
+/*
+ * Layer normalization of each row of m:
+ * result[i] = (m[i] - mean[i]) * rstd[i] * gain + bias, rstd[i] = 1 / sqrt(var(m[i]) + eps).
+ * gain and bias (d = m->d2) may be NULL. mean and rstd (d = m->d1) may be NULL;
+ * if given, the row statistics are stored there for mat_layernorm_rows_backward.
+ * result may alias m.
+ */
+mat *mat_layernorm_rows(mat *result, const mat *m, const vec *gain, const vec *bias, FLD_TYP eps,
+                        vec *mean, vec *rstd);
+
+/*
+ * Backward pass of mat_layernorm_rows given d_result = dL/d(result) and the stored mean and rstd.
+ * d_m = dL/dm; d_gain and d_bias (may be NULL) are set to dL/d(gain) and dL/d(bias).
+ * d_m may alias d_result.
+ */
+mat *mat_layernorm_rows_backward(mat *d_m, vec *d_gain, vec *d_bias, const mat *d_result,
+                                 const mat *m, const vec *gain, const vec *mean, const vec *rstd);
+
+/*
+ * RMS normalization of each row of m:
+ * result[i] = m[i] * rstd[i] * gain, rstd[i] = 1 / sqrt(mean(m[i]^2) + eps).
+ * gain and rstd may be NULL; result may alias m.
+ */
+mat *mat_rmsnorm_rows(mat *result, const mat *m, const vec *gain, FLD_TYP eps, vec *rstd);
+
+// Backward pass of mat_rmsnorm_rows; see mat_layernorm_rows_backward
+mat *mat_rmsnorm_rows_backward(mat *d_m, vec *d_gain, const mat *d_result,
+                               const mat *m, const vec *gain, const vec *rstd);
+
 #endif /* VEC_MAT_H_INCLUDED */
\ No newline at end of file
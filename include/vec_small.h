@@ -0,0 +1,263 @@
+#pragma once
+
+#include <stdbool.h>
+#include <math.h>
+
+#include "lin_alg_config.h"
+#include "vec.h"
+#include "mat.h"
+
+/*
+ * Small fixed-size vectors (vec2, vec3, vec4, vec8, vec16) and square matrices (mat2, mat3,
+ * mat4) of FLD_TYP, held by value on the stack: no payload, offset or step, and no BLAS call.
+ * The ops are header-inline loops of fixed trip count, vectorized by the compiler
+ * (omp simd); they take and return their operands by value. matN is row-major: e[i][j].
+ * Arrays of them are processed in SoA layout, one mat row per component: see the *_soa_*
+ * kernels at the end.
+ */
+
+#define VEC_SMALL_LOOP(n) _Pragma("omp simd") for (int i = 0; i < (n); i++)
+
+// Defines the type vecN and its ops. ALIGN is at most 16 bytes, the alignment of malloc, so
+// heap arrays of them are aligned too.
+#define VEC_SMALL_DEF(N, ALIGN)                                                            \
+    typedef struct vec##N                                                                  \
+    {                                                                                      \
+        _Alignas(ALIGN) FLD_TYP e[N];                                                      \
+    } vec##N;                                                                              \
+                                                                                           \
+    static inline vec##N vec##N##_load(const FLD_TYP *arr)                                 \
+    {                                                                                      \
+        vec##N r;                                                                          \
+        VEC_SMALL_LOOP(N) r.e[i] = arr[i];                                                 \
+        return r;                                                                          \
+    }                                                                                      \
+    static inline vec##N vec##N##_fill(FLD_TYP x)                                          \
+    {                                                                                      \
+        vec##N r;                                                                          \
+        VEC_SMALL_LOOP(N) r.e[i] = x;                                                      \
+        return r;                                                                          \
+    }                                                                                      \
+    static inline vec##N vec##N##_add(vec##N a, vec##N b)                                  \
+    {                                                                                      \
+        VEC_SMALL_LOOP(N) a.e[i] += b.e[i];                                                \
+        return a;                                                                          \
+    }                                                                                      \
+    static inline vec##N vec##N##_sub(vec##N a, vec##N b)                                  \
+    {                                                                                      \
+        VEC_SMALL_LOOP(N) a.e[i] -= b.e[i];                                                \
+        return a;                                                                          \
+    }                                                                                      \
+    static inline vec##N vec##N##_mul(vec##N a, vec##N b)                                  \
+    {                                                                                      \
+        VEC_SMALL_LOOP(N) a.e[i] *= b.e[i];                                                \
+        return a;                                                                          \
+    }                                                                                      \
+    static inline vec##N vec##N##_scale(vec##N a, FLD_TYP s)                               \
+    {                                                                                      \
+        VEC_SMALL_LOOP(N) a.e[i] *= s;                                                     \
+        return a;                                                                          \
+    }                                                                                      \
+    /* y + alpha * x */                                                                    \
+    static inline vec##N vec##N##_axpy(FLD_TYP alpha, vec##N x, vec##N y)                  \
+    {                                                                                      \
+        VEC_SMALL_LOOP(N) y.e[i] += alpha * x.e[i];                                        \
+        return y;                                                                          \
+    }                                                                                      \
+    static inline FLD_TYP vec##N##_dot(vec##N a, vec##N b)                                 \
+    {                                                                                      \
+        FLD_TYP s = 0;                                                                     \
+        _Pragma("omp simd reduction(+ : s)") for (int i = 0; i < N; i++) s +=              \
+            a.e[i] * b.e[i];                                                               \
+        return s;                                                                          \
+    }                                                                                      \
+    static inline FLD_TYP vec##N##_norm(vec##N a)                                          \
+    {                                                                                      \
+        return (FLD_TYP)sqrt(vec##N##_dot(a, a));                                          \
+    }                                                                                      \
+    /* Copies the N elements of v (may be strided) */                                      \
+    static inline vec##N vec##N##_from_vec(const vec *v)                                   \
+    {                                                                                      \
+        assert(v->d == N);                                                                 \
+        vec##N r;                                                                          \
+        for (int i = 0; i < N; i++)                                                        \
+            r.e[i] = v->pyl->arr[v->offset + i * v->step];                                 \
+        return r;                                                                          \
+    }                                                                                      \
+    /* Copies a into v (d == N, may be strided); returns v */                              \
+    static inline vec *vec##N##_to_vec(vec *v, vec##N a)                                   \
+    {                                                                                      \
+        assert(v->d == N);                                                                 \
+        if (!vec_touch(v))                                                                 \
+            return NULL;                                                                   \
+        for (int i = 0; i < N; i++)                                                        \
+            v->pyl->arr[v->offset + i * v->step] = a.e[i];                                 \
+        return v;                                                                          \
+    }
+
+// Defines the square matrix type matN over vecN and its ops
+#define MAT_SMALL_DEF(N, ALIGN)                                                            \
+    typedef struct mat##N                                                                  \
+    {                                                                                      \
+        _Alignas(ALIGN) FLD_TYP e[N][N];                                                   \
+    } mat##N;                                                                              \
+                                                                                           \
+    static inline mat##N mat##N##_eye(void)                                                \
+    {                                                                                      \
+        mat##N r = {0};                                                                    \
+        for (int i = 0; i < N; i++)                                                        \
+            r.e[i][i] = 1;                                                                 \
+        return r;                                                                          \
+    }                                                                                      \
+    static inline vec##N mat##N##_row(mat##N m, int i)                                     \
+    {                                                                                      \
+        return vec##N##_load(m.e[i]);                                                      \
+    }                                                                                      \
+    static inline mat##N mat##N##_add(mat##N a, mat##N b)                                  \
+    {                                                                                      \
+        for (int k = 0; k < N; k++)                                                        \
+            VEC_SMALL_LOOP(N) a.e[k][i] += b.e[k][i];                                      \
+        return a;                                                                          \
+    }                                                                                      \
+    static inline mat##N mat##N##_scale(mat##N a, FLD_TYP s)                               \
+    {                                                                                      \
+        for (int k = 0; k < N; k++)                                                        \
+            VEC_SMALL_LOOP(N) a.e[k][i] *= s;                                              \
+        return a;                                                                          \
+    }                                                                                      \
+    static inline mat##N mat##N##_transpose(mat##N a)                                      \
+    {                                                                                      \
+        mat##N r;                                                                          \
+        for (int i = 0; i < N; i++)                                                        \
+            for (int j = 0; j < N; j++)                                                    \
+                r.e[j][i] = a.e[i][j];                                                     \
+        return r;                                                                          \
+    }                                                                                      \
+    /* a @ v */                                                                            \
+    static inline vec##N mat##N##_mul_vec(mat##N a, vec##N v)                              \
+    {                                                                                      \
+        vec##N r = vec##N##_fill(0);                                                       \
+        for (int k = 0; k < N; k++)                                                        \
+            VEC_SMALL_LOOP(N) r.e[i] += a.e[i][k] * v.e[k];                                \
+        return r;                                                                          \
+    }                                                                                      \
+    /* a @ b: row i of the result is the combination of the rows of b by row i of a */     \
+    static inline mat##N mat##N##_mul(mat##N a, mat##N b)                                  \
+    {                                                                                      \
+        mat##N r;                                                                          \
+        for (int i = 0; i < N; i++)                                                        \
+        {                                                                                  \
+            vec##N row = vec##N##_fill(0);                                                 \
+            for (int k = 0; k < N; k++)                                                    \
+                row = vec##N##_axpy(a.e[i][k], vec##N##_load(b.e[k]), row);                \
+            for (int j = 0; j < N; j++)                                                    \
+                r.e[i][j] = row.e[j];                                                      \
+        }                                                                                  \
+        return r;                                                                          \
+    }                                                                                      \
+    /* Inverse by Gauss-Jordan elimination with partial pivoting; false (inv unchanged)    \
+       if a is singular */                                                                 \
+    static inline bool mat##N##_inv(mat##N *inv, mat##N a)                                 \
+    {                                                                                      \
+        mat##N r = mat##N##_eye();                                                         \
+        for (int c = 0; c < N; c++)                                                        \
+        {                                                                                  \
+            int p = c;                                                                     \
+            for (int i = c + 1; i < N; i++)                                                \
+                if ((a.e[i][c] < 0 ? -a.e[i][c] : a.e[i][c]) >                             \
+                    (a.e[p][c] < 0 ? -a.e[p][c] : a.e[p][c]))                              \
+                    p = i;                                                                 \
+            if (a.e[p][c] == 0)                                                            \
+                return false;                                                              \
+            vec##N a_p = vec##N##_load(a.e[p]), r_p = vec##N##_load(r.e[p]);               \
+            for (int j = 0; j < N; j++)                                                    \
+            {                                                                              \
+                a.e[p][j] = a.e[c][j];                                                     \
+                r.e[p][j] = r.e[c][j];                                                     \
+            }                                                                              \
+            const FLD_TYP s = 1 / a_p.e[c];                                                \
+            a_p = vec##N##_scale(a_p, s);                                                  \
+            r_p = vec##N##_scale(r_p, s);                                                  \
+            for (int i = 0; i < N; i++)                                                    \
+            {                                                                              \
+                const FLD_TYP f = i == c ? 0 : -a.e[i][c];                                 \
+                vec##N a_i = vec##N##_axpy(f, a_p, vec##N##_load(a.e[i]));                 \
+                vec##N r_i = vec##N##_axpy(f, r_p, vec##N##_load(r.e[i]));                 \
+                for (int j = 0; j < N; j++)                                                \
+                {                                                                          \
+                    a.e[i][j] = i == c ? a_p.e[j] : a_i.e[j];                              \
+                    r.e[i][j] = i == c ? r_p.e[j] : r_i.e[j];                              \
+                }                                                                          \
+            }                                                                              \
+        }                                                                                  \
+        *inv = r;                                                                          \
+        return true;                                                                       \
+    }                                                                                      \
+    /* Copies the N x N m */                                                               \
+    static inline mat##N mat##N##_from_mat(const mat *m)                                   \
+    {                                                                                      \
+        assert(m->d1 == N && m->d2 == N);                                                  \
+        mat##N r;                                                                          \
+        for (int i = 0; i < N; i++)                                                        \
+            for (int j = 0; j < N; j++)                                                    \
+                r.e[i][j] = m->pyl->arr[m->offset + i * N + j];                            \
+        return r;                                                                          \
+    }                                                                                      \
+    /* Copies a into m (N x N); returns m */                                               \
+    static inline mat *mat##N##_to_mat(mat *m, mat##N a)                                   \
+    {                                                                                      \
+        assert(m->d1 == N && m->d2 == N);                                                  \
+        if (!mat_touch(m))                                                                 \
+            return NULL;                                                                   \
+        for (int i = 0; i < N; i++)                                                        \
+            for (int j = 0; j < N; j++)                                                    \
+                m->pyl->arr[m->offset + i * N + j] = a.e[i][j];                            \
+        return m;                                                                          \
+    }
+
+#define SMALL_ALIGN(N) ((N) * sizeof(FLD_TYP) < 16 ? (N) * sizeof(FLD_TYP) : 16)
+
+VEC_SMALL_DEF(2, SMALL_ALIGN(2))
+VEC_SMALL_DEF(3, sizeof(FLD_TYP))
+VEC_SMALL_DEF(4, SMALL_ALIGN(4))
+VEC_SMALL_DEF(8, SMALL_ALIGN(8))
+VEC_SMALL_DEF(16, SMALL_ALIGN(16))
+
+MAT_SMALL_DEF(2, SMALL_ALIGN(4))
+MAT_SMALL_DEF(3, sizeof(FLD_TYP))
+MAT_SMALL_DEF(4, SMALL_ALIGN(16))
+
+static inline vec3 vec3_cross(vec3 a, vec3 b)
+{
+    return (vec3){{a.e[1] * b.e[2] - a.e[2] * b.e[1],
+                   a.e[2] * b.e[0] - a.e[0] * b.e[2],
+                   a.e[0] * b.e[1] - a.e[1] * b.e[0]}};
+}
+
+/*
+ * SoA batches: n small vectors as an N x n mat, row k holding component k of all of them, so
+ * the kernels below run unit-stride over n. Multi-threaded from PAR_MIN_SIZE vectors.
+ */
+
+// soa (N x n) = the n vectors of arr, arr[j] in column j
+mat *vec2_soa_pack(mat *soa, const vec2 *arr);
+mat *vec3_soa_pack(mat *soa, const vec3 *arr);
+mat *vec4_soa_pack(mat *soa, const vec4 *arr);
+
+// arr[j] = column j of soa (N x n)
+vec2 *vec2_soa_unpack(vec2 *arr, const mat *soa);
+vec3 *vec3_soa_unpack(vec3 *arr, const mat *soa);
+vec4 *vec4_soa_unpack(vec4 *arr, const mat *soa);
+
+// result[j] = a[:, j] . b[:, j]; a and b are N x n, result->d == n
+vec *vec2_soa_dot(vec *result, const mat *a, const mat *b);
+vec *vec3_soa_dot(vec *result, const mat *a, const mat *b);
+vec *vec4_soa_dot(vec *result, const mat *a, const mat *b);
+
+// result[:, j] = a[:, j] x b[:, j]; all 3 x n; result may alias a or b
+mat *vec3_soa_cross(mat *result, const mat *a, const mat *b);
+
+// result[:, j] = m @ v[:, j] (e.g. one transform of n points); N x n; result may alias v
+mat *mat2_soa_mul_vec(mat *result, mat2 m, const mat *v);
+mat *mat3_soa_mul_vec(mat *result, mat3 m, const mat *v);
+mat *mat4_soa_mul_vec(mat *result, mat4 m, const mat *v);
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "lin_alg_config.h"
+#include "vec.h"
+#include "mat.h"
+
+/*
+ * Ordering primitives: top-k selection and argsort.
+ * Top-k scans the input in chunks of TOPK_CHUNK elements. Once k candidates are known, a
+ * chunk whose (SIMD) maximum does not beat the current k-th best is skipped as a whole,
+ * the others are compacted into a candidate buffer that is cut back to k by quickselect.
+ * Results are ordered largest first; ties go to the smaller index. NaNs are not supported.
+ */
+
+#ifndef TOPK_CHUNK
+#define TOPK_CHUNK 256
+#endif
+
+// values (k) = the k largest elements of v, largest first; idx (k, may be NULL) gets
+// their indices in v. v may be a strided view. Large v is split between threads.
+vec *vec_topk(vec *values, IND_TYP idx[], const vec *v, IND_TYP k);
+
+// Row-wise vec_topk: values (m->d1 x k) and idx (m->d1 x k, row-major, may be NULL);
+// rows run in parallel
+mat *mat_topk_rows(mat *values, IND_TYP idx[], const mat *m, IND_TYP k);
+
+// idx (v->d) = permutation that sorts v, ascending or descending; stable
+IND_TYP *vec_argsort(IND_TYP idx[], const vec *v, bool descending);
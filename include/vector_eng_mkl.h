@@ -12,7 +12,18 @@
 #define GEMV cblas_sgemv
 #define GEMM cblas_sgemm
 #define GER cblas_sger
+#define SYRK cblas_ssyrk
+#define TRSM cblas_strsm
+#define GETRF LAPACKE_sgetrf
+#define GETRS LAPACKE_sgetrs
+#define POTRF LAPACKE_spotrf
+#define POTRS LAPACKE_spotrs
+#define GEQRF LAPACKE_sgeqrf
+#define ORMQR LAPACKE_sormqr
+#define ORGQR LAPACKE_sorgqr
+#define SYEVD LAPACKE_ssyevd
 #define AXPY cblas_saxpy
+#define AXPBY cblas_saxpby
 #define SCAL cblas_sscal
 #define ASUM cblas_sasum
 #define NRM2 cblas_snrm2
@@ -44,7 +55,18 @@
 #define GEMV cblas_dgemv
 #define GEMM cblas_dgemm
 #define GER cblas_dger
+#define SYRK cblas_dsyrk
+#define TRSM cblas_dtrsm
+#define GETRF LAPACKE_dgetrf
+#define GETRS LAPACKE_dgetrs
+#define POTRF LAPACKE_dpotrf
+#define POTRS LAPACKE_dpotrs
+#define GEQRF LAPACKE_dgeqrf
+#define ORMQR LAPACKE_dormqr
+#define ORGQR LAPACKE_dorgqr
+#define SYEVD LAPACKE_dsyevd
 #define AXPY cblas_daxpy
+#define AXPBY cblas_daxpby
 #define SCAL cblas_dscal
 #define ASUM cblas_dasum
 #define NRM2 cblas_dnrm2
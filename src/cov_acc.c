@@ -0,0 +1,168 @@
+#include "cov_acc.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "vec_mat.h"
+
+cov_acc *cov_acc_construct(cov_acc *acc, IND_TYP d)
+{
+    assert(acc);
+    assert(d > 0);
+
+    *acc = cov_acc_NULL;
+    vec_construct(&acc->mean, d);
+    mat_construct(&acc->m2, d, d);
+    if (vec_is_null(&acc->mean) || mat_is_null(&acc->m2))
+    {
+        cov_acc_destruct(acc);
+        return NULL;
+    }
+    return cov_acc_reset(acc);
+}
+
+void cov_acc_destruct(cov_acc *acc)
+{
+    if (acc)
+    {
+        vec_destruct(&acc->mean);
+        mat_destruct(&acc->m2);
+        mat_destruct(&acc->buf);
+        *acc = cov_acc_NULL;
+    }
+}
+
+cov_acc *cov_acc_reset(cov_acc *acc)
+{
+    assert(acc);
+    assert(vec_is_valid(&acc->mean));
+    assert(mat_is_valid(&acc->m2));
+
+    acc->n = 0;
+    vec_fill_zero(&acc->mean);
+    mat_fill_zero(&acc->m2);
+    return acc;
+}
+
+// Makes buf at least rows x d
+static bool grow_buf(cov_acc *acc, IND_TYP rows)
+{
+    if (!mat_is_null(&acc->buf) && acc->buf.d1 >= rows)
+        return true;
+    mat_destruct(&acc->buf);
+    mat_construct(&acc->buf, rows, acc->mean.d);
+    return !mat_is_null(&acc->buf);
+}
+
+// Folds in n_b rows with mean mean_b whose scatter is already added to acc->m2:
+// delta = mean_b - mean; m2 += n n_b / (n + n_b) delta (*) delta; mean += n_b / (n + n_b) delta
+static void merge_moments(cov_acc *acc, IND_TYP n_b, const vec *mean_b, vec *delta)
+{
+    const IND_TYP n = acc->n + n_b;
+    vec_sub(delta, mean_b, &acc->mean);
+    if (acc->n > 0)
+        mat_update_outer(&acc->m2, (FLD_TYP)acc->n * n_b / n, delta, delta);
+    vec_update(&acc->mean, (FLD_TYP)n_b / n, delta);
+    acc->n = n;
+}
+
+cov_acc *cov_acc_update(cov_acc *acc, const mat *blk)
+{
+    assert(acc);
+    assert(mat_is_valid(&acc->m2));
+    assert(mat_is_valid(blk));
+    assert(blk->d2 == acc->mean.d);
+
+    const IND_TYP b = blk->d1, d = blk->d2;
+    // buf rows: the centered block, its mean and the mean difference
+    if (!grow_buf(acc, b + 2))
+        return NULL;
+    mat c = mat_NULL;
+    vec mean_b = vec_NULL, delta = vec_NULL;
+    mat_construct_prealloc(&c, acc->buf.pyl, acc->buf.offset, b, d);
+    vec_construct_prealloc(&mean_b, acc->buf.pyl, acc->buf.offset + b * d, d, 1);
+    vec_construct_prealloc(&delta, acc->buf.pyl, acc->buf.offset + (b + 1) * d, d, 1);
+
+    FLD_TYP *mb_arr = mean_b.pyl->arr + mean_b.offset;
+    const FLD_TYP *blk_arr = blk->pyl->arr + blk->offset;
+    vec_fill_zero(&mean_b);
+    for (IND_TYP i = 0; i < b; i++)
+    {
+        const FLD_TYP *row = blk_arr + i * d;
+#pragma omp simd
+        for (IND_TYP j = 0; j < d; j++)
+            mb_arr[j] += row[j];
+    }
+    vec_scale(&mean_b, (FLD_TYP)1 / b);
+
+    // m2 += (blk - mean_b)^T (blk - mean_b)
+    vec_sclmul(&delta, &mean_b, -1);
+    mat_add_row_vec(&c, blk, &delta);
+    mat_update_gram(&acc->m2, 1, &c);
+    merge_moments(acc, b, &mean_b, &delta);
+
+    mat_destruct(&c);
+    vec_destruct(&mean_b);
+    vec_destruct(&delta);
+
+    return acc;
+}
+
+cov_acc *cov_acc_merge(cov_acc *acc, const cov_acc *oth)
+{
+    assert(acc);
+    assert(oth);
+    assert(acc != oth);
+    assert(mat_is_valid(&acc->m2));
+    assert(mat_is_valid(&oth->m2));
+    assert(oth->mean.d == acc->mean.d);
+
+    if (oth->n == 0)
+        return acc;
+    if (!grow_buf(acc, 1))
+        return NULL;
+    vec delta = vec_NULL;
+    vec_construct_prealloc(&delta, acc->buf.pyl, acc->buf.offset, acc->mean.d, 1);
+
+    mat_addto(&acc->m2, &oth->m2);
+    merge_moments(acc, oth->n, &oth->mean, &delta);
+
+    vec_destruct(&delta);
+    return acc;
+}
+
+vec *cov_acc_mean(const cov_acc *acc, vec *mean)
+{
+    assert(acc);
+    assert(acc->n > 0);
+    assert(vec_is_valid(mean));
+    assert(mean->d == acc->mean.d);
+
+    return vec_assign(mean, &acc->mean);
+}
+
+vec *cov_acc_var(const cov_acc *acc, vec *var, IND_TYP ddof)
+{
+    assert(acc);
+    assert(acc->n > ddof);
+    assert(vec_is_valid(var));
+    assert(var->d == acc->mean.d);
+
+    if (!vec_touch(var))
+        return NULL;
+    const FLD_TYP scale = (FLD_TYP)1 / (acc->n - ddof);
+    for (IND_TYP j = 0; j < var->d; j++)
+        *vec_at(var, j) = *mat_at(&acc->m2, j, j) * scale;
+    return var;
+}
+
+mat *cov_acc_cov(const cov_acc *acc, mat *cov, IND_TYP ddof)
+{
+    assert(acc);
+    assert(acc->n > ddof);
+    assert(mat_is_valid(cov));
+    assert(cov->d1 == acc->m2.d1 && cov->d2 == acc->m2.d2);
+
+    mat_assign(cov, &acc->m2);
+    return mat_scale(cov, (FLD_TYP)1 / (acc->n - ddof));
+}
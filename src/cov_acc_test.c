@@ -0,0 +1,138 @@
+#include "cov_acc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <tgmath.h>
+#include <omp.h>
+
+#define TOL (sizeof(FLD_TYP) == 4 ? 1E-3 : 1E-10)
+
+static FLD_TYP rnd(void)
+{
+    return 2 * (rand() / (FLD_TYP)RAND_MAX) - 1;
+}
+
+// Two-pass reference: mean and cov with ddof 1
+static void cov_naive(vec *mean, mat *cov, const mat *x)
+{
+    vec_fill_zero(mean);
+    mat_fill_zero(cov);
+    for (IND_TYP i = 0; i < x->d1; i++)
+        for (IND_TYP j = 0; j < x->d2; j++)
+            *vec_at(mean, j) += *mat_at(x, i, j) / x->d1;
+    for (IND_TYP i = 0; i < x->d1; i++)
+        for (IND_TYP j = 0; j < x->d2; j++)
+            for (IND_TYP l = 0; l < x->d2; l++)
+                *mat_at(cov, j, l) += (*mat_at(x, i, j) - *vec_at(mean, j)) *
+                                      (*mat_at(x, i, l) - *vec_at(mean, l)) / (x->d1 - 1);
+}
+
+// Relative error of the mean and the covariance of acc against the reference
+static FLT_TYP acc_err(const cov_acc *acc, const vec *mean_ref, const mat *cov_ref)
+{
+    vec mean = vec_NULL;
+    mat cov = mat_NULL;
+    vec_construct(&mean, mean_ref->d);
+    mat_construct(&cov, cov_ref->d1, cov_ref->d2);
+    cov_acc_mean(acc, &mean);
+    cov_acc_cov(acc, &cov, 1);
+    vec_subfrom(&mean, mean_ref);
+    mat_subfrom(&cov, cov_ref);
+    FLT_TYP err = fmax(vec_norm_2(&mean) / vec_norm_2(mean_ref), mat_norm_2(&cov) / mat_norm_2(cov_ref));
+    vec_destruct(&mean);
+    mat_destruct(&cov);
+    return err;
+}
+
+// Rows [start, stop) of x as a block
+static mat *row_blk(mat *blk, const mat *x, IND_TYP start, IND_TYP stop)
+{
+    mat_destruct(blk);
+    return mat_construct_prealloc(blk, x->pyl, x->offset + start * x->d2, stop - start, x->d2);
+}
+
+static void cov_acc_stream_test(void)
+{
+    const IND_TYP m = 1000, d = 12, b = 97;
+    mat x = mat_NULL, cov_ref = mat_NULL, blk = mat_NULL;
+    vec mean_ref = vec_NULL, var = vec_NULL;
+    mat_construct(&x, m, d);
+    mat_construct(&cov_ref, d, d);
+    vec_construct(&mean_ref, d);
+    vec_construct(&var, d);
+    mat_fill_rnd(&x, rnd);
+    // Large column offsets stress the numerical stability
+    for (IND_TYP i = 0; i < m; i++)
+        for (IND_TYP j = 0; j < d; j++)
+            *mat_at(&x, i, j) = 1000 * (j + 1) + (j + 1) * *mat_at(&x, i, j) + *mat_at(&x, i, 0);
+    cov_naive(&mean_ref, &cov_ref, &x);
+
+    cov_acc acc;
+    cov_acc_construct(&acc, d);
+    for (IND_TYP start = 0; start < m; start += b)
+        cov_acc_update(&acc, row_blk(&blk, &x, start, (start + b < m) ? start + b : m));
+    FLT_TYP err = acc_err(&acc, &mean_ref, &cov_ref);
+    printf("cov_acc blocks of %ld rows: n = %ld, rel err: %g\n", b, acc.n, err);
+    assert(acc.n == m && err < TOL);
+
+    cov_acc_var(&acc, &var, 1);
+    FLT_TYP var_err = 0;
+    for (IND_TYP j = 0; j < d; j++)
+        var_err = fmax(var_err, fabs(*vec_at(&var, j) - *mat_at(&cov_ref, j, j)) / *mat_at(&cov_ref, j, j));
+    printf("cov_acc variance rel err: %g\n", var_err);
+    assert(var_err < TOL);
+
+    // One row at a time
+    cov_acc_reset(&acc);
+    for (IND_TYP i = 0; i < m; i++)
+        cov_acc_update(&acc, row_blk(&blk, &x, i, i + 1));
+    err = acc_err(&acc, &mean_ref, &cov_ref);
+    printf("cov_acc single rows: rel err: %g\n", err);
+    assert(err < TOL);
+
+    // Per-thread accumulators over interleaved blocks, merged at the end.
+    // The block views are made up front: sharing a payload is not thread-safe.
+    const IND_TYP n_blk = (m + b - 1) / b;
+    mat *blks = (mat *)malloc(n_blk * sizeof(mat));
+    for (IND_TYP i = 0; i < n_blk; i++)
+    {
+        blks[i] = mat_NULL;
+        row_blk(&blks[i], &x, i * b, ((i + 1) * b < m) ? (i + 1) * b : m);
+    }
+    cov_acc_reset(&acc);
+#pragma omp parallel
+    {
+        cov_acc acc_t;
+        cov_acc_construct(&acc_t, d);
+#pragma omp for schedule(dynamic)
+        for (IND_TYP i = 0; i < n_blk; i++)
+            cov_acc_update(&acc_t, &blks[i]);
+#pragma omp critical
+        cov_acc_merge(&acc, &acc_t);
+        cov_acc_destruct(&acc_t);
+    }
+    for (IND_TYP i = 0; i < n_blk; i++)
+        mat_destruct(&blks[i]);
+    free(blks);
+    err = acc_err(&acc, &mean_ref, &cov_ref);
+    printf("cov_acc merged over %d threads: rel err: %g\n", omp_get_max_threads(), err);
+    assert(acc.n == m && err < TOL);
+    cov_acc_destruct(&acc);
+
+    mat_destruct(&x);
+    mat_destruct(&cov_ref);
+    mat_destruct(&blk);
+    vec_destruct(&mean_ref);
+    vec_destruct(&var);
+    puts("------");
+}
+
+void cov_acc_test(void)
+{
+    puts("+++ cov_acc_test +++");
+
+    cov_acc_stream_test();
+
+    puts("^^^ cov_acc_test ^^^");
+}
@@ -0,0 +1,359 @@
+#include "fmt.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tgmath.h>
+#include <unistd.h>
+
+// Stack buffer of the streaming outputs
+#define FMT_BLK 4096
+
+static const uint64_t pow10_u[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+    100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+    10000000000000ULL, 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+    100000000000000000ULL};
+
+// x * 10^s; exact powers up to 10^22
+static double scale10(double x, int s)
+{
+    static const double pow10_d[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                     1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    // Keeps the intermediate in range for subnormals and huge values
+    while (s > 22)
+    {
+        const int t = (s > 300) ? 300 : 22;
+        x *= (t == 300) ? 1e300 : pow10_d[22];
+        s -= t;
+    }
+    while (s < -22)
+    {
+        const int t = (s < -300) ? 300 : 22;
+        x /= (t == 300) ? 1e300 : pow10_d[22];
+        s += t;
+    }
+    return (s >= 0) ? x * pow10_d[s] : x / pow10_d[-s];
+}
+
+// *dig = round(v * 10^s); false if the few ulps of scaling error may have moved it across a
+// rounding boundary, i.e. the scaled value is that close to a half
+static bool round_scaled(double v, int s, uint64_t *dig)
+{
+    const double w = scale10(v, s);
+    *dig = (uint64_t)llrint(w);
+    return fabs(w - floor(w) - 0.5) > w * 0x1p-50;
+}
+
+// prec significant digits of v > 0 as an integer, *e (a guess on entry) the decimal exponent
+// of the first; false if they cannot be told exactly in double arithmetic
+static bool dig_scaled(double v, int prec, int *e, uint64_t *dig)
+{
+    int k = *e;
+    bool ok = round_scaled(v, prec - 1 - k, dig);
+    if (*dig >= pow10_u[prec])
+        ok = round_scaled(v, prec - 1 - ++k, dig) && ok;
+    else if (*dig < pow10_u[prec - 1])
+        ok = round_scaled(v, prec - 1 - --k, dig) && ok;
+    if (*dig >= pow10_u[prec]) // 9.99..5 rounded up to the next power of ten
+    {
+        *dig /= 10;
+        k++;
+    }
+    *e = k;
+    return ok;
+}
+
+// Same as dig_scaled by snprintf's correctly rounded "%.*e"
+static uint64_t dig_printf(double v, int prec, int *e)
+{
+    char txt[32];
+    snprintf(txt, sizeof(txt), "%.*e", prec - 1, v);
+    uint64_t dig = 0;
+    const char *p = txt;
+    for (; *p != 'e'; p++)
+        if (*p != '.')
+            dig = dig * 10 + (uint64_t)(*p - '0');
+    *e = (int)strtol(p + 1, NULL, 10);
+    return dig;
+}
+
+size_t fmt_fld(char *out, FLD_TYP x, int prec)
+{
+    assert(out);
+
+    char *p = out;
+    double v = x;
+    if (signbit(v))
+    {
+        *p++ = '-';
+        v = -v;
+    }
+    if (isnan(v) || isinf(v))
+    {
+        strcpy(p, isnan(v) ? "nan" : "inf");
+        return p + 3 - out;
+    }
+    if (v == 0)
+    {
+        strcpy(p, "0");
+        return p + 1 - out;
+    }
+    prec = (prec < 1) ? 1 : (prec > 17) ? 17 : prec;
+
+    // prec significant digits as an integer: dig = round(v * 10^(prec - 1 - e)); snprintf when
+    // the scaled double is too close to a half, and always above 15 digits where it is inexact
+    int e = (int)floor(log10(v));
+    uint64_t dig;
+    if (prec > 15 || !dig_scaled(v, prec, &e, &dig))
+        dig = dig_printf(v, prec, &e);
+
+    char d[20];
+    for (int i = prec - 1; i >= 0; i--, dig /= 10)
+        d[i] = '0' + dig % 10;
+    int n_d = prec;
+    while (n_d > 1 && d[n_d - 1] == '0')
+        n_d--;
+
+    if (e < -4 || e >= prec)
+    {
+        *p++ = d[0];
+        if (n_d > 1)
+        {
+            *p++ = '.';
+            memcpy(p, d + 1, n_d - 1);
+            p += n_d - 1;
+        }
+        *p++ = 'e';
+        *p++ = (e < 0) ? '-' : '+';
+        const int ae = abs(e);
+        if (ae >= 100)
+            *p++ = '0' + ae / 100;
+        *p++ = '0' + ae / 10 % 10;
+        *p++ = '0' + ae % 10;
+    }
+    else if (e >= 0)
+    {
+        for (int i = 0; i <= e; i++)
+            *p++ = (i < n_d) ? d[i] : '0';
+        if (n_d > e + 1)
+        {
+            *p++ = '.';
+            memcpy(p, d + e + 1, n_d - e - 1);
+            p += n_d - e - 1;
+        }
+    }
+    else
+    {
+        *p++ = '0';
+        *p++ = '.';
+        for (int i = 0; i < -e - 1; i++)
+            *p++ = '0';
+        memcpy(p, d, n_d);
+        p += n_d;
+    }
+    *p = 0;
+    return p - out;
+}
+
+// Output target: a bounded string, or a stream / file descriptor behind blk
+typedef struct sink
+{
+    char *str;
+    size_t size;
+    FILE *f;
+    int fd;
+    size_t len;
+    bool err;
+    size_t blk_len;
+    char blk[FMT_BLK];
+} sink;
+
+static void sink_flush(sink *s)
+{
+    if (s->blk_len == 0 || s->err)
+        return;
+    if (s->f)
+        s->err = fwrite(s->blk, 1, s->blk_len, s->f) != s->blk_len;
+    else
+        for (size_t off = 0; off < s->blk_len;)
+        {
+            ssize_t w = write(s->fd, s->blk + off, s->blk_len - off);
+            if (w < 0 && errno == EINTR)
+                continue;
+            if (w <= 0)
+            {
+                s->err = true;
+                break;
+            }
+            off += w;
+        }
+    s->blk_len = 0;
+}
+
+static void sink_put(sink *s, const char *txt, size_t n)
+{
+    if (s->str)
+    {
+        if (s->len + 1 < s->size)
+        {
+            const size_t room = s->size - 1 - s->len;
+            memcpy(s->str + s->len, txt, (n < room) ? n : room);
+        }
+    }
+    else
+    {
+        assert(n <= FMT_BLK);
+        if (s->blk_len + n > FMT_BLK)
+            sink_flush(s);
+        memcpy(s->blk + s->blk_len, txt, n);
+        s->blk_len += n;
+    }
+    s->len += n;
+}
+
+static void sink_fld(sink *s, FLD_TYP x, int prec)
+{
+    char buff[FMT_FLD_MAX];
+    sink_put(s, buff, fmt_fld(buff, x, prec));
+}
+
+// The summarized middle of a dimension of d starts after element j
+static inline bool gap_after(IND_TYP j, IND_TYP d, IND_TYP edge)
+{
+    return edge > 0 && d > 2 * edge && j + 1 == edge;
+}
+
+static void put_vec(sink *s, const FLD_TYP *arr, IND_TYP step, IND_TYP d, const fmt_spec *spec)
+{
+    sink_put(s, "[", 1);
+    for (IND_TYP j = 0; j < d; j++)
+    {
+        sink_fld(s, arr[j * step], spec->prec);
+        if (j + 1 != d)
+            sink_put(s, ",", 1);
+        if (gap_after(j, d, spec->edge))
+        {
+            sink_put(s, "...,", 4);
+            j = d - spec->edge - 1;
+        }
+    }
+    sink_put(s, "]", 1);
+}
+
+static void put_mat(sink *s, const mat *m, const fmt_spec *spec)
+{
+    if (mat_is_null(m))
+    {
+        sink_put(s, "mat_NULL\n", 9);
+        return;
+    }
+    assert(mat_is_valid(m));
+
+    const FLD_TYP *arr = m->pyl->arr + m->offset;
+    sink_put(s, "[", 1);
+    for (IND_TYP i = 0; i < m->d1; i++)
+    {
+        if (i != 0)
+            sink_put(s, " ", 1);
+        put_vec(s, arr + i * m->d2, 1, m->d2, spec);
+        if (i + 1 != m->d1)
+            sink_put(s, ",\n", 2);
+        if (gap_after(i, m->d1, spec->edge))
+        {
+            sink_put(s, " ...,\n", 6);
+            i = m->d1 - spec->edge - 1;
+        }
+    }
+    sink_put(s, "]", 1);
+}
+
+static inline sink sink_str(char *str, size_t size)
+{
+    return (sink){.str = str, .size = size, .f = NULL, .fd = -1, .len = 0, .err = false, .blk_len = 0};
+}
+
+static inline sink sink_stream(FILE *f, int fd)
+{
+    return (sink){.str = NULL, .size = 0, .f = f, .fd = fd, .len = 0, .err = false, .blk_len = 0};
+}
+
+static inline size_t sink_str_end(sink *s)
+{
+    s->str[(s->len < s->size) ? s->len : s->size - 1] = 0;
+    return s->len;
+}
+
+static inline IND_TYP sink_stream_end(sink *s)
+{
+    sink_flush(s);
+    return s->err ? -1 : (IND_TYP)s->len;
+}
+
+static inline const fmt_spec *spec_or_default(const fmt_spec *spec)
+{
+    static const fmt_spec def = fmt_spec_DEFAULT;
+    return spec ? spec : &def;
+}
+
+size_t vec_to_strn(const vec *v, char *str, size_t size, const fmt_spec *spec)
+{
+    assert(vec_is_valid(v));
+    assert(str && size > 0);
+
+    sink s = sink_str(str, size);
+    put_vec(&s, v->pyl->arr + v->offset, v->step, v->d, spec_or_default(spec));
+    return sink_str_end(&s);
+}
+
+IND_TYP vec_fprint(FILE *f, const vec *v, const fmt_spec *spec)
+{
+    assert(f);
+    assert(vec_is_valid(v));
+
+    sink s = sink_stream(f, -1);
+    put_vec(&s, v->pyl->arr + v->offset, v->step, v->d, spec_or_default(spec));
+    return sink_stream_end(&s);
+}
+
+IND_TYP vec_dprint(int fd, const vec *v, const fmt_spec *spec)
+{
+    assert(fd >= 0);
+    assert(vec_is_valid(v));
+
+    sink s = sink_stream(NULL, fd);
+    put_vec(&s, v->pyl->arr + v->offset, v->step, v->d, spec_or_default(spec));
+    return sink_stream_end(&s);
+}
+
+size_t mat_to_strn(const mat *m, char *str, size_t size, const fmt_spec *spec)
+{
+    assert(m);
+    assert(str && size > 0);
+
+    sink s = sink_str(str, size);
+    put_mat(&s, m, spec_or_default(spec));
+    return sink_str_end(&s);
+}
+
+IND_TYP mat_fprint(FILE *f, const mat *m, const fmt_spec *spec)
+{
+    assert(f);
+    assert(m);
+
+    sink s = sink_stream(f, -1);
+    put_mat(&s, m, spec_or_default(spec));
+    return sink_stream_end(&s);
+}
+
+IND_TYP mat_dprint(int fd, const mat *m, const fmt_spec *spec)
+{
+    assert(fd >= 0);
+    assert(m);
+
+    sink s = sink_stream(NULL, fd);
+    put_mat(&s, m, spec_or_default(spec));
+    return sink_stream_end(&s);
+}
@@ -0,0 +1,187 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "fmt.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <unistd.h>
+#include <omp.h>
+
+static FLD_TYP rnd(void)
+{
+    return 2 * (rand() / (FLD_TYP)RAND_MAX) - 1;
+}
+
+static void fld_test(void)
+{
+    char buff[FMT_FLD_MAX], ref[64];
+    const FLD_TYP xs[] = {0, -0.0, 1, -1, 0.5, 0.1, 0.25, 3, 10, 100, 123456, 1234567, 1e-4, 1e-5,
+                          2.5e-7, 1e10, -4.75e12, 1e30, 1e-30, 999999.5, 0.000123, 65536, 1.5, -2.0625,
+                          INFINITY, -INFINITY, NAN};
+    const int n = sizeof(xs) / sizeof(xs[0]);
+    const int precs[] = {1, 3, 6, 9, 15, 16, 17};
+    const int n_prec = sizeof(precs) / sizeof(precs[0]);
+    int n_bad = 0;
+    for (int p = 0; p < n_prec; p++)
+        for (int i = 0; i < n; i++)
+        {
+            fmt_fld(buff, xs[i], precs[p]);
+            snprintf(ref, sizeof(ref), "%.*g", precs[p], (double)xs[i]);
+            if (strcmp(buff, ref) != 0)
+            {
+                printf("fmt_fld(%.17g, %d): %s, printf: %s\n", (double)xs[i], precs[p], buff, ref);
+                n_bad++;
+            }
+        }
+    printf("fmt_fld exact values: %d mismatches of %d\n", n_bad, n_prec * n);
+    assert(n_bad == 0);
+
+    // Random values over many magnitudes, all digits; at 17 they read back exactly
+    const int n_rnd = 100000, rnd_precs[] = {6, 9, 15, 16, 17};
+    int n_diff = 0, n_trip = 0;
+    for (int p = 0; p < 5; p++)
+        for (int i = 0; i < n_rnd; i++)
+        {
+            const FLD_TYP x = rnd() * pow(10, rand() % 80 - 40) + rnd() * 1e-3;
+            fmt_fld(buff, x, rnd_precs[p]);
+            snprintf(ref, sizeof(ref), "%.*g", rnd_precs[p], (double)x);
+            if (strcmp(buff, ref) != 0 && n_diff++ < 5)
+                printf("fmt_fld(%.17g, %d): %s, printf: %s\n", (double)x, rnd_precs[p], buff, ref);
+            if (rnd_precs[p] == 17)
+                n_trip += (FLD_TYP)strtod(buff, NULL) != x;
+        }
+    printf("fmt_fld random values, prec 6 to 17: %d of %d differ from printf, %d do not read back at 17\n", n_diff,
+           5 * n_rnd, n_trip);
+    assert(n_diff == 0 && n_trip == 0);
+    puts("------");
+}
+
+static void strn_test(void)
+{
+    char buff[1024], small[8];
+    const FLD_TYP arr[] = {1, -2.5, 3e-7, 4, 5, 6};
+    vec v = vec_NULL;
+    vec_construct(&v, 6);
+    vec_copy_arr(&v, arr);
+
+    size_t len = vec_to_strn(&v, buff, sizeof(buff), NULL);
+    printf("vec_to_strn: %s (%zu)\n", buff, len);
+    assert(strcmp(buff, "[1,-2.5,3e-07,4,5,6]") == 0 && len == strlen(buff));
+
+    len = vec_to_strn(&v, small, sizeof(small), NULL);
+    printf("vec_to_strn into 8 bytes: %s (%zu)\n", small, len);
+    assert(strcmp(small, "[1,-2.5") == 0 && len == strlen(buff));
+
+    const fmt_spec sum = {.prec = 3, .edge = 2};
+    vec_to_strn(&v, buff, sizeof(buff), &sum);
+    printf("vec_to_strn edge 2: %s\n", buff);
+    assert(strcmp(buff, "[1,-2.5,...,5,6]") == 0);
+
+    mat m = mat_NULL;
+    mat_construct(&m, 5, 5);
+    for (IND_TYP i = 0; i < 25; i++)
+        m.pyl->arr[m.offset + i] = i / 3.0;
+    len = mat_to_strn(&m, buff, sizeof(buff), &sum);
+    printf("mat_to_strn prec 3, edge 2:\n%s\n", buff);
+    assert(strcmp(buff, "[[0,0.333,...,1,1.33],\n"
+                        " [1.67,2,...,2.67,3],\n"
+                        " ...,\n"
+                        " [5,5.33,...,6,6.33],\n"
+                        " [6.67,7,...,7.67,8]]") == 0);
+
+    // vec_to_str / mat_to_str keep their format
+    char ref[1024];
+    mat_to_str(&m, ref);
+    mat_to_strn(&m, buff, sizeof(buff), NULL);
+    assert(strcmp(ref, buff) == 0);
+    mat m_null = mat_NULL;
+    mat_to_str(&m_null, ref);
+    assert(strcmp(ref, "mat_NULL\n") == 0);
+
+    vec_destruct(&v);
+    mat_destruct(&m);
+    puts("------");
+}
+
+static void stream_test(void)
+{
+    const IND_TYP d1 = 300, d2 = 200;
+    mat m = mat_NULL;
+    mat_construct(&m, d1, d2);
+    mat_fill_rnd(&m, rnd);
+    const fmt_spec spec = {.prec = 9, .edge = 0};
+    char one[1];
+    const size_t len = mat_to_strn(&m, one, sizeof(one), &spec);
+    char *ref = (char *)malloc(len + 1);
+    char *txt = (char *)malloc(len + 1);
+    mat_to_strn(&m, ref, len + 1, &spec);
+
+    FILE *f = tmpfile();
+    assert(f);
+    IND_TYP n_f = mat_fprint(f, &m, &spec);
+    rewind(f);
+    size_t n_rd = fread(txt, 1, len, f);
+    txt[n_rd] = 0;
+    bool ok_f = n_f == (IND_TYP)len && n_rd == len && strcmp(txt, ref) == 0;
+    printf("mat_fprint %ldx%ld, %zu bytes: %s\n", d1, d2, len, ok_f ? "ok" : "failed");
+    fclose(f);
+
+    f = tmpfile();
+    assert(f);
+    IND_TYP n_d = mat_dprint(fileno(f), &m, &spec);
+    rewind(f);
+    n_rd = fread(txt, 1, len, f);
+    txt[n_rd] = 0;
+    bool ok_d = n_d == (IND_TYP)len && n_rd == len && strcmp(txt, ref) == 0;
+    printf("mat_dprint %ldx%ld, %zu bytes: %s\n", d1, d2, len, ok_d ? "ok" : "failed");
+    fclose(f);
+    assert(ok_f && ok_d);
+
+    free(ref);
+    free(txt);
+    mat_destruct(&m);
+    puts("------");
+}
+
+static void dump_time_test(void)
+{
+    const IND_TYP d = 1000;
+    mat m = mat_NULL;
+    mat_construct(&m, d, d);
+    mat_fill_rnd(&m, rnd);
+    FILE *f = tmpfile();
+    assert(f);
+
+    double t0 = omp_get_wtime();
+    IND_TYP n = mat_fprint(f, &m, NULL);
+    double elp = omp_get_wtime() - t0;
+    printf("mat_fprint %ldx%ld: %ld bytes, %g s, %g MB/s\n", d, d, n, elp, n / elp * 1e-6);
+
+    rewind(f);
+    char buff[64];
+    t0 = omp_get_wtime();
+    for (IND_TYP i = 0; i < d * d; i++)
+        fprintf(f, "%g,", (double)m.pyl->arr[m.offset + i]);
+    double elp_ref = omp_get_wtime() - t0;
+    snprintf(buff, sizeof(buff), "%g", elp_ref);
+    printf("fprintf(\"%%g\") of the same elements: %s s, speed-up: %.1f\n", buff, elp_ref / elp);
+    fclose(f);
+
+    mat_destruct(&m);
+    puts("------");
+}
+
+void fmt_test(void)
+{
+    puts("+++ fmt_test +++");
+
+    fld_test();
+    strn_test();
+    stream_test();
+    dump_time_test();
+
+    puts("^^^ fmt_test ^^^");
+}
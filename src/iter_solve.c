@@ -0,0 +1,311 @@
+#include "iter_solve.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <tgmath.h>
+
+#include "vec_mat.h"
+
+#define MAX(x, y) (((x) >= (y)) ? (x) : (y))
+
+// Work vectors needed by CG (4) and BiCGSTAB (7); GMRES needs restart + 3.
+#define WS_MIN_VECS 7
+
+iter_ws *iter_ws_construct(iter_ws *ws, IND_TYP d, IND_TYP restart)
+{
+    assert(ws);
+    assert(d > 0);
+    assert(restart >= 0);
+
+    *ws = iter_ws_NULL;
+    ws->restart = restart;
+    mat_construct(&ws->vs, MAX(WS_MIN_VECS, restart + 3), d);
+    if (mat_is_null(&ws->vs))
+        return NULL;
+    if (restart > 0)
+    {
+        mat_construct(&ws->h, restart + 1, restart);
+        ws->givens = (FLD_TYP *)malloc(4 * (restart + 1) * sizeof(FLD_TYP));
+        assert(ws->givens);
+        if (mat_is_null(&ws->h) || !ws->givens)
+        {
+            iter_ws_destruct(ws);
+            return NULL;
+        }
+    }
+    return ws;
+}
+
+void iter_ws_destruct(iter_ws *ws)
+{
+    if (ws)
+    {
+        mat_destruct(&ws->vs);
+        mat_destruct(&ws->h);
+        free((void *)ws->givens);
+        *ws = iter_ws_NULL;
+    }
+}
+
+void iter_apply_mat(vec *out, const vec *in, void *m)
+{
+    mat_dot_vec(out, (const mat *)m, in);
+}
+
+void iter_apply_diag(vec *out, const vec *in, void *inv_diag)
+{
+    vec_mul(out, (const vec *)inv_diag, in);
+}
+
+static inline vec *ws_vec(iter_ws *ws, vec *v, IND_TYP i)
+{
+    return mat_row_at(&ws->vs, v, i);
+}
+
+// Returns M in, computed into out, or in itself without preconditioner
+static inline const vec *precond(const iter_param *prm, vec *out, const vec *in)
+{
+    if (!prm->prec.apply)
+        return in;
+    prm->prec.apply(out, in, prm->prec.ctx);
+    return out;
+}
+
+static inline void check_args(const vec *x, const iter_op *a, const vec *b, const iter_param *prm,
+                              const iter_ws *ws)
+{
+    assert(vec_is_valid(x));
+    assert(vec_is_valid(b));
+    assert(a->apply);
+    assert(prm && prm->tol > 0 && prm->max_iter >= 0);
+    assert(ws && mat_is_valid(&ws->vs));
+    assert(x->d == b->d && x->d == ws->vs.d2);
+    (void)x, (void)a, (void)b, (void)prm, (void)ws;
+}
+
+IND_TYP iter_cg(vec *x, iter_op a, const vec *b, const iter_param *prm, iter_ws *ws, FLT_TYP *res_norm)
+{
+    check_args(x, &a, b, prm, ws);
+
+    vec r = vec_NULL, p = vec_NULL, ap = vec_NULL, z = vec_NULL;
+    ws_vec(ws, &r, 0);
+    ws_vec(ws, &p, 1);
+    ws_vec(ws, &ap, 2);
+    ws_vec(ws, &z, 3);
+
+    const FLT_TYP b_nrm = vec_norm_2(b);
+    const FLD_TYP tol_2 = (prm->tol * b_nrm) * (prm->tol * b_nrm);
+
+    a.apply(&ap, x, a.ctx);
+    vec_sub(&r, b, &ap);
+    FLD_TYP rr = vec_dot(&r, &r);
+    IND_TYP it = 0;
+    if (rr > tol_2)
+    {
+        const vec *zr = precond(prm, &z, &r);
+        FLD_TYP rz = (zr == &r) ? rr : vec_dot(&r, zr);
+        vec_assign(&p, zr);
+        for (it = 1; it <= prm->max_iter; it++)
+        {
+            a.apply(&ap, &p, a.ctx);
+            const FLD_TYP alpha = rz / vec_dot(&p, &ap);
+            vec_update(x, alpha, &p);
+            rr = vec_update_dot(&r, -alpha, &ap, &r);
+            if (rr <= tol_2)
+                break;
+            zr = precond(prm, &z, &r);
+            const FLD_TYP rz_new = (zr == &r) ? rr : vec_dot(&r, zr);
+            vec_axpby(&p, 1, zr, rz_new / rz);
+            rz = rz_new;
+        }
+    }
+
+    vec_destruct(&r);
+    vec_destruct(&p);
+    vec_destruct(&ap);
+    vec_destruct(&z);
+
+    if (res_norm)
+        *res_norm = (b_nrm > 0) ? sqrt(rr) / b_nrm : sqrt(rr);
+    return (rr <= tol_2) ? it : -1;
+}
+
+IND_TYP iter_bicgstab(vec *x, iter_op a, const vec *b, const iter_param *prm, iter_ws *ws, FLT_TYP *res_norm)
+{
+    check_args(x, &a, b, prm, ws);
+
+    vec r = vec_NULL, r_h = vec_NULL, p = vec_NULL, v = vec_NULL;
+    vec p_h = vec_NULL, s_h = vec_NULL, t = vec_NULL;
+    ws_vec(ws, &r, 0);
+    ws_vec(ws, &r_h, 1);
+    ws_vec(ws, &p, 2);
+    ws_vec(ws, &v, 3);
+    ws_vec(ws, &p_h, 4);
+    ws_vec(ws, &s_h, 5);
+    ws_vec(ws, &t, 6);
+
+    const FLT_TYP b_nrm = vec_norm_2(b);
+    const FLD_TYP tol_2 = (prm->tol * b_nrm) * (prm->tol * b_nrm);
+
+    a.apply(&t, x, a.ctx);
+    vec_sub(&r, b, &t);
+    FLD_TYP rr = vec_dot(&r, &r);
+    IND_TYP it = 0;
+    if (rr > tol_2)
+    {
+        vec_assign(&r_h, &r);
+        vec_fill_zero(&p);
+        vec_fill_zero(&v);
+        FLD_TYP rho = 1, alpha = 1, omega = 1;
+        for (it = 1; it <= prm->max_iter; it++)
+        {
+            const FLD_TYP rho_new = vec_dot(&r_h, &r);
+            if (rho_new == 0 || omega == 0)
+                break;
+            // p = r + beta * (p - omega * v)
+            vec_update(&p, -omega, &v);
+            vec_axpby(&p, 1, &r, (rho_new / rho) * (alpha / omega));
+            const vec *ph = precond(prm, &p_h, &p);
+            a.apply(&v, ph, a.ctx);
+            alpha = rho_new / vec_dot(&r_h, &v);
+            vec_update(x, alpha, ph);
+            // r becomes s = r - alpha * v
+            rr = vec_update_dot(&r, -alpha, &v, &r);
+            if (rr <= tol_2)
+                break;
+            const vec *sh = precond(prm, &s_h, &r);
+            a.apply(&t, sh, a.ctx);
+            FLD_TYP ts, tt;
+            vec_dot_pair(&t, &r, &t, &ts, &tt);
+            omega = (tt != 0) ? ts / tt : 0;
+            vec_update(x, omega, sh);
+            rr = vec_update_dot(&r, -omega, &t, &r);
+            if (rr <= tol_2)
+                break;
+            rho = rho_new;
+        }
+    }
+
+    vec *all[] = {&r, &r_h, &p, &v, &p_h, &s_h, &t};
+    for (int i = 0; i < 7; i++)
+        vec_destruct(all[i]);
+
+    if (res_norm)
+        *res_norm = (b_nrm > 0) ? sqrt(rr) / b_nrm : sqrt(rr);
+    return (rr <= tol_2) ? it : -1;
+}
+
+IND_TYP iter_gmres(vec *x, iter_op a, const vec *b, const iter_param *prm, iter_ws *ws, FLT_TYP *res_norm)
+{
+    check_args(x, &a, b, prm, ws);
+    assert(ws->restart > 0 && mat_is_valid(&ws->h));
+
+    const IND_TYP m = ws->restart;
+    FLD_TYP *cs = ws->givens;
+    FLD_TYP *sn = cs + (m + 1);
+    FLD_TYP *g = sn + (m + 1);
+    FLD_TYP *y = g + (m + 1);
+    mat *h = &ws->h;
+
+    // Rows 0..m hold the Krylov basis, m + 1 and m + 2 are temporaries.
+    vec v_0 = vec_NULL, v_i = vec_NULL, v_i1 = vec_NULL, w = vec_NULL, z = vec_NULL, u = vec_NULL;
+    ws_vec(ws, &v_0, 0);
+    ws_vec(ws, &z, m + 1);
+    ws_vec(ws, &u, m + 2);
+
+    const FLT_TYP b_nrm = vec_norm_2(b);
+    const FLT_TYP tol = prm->tol * b_nrm;
+    FLT_TYP res = 0;
+    IND_TYP it = 0;
+    bool converged = false;
+
+    for (;;)
+    {
+        a.apply(&u, x, a.ctx);
+        vec_sub(&v_0, b, &u);
+        res = vec_norm_2(&v_0);
+        if (res <= tol)
+        {
+            converged = true;
+            break;
+        }
+        if (it >= prm->max_iter)
+            break;
+        vec_scale(&v_0, 1 / res);
+        g[0] = res;
+
+        IND_TYP k = 0;
+        while (k < m && it < prm->max_iter)
+        {
+            const IND_TYP j = k;
+            ws_vec(ws, &v_i, j);
+            ws_vec(ws, &w, j + 1);
+            a.apply(&w, precond(prm, &z, &v_i), a.ctx);
+
+            // Modified Gram-Schmidt; each projection is fused with the next dot product.
+            FLD_TYP h_ij = vec_dot(&w, &v_0);
+            for (IND_TYP i = 0; i < j; i++)
+            {
+                *mat_at(h, i, j) = h_ij;
+                ws_vec(ws, &v_i, i);
+                ws_vec(ws, &v_i1, i + 1);
+                h_ij = vec_update_dot(&w, -h_ij, &v_i, &v_i1);
+            }
+            *mat_at(h, j, j) = h_ij;
+            ws_vec(ws, &v_i, j);
+            const FLD_TYP h_nrm = sqrt(fabs(vec_update_dot(&w, -h_ij, &v_i, &w)));
+            *mat_at(h, j + 1, j) = h_nrm;
+            if (h_nrm != 0)
+                vec_scale(&w, 1 / h_nrm);
+
+            // Apply the previous Givens rotations, then annihilate h[j + 1][j].
+            for (IND_TYP i = 0; i < j; i++)
+            {
+                const FLD_TYP h_0 = *mat_at(h, i, j), h_1 = *mat_at(h, i + 1, j);
+                *mat_at(h, i, j) = cs[i] * h_0 + sn[i] * h_1;
+                *mat_at(h, i + 1, j) = -sn[i] * h_0 + cs[i] * h_1;
+            }
+            const FLD_TYP h_jj = *mat_at(h, j, j);
+            const FLD_TYP den = hypot(h_jj, h_nrm);
+            cs[j] = (den != 0) ? h_jj / den : 1;
+            sn[j] = (den != 0) ? h_nrm / den : 0;
+            *mat_at(h, j, j) = den;
+            *mat_at(h, j + 1, j) = 0;
+            g[j + 1] = -sn[j] * g[j];
+            g[j] = cs[j] * g[j];
+
+            k++;
+            it++;
+            res = fabs(g[k]);
+            if (res <= tol)
+                break;
+        }
+
+        // y = H[:k, :k]^-1 g[:k]; x += M (V[:k] y)
+        for (IND_TYP i = k - 1; i >= 0; i--)
+        {
+            FLD_TYP s = g[i];
+            for (IND_TYP l = i + 1; l < k; l++)
+                s -= *mat_at(h, i, l) * y[l];
+            y[i] = s / *mat_at(h, i, i);
+        }
+        vec_fill_zero(&u);
+        for (IND_TYP i = 0; i < k; i++)
+            vec_update(&u, y[i], ws_vec(ws, &v_i, i));
+        vec_addto(x, precond(prm, &z, &u));
+
+        if (res <= tol)
+        {
+            converged = true;
+            break;
+        }
+    }
+
+    vec *all[] = {&v_0, &v_i, &v_i1, &w, &z, &u};
+    for (int i = 0; i < 6; i++)
+        vec_destruct(all[i]);
+
+    if (res_norm)
+        *res_norm = (b_nrm > 0) ? res / b_nrm : res;
+    return converged ? it : -1;
+}
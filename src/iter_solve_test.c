@@ -0,0 +1,152 @@
+#include "iter_solve.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <tgmath.h>
+
+#include "vec_mat.h"
+
+static FLD_TYP rnd(void)
+{
+    return 2 * (rand() / (FLD_TYP)RAND_MAX) - 1;
+}
+
+// ||a @ x - b|| / ||b||
+static FLT_TYP residual(const mat *a, const vec *x, const vec *b)
+{
+    vec r = vec_NULL;
+    vec_construct(&r, b->d);
+    mat_dot_vec(&r, a, x);
+    vec_subfrom(&r, b);
+    FLT_TYP res = vec_norm_2(&r) / vec_norm_2(b);
+    vec_destruct(&r);
+    return res;
+}
+
+// a = g @ g^T / n + diag, with diag in [1, 1 + 4 n): symmetric positive definite, badly scaled
+static mat *fill_spd(mat *a)
+{
+    const IND_TYP n = a->d1;
+    mat g = mat_NULL, g_t = mat_NULL;
+    mat_construct(&g, n, n);
+    mat_construct(&g_t, n, n);
+    mat_fill_rnd(&g, rnd);
+    mat_transpose(&g_t, &g);
+    mat_dot(a, &g, &g_t);
+    mat_scale(a, (FLD_TYP)1 / n);
+    for (IND_TYP i = 0; i < n; i++)
+        *mat_at(a, i, i) += 1 + 4 * i;
+    mat_destruct(&g);
+    mat_destruct(&g_t);
+    return a;
+}
+
+// a = rnd / sqrt(n) + diag: nonsymmetric, diagonally dominated
+static mat *fill_nonsym(mat *a)
+{
+    const IND_TYP n = a->d1;
+    mat_fill_rnd(a, rnd);
+    mat_scale(a, 1 / sqrt((FLD_TYP)n));
+    for (IND_TYP i = 0; i < n; i++)
+        *mat_at(a, i, i) += 2 + 4 * i;
+    return a;
+}
+
+typedef IND_TYP (*solver)(vec *, iter_op, const vec *, const iter_param *, iter_ws *, FLT_TYP *);
+
+static bool run_solver(const char *name, solver slv, mat *a, const vec *b, const vec *inv_diag, iter_ws *ws)
+{
+    const FLT_TYP tol = sizeof(FLD_TYP) == 4 ? 1E-4 : 1E-8;
+    iter_op op = {.apply = iter_apply_mat, .ctx = a};
+    iter_param prm = {.tol = tol, .max_iter = 4 * a->d1, .prec = iter_op_NONE};
+    vec x = vec_NULL;
+    vec_construct(&x, b->d);
+    bool ok = true;
+    for (int pc = 0; pc < 2; pc++)
+    {
+        if (pc)
+            prm.prec = (iter_op){.apply = iter_apply_diag, .ctx = (void *)inv_diag};
+        vec_fill_zero(&x);
+        FLT_TYP res_norm = 0;
+        IND_TYP it = slv(&x, op, b, &prm, ws, &res_norm);
+        FLT_TYP res = residual(a, &x, b);
+        printf("%-9s %-6s iterations: %4ld, reported residual: %g, true residual: %g\n",
+               name, pc ? "jacobi" : "none", it, res_norm, res);
+        ok = ok && it >= 0 && res < 10 * tol;
+    }
+    vec_destruct(&x);
+    return ok;
+}
+
+static void iter_solve_sys_test(bool sym)
+{
+    const IND_TYP n = 200;
+    mat a = mat_NULL;
+    vec b = vec_NULL, inv_diag = vec_NULL;
+    mat_construct(&a, n, n);
+    vec_construct(&b, n);
+    vec_construct(&inv_diag, n);
+    if (sym)
+        fill_spd(&a);
+    else
+        fill_nonsym(&a);
+    vec_fill_rnd(&b, rnd);
+    for (IND_TYP i = 0; i < n; i++)
+        *vec_at(&inv_diag, i) = 1 / *mat_at(&a, i, i);
+
+    iter_ws ws;
+    iter_ws_construct(&ws, n, 30);
+    printf("%s system, n = %ld\n", sym ? "SPD" : "nonsymmetric", n);
+    bool ok = true;
+    if (sym)
+        ok = run_solver("cg", iter_cg, &a, &b, &inv_diag, &ws) && ok;
+    ok = run_solver("gmres(30)", iter_gmres, &a, &b, &inv_diag, &ws) && ok;
+    ok = run_solver("bicgstab", iter_bicgstab, &a, &b, &inv_diag, &ws) && ok;
+    printf("converged: %s\n", ok ? "yes" : "no");
+    assert(ok);
+    iter_ws_destruct(&ws);
+
+    mat_destruct(&a);
+    vec_destruct(&b);
+    vec_destruct(&inv_diag);
+    puts("------");
+}
+
+static void iter_solve_no_conv_test(void)
+{
+    const IND_TYP n = 100;
+    mat a = mat_NULL;
+    vec b = vec_NULL, x = vec_NULL;
+    mat_construct(&a, n, n);
+    vec_construct(&b, n);
+    vec_construct(&x, n);
+    fill_spd(&a);
+    vec_fill_rnd(&b, rnd);
+    vec_fill_zero(&x);
+
+    iter_ws ws;
+    iter_ws_construct(&ws, n, 0);
+    iter_param prm = {.tol = 1E-6, .max_iter = 2, .prec = iter_op_NONE};
+    FLT_TYP res_norm = 0;
+    IND_TYP it = iter_cg(&x, (iter_op){.apply = iter_apply_mat, .ctx = &a}, &b, &prm, &ws, &res_norm);
+    printf("cg with max_iter 2: %ld, residual: %g\n", it, res_norm);
+    assert(it == -1);
+    iter_ws_destruct(&ws);
+
+    mat_destruct(&a);
+    vec_destruct(&b);
+    vec_destruct(&x);
+    puts("------");
+}
+
+void iter_solve_test(void)
+{
+    puts("+++ iter_solve_test +++");
+
+    iter_solve_sys_test(true);
+    iter_solve_sys_test(false);
+    iter_solve_no_conv_test();
+
+    puts("^^^ iter_solve_test ^^^");
+}
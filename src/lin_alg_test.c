@@ -1,16 +1,74 @@
 #include "lin_alg.h"
 
+#include <string.h>
+
 void vec_mat_test(void);
 void vec_test(void);
 void mat_test(void);
 void slice_test(void);
+void optim_test(void);
+void mat_solve_test(void);
+void iter_solve_test(void);
+void mat_svd_test(void);
+void cov_acc_test(void);
+void mat_knn_test(void);
+void vec_sort_test(void);
+void fmt_test(void);
+void mat_io_test(void);
+void mat_arch_test(void);
+void mat_zip_test(void);
+void mat_delta_test(void);
+void mat_ring_test(void);
+void vec_small_test(void);
+
+void vec_mat_bench(void);
+void mat_solve_bench(void);
+void mat_svd_bench(void);
+void mat_knn_bench(void);
+void vec_sort_bench(void);
+void mat_io_bench(void);
+void mat_zip_bench(void);
+void mat_delta_bench(void);
+void mat_ring_bench(void);
+void vec_small_bench(void);
+void vec_bench(void);
 
-int main()
+int main(int argc, char *argv[])
 {
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+    {
+        vec_mat_bench();
+        mat_solve_bench();
+        mat_svd_bench();
+        mat_knn_bench();
+        vec_sort_bench();
+        mat_io_bench();
+        mat_zip_bench();
+        mat_delta_bench();
+        mat_ring_bench();
+        vec_small_bench();
+        vec_bench();
+        return 0;
+    }
+
     vec_test();
     mat_test();
     vec_mat_test();
     slice_test();
+    optim_test();
+    mat_solve_test();
+    iter_solve_test();
+    mat_svd_test();
+    cov_acc_test();
+    mat_knn_test();
+    vec_sort_test();
+    fmt_test();
+    mat_io_test();
+    mat_arch_test();
+    mat_zip_test();
+    mat_delta_test();
+    mat_ring_test();
+    vec_small_test();
 
     return 0;
 }
\ No newline at end of file
@@ -3,7 +3,11 @@
 #include <string.h>
 #include <stdio.h>
 #include <assert.h>
+#include <tgmath.h>
+#include <stdint.h>
 
+#include "vec.h"
+#include "fmt.h"
 #include "vector_eng.h"
 
 bool mat_is_null(const mat *m)
@@ -123,6 +127,26 @@ mat *mat_view_new(const mat *src, IND_TYP offset, IND_TYP d1, IND_TYP d2)
     return mat_view(new_m, src, offset, d1, d2);
 }
 
+mat *mat_clone(mat *dst, const mat *src)
+{
+    assert(dst);
+    assert(mat_is_valid(src));
+
+    payload *pyl = payload_cow(src->pyl);
+    payload_release(dst->pyl);
+    if (!pyl)
+    {
+        *dst = mat_NULL;
+        return dst;
+    }
+    dst->pyl = pyl;
+    dst->size = src->size;
+    dst->d1 = src->d1;
+    dst->d2 = src->d2;
+    dst->offset = src->offset;
+    return dst;
+}
+
 void mat_destruct(mat *m)
 {
     if (m)
@@ -165,6 +189,8 @@ mat *mat_assign(mat *m_dst, const mat *m_src)
     assert(m_dst->d1 == m_src->d1);
     assert(m_dst->d2 == m_src->d2);
 
+    if (!mat_touch(m_dst))
+        return NULL;
     FLD_TYP *arr_dst = payload_at(m_dst->pyl, m_dst->offset);
     FLD_TYP *arr_src = payload_at(m_src->pyl, m_src->offset);
 
@@ -178,10 +204,44 @@ mat *mat_assign(mat *m_dst, const mat *m_src)
     return m_dst;
 }
 
+mat *mat_append_rows(mat *m, const mat *rows)
+{
+    assert(m);
+    assert(mat_is_valid(rows));
+
+    // rows may be m: its elements are read after the growth, from the moved payload
+    const mat r = *rows;
+    IND_TYP i = 0;
+    if (mat_is_null(m))
+    {
+        mat_construct(m, r.d1, r.d2);
+        if (mat_is_null(m))
+            return NULL;
+    }
+    else
+    {
+        assert(mat_is_valid(m));
+        assert(m->d2 == r.d2);
+        assert((size_t)(m->offset + m->size) == m->pyl->size);
+        if (m->d2 != r.d2 || (size_t)(m->offset + m->size) != m->pyl->size)
+            return NULL;
+        i = m->offset + m->size;
+        if (!payload_resize(m->pyl, i + r.size))
+            return NULL;
+        m->d1 += r.d1;
+        m->size += r.size;
+    }
+    memcpy(payload_at(m->pyl, i), payload_at(r.pyl, r.offset), r.size * sizeof(FLD_TYP));
+    payload_mark(m->pyl, i, i + r.size);
+    return m;
+}
+
 mat *mat_fill_zero(mat *m)
 {
     assert(mat_is_valid(m));
 
+    if (!mat_touch(m))
+        return NULL;
     memset(payload_at(m->pyl, m->offset), 0, m->size * sizeof(FLD_TYP));
 
     return m;
@@ -192,6 +252,8 @@ mat *mat_fill_rnd(mat *m, FLD_TYP (*rnd)(void))
     assert(mat_is_valid(m));
     assert(rnd);
 
+    if (!mat_touch(m))
+        return NULL;
     for (IND_TYP i = m->offset; i < m->offset + m->size; i++)
         *payload_at(m->pyl, i) = rnd();
 
@@ -203,6 +265,8 @@ mat *mat_fill_gen(mat *m, FLD_TYP (*gen)(const void *param), const void *param)
     assert(mat_is_valid(m));
     assert(gen);
 
+    if (!mat_touch(m))
+        return NULL;
     for (IND_TYP i = m->offset; i < m->offset + m->size; i++)
         *payload_at(m->pyl, i) = gen(param);
 
@@ -212,26 +276,8 @@ mat *mat_fill_gen(mat *m, FLD_TYP (*gen)(const void *param), const void *param)
 char *mat_to_str(const mat *m, char *m_str)
 {
     assert(m);
-    if (mat_is_null(m))
-    {
-        strcpy(m_str, "mat_NULL\n");
-        return m_str;
-    }
-    assert(mat_is_valid(m));
 
-    char buff[64] = {0};
-    strcpy(m_str, "[");
-    for (IND_TYP i = 0; i < m->d1; i++)
-    {
-        strcat(m_str, (i != 0) ? " [" : "[");
-        for (IND_TYP j = 0; j < m->d2; j++)
-        {
-            sprintf(buff, (j + 1 != m->d2) ? "%g," : "%g", *mat_at(m, i, j));
-            strcat(m_str, buff);
-        }
-        strcat(m_str, (i + 1 != m->d1) ? "],\n" : "]");
-    }
-    strcat(m_str, "]");
+    mat_to_strn(m, m_str, SIZE_MAX, &fmt_spec_DEFAULT);
     return m_str;
 }
 
@@ -242,6 +288,8 @@ mat *mat_update(mat *m_trg, FLD_TYP alpha, const mat *m_right)
     assert(m_trg->d1 == m_right->d1);
     assert(m_trg->d2 == m_right->d2);
 
+    if (!mat_touch(m_trg))
+        return NULL;
     AXPY(m_trg->size, alpha,
          payload_at(m_right->pyl, m_right->offset), 1,
          payload_at(m_trg->pyl, m_trg->offset), 1);
@@ -263,6 +311,7 @@ FLD_TYP *mat_at(const mat *m, IND_TYP i, IND_TYP j)
 }
 
 #define MIN(x, y) (((x) <= (y)) ? (x) : (y))
+#define MAX(x, y) (((x) >= (y)) ? (x) : (y))
 
 IND_TYP mat_insert(mat *trg, const mat *src, IND_TYP row_i)
 {
@@ -270,6 +319,8 @@ IND_TYP mat_insert(mat *trg, const mat *src, IND_TYP row_i)
     assert(mat_is_valid(src));
     assert(trg->d2 == src->d2);
 
+    if (!payload_own(trg->pyl))
+        return 0;
     if (row_i < 0)
         row_i += trg->d1;
     assert(row_i >= 0 && row_i < trg->d1);
@@ -279,6 +330,7 @@ IND_TYP mat_insert(mat *trg, const mat *src, IND_TYP row_i)
     memcpy(payload_at(trg->pyl, trg->offset + row_i * trg->d2),
            payload_at(src->pyl, src->offset),
            nbr_rows_replaced * src->d2 * sizeof(FLD_TYP));
+    payload_mark(trg->pyl, trg->offset + row_i * trg->d2, trg->offset + (row_i + nbr_rows_replaced) * trg->d2);
     return nbr_rows_replaced;
 }
 
@@ -324,6 +376,7 @@ const uint8_t *mat_deserialize(mat *m, const uint8_t *byte_arr)
     sz = sizeof(m->d2);
     memcpy(&d2, byte_arr, sz);
     byte_arr += sz;
+    mat_destruct(m);
     mat_construct(m, d1, d2);
     sz = m->size * sizeof(FLD_TYP);
     memcpy(payload_at(m->pyl, 0), byte_arr, sz);
@@ -341,6 +394,8 @@ mat *mat_mul(mat *result, const mat *m_left, const mat *m_right)
     assert(result->d2 == m_left->d2);
     assert(result->d2 == m_right->d2);
 
+    if (!mat_touch(result))
+        return NULL;
     VMUL(m_left->size,
          payload_at(m_left->pyl, m_left->offset),
          payload_at(m_right->pyl, m_right->offset),
@@ -359,6 +414,8 @@ mat *mat_div(mat *result, const mat *m_left, const mat *m_right)
     assert(result->d2 == m_left->d2);
     assert(result->d2 == m_right->d2);
 
+    if (!mat_touch(result))
+        return NULL;
     VDIV(m_left->size,
          payload_at(m_left->pyl, m_left->offset),
          payload_at(m_right->pyl, m_right->offset),
@@ -374,6 +431,8 @@ mat *mat_mulby(mat *m_target, const mat *m_right)
     assert(m_target->d1 == m_right->d1);
     assert(m_target->d2 == m_right->d2);
 
+    if (!mat_touch(m_target))
+        return NULL;
     return mat_mul(m_target, m_target, m_right);
 }
 
@@ -385,6 +444,8 @@ mat *mat_dot(mat *result, const mat *m_left, const mat *m_right)
     assert(result->d1 == m_left->d1);
     assert(result->d2 == m_right->d2);
 
+    if (!mat_touch(result))
+        return NULL;
     GEMM(CblasRowMajor, CblasNoTrans, CblasNoTrans,
          m_left->d1, m_right->d2, m_left->d2, 1,
          payload_at(m_left->pyl, m_left->offset), m_left->d2,
@@ -419,6 +480,8 @@ mat *mat_add(mat *result, const mat *m_left, const mat *m_right)
     assert(result->d2 == m_left->d2);
     assert(result->d2 == m_right->d2);
 
+    if (!mat_touch(result))
+        return NULL;
     VADD(result->size,
          payload_at(m_left->pyl, m_left->offset),
          payload_at(m_right->pyl, m_right->offset),
@@ -437,6 +500,8 @@ mat *mat_sub(mat *result, const mat *m_left, const mat *m_right)
     assert(result->d2 == m_left->d2);
     assert(result->d2 == m_right->d2);
 
+    if (!mat_touch(result))
+        return NULL;
     VSUB(result->size,
          payload_at(m_left->pyl, m_left->offset),
          payload_at(m_right->pyl, m_right->offset),
@@ -452,6 +517,8 @@ mat *mat_addto(mat *m_target, const mat *m_right)
     assert(m_target->d1 == m_right->d1);
     assert(m_target->d2 == m_right->d2);
 
+    if (!mat_touch(m_target))
+        return NULL;
     return mat_add(m_target, m_target, m_right);
 }
 
@@ -459,6 +526,8 @@ mat *mat_f_addto(mat *m, FLD_TYP f)
 {
     assert(mat_is_valid(m));
 
+    if (!mat_touch(m))
+        return NULL;
     AXPY(m->size, 1, &f, 0, payload_at(m->pyl, m->offset), 1);
     return m;
 }
@@ -470,6 +539,8 @@ mat *mat_subfrom(mat *m_target, const mat *m_right)
     assert(m_target->d1 == m_right->d1);
     assert(m_target->d2 == m_right->d2);
 
+    if (!mat_touch(m_target))
+        return NULL;
     return mat_sub(m_target, m_target, m_right);
 }
 
@@ -477,6 +548,8 @@ mat *mat_scale(mat *m, FLD_TYP scale)
 {
     assert(mat_is_valid(m));
 
+    if (!mat_touch(m))
+        return NULL;
     SCAL(m->size, scale, payload_at(m->pyl, m->offset), 1);
 
     return m;
@@ -489,6 +562,8 @@ mat *mat_square(mat *result, const mat *m)
     assert(result->d1 == m->d1);
     assert(result->d2 == m->d2);
 
+    if (!mat_touch(result))
+        return NULL;
     VSQR(m->size, payload_at(m->pyl, m->offset), payload_at(result->pyl, result->offset));
 
     return result;
@@ -501,6 +576,8 @@ mat *mat_sqrt(mat *result, const mat *m)
     assert(result->d1 == m->d1);
     assert(result->d2 == m->d2);
 
+    if (!mat_touch(result))
+        return NULL;
     VSQRT(m->size, payload_at(m->pyl, m->offset), payload_at(result->pyl, result->offset));
 
     return result;
@@ -513,6 +590,8 @@ mat *mat_transpose(mat *result, const mat *target)
     assert(result->d2 == target->d1);
     assert(result->d1 == target->d2);
 
+    if (!mat_touch(result))
+        return NULL;
     OMAT('R', 'T', target->d1, target->d2, 1,
          payload_at(target->pyl, target->offset), target->d2,
          payload_at(result->pyl, result->offset), result->d2);
@@ -524,6 +603,8 @@ mat *mat_T(mat *m)
 {
     assert(mat_is_valid(m));
 
+    if (!mat_touch(m))
+        return NULL;
     IMAT('R', 'T', m->d1, m->d2, 1, payload_at(m->pyl, m->offset), m->d2, m->d1);
     IND_TYP tmp = m->d1;
     m->d1 = m->d2;
@@ -532,6 +613,12 @@ mat *mat_T(mat *m)
     return m;
 }
 
+// Non-owning vec over all the elements of m; must not be destructed
+static inline vec mat_as_vec(const mat *m)
+{
+    return (vec){.pyl = m->pyl, .d = m->size, .offset = m->offset, .step = 1};
+}
+
 bool mat_is_close(const mat *m_1, const mat *m_2, FLD_TYP eps)
 {
     assert(mat_is_valid(m_1));
@@ -542,15 +629,150 @@ bool mat_is_close(const mat *m_1, const mat *m_2, FLD_TYP eps)
         return false;
     if (payload_at(m_1->pyl, m_1->offset) == payload_at(m_2->pyl,  m_2->offset))
         return true;
-    FLD_TYP nrm_ratio = mat_norm_2(m_1);
-    nrm_ratio += mat_norm_2(m_2);
-    if (nrm_ratio == 0)
-        return true;
-    mat result = mat_NULL;
-    mat_construct(&result, m_1->d1, m_1->d2);
-    mat_sub(&result, m_1, m_2);
-    nrm_ratio = 2 * mat_norm_2(&result) / nrm_ratio;
-    mat_destruct(&result);
+    const vec v_1 = mat_as_vec(m_1), v_2 = mat_as_vec(m_2);
+    return vec_is_close(&v_1, &v_2, eps);
+}
 
-    return nrm_ratio < eps;
+bool mat_allclose(const mat *m_1, const mat *m_2, FLD_TYP atol, FLD_TYP rtol)
+{
+    assert(mat_is_valid(m_1));
+    assert(mat_is_valid(m_2));
+
+    if (m_1->d1 != m_2->d1 || m_1->d2 != m_2->d2)
+        return false;
+    const vec v_1 = mat_as_vec(m_1), v_2 = mat_as_vec(m_2);
+    return vec_allclose(&v_1, &v_2, atol, rtol);
 }
+
+
+#define ATT_BLK_Q 64
+#define ATT_BLK_K 64
+
+mat *mat_attention(mat *out, const mat *q, const mat *k, const mat *v, FLD_TYP scale, bool causal)
+{
+    return mat_attention_heads(out, q, k, v, 1, scale, causal);
+}
+
+mat *mat_attention_heads(mat *out, const mat *q, const mat *k, const mat *v, IND_TYP n_heads,
+                         FLD_TYP scale, bool causal)
+{
+    assert(mat_is_valid(out));
+    assert(mat_is_valid(q));
+    assert(mat_is_valid(k));
+    assert(mat_is_valid(v));
+    assert(n_heads > 0);
+    assert(q->d2 == k->d2 && q->d2 % n_heads == 0);
+    assert(k->d1 == v->d1 && v->d2 % n_heads == 0);
+    assert(out->d1 == q->d1 && out->d2 == v->d2);
+    assert(out->pyl->arr + out->offset != k->pyl->arr + k->offset);
+    assert(out->pyl->arr + out->offset != v->pyl->arr + v->offset);
+
+    if (!mat_touch(out))
+        return NULL;
+    const IND_TYP l_q = q->d1, l_k = k->d1;
+    const IND_TYP d_k = q->d2 / n_heads, d_v = v->d2 / n_heads;
+    const IND_TYP n_qb = (l_q + ATT_BLK_Q - 1) / ATT_BLK_Q;
+    const IND_TYP diag = l_k - l_q; // query i sees keys j <= i + diag when causal
+    const FLD_TYP *q_arr = q->pyl->arr + q->offset;
+    const FLD_TYP *k_arr = k->pyl->arr + k->offset;
+    const FLD_TYP *v_arr = v->pyl->arr + v->offset;
+    FLD_TYP *o_arr = out->pyl->arr + out->offset;
+    bool ok = true;
+
+#pragma omp parallel if (n_heads * n_qb > 1 && q->size + k->size >= PAR_MIN_SIZE)
+    {
+        // Per-thread tile workspace: scores, output accumulator, running max and sum
+        FLD_TYP *s = (FLD_TYP *)malloc((ATT_BLK_Q * ATT_BLK_K + ATT_BLK_Q * d_v + 2 * ATT_BLK_Q) * sizeof(FLD_TYP));
+        assert(s);
+        if (!s)
+        {
+#pragma omp atomic write
+            ok = false;
+        }
+        FLD_TYP *acc = s ? s + ATT_BLK_Q * ATT_BLK_K : NULL;
+        FLD_TYP *r_max = s ? acc + ATT_BLK_Q * d_v : NULL;
+        FLD_TYP *r_sum = s ? r_max + ATT_BLK_Q : NULL;
+
+        // Every thread takes part in the loop; one without a workspace skips its tiles
+#pragma omp for collapse(2) schedule(dynamic)
+        for (IND_TYP h = 0; h < n_heads; h++)
+            for (IND_TYP qb = 0; qb < n_qb; qb++)
+            {
+                if (!s)
+                    continue;
+                const IND_TYP i_0 = qb * ATT_BLK_Q;
+                const IND_TYP n_r = MIN(ATT_BLK_Q, l_q - i_0);
+                const IND_TYP j_end = causal ? MIN(l_k, i_0 + n_r + diag) : l_k;
+
+                for (IND_TYP r = 0; r < n_r; r++)
+                {
+                    r_max[r] = -INFINITY;
+                    r_sum[r] = 0;
+                }
+                memset(acc, 0, n_r * d_v * sizeof(FLD_TYP));
+
+                for (IND_TYP j_0 = 0; j_0 < j_end; j_0 += ATT_BLK_K)
+                {
+                    const IND_TYP n_c = MIN(ATT_BLK_K, j_end - j_0);
+
+                    GEMM(CblasRowMajor, CblasNoTrans, CblasTrans,
+                         n_r, n_c, d_k, scale,
+                         q_arr + i_0 * q->d2 + h * d_k, q->d2,
+                         k_arr + j_0 * k->d2 + h * d_k, k->d2,
+                         0, s, n_c);
+
+                    for (IND_TYP r = 0; r < n_r; r++)
+                    {
+                        FLD_TYP *s_r = s + r * n_c;
+                        if (causal)
+                            for (IND_TYP c = MAX(0, i_0 + r + diag + 1 - j_0); c < n_c; c++)
+                                s_r[c] = -INFINITY;
+
+                        FLD_TYP m_new = r_max[r];
+                        for (IND_TYP c = 0; c < n_c; c++)
+                            m_new = (s_r[c] > m_new) ? s_r[c] : m_new;
+                        // Rows with no visible key so far keep a zero accumulator.
+                        const FLD_TYP m_ref = (m_new == -INFINITY) ? 0 : m_new;
+
+                        FLD_TYP p_sum = 0;
+#pragma omp simd reduction(+ : p_sum)
+                        for (IND_TYP c = 0; c < n_c; c++)
+                        {
+                            s_r[c] = exp(s_r[c] - m_ref);
+                            p_sum += s_r[c];
+                        }
+                        const FLD_TYP corr = exp(r_max[r] - m_ref);
+                        r_sum[r] = r_sum[r] * corr + p_sum;
+                        r_max[r] = m_new;
+                        if (corr != 1)
+                        {
+                            FLD_TYP *a_r = acc + r * d_v;
+#pragma omp simd
+                            for (IND_TYP c = 0; c < d_v; c++)
+                                a_r[c] *= corr;
+                        }
+                    }
+
+                    GEMM(CblasRowMajor, CblasNoTrans, CblasNoTrans,
+                         n_r, d_v, n_c, 1,
+                         s, n_c,
+                         v_arr + j_0 * v->d2 + h * d_v, v->d2,
+                         1, acc, d_v);
+                }
+
+                for (IND_TYP r = 0; r < n_r; r++)
+                {
+                    const FLD_TYP inv = (r_sum[r] > 0) ? 1 / r_sum[r] : 0;
+                    FLD_TYP *o_r = o_arr + (i_0 + r) * out->d2 + h * d_v;
+                    const FLD_TYP *a_r = acc + r * d_v;
+#pragma omp simd
+                    for (IND_TYP c = 0; c < d_v; c++)
+                        o_r[c] = a_r[c] * inv;
+                }
+            }
+
+        free((void *)s);
+    }
+
+    return ok ? out : NULL;
+}
\ No newline at end of file
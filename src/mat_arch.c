@@ -0,0 +1,418 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "mat_arch.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <omp.h>
+
+#include "log.h"
+
+#define MIN(x, y) (((x) <= (y)) ? (x) : (y))
+
+#if defined(FLD_CLX64) || defined(FLD_CLX32)
+#define ARCH_DTYPE (0x200u | sizeof(FLD_TYP))
+#else
+#define ARCH_DTYPE (0x100u | sizeof(FLD_TYP))
+#endif
+
+#define ARCH_MAGIC "LAARCH\0\1"
+#define ARCH_PRIME 0x100000001b3ULL
+
+typedef struct arch_hdr
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t rec_size;
+    uint64_t n;
+    uint8_t reserved[40];
+} arch_hdr;
+
+_Static_assert(sizeof(arch_rec) == 128, "arch_rec is 128 bytes on disk");
+_Static_assert(sizeof(arch_hdr) == 64, "arch_hdr is 64 bytes on disk");
+
+static inline uint64_t rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t fmix(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    return h ^ (h >> 33);
+}
+
+// Hash of one piece of at most ARCH_BLK bytes
+static uint64_t blk_hash(const uint8_t *p, size_t n)
+{
+    uint64_t l[4] = {0xcbf29ce484222325ULL, 0x84222325cbf29ce4ULL, 0x9e3779b97f4a7c15ULL, 0x7f4a7c159e3779b9ULL};
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+        for (int k = 0; k < 4; k++)
+        {
+            uint64_t w;
+            memcpy(&w, p + i + 8 * k, 8);
+            l[k] = (l[k] ^ w) * ARCH_PRIME;
+        }
+    if (i < n)
+    {
+        uint8_t tail[32] = {0};
+        memcpy(tail, p + i, n - i);
+        for (int k = 0; k < 4; k++)
+        {
+            uint64_t w;
+            memcpy(&w, tail + 8 * k, 8);
+            l[k] = (l[k] ^ w) * ARCH_PRIME;
+        }
+    }
+    return fmix(l[0] ^ rotl(l[1], 17) ^ rotl(l[2], 31) ^ rotl(l[3], 47) ^ n);
+}
+
+// Checksum of the piece hashes h[0..n_blk)
+static uint64_t fold_hashes(const uint64_t *h, IND_TYP n_blk)
+{
+    uint64_t c = 0;
+    for (IND_TYP b = 0; b < n_blk; b++)
+        c = fmix(c ^ h[b]) * ARCH_PRIME + b;
+    return c;
+}
+
+static inline IND_TYP n_blocks(uint64_t bytes)
+{
+    return (bytes + ARCH_BLK - 1) / ARCH_BLK;
+}
+
+static bool pwrite_full(int fd, const void *buf, size_t n, size_t off)
+{
+    for (size_t done = 0; done < n;)
+    {
+        const ssize_t w = pwrite(fd, (const char *)buf + done, n - done, off + done);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            return false;
+        done += w;
+    }
+    return true;
+}
+
+static bool pread_full(int fd, void *buf, size_t n, size_t off)
+{
+    for (size_t done = 0; done < n;)
+    {
+        const ssize_t r = pread(fd, (char *)buf + done, n - done, off + done);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return false;
+        done += r;
+    }
+    return true;
+}
+
+arch_w *arch_w_construct(arch_w *w)
+{
+    assert(w);
+
+    *w = arch_w_NULL;
+    return w;
+}
+
+void arch_w_destruct(arch_w *w)
+{
+    if (!w)
+        return;
+    free((void *)w->recs);
+    free((void *)w->arrs);
+    free((void *)w->steps);
+    *w = arch_w_NULL;
+}
+
+static arch_w *w_add(arch_w *w, const char *name, const FLD_TYP *arr, IND_TYP step, uint32_t ndim, IND_TYP d1,
+                     IND_TYP d2)
+{
+    assert(w);
+    assert(name && strlen(name) < ARCH_NAME_MAX);
+
+    if (w->n == w->cap)
+    {
+        const IND_TYP cap = w->cap ? 2 * w->cap : 16;
+        arch_rec *recs = (arch_rec *)realloc(w->recs, cap * sizeof(arch_rec));
+        const FLD_TYP **arrs = (const FLD_TYP **)realloc(w->arrs, cap * sizeof(FLD_TYP *));
+        IND_TYP *steps = (IND_TYP *)realloc(w->steps, cap * sizeof(IND_TYP));
+        w->recs = recs ? recs : w->recs;
+        w->arrs = arrs ? arrs : w->arrs;
+        w->steps = steps ? steps : w->steps;
+        assert(recs && arrs && steps);
+        if (!recs || !arrs || !steps)
+            return NULL;
+        w->cap = cap;
+    }
+    arch_rec *r = w->recs + w->n;
+    memset(r, 0, sizeof(arch_rec));
+    strcpy(r->name, name);
+    r->ndim = ndim;
+    r->dtype = ARCH_DTYPE;
+    r->shape[0] = d1;
+    r->shape[1] = d2;
+    r->bytes = d1 * (ndim > 1 ? d2 : 1) * sizeof(FLD_TYP);
+    w->arrs[w->n] = arr;
+    w->steps[w->n] = step;
+    w->n++;
+    return w;
+}
+
+arch_w *arch_w_add_vec(arch_w *w, const char *name, const vec *v)
+{
+    assert(vec_is_valid(v));
+
+    return w_add(w, name, v->pyl->arr + v->offset, v->step, 1, v->d, 0);
+}
+
+arch_w *arch_w_add_mat(arch_w *w, const char *name, const mat *m)
+{
+    assert(mat_is_valid(m));
+
+    return w_add(w, name, m->pyl->arr + m->offset, 1, 2, m->d1, m->d2);
+}
+
+typedef struct name_idx
+{
+    const char *name;
+    IND_TYP i;
+} name_idx;
+
+static int cmp_name(const void *x, const void *y)
+{
+    return strcmp(((const name_idx *)x)->name, ((const name_idx *)y)->name);
+}
+
+IND_TYP arch_w_save(const arch_w *w, const char *path)
+{
+    assert(w && w->n > 0);
+    assert(path);
+
+    // Index sorted by name, data offsets aligned
+    const IND_TYP n = w->n;
+    name_idx *ord = (name_idx *)malloc(n * sizeof(name_idx));
+    arch_rec *recs = (arch_rec *)malloc(n * sizeof(arch_rec));
+    IND_TYP *blk_0 = (IND_TYP *)malloc((n + 1) * sizeof(IND_TYP));
+    assert(ord && recs && blk_0);
+    bool ok = ord && recs && blk_0;
+    for (IND_TYP t = 0; ok && t < n; t++)
+        ord[t] = (name_idx){.name = w->recs[t].name, .i = t};
+    if (ok)
+    {
+        qsort(ord, n, sizeof(name_idx), cmp_name);
+        blk_0[0] = 0;
+    }
+    uint64_t off = (sizeof(arch_hdr) + n * sizeof(arch_rec) + ARCH_ALIGN - 1) / ARCH_ALIGN * ARCH_ALIGN;
+    for (IND_TYP t = 0; ok && t < n; t++)
+    {
+        recs[t] = w->recs[ord[t].i];
+        recs[t].offset = off;
+        off += (recs[t].bytes + ARCH_ALIGN - 1) / ARCH_ALIGN * ARCH_ALIGN;
+        blk_0[t + 1] = blk_0[t] + n_blocks(recs[t].bytes);
+        if (t > 0 && strcmp(recs[t - 1].name, recs[t].name) == 0)
+        {
+            log_msg(LOG_ERR, "arch_w_save: duplicate name %s\n", recs[t].name);
+            ok = false;
+        }
+    }
+    const int fd = ok ? open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644) : -1;
+    if (ok && fd < 0)
+        log_msg(LOG_ERR, "arch_w_save: cannot create %s\n", path);
+    ok = ok && fd >= 0 && ftruncate(fd, off) == 0;
+
+    // Pieces of all tensors in parallel: gathered if strided, hashed and written
+    const IND_TYP n_blk = ok ? blk_0[n] : 0;
+    uint64_t *hash = (uint64_t *)malloc((n_blk + 1) * sizeof(uint64_t));
+    ok = ok && hash;
+#pragma omp parallel if (ok && n_blk > 1)
+    {
+        FLD_TYP *buf = NULL;
+#pragma omp for schedule(dynamic, 1)
+        for (IND_TYP b = 0; b < n_blk; b++)
+        {
+            IND_TYP lo = 0, hi = n - 1;
+            while (lo < hi)
+            {
+                const IND_TYP mid = (lo + hi + 1) / 2;
+                if (blk_0[mid] <= b)
+                    lo = mid;
+                else
+                    hi = mid - 1;
+            }
+            const arch_rec *r = recs + lo;
+            const uint64_t b_off = (uint64_t)(b - blk_0[lo]) * ARCH_BLK;
+            const size_t len = MIN((uint64_t)ARCH_BLK, r->bytes - b_off);
+            const IND_TYP step = w->steps[ord[lo].i];
+            const FLD_TYP *src = w->arrs[ord[lo].i] + (b_off / sizeof(FLD_TYP)) * step;
+            if (step != 1)
+            {
+                buf = buf ? buf : (FLD_TYP *)malloc(ARCH_BLK);
+                for (size_t i = 0; buf && i < len / sizeof(FLD_TYP); i++)
+                    buf[i] = src[i * step];
+                src = buf;
+            }
+            const bool ok_b = src && pwrite_full(fd, src, len, r->offset + b_off);
+            hash[b] = blk_hash((const uint8_t *)src, ok_b ? len : 0);
+            if (!ok_b)
+            {
+#pragma omp atomic write
+                ok = false;
+            }
+        }
+        free((void *)buf);
+    }
+    for (IND_TYP t = 0; ok && t < n; t++)
+        recs[t].checksum = fold_hashes(hash + blk_0[t], blk_0[t + 1] - blk_0[t]);
+
+    arch_hdr hdr = {.magic = ARCH_MAGIC, .version = 1, .rec_size = sizeof(arch_rec), .n = n};
+    ok = ok && pwrite_full(fd, &hdr, sizeof(hdr), 0) && pwrite_full(fd, recs, n * sizeof(arch_rec), sizeof(hdr));
+    if (fd >= 0)
+        ok = (close(fd) == 0) && ok;
+
+    free((void *)ord);
+    free((void *)recs);
+    free((void *)blk_0);
+    free((void *)hash);
+    return ok ? (IND_TYP)off : -1;
+}
+
+arch *arch_open(arch *a, const char *path)
+{
+    assert(a);
+    assert(path);
+
+    *a = arch_NULL;
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        log_msg(LOG_ERR, "arch_open: cannot open %s\n", path);
+        return NULL;
+    }
+    arch_hdr hdr;
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && pread_full(fd, &hdr, sizeof(hdr), 0) &&
+              memcmp(hdr.magic, ARCH_MAGIC, 8) == 0 && hdr.version == 1 && hdr.rec_size == sizeof(arch_rec) &&
+              hdr.n > 0 && hdr.n <= ((uint64_t)st.st_size - sizeof(hdr)) / sizeof(arch_rec);
+    arch_rec *recs = ok ? (arch_rec *)malloc(hdr.n * sizeof(arch_rec)) : NULL;
+    ok = ok && recs && pread_full(fd, recs, hdr.n * sizeof(arch_rec), sizeof(hdr));
+    for (uint64_t t = 0; ok && t < hdr.n; t++)
+        ok = recs[t].name[ARCH_NAME_MAX - 1] == 0 && recs[t].offset % ARCH_ALIGN == 0 &&
+             recs[t].offset <= (uint64_t)st.st_size && recs[t].bytes <= (uint64_t)st.st_size - recs[t].offset;
+    if (!ok)
+    {
+        log_msg(LOG_ERR, "arch_open: not an archive: %s\n", path);
+        free((void *)recs);
+        close(fd);
+        return NULL;
+    }
+    a->fd = fd;
+    a->n = hdr.n;
+    a->recs = recs;
+    return a;
+}
+
+void arch_close(arch *a)
+{
+    if (!a)
+        return;
+    if (a->fd >= 0)
+        close(a->fd);
+    free((void *)a->recs);
+    *a = arch_NULL;
+}
+
+const arch_rec *arch_find(const arch *a, const char *name)
+{
+    assert(a && a->recs);
+    assert(name);
+
+    IND_TYP lo = 0, hi = a->n - 1;
+    while (lo <= hi)
+    {
+        const IND_TYP mid = lo + (hi - lo) / 2;
+        const int c = strcmp(a->recs[mid].name, name);
+        if (c == 0)
+            return a->recs + mid;
+        if (c < 0)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    return NULL;
+}
+
+// Mapped payload of the tensor name of ndim dimensions, NULL on error
+static payload *arch_payload(const arch *a, const char *name, uint32_t ndim, bool verify, const arch_rec **rec)
+{
+    const arch_rec *r = arch_find(a, name);
+    *rec = r;
+    // shape[0] * shape[1] elements, checked against overflow before the byte count
+    const int64_t d1 = r ? r->shape[0] : 0, d2 = (r && ndim > 1) ? r->shape[1] : 1;
+    const bool ok_shape = d1 > 0 && d2 > 0 && d2 <= INT64_MAX / d1 && (uint64_t)(d1 * d2) <= SIZE_MAX / sizeof(FLD_TYP);
+    const int64_t size = ok_shape ? d1 * d2 : 0;
+    if (!r || r->ndim != ndim || r->dtype != ARCH_DTYPE || !ok_shape || r->bytes != size * sizeof(FLD_TYP))
+    {
+        log_msg(LOG_ERR, "arch: no %s tensor %s\n", (ndim == 1) ? "vec" : "mat", name);
+        return NULL;
+    }
+    payload *pyl = payload_map(a->fd, r->offset, size);
+    if (!pyl || !verify)
+        return pyl;
+
+    const IND_TYP n_blk = n_blocks(r->bytes);
+    uint64_t *hash = (uint64_t *)malloc(n_blk * sizeof(uint64_t));
+    assert(hash);
+    const uint8_t *data = (const uint8_t *)pyl->arr;
+#pragma omp parallel for schedule(dynamic, 1) if (hash && n_blk > 1)
+    for (IND_TYP b = 0; b < n_blk; b++)
+        hash[b] = blk_hash(data + b * (uint64_t)ARCH_BLK, MIN((uint64_t)ARCH_BLK, r->bytes - b * (uint64_t)ARCH_BLK));
+    const bool ok = hash && fold_hashes(hash, n_blk) == r->checksum;
+    free((void *)hash);
+    if (!ok)
+    {
+        log_msg(LOG_ERR, "arch: checksum mismatch of %s\n", name);
+        payload_release(pyl);
+        return NULL;
+    }
+    return pyl;
+}
+
+vec *arch_load_vec(vec *v, const arch *a, const char *name, bool verify)
+{
+    assert(v);
+
+    *v = vec_NULL;
+    const arch_rec *r;
+    payload *pyl = arch_payload(a, name, 1, verify, &r);
+    if (!pyl)
+        return NULL;
+    vec_construct_prealloc(v, pyl, 0, r->shape[0], 1);
+    payload_release(pyl);
+    return v;
+}
+
+mat *arch_load_mat(mat *m, const arch *a, const char *name, bool verify)
+{
+    assert(m);
+
+    *m = mat_NULL;
+    const arch_rec *r;
+    payload *pyl = arch_payload(a, name, 2, verify, &r);
+    if (!pyl)
+        return NULL;
+    mat_construct_prealloc(m, pyl, 0, r->shape[0], r->shape[1]);
+    payload_release(pyl);
+    return m;
+}
@@ -0,0 +1,140 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "mat_arch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <omp.h>
+
+static FLD_TYP rnd(void)
+{
+    return 2 * (rand() / (FLD_TYP)RAND_MAX) - 1;
+}
+
+static bool mat_same(const mat *a, const mat *b)
+{
+    return a->d1 == b->d1 && a->d2 == b->d2 &&
+           memcmp(a->pyl->arr + a->offset, b->pyl->arr + b->offset, a->size * sizeof(FLD_TYP)) == 0;
+}
+
+static bool vec_same(const vec *a, const vec *b)
+{
+    bool ok = a->d == b->d;
+    for (IND_TYP i = 0; ok && i < a->d; i++)
+        ok = *vec_at(a, i) == *vec_at(b, i);
+    return ok;
+}
+
+static void archive_test(void)
+{
+    // n_layer layers of a weight mat and a bias vec, one mat over several ARCH_BLK pieces,
+    // and a strided vec view
+    enum
+    {
+        n_layer = 100
+    };
+    const IND_TYP d = 32, d_big = 700;
+    mat w[n_layer], big = mat_NULL;
+    vec b[n_layer], v = vec_NULL, v_s = vec_NULL;
+    char name[ARCH_NAME_MAX], path[32];
+    arch_w aw;
+    arch_w_construct(&aw);
+    for (int l = 0; l < n_layer; l++)
+    {
+        w[l] = mat_NULL;
+        b[l] = vec_NULL;
+        mat_construct(w + l, d, d + l % 3);
+        vec_construct(b + l, d);
+        mat_fill_rnd(w + l, rnd);
+        vec_fill_rnd(b + l, rnd);
+        snprintf(name, sizeof(name), "layer%03d.weight", l);
+        arch_w_add_mat(&aw, name, w + l);
+        snprintf(name, sizeof(name), "layer%03d.bias", l);
+        arch_w_add_vec(&aw, name, b + l);
+    }
+    mat_construct(&big, d_big, d_big);
+    mat_fill_rnd(&big, rnd);
+    vec_construct(&v, 1001);
+    vec_fill_rnd(&v, rnd);
+    vec_view(&v_s, &v, 1000, 500, -2);
+    arch_w_add_mat(&aw, "embedding", &big);
+    arch_w_add_vec(&aw, "strided", &v_s);
+
+    strcpy(path, "/tmp/lin_alg_arch_XXXXXX");
+    close(mkstemp(path));
+    double t0 = omp_get_wtime();
+    IND_TYP sz = arch_w_save(&aw, path);
+    double elp = omp_get_wtime() - t0;
+    printf("arch_w_save %ld tensors, %ld bytes: %g s\n", aw.n, sz, elp);
+
+    arch a;
+    bool ok_open = arch_open(&a, path) && a.n == 2 * n_layer + 2;
+    mat m = mat_NULL;
+    vec u = vec_NULL;
+    bool ok = ok_open;
+    for (int l = n_layer - 1; ok && l >= 0; l -= 7)
+    {
+        snprintf(name, sizeof(name), "layer%03d.weight", l);
+        ok = arch_load_mat(&m, &a, name, true) && mat_same(&m, w + l) && (m.pyl->flags & payload_FLG_MMAP);
+        mat_destruct(&m);
+        snprintf(name, sizeof(name), "layer%03d.bias", l);
+        ok = ok && arch_load_vec(&u, &a, name, false) && vec_same(&u, b + l);
+        vec_destruct(&u);
+    }
+    ok = ok && arch_load_mat(&m, &a, "embedding", true) && mat_same(&m, &big);
+    mat_destruct(&m);
+    ok = ok && arch_load_vec(&u, &a, "strided", true) && vec_same(&u, &v_s);
+    vec_destruct(&u);
+    bool ok_rej = !arch_load_vec(&u, &a, "missing", false) && !arch_load_vec(&u, &a, "embedding", false) &&
+                  !arch_load_mat(&m, &a, "strided", false) && vec_is_null(&u) && mat_is_null(&m);
+
+    // Checksum catches a flipped byte in the data of one tensor only
+    const arch_rec *r = arch_find(&a, "layer050.bias");
+    const size_t corrupt_off = r->offset + 5;
+    arch_close(&a);
+    FILE *f = fopen(path, "r+b");
+    fseek(f, corrupt_off, SEEK_SET);
+    const int c = fgetc(f);
+    fseek(f, corrupt_off, SEEK_SET);
+    fputc(c ^ 0x10, f);
+    fclose(f);
+    arch_open(&a, path);
+    bool ok_cks = !arch_load_vec(&u, &a, "layer050.bias", true) && arch_load_vec(&u, &a, "layer051.bias", true);
+    vec_destruct(&u);
+    arch_close(&a);
+
+    arch_w aw_dup;
+    arch_w_construct(&aw_dup);
+    arch_w_add_vec(&aw_dup, "x", &v);
+    arch_w_add_vec(&aw_dup, "x", &v_s);
+    bool ok_dup = arch_w_save(&aw_dup, path) == -1;
+    arch_w_destruct(&aw_dup);
+    unlink(path);
+
+    printf("open: %d, loads: %d, bad names rejected: %d, corruption detected: %d, duplicates rejected: %d\n",
+           ok_open, ok, ok_rej, ok_cks, ok_dup);
+    assert(ok && ok_rej && ok_cks && ok_dup);
+
+    arch_w_destruct(&aw);
+    for (int l = 0; l < n_layer; l++)
+    {
+        mat_destruct(w + l);
+        vec_destruct(b + l);
+    }
+    mat_destruct(&big);
+    vec_destruct(&v);
+    vec_destruct(&v_s);
+    puts("------");
+}
+
+void mat_arch_test(void)
+{
+    puts("+++ mat_arch_test +++");
+
+    archive_test();
+
+    puts("^^^ mat_arch_test ^^^");
+}
@@ -0,0 +1,469 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "mat_delta.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mat_io.h"
+#include "log.h"
+
+#define MIN(x, y) (((x) <= (y)) ? (x) : (y))
+#define MAX(x, y) (((x) >= (y)) ? (x) : (y))
+
+// Elements off + i * step, i in [0, n), of a payload
+typedef struct span
+{
+    payload *pyl;
+    IND_TYP off;
+    IND_TYP n;
+    IND_TYP step;
+} span;
+
+static inline span vec_span(const vec *v)
+{
+    return (span){.pyl = v->pyl, .off = v->offset, .n = v->d, .step = v->step};
+}
+
+static inline span mat_span(const mat *m)
+{
+    return (span){.pyl = m->pyl, .off = m->offset, .n = m->size, .step = 1};
+}
+
+static inline IND_TYP floor_div(IND_TYP a, IND_TYP b)
+{
+    return a / b - (IND_TYP)(a % b != 0 && (a < 0) != (b < 0));
+}
+
+/*
+ * Runs of element indexes of s lying in dirty blocks, in ascending order; writes them into
+ * runs (2 IND_TYP per run) if not NULL. Returns the run count; *n_elm gets the element count.
+ */
+static IND_TYP dirty_runs(const span *s, IND_TYP *runs, IND_TYP *n_elm)
+{
+    if (!s->pyl->dirty)
+    {
+        if (runs)
+        {
+            runs[0] = 0;
+            runs[1] = s->n;
+        }
+        *n_elm = s->n;
+        return 1;
+    }
+
+    const unsigned sh = s->pyl->blk_shift;
+    const IND_TYP last = s->off + (s->n - 1) * s->step;
+    const IND_TYP lo = MIN(s->off, last), hi = MAX(s->off, last) + 1;
+    const IND_TYP b_lo = lo >> sh, b_hi = (hi - 1) >> sh;
+    IND_TYP n_run = 0, i_end = -1;
+    *n_elm = 0;
+    for (IND_TYP k = 0; k <= b_hi - b_lo; k++)
+    {
+        // Ascending element indexes: blocks go backwards for a negative step
+        const IND_TYP b = (s->step > 0) ? b_lo + k : b_hi - k;
+        if (!payload_blk_dirty(s->pyl, b))
+            continue;
+        const IND_TYP q0 = MAX(b << sh, lo), q1 = MIN((b + 1) << sh, hi);
+        IND_TYP i0, i1;
+        if (s->step > 0)
+        {
+            i0 = floor_div(q0 - s->off + s->step - 1, s->step);
+            i1 = floor_div(q1 - s->off + s->step - 1, s->step);
+        }
+        else
+        {
+            i0 = floor_div(s->off - q1, -s->step) + 1;
+            i1 = floor_div(s->off - q0, -s->step) + 1;
+        }
+        i0 = MAX(i0, 0);
+        i1 = MIN(i1, s->n);
+        if (i1 <= i0)
+            continue;
+        if (i0 != i_end)
+        {
+            if (runs)
+                runs[2 * n_run] = i0;
+            n_run++;
+        }
+        if (runs)
+            runs[2 * n_run - 1] = i1 - runs[2 * n_run - 2];
+        *n_elm += i1 - i0;
+        i_end = i1;
+    }
+    return n_run;
+}
+
+static inline FLD_TYP *span_at(const span *s, IND_TYP i)
+{
+    return s->pyl->arr + s->off + i * s->step;
+}
+
+static size_t delta_size(const span *s, size_t hdr_len)
+{
+    IND_TYP n_elm;
+    const IND_TYP n_run = dirty_runs(s, NULL, &n_elm);
+    return hdr_len + sizeof(IND_TYP) * (1 + 2 * n_run) + n_elm * sizeof(FLD_TYP);
+}
+
+// Writes the serial size, the runs and their elements around the dims already in out
+static uint8_t *delta_out(const span *s, uint8_t *out, size_t hdr_len)
+{
+    IND_TYP n_elm;
+    const IND_TYP n_cnt = dirty_runs(s, NULL, &n_elm);
+    IND_TYP *runs = (IND_TYP *)malloc((3 * n_cnt + 1) * sizeof(IND_TYP));
+    assert(runs);
+    if (!runs)
+        return NULL;
+    const IND_TYP n_run = dirty_runs(s, runs, &n_elm);
+    assert(n_run == n_cnt);
+
+    const size_t sr_sz = hdr_len + sizeof(IND_TYP) * (1 + 2 * n_run) + n_elm * sizeof(FLD_TYP);
+    memcpy(out, &sr_sz, sizeof(size_t));
+    uint8_t *p = out + hdr_len;
+    memcpy(p, &n_run, sizeof(IND_TYP));
+    p += sizeof(IND_TYP);
+    memcpy(p, runs, 2 * n_run * sizeof(IND_TYP));
+    p += 2 * n_run * sizeof(IND_TYP);
+
+    // Output position of each run
+    IND_TYP *at = runs + 2 * n_run;
+    for (IND_TYP r = 0, pos = 0; r < n_run; r++)
+    {
+        at[r] = pos;
+        pos += runs[2 * r + 1];
+    }
+#pragma omp parallel for schedule(dynamic) if (n_elm >= PAR_MIN_SIZE)
+    for (IND_TYP r = 0; r < n_run; r++)
+    {
+        uint8_t *dst = p + at[r] * sizeof(FLD_TYP);
+        const IND_TYP i0 = runs[2 * r], len = runs[2 * r + 1];
+        if (s->step == 1)
+            memcpy(dst, span_at(s, i0), len * sizeof(FLD_TYP));
+        else
+            for (IND_TYP i = 0; i < len; i++)
+                memcpy(dst + i * sizeof(FLD_TYP), span_at(s, i0 + i), sizeof(FLD_TYP));
+    }
+    free((void *)runs);
+    return p + n_elm * sizeof(FLD_TYP);
+}
+
+// Replays the runs of a delta of serial size sr_sz onto s; false if they are malformed
+static bool delta_in(span *s, const uint8_t *in, size_t sr_sz, size_t hdr_len)
+{
+    IND_TYP n_run;
+    if (sr_sz < hdr_len + sizeof(IND_TYP))
+        return false;
+    memcpy(&n_run, in + hdr_len, sizeof(IND_TYP));
+    const size_t run_len = sr_sz - hdr_len - sizeof(IND_TYP);
+    if (n_run < 0 || (size_t)n_run > run_len / (2 * sizeof(IND_TYP)))
+        return false;
+    IND_TYP *runs = (IND_TYP *)malloc((3 * n_run + 1) * sizeof(IND_TYP));
+    assert(runs);
+    if (!runs)
+        return false;
+    const uint8_t *p = in + hdr_len + sizeof(IND_TYP);
+    memcpy(runs, p, 2 * n_run * sizeof(IND_TYP));
+    p += 2 * n_run * sizeof(IND_TYP);
+
+    // Runs ascending, disjoint and inside s; their elements fill the rest exactly
+    IND_TYP *at = runs + 2 * n_run, end = 0, pos = 0;
+    bool ok = true;
+    for (IND_TYP r = 0; ok && r < n_run; r++)
+    {
+        const IND_TYP i0 = runs[2 * r], len = runs[2 * r + 1];
+        ok = i0 >= end && len > 0 && len <= s->n - i0;
+        end = i0 + len;
+        at[r] = pos;
+        pos += len;
+    }
+    ok = ok && (size_t)(in + sr_sz - p) == pos * sizeof(FLD_TYP) && payload_own(s->pyl);
+    if (ok)
+    {
+#pragma omp parallel for schedule(dynamic) if (pos >= PAR_MIN_SIZE)
+        for (IND_TYP r = 0; r < n_run; r++)
+        {
+            const uint8_t *src = p + at[r] * sizeof(FLD_TYP);
+            const IND_TYP i0 = runs[2 * r], len = runs[2 * r + 1];
+            if (s->step == 1)
+                memcpy(span_at(s, i0), src, len * sizeof(FLD_TYP));
+            else
+                for (IND_TYP i = 0; i < len; i++)
+                    memcpy(span_at(s, i0 + i), src + i * sizeof(FLD_TYP), sizeof(FLD_TYP));
+        }
+        for (IND_TYP r = 0; r < n_run; r++)
+        {
+            const IND_TYP a = s->off + runs[2 * r] * s->step;
+            const IND_TYP b = s->off + (runs[2 * r] + runs[2 * r + 1] - 1) * s->step;
+            payload_mark(s->pyl, MIN(a, b), MAX(a, b) + 1);
+        }
+    }
+    free((void *)runs);
+    return ok;
+}
+
+/*
+ * Cleans the blocks whose elements all lie in s, the others may hold unsaved writes outside it.
+ * A block of one element is covered by any s holding it; longer ones only by a contiguous s.
+ */
+static void span_clean(const span *s)
+{
+    payload *pyl = s->pyl;
+    if (!pyl->dirty)
+        return;
+    const unsigned sh = pyl->blk_shift;
+    if (sh == 0)
+    {
+        for (IND_TYP i = 0; i < s->n; i++)
+            payload_clean(pyl, s->off + i * s->step, s->off + i * s->step + 1);
+        return;
+    }
+    if (s->n > 1 && s->step != 1 && s->step != -1)
+        return;
+    const IND_TYP last = s->off + (s->n - 1) * s->step;
+    const IND_TYP lo = MIN(s->off, last), hi = MAX(s->off, last) + 1;
+    // Inner block bounds; the last block of the payload ends at its size
+    const IND_TYP b_lo = ((lo - 1) >> sh) + 1;
+    const IND_TYP b_hi = ((size_t)hi == pyl->size) ? (IND_TYP)payload_n_blk(pyl) : hi >> sh;
+    if (b_lo < b_hi)
+        payload_clean(pyl, b_lo << sh, b_hi << sh);
+}
+
+#define VEC_HDR (sizeof(size_t) + sizeof(IND_TYP))
+#define MAT_HDR (sizeof(size_t) + 2 * sizeof(IND_TYP))
+
+size_t vec_serial_delta_size(const vec *v)
+{
+    assert(vec_is_valid(v));
+
+    const span s = vec_span(v);
+    return delta_size(&s, VEC_HDR);
+}
+
+size_t mat_serial_delta_size(const mat *m)
+{
+    assert(mat_is_valid(m));
+
+    const span s = mat_span(m);
+    return delta_size(&s, MAT_HDR);
+}
+
+uint8_t *vec_serialize_delta(const vec *v, uint8_t *byte_arr)
+{
+    assert(vec_is_valid(v));
+    assert(byte_arr);
+
+    const span s = vec_span(v);
+    memcpy(byte_arr + sizeof(size_t), &v->d, sizeof(IND_TYP));
+    return delta_out(&s, byte_arr, VEC_HDR);
+}
+
+uint8_t *mat_serialize_delta(const mat *m, uint8_t *byte_arr)
+{
+    assert(mat_is_valid(m));
+    assert(byte_arr);
+
+    const span s = mat_span(m);
+    memcpy(byte_arr + sizeof(size_t), &m->d1, sizeof(IND_TYP));
+    memcpy(byte_arr + sizeof(size_t) + sizeof(IND_TYP), &m->d2, sizeof(IND_TYP));
+    return delta_out(&s, byte_arr, MAT_HDR);
+}
+
+const uint8_t *vec_apply_delta(vec *v, const uint8_t *byte_arr)
+{
+    assert(vec_is_valid(v));
+    assert(byte_arr);
+
+    size_t sr_sz;
+    IND_TYP d;
+    memcpy(&sr_sz, byte_arr, sizeof(size_t));
+    memcpy(&d, byte_arr + sizeof(size_t), sizeof(IND_TYP));
+    span s = vec_span(v);
+    if (d != v->d || !delta_in(&s, byte_arr, sr_sz, VEC_HDR))
+        return NULL;
+    return byte_arr + sr_sz;
+}
+
+const uint8_t *mat_apply_delta(mat *m, const uint8_t *byte_arr)
+{
+    assert(mat_is_valid(m));
+    assert(byte_arr);
+
+    size_t sr_sz;
+    IND_TYP d1, d2;
+    memcpy(&sr_sz, byte_arr, sizeof(size_t));
+    memcpy(&d1, byte_arr + sizeof(size_t), sizeof(IND_TYP));
+    memcpy(&d2, byte_arr + sizeof(size_t) + sizeof(IND_TYP), sizeof(IND_TYP));
+    span s = mat_span(m);
+    if (d1 != m->d1 || d2 != m->d2 || !delta_in(&s, byte_arr, sr_sz, MAT_HDR))
+        return NULL;
+    return byte_arr + sr_sz;
+}
+
+void vec_clean(vec *v)
+{
+    assert(vec_is_valid(v));
+
+    const span s = vec_span(v);
+    span_clean(&s);
+}
+
+void mat_clean(mat *m)
+{
+    assert(mat_is_valid(m));
+
+    const span s = mat_span(m);
+    span_clean(&s);
+}
+
+// Writes n bytes at the current position
+static bool write_full(int fd, const void *buf, size_t n)
+{
+    for (size_t done = 0; done < n;)
+    {
+        const ssize_t w = write(fd, (const char *)buf + done, n - done);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            return false;
+        done += w;
+    }
+    return true;
+}
+
+static IND_TYP delta_write(int fd, const span *s, const IND_TYP *dims, int n_dim)
+{
+    const size_t hdr_len = sizeof(size_t) + n_dim * sizeof(IND_TYP);
+    const size_t sr_sz = delta_size(s, hdr_len);
+    uint8_t *buf = (uint8_t *)malloc(sr_sz);
+    assert(buf);
+    if (!buf)
+        return -1;
+    memcpy(buf + sizeof(size_t), dims, n_dim * sizeof(IND_TYP));
+    const bool ok = delta_out(s, buf, hdr_len) == buf + sr_sz && write_full(fd, buf, sr_sz);
+    free((void *)buf);
+    if (!ok)
+    {
+        log_msg(LOG_ERR, "delta_write: writing %zu bytes failed\n", sr_sz);
+        return -1;
+    }
+    span_clean(s);
+    return sr_sz;
+}
+
+IND_TYP vec_write_delta_fd(int fd, vec *v)
+{
+    assert(fd >= 0);
+    assert(vec_is_valid(v));
+
+    const span s = vec_span(v);
+    return delta_write(fd, &s, &v->d, 1);
+}
+
+IND_TYP mat_write_delta_fd(int fd, mat *m)
+{
+    assert(fd >= 0);
+    assert(mat_is_valid(m));
+
+    const span s = mat_span(m);
+    const IND_TYP dims[2] = {m->d1, m->d2};
+    return delta_write(fd, &s, dims, 2);
+}
+
+// Maps the delta file at path and replays each delta in it onto s
+static bool replay(const char *path, span *s, const IND_TYP *dims, int n_dim)
+{
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        log_msg(LOG_ERR, "replay: cannot open %s\n", path);
+        return false;
+    }
+    struct stat st;
+    const bool ok_st = fstat(fd, &st) == 0;
+    const size_t len = ok_st ? (size_t)st.st_size : 0;
+    const uint8_t *base = len ? (const uint8_t *)mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    close(fd);
+    if (!ok_st || base == MAP_FAILED)
+        return false;
+
+    const size_t hdr_len = sizeof(size_t) + n_dim * sizeof(IND_TYP);
+    bool ok = true;
+    for (size_t off = 0; ok && off < len;)
+    {
+        size_t sr_sz = 0;
+        if (len - off >= hdr_len)
+            memcpy(&sr_sz, base + off, sizeof(size_t));
+        ok = len - off >= hdr_len && sr_sz >= hdr_len && sr_sz <= len - off &&
+             memcmp(base + off + sizeof(size_t), dims, n_dim * sizeof(IND_TYP)) == 0 &&
+             delta_in(s, base + off, sr_sz, hdr_len);
+        off += sr_sz;
+    }
+    if (len)
+        munmap((void *)base, len);
+    if (!ok)
+        log_msg(LOG_ERR, "replay: bad delta in %s\n", path);
+    return ok;
+}
+
+vec *vec_load_delta(vec *v, const char *base, const char *const deltas[], int n_delta)
+{
+    assert(v);
+    assert(base);
+    assert(deltas || n_delta == 0);
+
+    *v = vec_NULL;
+    const int fd = open(base, O_RDONLY);
+    if (fd < 0)
+    {
+        log_msg(LOG_ERR, "vec_load_delta: cannot open %s\n", base);
+        return NULL;
+    }
+    const bool ok_base = vec_read_fd(v, fd) != NULL;
+    close(fd);
+    bool ok = ok_base;
+    span s = ok ? vec_span(v) : (span){0};
+    for (int k = 0; ok && k < n_delta; k++)
+        ok = replay(deltas[k], &s, &v->d, 1);
+    if (!ok)
+    {
+        vec_destruct(v);
+        return NULL;
+    }
+    return v;
+}
+
+mat *mat_load_delta(mat *m, const char *base, const char *const deltas[], int n_delta)
+{
+    assert(m);
+    assert(base);
+    assert(deltas || n_delta == 0);
+
+    *m = mat_NULL;
+    const int fd = open(base, O_RDONLY);
+    if (fd < 0)
+    {
+        log_msg(LOG_ERR, "mat_load_delta: cannot open %s\n", base);
+        return NULL;
+    }
+    const bool ok_base = mat_read_fd(m, fd) != NULL;
+    close(fd);
+    bool ok = ok_base;
+    span s = ok ? mat_span(m) : (span){0};
+    const IND_TYP dims[2] = {m->d1, m->d2};
+    for (int k = 0; ok && k < n_delta; k++)
+        ok = replay(deltas[k], &s, dims, 2);
+    if (!ok)
+    {
+        mat_destruct(m);
+        return NULL;
+    }
+    return m;
+}
@@ -0,0 +1,242 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "mat_delta.h"
+#include "mat_io.h"
+#include "vec_mat.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <omp.h>
+
+#ifndef DELTA_BENCH_N
+#define DELTA_BENCH_N 4096
+#endif
+
+static FLD_TYP rnd(void)
+{
+    return 2 * (rand() / (FLD_TYP)RAND_MAX) - 1;
+}
+
+static bool mat_same(const mat *a, const mat *b)
+{
+    return a->d1 == b->d1 && a->d2 == b->d2 &&
+           memcmp(a->pyl->arr + a->offset, b->pyl->arr + b->offset, a->size * sizeof(FLD_TYP)) == 0;
+}
+
+static bool vec_same(const vec *a, const vec *b)
+{
+    bool ok = a->d == b->d;
+    for (IND_TYP i = 0; ok && i < a->d; i++)
+        ok = *vec_at(a, i) == *vec_at(b, i);
+    return ok;
+}
+
+static int tmp_file(char *path)
+{
+    strcpy(path, "/tmp/lin_alg_delta_XXXXXX");
+    return mkstemp(path);
+}
+
+static void checkpoint_test(void)
+{
+    // A base file, then two deltas appended to one file and a third in another
+    const IND_TYP d1 = 300, d2 = 257;
+    mat m = mat_NULL, sub = mat_NULL, r = mat_NULL;
+    vec row = vec_NULL;
+    mat_construct(&m, d1, d2);
+    mat_fill_rnd(&m, rnd);
+    const bool ok_track = payload_track(m.pyl, 4096);
+    char base[32], d_a[32], d_b[32];
+    int fd = tmp_file(base);
+    const IND_TYP sz_base = mat_write_fd(fd, &m);
+    close(fd);
+
+    int fd_a = tmp_file(d_a);
+    mat_row_at(&m, &row, 7);
+    vec_scale(&row, 2);
+    mat_row_at(&m, &row, 200);
+    vec_f_addto(&row, 1);
+    const size_t n_dirty = payload_n_dirty(m.pyl);
+    const IND_TYP sz_1 = mat_write_delta_fd(fd_a, &m);
+    const bool ok_clean = payload_n_dirty(m.pyl) == 0;
+    mat_construct_prealloc(&sub, m.pyl, 50 * d2, 10, d2);
+    mat_f_addto(&sub, -3);
+    const IND_TYP sz_2 = mat_write_delta_fd(fd_a, &m);
+    close(fd_a);
+
+    fd = tmp_file(d_b);
+    // A raw write, marked by hand
+    *mat_at(&m, d1 - 1, d2 - 1) = 42;
+    payload_mark(m.pyl, m.size - 1, m.size);
+    const IND_TYP sz_3 = mat_write_delta_fd(fd, &m);
+    close(fd);
+    printf("base %ld bytes, deltas %ld, %ld, %ld bytes (%zu dirty 4 KiB blocks)\n", sz_base, sz_1, sz_2, sz_3,
+           n_dirty);
+
+    const char *deltas[] = {d_a, d_b};
+    bool ok_load = mat_load_delta(&r, base, deltas, 2) && mat_same(&r, &m);
+    mat_destruct(&r);
+    // Only the base: the deltas are missing
+    bool ok_part = mat_load_delta(&r, base, deltas, 0) && !mat_same(&r, &m);
+    mat_destruct(&r);
+    const bool ok_small = n_dirty <= 4 && sz_1 < sz_base / 10 && sz_3 < 8192;
+
+    // Replaying onto the wrong shape fails and leaves the target alone
+    mat w = mat_NULL;
+    mat_construct(&w, d2, d1);
+    mat_fill_zero(&w);
+    uint8_t *buf = (uint8_t *)malloc(mat_serial_delta_size(&m));
+    mat_serialize_delta(&m, buf);
+    const bool ok_rej = !mat_apply_delta(&w, buf) && mat_sum(&w) == 0;
+    const char *bad[] = {base};
+    const bool ok_rej_file = !mat_load_delta(&r, base, bad, 1) && mat_is_null(&r);
+    free(buf);
+    mat_destruct(&w);
+
+    unlink(base);
+    unlink(d_a);
+    unlink(d_b);
+    printf("tracked: %d, cleaned: %d, small: %d, replayed: %d, base only differs: %d, rejected: %d %d\n",
+           ok_track, ok_clean, ok_small, ok_load, ok_part, ok_rej, ok_rej_file);
+    assert(ok_track && ok_clean && ok_small && ok_load && ok_part && ok_rej && ok_rej_file);
+
+    vec_destruct(&row);
+    mat_destruct(&sub);
+    mat_destruct(&m);
+    puts("------");
+}
+
+static void strided_test(void)
+{
+    // Deltas of strided views, in both directions, over a tracked payload
+    const IND_TYP n = 20000;
+    vec v = vec_NULL;
+    vec_construct(&v, n);
+    vec_fill_rnd(&v, rnd);
+    payload_track(v.pyl, 256);
+    bool ok = true;
+    for (IND_TYP step = -7; step <= 7; step += 2)
+    {
+        vec s = vec_NULL, part = vec_NULL, c = vec_NULL;
+        if (step > 0)
+            vec_view(&s, &v, 3, n, step);
+        else
+            vec_view(&s, &v, n - 2, 0, step);
+        vec_construct(&c, s.d);
+        for (IND_TYP i = 0; i < s.d; i++)
+            *vec_at(&c, i) = *vec_at(&s, i);
+        vec_clean(&v);
+        vec_view(&part, &s, s.d / 3, s.d / 2, 1);
+        // Element-wise: the BLAS kernels take a negative step from the other end
+        for (IND_TYP i = 0; i < part.d; i++)
+            *vec_at(&part, i) = 7;
+        vec_mark_dirty(&part);
+        // A single raw write, marked by hand
+        const IND_TYP i_last = s.offset + (s.d - 1) * s.step;
+        *vec_at(&s, s.d - 1) = 5;
+        payload_mark(v.pyl, i_last, i_last + 1);
+
+        uint8_t *buf = (uint8_t *)malloc(vec_serial_delta_size(&s));
+        uint8_t *end = vec_serialize_delta(&s, buf);
+        ok = ok && vec_apply_delta(&c, buf) == end && vec_same(&c, &s) &&
+             (size_t)(end - buf) == vec_serial_delta_size(&s) && vec_serial_delta_size(&s) < vec_serial_size(&s);
+        free(buf);
+        vec_destruct(&s);
+        vec_destruct(&part);
+        vec_destruct(&c);
+    }
+
+    // Only the blocks under a short view are in its delta
+    vec s = vec_NULL, c = vec_NULL;
+    vec_view(&s, &v, 1000, 1100, 1);
+    vec_clean(&v);
+    vec_fill(&s, 1);
+    const size_t sz = vec_serial_delta_size(&v);
+    const bool ok_sz = sz < 100 * sizeof(FLD_TYP) + 2 * 256 + 64;
+    vec_construct(&c, v.d);
+    vec_fill_zero(&c);
+    uint8_t *buf = (uint8_t *)malloc(sz);
+    vec_serialize_delta(&v, buf);
+    vec_apply_delta(&c, buf);
+    const bool ok_part = *vec_at(&c, 0) == 0 && *vec_at(&c, 1000) == 1 && *vec_at(&c, 1099) == 1 &&
+                         *vec_at(&c, n - 1) == 0;
+    free(buf);
+
+    // Cleaning a view keeps the blocks it shares with the rest of v dirty: the edges of s, all under t
+    const IND_TYP blk = 256 / sizeof(FLD_TYP);
+    vec t = vec_NULL;
+    vec_view(&t, &v, 0, n, 2);
+    vec_fill(&s, 2);
+    vec_clean(&s);
+    const size_t n_edge = payload_n_dirty(v.pyl);
+    const bool ok_edge = n_edge == 2 && payload_blk_dirty(v.pyl, 1000 / blk) && payload_blk_dirty(v.pyl, 1099 / blk);
+    vec_clean(&v);
+    vec_fill(&t, 3);
+    vec_clean(&t);
+    const size_t n_stride = payload_n_dirty(v.pyl);
+    const bool ok_stride = n_stride == payload_n_blk(v.pyl);
+    printf("strided views round trip: %d, delta of a short write %zu bytes: %d, partial: %d, "
+           "dirty after clean of a view %zu: %d, of a strided view %zu: %d\n",
+           ok, sz, ok_sz, ok_part, n_edge, ok_edge, n_stride, ok_stride);
+    assert(ok && ok_sz && ok_part && ok_edge && ok_stride);
+
+    vec_destruct(&s);
+    vec_destruct(&t);
+    vec_destruct(&c);
+    vec_destruct(&v);
+    puts("------");
+}
+
+void mat_delta_test(void)
+{
+    puts("+++ mat_delta_test +++");
+
+    checkpoint_test();
+    strided_test();
+
+    puts("^^^ mat_delta_test ^^^");
+}
+
+void mat_delta_bench(void)
+{
+    puts("+++ mat_delta_bench +++");
+
+    // Updates to 1% of the rows of an embedding between checkpoints
+    const IND_TYP n = DELTA_BENCH_N, n_upd = n / 100;
+    mat m = mat_NULL;
+    vec row = vec_NULL;
+    mat_construct(&m, n, n);
+    mat_fill_rnd(&m, rnd);
+    char path[32];
+    int fd = tmp_file(path);
+    for (IND_TYP blk = 4096; blk <= 65536; blk *= 16)
+    {
+        payload_untrack(m.pyl);
+        payload_track(m.pyl, blk);
+        for (IND_TYP k = 0; k < n_upd; k++)
+        {
+            mat_row_at(&m, &row, rand() % n);
+            vec_scale(&row, 0.5);
+        }
+        lseek(fd, 0, SEEK_SET);
+        double t0 = omp_get_wtime();
+        const IND_TYP sz_full = mat_write_fd(fd, &m);
+        const double t_full = omp_get_wtime() - t0;
+        lseek(fd, 0, SEEK_SET);
+        t0 = omp_get_wtime();
+        const IND_TYP sz_delta = mat_write_delta_fd(fd, &m);
+        const double t_delta = omp_get_wtime() - t0;
+        printf("%ldx%ld, %ld rows updated, %ld B blocks: full %ld B in %.4f s, delta %ld B in %.4f s\n", n, n,
+               n_upd, blk, sz_full, t_full, sz_delta, t_delta);
+    }
+    close(fd);
+    unlink(path);
+    vec_destruct(&row);
+    mat_destruct(&m);
+
+    puts("^^^ mat_delta_bench ^^^");
+}
@@ -0,0 +1,831 @@
+#define _GNU_SOURCE // O_DIRECT
+
+#include "mat_io.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <omp.h>
+
+#include "log.h"
+
+#define MIN(x, y) (((x) <= (y)) ? (x) : (y))
+
+// Chunks per thread, for load balance between chunks of unequal line lengths
+#define TXT_CHUNKS_PER_THREAD 4
+
+static const double pow10_d[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+static inline bool is_blank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline bool is_digit(char c)
+{
+    return (unsigned)(c - '0') < 10u;
+}
+
+// Number at p (end: line end); returns the position after it, p on failure
+static const char *parse_num(const char *p, const char *end, char delim, double *x)
+{
+    const char *s = p;
+    bool neg = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        neg = *p++ == '-';
+
+    uint64_t mant = 0;
+    int n_sig = 0, exp10 = 0, n_dig = 0;
+    bool exact = true;
+    for (; p < end && is_digit(*p); p++, n_dig++)
+    {
+        if (n_sig < 19)
+        {
+            mant = mant * 10 + (*p - '0');
+            n_sig += mant != 0;
+        }
+        else
+        {
+            exp10++;
+            exact = exact && *p == '0';
+        }
+    }
+    if (p < end && *p == '.')
+    {
+        for (p++; p < end && is_digit(*p); p++, n_dig++)
+        {
+            if (n_sig < 19)
+            {
+                mant = mant * 10 + (*p - '0');
+                n_sig += mant != 0;
+                exp10--;
+            }
+            else
+                exact = exact && *p == '0';
+        }
+    }
+    if (n_dig > 0 && p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char *q = p + 1;
+        bool e_neg = false;
+        if (q < end && (*q == '-' || *q == '+'))
+            e_neg = *q++ == '-';
+        if (q < end && is_digit(*q))
+        {
+            int e = 0;
+            for (; q < end && is_digit(*q); q++)
+                e = (e < 10000) ? e * 10 + (*q - '0') : e;
+            exp10 += e_neg ? -e : e;
+            p = q;
+        }
+    }
+
+    if (n_dig > 0 && exact && mant <= (1ULL << 53) && exp10 >= -22 && exp10 <= 22)
+    {
+        const double v = (exp10 < 0) ? mant / pow10_d[-exp10] : mant * pow10_d[exp10];
+        *x = neg ? -v : v;
+        return p;
+    }
+
+    // Slow path: long mantissas, large exponents, nan, inf; the token is copied to be terminated
+    char buff[128];
+    size_t n = 0;
+    while (s + n < end && n + 1 < sizeof(buff) && !is_blank(s[n]) && s[n] != delim)
+        n++;
+    memcpy(buff, s, n);
+    buff[n] = 0;
+    char *e_ptr;
+    *x = strtod(buff, &e_ptr);
+    return s + (e_ptr - buff);
+}
+
+// Parses the fields of the line [p, end) into out (NULL to count them only, at most cap);
+// returns the field count, -1 if malformed
+static IND_TYP parse_line(const char *p, const char *end, char delim, FLD_TYP *out, IND_TYP cap)
+{
+    IND_TYP f = 0;
+    for (;;)
+    {
+        while (p < end && is_blank(*p))
+            p++;
+        if (p == end)
+            return (delim == ' ' || f == 0) ? f : -1;
+        double x;
+        const char *q = parse_num(p, end, delim, &x);
+        if (q == p)
+            return -1;
+        if (out)
+        {
+            if (f >= cap)
+                return -1;
+            out[f] = (FLD_TYP)x;
+        }
+        f++;
+        for (p = q; p < end && is_blank(*p); p++)
+            ;
+        if (p == end)
+            return f;
+        if (delim != ' ')
+        {
+            if (*p != delim)
+                return -1;
+            p++;
+        }
+        else if (p == q)
+            return -1;
+    }
+}
+
+static inline const char *line_end(const char *p, const char *end)
+{
+    const char *nl = (const char *)memchr(p, '\n', end - p);
+    return nl ? nl : end;
+}
+
+static inline bool line_is_blank(const char *p, const char *eol)
+{
+    while (p < eol && is_blank(*p))
+        p++;
+    return p == eol;
+}
+
+// Start of the first line at or after p; chunk boundaries
+static inline const char *line_start(const char *base, const char *p, const char *end)
+{
+    if (p == base || p >= end)
+        return MIN(p, end);
+    if (p[-1] == '\n')
+        return p;
+    const char *eol = line_end(p, end);
+    return (eol == end) ? end : eol + 1;
+}
+
+mat *mat_load_text(mat *m, const char *path, char delim, const txt_schema *schema)
+{
+    assert(m);
+    assert(path);
+    assert(delim != '\n' && delim != '\r' && delim != '\t' && !is_digit(delim) && delim != '.' &&
+           delim != '-' && delim != '+');
+    const txt_schema sch = schema ? *schema : txt_schema_DEFAULT;
+    assert(sch.skip_rows >= 0);
+    assert(!sch.cols || sch.n_cols > 0);
+
+    *m = mat_NULL;
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        log_msg(LOG_ERR, "mat_load_text: cannot open %s\n", path);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return NULL;
+    }
+    const size_t len = st.st_size;
+    const char *map = (const char *)mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return NULL;
+    posix_madvise((void *)map, len, POSIX_MADV_SEQUENTIAL);
+    const char *end = map + len;
+
+    // Header lines, then the field count of the first row
+    const char *body = map;
+    for (IND_TYP r = 0; r < sch.skip_rows && body < end; r++)
+        body = MIN(line_end(body, end) + 1, end);
+    const char *first = body;
+    while (first < end && line_is_blank(first, line_end(first, end)))
+        first = MIN(line_end(first, end) + 1, end);
+    const IND_TYP n_fld = (first < end) ? parse_line(first, line_end(first, end), delim, NULL, 0) : 0;
+    bool ok = n_fld > 0;
+    for (IND_TYP c = 0; ok && sch.cols && c < sch.n_cols; c++)
+        ok = sch.cols[c] >= 0 && sch.cols[c] < n_fld;
+    if (!ok)
+    {
+        log_msg(LOG_ERR, "mat_load_text: no data or bad column selection in %s\n", path);
+        munmap((void *)map, len);
+        return NULL;
+    }
+    const IND_TYP d2 = sch.cols ? sch.n_cols : n_fld;
+
+    // Chunks at line boundaries: rows per chunk, then parse into the rows from the prefix sum
+    const size_t body_len = end - body;
+    const IND_TYP n_chunk = MIN((IND_TYP)(body_len / PAR_MIN_SIZE) + 1,
+                                (IND_TYP)omp_get_max_threads() * TXT_CHUNKS_PER_THREAD);
+    IND_TYP *rows = (IND_TYP *)calloc(n_chunk + 1, sizeof(IND_TYP));
+    assert(rows);
+    if (!rows)
+    {
+        munmap((void *)map, len);
+        return NULL;
+    }
+
+#pragma omp parallel for schedule(dynamic, 1) if (n_chunk > 1)
+    for (IND_TYP c = 0; c < n_chunk; c++)
+    {
+        const char *p = line_start(body, body + body_len * c / n_chunk, end);
+        const char *c_end = line_start(body, body + body_len * (c + 1) / n_chunk, end);
+        IND_TYP n = 0;
+        while (p < c_end)
+        {
+            const char *eol = line_end(p, c_end);
+            n += !line_is_blank(p, eol);
+            p = eol + 1;
+        }
+        rows[c + 1] = n;
+    }
+    for (IND_TYP c = 0; c < n_chunk; c++)
+        rows[c + 1] += rows[c];
+
+    if (rows[n_chunk] == 0 || !mat_construct(m, rows[n_chunk], d2) || mat_is_null(m))
+    {
+        free((void *)rows);
+        munmap((void *)map, len);
+        *m = mat_NULL;
+        return NULL;
+    }
+    FLD_TYP *arr = m->pyl->arr + m->offset;
+    IND_TYP bad_row = -1;
+
+#pragma omp parallel if (n_chunk > 1)
+    {
+        // Selected columns go through a full row of fields
+        FLD_TYP *fld = sch.cols ? (FLD_TYP *)malloc(n_fld * sizeof(FLD_TYP)) : NULL;
+        assert(!sch.cols || fld);
+#pragma omp for schedule(dynamic, 1)
+        for (IND_TYP c = 0; c < n_chunk; c++)
+        {
+            const char *p = line_start(body, body + body_len * c / n_chunk, end);
+            const char *c_end = line_start(body, body + body_len * (c + 1) / n_chunk, end);
+            for (IND_TYP r = rows[c]; p < c_end; p++)
+            {
+                const char *eol = line_end(p, c_end);
+                if (!line_is_blank(p, eol))
+                {
+                    FLD_TYP *row = arr + r * d2;
+                    const IND_TYP n = (sch.cols && !fld) ? -1 : parse_line(p, eol, delim, sch.cols ? fld : row, n_fld);
+                    if (n != n_fld)
+                    {
+#pragma omp critical(mat_load_text_err)
+                        bad_row = (bad_row < 0 || r < bad_row) ? r : bad_row;
+                        break;
+                    }
+                    for (IND_TYP j = 0; sch.cols && j < d2; j++)
+                        row[j] = fld[sch.cols[j]];
+                    r++;
+                }
+                p = eol;
+            }
+        }
+        free((void *)fld);
+    }
+
+    free((void *)rows);
+    munmap((void *)map, len);
+    if (bad_row >= 0)
+    {
+        log_msg(LOG_ERR, "mat_load_text: malformed data row %ld in %s\n", bad_row, path);
+        mat_destruct(m);
+        *m = mat_NULL;
+        return NULL;
+    }
+    return m;
+}
+
+#if defined(FLD_FLT64)
+#define NPY_DESCR "<f8"
+#elif defined(FLD_CLX64)
+#define NPY_DESCR "<c16"
+#elif defined(FLD_CLX32)
+#define NPY_DESCR "<c8"
+#else
+#define NPY_DESCR "<f4"
+#endif
+
+// Elements per write of a strided vec
+#define NPY_GATHER 4096
+
+typedef struct npy_hdr
+{
+    size_t data_off;
+    int ndim;
+    IND_TYP shape[2];
+    bool fortran;
+} npy_hdr;
+
+static bool pread_full(int fd, void *buf, size_t n, size_t off)
+{
+    for (size_t done = 0; done < n;)
+    {
+        const ssize_t r = pread(fd, (char *)buf + done, n - done, off + done);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return false;
+        done += r;
+    }
+    return true;
+}
+
+// Value text of key in the header dict, NULL if missing
+static const char *npy_value(const char *dict, const char *key)
+{
+    const char *p = strstr(dict, key);
+    if (!p)
+        return NULL;
+    p = strchr(p + strlen(key), ':');
+    if (!p)
+        return NULL;
+    for (p++; *p == ' '; p++)
+        ;
+    return p;
+}
+
+static bool npy_read_hdr(int fd, npy_hdr *h)
+{
+    uint8_t pre[12];
+    if (!pread_full(fd, pre, sizeof(pre), 0) || memcmp(pre, "\x93NUMPY", 6) != 0 || pre[6] < 1 || pre[6] > 3)
+        return false;
+    const size_t pre_len = (pre[6] == 1) ? 10 : 12;
+    const size_t txt_len = (pre[6] == 1) ? (size_t)pre[8] | (size_t)pre[9] << 8
+                                         : (size_t)pre[8] | (size_t)pre[9] << 8 | (size_t)pre[10] << 16 |
+                                               (size_t)pre[11] << 24;
+    char *txt = (char *)malloc(txt_len + 1);
+    if (!txt)
+        return false;
+    bool ok = pread_full(fd, txt, txt_len, pre_len);
+    txt[ok ? txt_len : 0] = 0;
+
+    const char *descr = npy_value(txt, "'descr'");
+    const char *order = npy_value(txt, "'fortran_order'");
+    const char *shape = npy_value(txt, "'shape'");
+    const size_t descr_len = strlen(NPY_DESCR);
+    ok = ok && descr && order && shape && descr[0] == '\'' && strncmp(descr + 1, NPY_DESCR, descr_len) == 0 &&
+         descr[descr_len + 1] == '\'' && *shape == '(';
+    h->fortran = ok && strncmp(order, "True", 4) == 0;
+    ok = ok && (h->fortran || strncmp(order, "False", 5) == 0);
+    h->ndim = 0;
+    for (const char *p = shape + 1; ok;)
+    {
+        while (*p == ' ' || *p == ',')
+            p++;
+        if (*p == ')')
+            break;
+        char *q;
+        const long long d = strtoll(p, &q, 10);
+        ok = q != p && d > 0 && h->ndim < 2;
+        if (ok)
+            h->shape[h->ndim++] = d;
+        p = q;
+    }
+    h->data_off = pre_len + txt_len;
+    // Shape from the file: the element and byte counts must not overflow
+    const IND_TYP d1 = (h->ndim > 0) ? h->shape[0] : 1, d2 = (h->ndim > 1) ? h->shape[1] : 1;
+    ok = ok && d2 <= INT64_MAX / d1 && (size_t)(d1 * d2) <= (SIZE_MAX - h->data_off) / sizeof(FLD_TYP);
+    free((void *)txt);
+    return ok;
+}
+
+/*
+ * Payload holding the n elements of the open .npy file fd from its data offset; mapped when
+ * map is set and the offset is aligned, else read. NULL on error.
+ */
+static payload *npy_payload(int fd, const npy_hdr *h, size_t n, bool map)
+{
+    struct stat st;
+    const size_t bytes = n * sizeof(FLD_TYP);
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < h->data_off + bytes)
+        return NULL;
+
+    if (map && h->data_off % NPY_ALIGN == 0)
+        return payload_map(fd, h->data_off, n);
+
+    payload *pyl = payload_new(n);
+    if (!payload_is_valid(pyl))
+        return NULL;
+    if (!pread_full(fd, pyl->arr, bytes, h->data_off))
+    {
+        payload_release(pyl);
+        return NULL;
+    }
+    return pyl;
+}
+
+// Opens path and reads its header; -1 on error
+static int npy_open(const char *path, npy_hdr *h)
+{
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        log_msg(LOG_ERR, "npy: cannot open %s\n", path);
+        return -1;
+    }
+    if (!npy_read_hdr(fd, h))
+    {
+        log_msg(LOG_ERR, "npy: not a " NPY_DESCR " .npy file: %s\n", path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+vec *vec_load_npy(vec *v, const char *path, bool map)
+{
+    assert(v);
+    assert(path);
+
+    *v = vec_NULL;
+    npy_hdr h;
+    const int fd = npy_open(path, &h);
+    if (fd < 0)
+        return NULL;
+    payload *pyl = (h.ndim == 1) ? npy_payload(fd, &h, h.shape[0], map) : NULL;
+    close(fd);
+    if (!pyl)
+        return NULL;
+    vec_construct_prealloc(v, pyl, 0, h.shape[0], 1);
+    payload_release(pyl);
+    return v;
+}
+
+mat *mat_load_npy(mat *m, const char *path, bool map)
+{
+    assert(m);
+    assert(path);
+
+    *m = mat_NULL;
+    npy_hdr h;
+    const int fd = npy_open(path, &h);
+    if (fd < 0)
+        return NULL;
+    const IND_TYP d1 = h.shape[0], d2 = h.shape[1];
+    // Fortran order is the transpose in C order, read and transposed
+    payload *pyl = (h.ndim == 2) ? npy_payload(fd, &h, d1 * d2, map && !h.fortran) : NULL;
+    close(fd);
+    if (!pyl)
+        return NULL;
+    if (!h.fortran)
+        mat_construct_prealloc(m, pyl, 0, d1, d2);
+    else
+    {
+        mat m_t = mat_NULL;
+        mat_construct_prealloc(&m_t, pyl, 0, d2, d1);
+        mat_construct(m, d1, d2);
+        if (mat_is_valid(m))
+            mat_transpose(m, &m_t);
+        mat_destruct(&m_t);
+    }
+    payload_release(pyl);
+    return mat_is_valid(m) ? m : NULL;
+}
+
+// Writes the header and arr[0], arr[step], ... (n elements) to path
+static IND_TYP npy_write(const char *path, const IND_TYP *shape, int ndim, const FLD_TYP *arr, IND_TYP step,
+                         IND_TYP n)
+{
+    char hdr[256];
+    int len = snprintf(hdr + 10, sizeof(hdr) - 10,
+                       (ndim == 1) ? "{'descr': '%s', 'fortran_order': False, 'shape': (%ld,), }"
+                                   : "{'descr': '%s', 'fortran_order': False, 'shape': (%ld, %ld), }",
+                       NPY_DESCR, (long)shape[0], (long)(ndim > 1 ? shape[1] : 0));
+    // Spaces and '\n' up to an aligned data offset
+    const int txt_len = (10 + len + 1 + NPY_ALIGN - 1) / NPY_ALIGN * NPY_ALIGN - 10;
+    memset(hdr + 10 + len, ' ', txt_len - len - 1);
+    hdr[10 + txt_len - 1] = '\n';
+    memcpy(hdr, "\x93NUMPY\x01\x00", 8);
+    hdr[8] = txt_len & 0xff;
+    hdr[9] = txt_len >> 8;
+
+    FILE *f = fopen(path, "wb");
+    if (!f)
+    {
+        log_msg(LOG_ERR, "npy: cannot create %s\n", path);
+        return -1;
+    }
+    bool ok = fwrite(hdr, 1, 10 + txt_len, f) == (size_t)(10 + txt_len);
+    if (step == 1)
+        ok = ok && fwrite(arr, sizeof(FLD_TYP), n, f) == (size_t)n;
+    else
+    {
+        FLD_TYP buf[NPY_GATHER];
+        for (IND_TYP i_0 = 0; ok && i_0 < n; i_0 += NPY_GATHER)
+        {
+            const IND_TYP cnt = MIN(NPY_GATHER, n - i_0);
+            for (IND_TYP i = 0; i < cnt; i++)
+                buf[i] = arr[(i_0 + i) * step];
+            ok = fwrite(buf, sizeof(FLD_TYP), cnt, f) == (size_t)cnt;
+        }
+    }
+    ok = (fclose(f) == 0) && ok;
+    return ok ? 10 + txt_len + n * (IND_TYP)sizeof(FLD_TYP) : -1;
+}
+
+IND_TYP vec_save_npy(const vec *v, const char *path)
+{
+    assert(vec_is_valid(v));
+    assert(path);
+
+    return npy_write(path, &v->d, 1, v->pyl->arr + v->offset, v->step, v->d);
+}
+
+IND_TYP mat_save_npy(const mat *m, const char *path)
+{
+    assert(mat_is_valid(m));
+    assert(path);
+
+    const IND_TYP shape[2] = {m->d1, m->d2};
+    return npy_write(path, shape, 2, m->pyl->arr + m->offset, 1, m->size);
+}
+
+// Writes n bytes at the current position
+static bool write_full(int fd, const void *buf, size_t n)
+{
+    for (size_t done = 0; done < n;)
+    {
+        const ssize_t w = write(fd, (const char *)buf + done, n - done);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            return false;
+        done += w;
+    }
+    return true;
+}
+
+// Reads up to n bytes from the current position, less at end of file; -1 on error
+static ssize_t read_full(int fd, void *buf, size_t n)
+{
+    size_t done = 0;
+    while (done < n)
+    {
+        const ssize_t r = read(fd, (char *)buf + done, n - done);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r < 0)
+            return -1;
+        if (r == 0)
+            break;
+        done += r;
+    }
+    return done;
+}
+
+static bool writev_full(int fd, struct iovec *iov, int cnt)
+{
+    while (cnt > 0)
+    {
+        ssize_t w = writev(fd, iov, cnt);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            return false;
+        for (; cnt > 0 && (size_t)w >= iov->iov_len; iov++, cnt--)
+            w -= iov->iov_len;
+        if (cnt > 0)
+        {
+            iov->iov_base = (char *)iov->iov_base + w;
+            iov->iov_len -= w;
+        }
+    }
+    return true;
+}
+
+static inline bool fd_direct(int fd)
+{
+#ifdef O_DIRECT
+    const int fl = fcntl(fd, F_GETFL);
+    return fl >= 0 && (fl & O_DIRECT);
+#else
+    (void)fd;
+    return false;
+#endif
+}
+
+// Output staged in IO_CHUNK pieces of an aligned buffer, for strided views and O_DIRECT
+typedef struct chunk_out
+{
+    int fd;
+    uint8_t *buf;
+    size_t fill;
+    bool ok;
+} chunk_out;
+
+static void chunk_put(chunk_out *c, const void *src, size_t n)
+{
+    for (const uint8_t *p = (const uint8_t *)src; c->ok && n > 0;)
+    {
+        const size_t k = MIN(n, IO_CHUNK - c->fill);
+        memcpy(c->buf + c->fill, p, k);
+        c->fill += k;
+        p += k;
+        n -= k;
+        if (c->fill == IO_CHUNK)
+        {
+            c->ok = write_full(c->fd, c->buf, IO_CHUNK);
+            c->fill = 0;
+        }
+    }
+}
+
+/*
+ * Writes hdr and then arr[0], arr[step], ... (n elements) at the current position of fd:
+ * by one writev for contiguous data, else through IO_CHUNK pieces. With O_DIRECT the
+ * position must be a multiple of IO_DIRECT_ALIGN; the last piece is padded and the file
+ * truncated back to the end of the data.
+ */
+static IND_TYP stream_out(int fd, const void *hdr, size_t hdr_len, const FLD_TYP *arr, IND_TYP step, IND_TYP n)
+{
+    const bool direct = fd_direct(fd);
+    const size_t total = hdr_len + n * sizeof(FLD_TYP);
+    if (!direct && step == 1)
+    {
+        struct iovec iov[2] = {{.iov_base = (void *)hdr, .iov_len = hdr_len},
+                               {.iov_base = (void *)arr, .iov_len = n * sizeof(FLD_TYP)}};
+        return writev_full(fd, iov, 2) ? (IND_TYP)total : -1;
+    }
+
+    const off_t start = direct ? lseek(fd, 0, SEEK_CUR) : 0;
+    if (start < 0 || start % IO_DIRECT_ALIGN != 0)
+    {
+        log_msg(LOG_ERR, "write_fd: O_DIRECT position not aligned\n");
+        return -1;
+    }
+    chunk_out c = {.fd = fd, .buf = (uint8_t *)aligned_alloc(IO_DIRECT_ALIGN, IO_CHUNK), .fill = 0, .ok = true};
+    assert(c.buf);
+    c.ok = c.buf != NULL;
+    chunk_put(&c, hdr, hdr_len);
+    if (step == 1)
+        chunk_put(&c, arr, n * sizeof(FLD_TYP));
+    else
+    {
+        FLD_TYP g[NPY_GATHER];
+        for (IND_TYP i_0 = 0; c.ok && i_0 < n; i_0 += NPY_GATHER)
+        {
+            const IND_TYP cnt = MIN(NPY_GATHER, n - i_0);
+            for (IND_TYP i = 0; i < cnt; i++)
+                g[i] = arr[(i_0 + i) * step];
+            chunk_put(&c, g, cnt * sizeof(FLD_TYP));
+        }
+    }
+    if (c.ok && c.fill > 0)
+    {
+        const size_t len = direct ? (c.fill + IO_DIRECT_ALIGN - 1) / IO_DIRECT_ALIGN * IO_DIRECT_ALIGN : c.fill;
+        memset(c.buf + c.fill, 0, len - c.fill);
+        c.ok = write_full(fd, c.buf, len);
+        if (c.ok && direct)
+            c.ok = ftruncate(fd, start + total) == 0 && lseek(fd, start + total, SEEK_SET) >= 0;
+    }
+    free((void *)c.buf);
+    return c.ok ? (IND_TYP)total : -1;
+}
+
+/*
+ * Reads a header of hdr_len bytes from the current position of fd, calls make(obj, hdr) to
+ * construct the destination and reads the data into the array it returns. With O_DIRECT,
+ * reads go through an aligned buffer and the position is set back to the end of the data.
+ */
+static bool stream_in(int fd, void *hdr, size_t hdr_len, FLD_TYP *(*make)(void *obj, const void *hdr, size_t *n),
+                      void *obj)
+{
+    size_t n = 0;
+    if (!fd_direct(fd))
+    {
+        if (read_full(fd, hdr, hdr_len) != (ssize_t)hdr_len)
+            return false;
+        FLD_TYP *arr = make(obj, hdr, &n);
+        return arr && read_full(fd, arr, n * sizeof(FLD_TYP)) == (ssize_t)(n * sizeof(FLD_TYP));
+    }
+
+    const off_t start = lseek(fd, 0, SEEK_CUR);
+    uint8_t *buf = (uint8_t *)aligned_alloc(IO_DIRECT_ALIGN, IO_CHUNK);
+    assert(buf);
+    if (start < 0 || start % IO_DIRECT_ALIGN != 0 || !buf)
+    {
+        free((void *)buf);
+        return false;
+    }
+    ssize_t got = read_full(fd, buf, IO_CHUNK);
+    bool ok = got >= (ssize_t)hdr_len;
+    if (ok)
+        memcpy(hdr, buf, hdr_len);
+    uint8_t *dst = ok ? (uint8_t *)make(obj, hdr, &n) : NULL;
+    ok = dst != NULL;
+    const size_t bytes = n * sizeof(FLD_TYP);
+    size_t done = 0, pos = hdr_len;
+    while (ok && done < bytes)
+    {
+        const size_t k = MIN(bytes - done, (size_t)got - pos);
+        memcpy(dst + done, buf + pos, k);
+        done += k;
+        pos += k;
+        if (done < bytes)
+        {
+            got = read_full(fd, buf, IO_CHUNK);
+            ok = got > 0;
+            pos = 0;
+        }
+    }
+    ok = ok && lseek(fd, start + hdr_len + bytes, SEEK_SET) >= 0;
+    free((void *)buf);
+    return ok;
+}
+
+IND_TYP vec_write_fd(int fd, const vec *v)
+{
+    assert(fd >= 0);
+    assert(vec_is_valid(v));
+
+    uint8_t hdr[sizeof(size_t) + sizeof(IND_TYP)];
+    const size_t sr_sz = vec_serial_size(v);
+    memcpy(hdr, &sr_sz, sizeof(size_t));
+    memcpy(hdr + sizeof(size_t), &v->d, sizeof(IND_TYP));
+    return stream_out(fd, hdr, sizeof(hdr), v->pyl->arr + v->offset, v->step, v->d);
+}
+
+IND_TYP mat_write_fd(int fd, const mat *m)
+{
+    assert(fd >= 0);
+    assert(mat_is_valid(m));
+
+    uint8_t hdr[sizeof(size_t) + 2 * sizeof(IND_TYP)];
+    const size_t sr_sz = mat_serial_size(m);
+    memcpy(hdr, &sr_sz, sizeof(size_t));
+    memcpy(hdr + sizeof(size_t), &m->d1, sizeof(IND_TYP));
+    memcpy(hdr + sizeof(size_t) + sizeof(IND_TYP), &m->d2, sizeof(IND_TYP));
+    return stream_out(fd, hdr, sizeof(hdr), m->pyl->arr + m->offset, 1, m->size);
+}
+
+static FLD_TYP *make_vec(void *obj, const void *hdr, size_t *n)
+{
+    vec *v = (vec *)obj;
+    size_t sr_sz;
+    IND_TYP d;
+    memcpy(&sr_sz, hdr, sizeof(size_t));
+    memcpy(&d, (const uint8_t *)hdr + sizeof(size_t), sizeof(IND_TYP));
+    // d from the stream: bounded before the byte count
+    if (d <= 0 || (size_t)d > (SIZE_MAX - sizeof(size_t) - sizeof(IND_TYP)) / sizeof(FLD_TYP) ||
+        sr_sz != sizeof(size_t) + sizeof(IND_TYP) + d * sizeof(FLD_TYP) || !vec_construct(v, d) || vec_is_null(v))
+        return NULL;
+    *n = d;
+    return v->pyl->arr + v->offset;
+}
+
+static FLD_TYP *make_mat(void *obj, const void *hdr, size_t *n)
+{
+    mat *m = (mat *)obj;
+    size_t sr_sz;
+    IND_TYP d1, d2;
+    memcpy(&sr_sz, hdr, sizeof(size_t));
+    memcpy(&d1, (const uint8_t *)hdr + sizeof(size_t), sizeof(IND_TYP));
+    memcpy(&d2, (const uint8_t *)hdr + sizeof(size_t) + sizeof(IND_TYP), sizeof(IND_TYP));
+    // d1, d2 from the stream: d1 * d2 bounded before the byte count
+    if (d1 <= 0 || d2 <= 0 || d2 > INT64_MAX / d1 ||
+        (size_t)(d1 * d2) > (SIZE_MAX - sizeof(size_t) - 2 * sizeof(IND_TYP)) / sizeof(FLD_TYP) ||
+        sr_sz != sizeof(size_t) + 2 * sizeof(IND_TYP) + d1 * d2 * sizeof(FLD_TYP) || !mat_construct(m, d1, d2) ||
+        mat_is_null(m))
+        return NULL;
+    *n = m->size;
+    return m->pyl->arr + m->offset;
+}
+
+vec *vec_read_fd(vec *v, int fd)
+{
+    assert(v);
+    assert(fd >= 0);
+
+    *v = vec_NULL;
+    uint8_t hdr[sizeof(size_t) + sizeof(IND_TYP)];
+    if (!stream_in(fd, hdr, sizeof(hdr), make_vec, v))
+    {
+        vec_destruct(v);
+        return NULL;
+    }
+    return v;
+}
+
+mat *mat_read_fd(mat *m, int fd)
+{
+    assert(m);
+    assert(fd >= 0);
+
+    *m = mat_NULL;
+    uint8_t hdr[sizeof(size_t) + 2 * sizeof(IND_TYP)];
+    if (!stream_in(fd, hdr, sizeof(hdr), make_mat, m))
+    {
+        mat_destruct(m);
+        return NULL;
+    }
+    return m;
+}
@@ -0,0 +1,353 @@
+#define _GNU_SOURCE // O_DIRECT
+
+#include "mat_io.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <omp.h>
+
+#ifndef TXT_BENCH_ROWS
+#define TXT_BENCH_ROWS (1 << 20)
+#endif
+
+static FLD_TYP rnd(void)
+{
+    return 2 * (rand() / (FLD_TYP)RAND_MAX) - 1;
+}
+
+// Writes txt to a new temporary file; its name goes to path (at least 32 chars)
+static void write_tmp(char *path, const char *txt)
+{
+    strcpy(path, "/tmp/lin_alg_io_XXXXXX");
+    const int fd = mkstemp(path);
+    assert(fd >= 0);
+    FILE *f = fdopen(fd, "w");
+    fputs(txt, f);
+    fclose(f);
+}
+
+static bool mat_equals_arr(const mat *m, const FLD_TYP *arr, IND_TYP d1, IND_TYP d2)
+{
+    if (m->d1 != d1 || m->d2 != d2)
+        return false;
+    for (IND_TYP i = 0; i < d1 * d2; i++)
+        if (m->pyl->arr[m->offset + i] != arr[i])
+            return false;
+    return true;
+}
+
+static void load_text_test(void)
+{
+    char path[32], buff[1024];
+    mat m = mat_NULL;
+
+    write_tmp(path, "a,b,c\n"
+                    "1,2.5,-3\n"
+                    "\n"
+                    " 4 , 5e2,6E-1\r\n"
+                    "-0.125,1234567890123456789012,+7\n");
+    const txt_schema hdr = {.skip_rows = 1, .cols = NULL, .n_cols = 0};
+    mat_load_text(&m, path, ',', &hdr);
+    printf("csv with header, blank line, CRLF:\n%s\n", mat_to_str(&m, buff));
+    const FLD_TYP csv[] = {1, 2.5, -3, 4, 500, 0.6, -0.125, 1234567890123456789012.0, 7};
+    bool ok_csv = mat_equals_arr(&m, csv, 3, 3);
+    mat_destruct(&m);
+
+    const IND_TYP cols[] = {2, 0, 2};
+    const txt_schema sel = {.skip_rows = 1, .cols = cols, .n_cols = 3};
+    mat_load_text(&m, path, ',', &sel);
+    printf("columns 2, 0, 2:\n%s\n", mat_to_str(&m, buff));
+    const FLD_TYP csv_sel[] = {-3, 1, -3, 0.6, 4, 0.6, 7, -0.125, 7};
+    bool ok_sel = mat_equals_arr(&m, csv_sel, 3, 3);
+    mat_destruct(&m);
+    unlink(path);
+
+    write_tmp(path, "  1\t2   3\n4 5\t\t6");
+    mat_load_text(&m, path, ' ', NULL);
+    printf("whitespace separated, no final newline:\n%s\n", mat_to_str(&m, buff));
+    const FLD_TYP ws[] = {1, 2, 3, 4, 5, 6};
+    bool ok_ws = mat_equals_arr(&m, ws, 2, 3);
+    mat_destruct(&m);
+    unlink(path);
+
+    write_tmp(path, "1,2,3\n4,5\n");
+    bool ok_ragged = mat_load_text(&m, path, ',', NULL) == NULL && mat_is_null(&m);
+    unlink(path);
+    write_tmp(path, "1,2,3\n4,x,6\n");
+    bool ok_bad = mat_load_text(&m, path, ',', NULL) == NULL && mat_is_null(&m);
+    unlink(path);
+    bool ok_missing = mat_load_text(&m, "/nonexistent/lin_alg.csv", ',', NULL) == NULL;
+    printf("csv: %d, selected columns: %d, whitespace: %d, ragged rejected: %d, bad field rejected: %d, "
+           "missing file: %d\n",
+           ok_csv, ok_sel, ok_ws, ok_ragged, ok_bad, ok_missing);
+    assert(ok_csv && ok_sel && ok_ws && ok_ragged && ok_bad && ok_missing);
+    puts("------");
+}
+
+// Many chunks: parallel parse against the written values
+static void load_text_large_test(void)
+{
+    const IND_TYP d1 = 20000, d2 = 7;
+    char path[32];
+    strcpy(path, "/tmp/lin_alg_io_XXXXXX");
+    const int fd = mkstemp(path);
+    assert(fd >= 0);
+    FILE *f = fdopen(fd, "w");
+    mat ref = mat_NULL, m = mat_NULL;
+    mat_construct(&ref, d1, d2);
+    mat_fill_rnd(&ref, rnd);
+    for (IND_TYP i = 0; i < d1; i++)
+        for (IND_TYP j = 0; j < d2; j++)
+            fprintf(f, (j + 1 != d2) ? "%.17g," : "%.17g\n", (double)*mat_at(&ref, i, j));
+    fclose(f);
+
+    double t0 = omp_get_wtime();
+    mat_load_text(&m, path, ',', NULL);
+    double elp = omp_get_wtime() - t0;
+    bool ok = mat_equals_arr(&m, ref.pyl->arr + ref.offset, d1, d2);
+    printf("mat_load_text %ldx%ld in %g s, round trip exact: %s\n", d1, d2, elp, ok ? "yes" : "no");
+    assert(ok);
+
+    unlink(path);
+    mat_destruct(&ref);
+    mat_destruct(&m);
+    puts("------");
+}
+
+// Writes a .npy file with the given header dict and data
+static void write_npy_raw(char *path, const char *dict, const void *data, size_t bytes)
+{
+    strcpy(path, "/tmp/lin_alg_io_XXXXXX");
+    const int fd = mkstemp(path);
+    assert(fd >= 0);
+    FILE *f = fdopen(fd, "wb");
+    const size_t len = strlen(dict);
+    const uint8_t pre[10] = {0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0, len & 0xff, len >> 8};
+    fwrite(pre, 1, sizeof(pre), f);
+    fwrite(dict, 1, len, f);
+    fwrite(data, 1, bytes, f);
+    fclose(f);
+}
+
+static void npy_test(void)
+{
+    char path[32], buff[1024];
+    const IND_TYP d1 = 3, d2 = 4;
+    mat m = mat_NULL, m_ld = mat_NULL;
+    vec v = vec_NULL, v_s = vec_NULL, v_ld = vec_NULL;
+    mat_construct(&m, d1, d2);
+    mat_fill_rnd(&m, rnd);
+    vec_construct(&v, 10);
+    vec_fill_rnd(&v, rnd);
+    vec_view(&v_s, &v, 9, 4, -2);
+
+    strcpy(path, "/tmp/lin_alg_io_XXXXXX");
+    close(mkstemp(path));
+    IND_TYP n_w = mat_save_npy(&m, path);
+    mat_load_npy(&m_ld, path, true);
+    bool ok_map = mat_equals_arr(&m_ld, m.pyl->arr + m.offset, d1, d2) && (m_ld.pyl->flags & payload_FLG_MMAP);
+    // Private mapping: changing the loaded mat leaves the file alone
+    *mat_at(&m_ld, 0, 0) += 1;
+    mat_destruct(&m_ld);
+    mat_load_npy(&m_ld, path, false);
+    bool ok_read = mat_equals_arr(&m_ld, m.pyl->arr + m.offset, d1, d2) && !(m_ld.pyl->flags & payload_FLG_MMAP);
+    printf("mat .npy %ldx%ld, %ld bytes: mapped: %d, read: %d\n", d1, d2, n_w, ok_map, ok_read);
+    mat_destruct(&m_ld);
+
+    vec_save_npy(&v_s, path);
+    vec_load_npy(&v_ld, path, true);
+    bool ok_vec = v_ld.d == v_s.d;
+    for (IND_TYP i = 0; ok_vec && i < v_s.d; i++)
+        ok_vec = *vec_at(&v_ld, i) == *vec_at(&v_s, i);
+    printf("strided vec %s .npy round trip: %d\n", vec_to_str(&v_s, buff), ok_vec);
+    vec_destruct(&v_ld);
+    bool ok_dim = !mat_load_npy(&m_ld, path, true) && mat_is_null(&m_ld);
+    unlink(path);
+
+    // Fortran order, unaligned data offset
+    const FLD_TYP f_arr[] = {1, 4, 2, 5, 3, 6};
+    char dict[128];
+    snprintf(dict, sizeof(dict), "{'descr': '%s', 'fortran_order': True, 'shape': (2, 3), }\n",
+             (sizeof(FLD_TYP) == 8) ? "<f8" : "<f4");
+    write_npy_raw(path, dict, f_arr, sizeof(f_arr));
+    mat_load_npy(&m_ld, path, true);
+    printf("Fortran order (2, 3):\n%s\n", mat_to_str(&m_ld, buff));
+    const FLD_TYP c_arr[] = {1, 2, 3, 4, 5, 6};
+    bool ok_f = mat_equals_arr(&m_ld, c_arr, 2, 3);
+    mat_destruct(&m_ld);
+    unlink(path);
+
+    snprintf(dict, sizeof(dict), "{'descr': '%s', 'fortran_order': False, 'shape': (6,), }\n",
+             (sizeof(FLD_TYP) == 8) ? "<f4" : "<f8");
+    write_npy_raw(path, dict, c_arr, sizeof(c_arr));
+    bool ok_dtype = !vec_load_npy(&v_ld, path, false) && vec_is_null(&v_ld);
+    unlink(path);
+
+    // Shapes whose byte count wraps around to 0, with the data of a small file
+    const char *descr = (sizeof(FLD_TYP) == 8) ? "<f8" : "<f4";
+    snprintf(dict, sizeof(dict), "{'descr': '%s', 'fortran_order': False, 'shape': (%llu,), }\n", descr,
+             (1ULL << 63) / sizeof(FLD_TYP) * 2);
+    write_npy_raw(path, dict, c_arr, sizeof(c_arr));
+    bool ok_ovf = !vec_load_npy(&v_ld, path, false) && vec_is_null(&v_ld);
+    unlink(path);
+    snprintf(dict, sizeof(dict), "{'descr': '%s', 'fortran_order': False, 'shape': (4294967296, 4294967296), }\n",
+             descr);
+    write_npy_raw(path, dict, c_arr, sizeof(c_arr));
+    ok_ovf = ok_ovf && !mat_load_npy(&m_ld, path, false) && mat_is_null(&m_ld);
+    unlink(path);
+    printf("Fortran order: %d, wrong dimensions rejected: %d, wrong dtype rejected: %d, overflowing shape "
+           "rejected: %d\n",
+           ok_f, ok_dim, ok_dtype, ok_ovf);
+    assert(ok_map && ok_read && ok_vec && ok_f && ok_dim && ok_dtype && ok_ovf);
+
+    mat_destruct(&m);
+    vec_destruct(&v);
+    vec_destruct(&v_s);
+    vec_destruct(&v_ld);
+    puts("------");
+}
+
+static void fd_test(void)
+{
+    char path[32];
+    mat m = mat_NULL, m_rd = mat_NULL;
+    vec v = vec_NULL, v_s = vec_NULL, v_rd = vec_NULL;
+    mat_construct(&m, 30, 20);
+    mat_fill_rnd(&m, rnd);
+    vec_construct(&v, 100);
+    vec_fill_rnd(&v, rnd);
+    vec_view(&v_s, &v, 1, 100, 3);
+
+    // Same bytes as vec_serialize + mat_serialize, read back in sequence
+    strcpy(path, "/tmp/lin_alg_io_XXXXXX");
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    IND_TYP n_v = vec_write_fd(fd, &v_s);
+    IND_TYP n_m = mat_write_fd(fd, &m);
+    const size_t sz = vec_serial_size(&v_s) + mat_serial_size(&m);
+    uint8_t *ser = (uint8_t *)malloc(sz), *txt = (uint8_t *)malloc(sz);
+    mat_serialize(&m, vec_serialize(&v_s, ser));
+    lseek(fd, 0, SEEK_SET);
+    bool ok_ser = n_v + n_m == (IND_TYP)sz && read(fd, txt, sz) == (ssize_t)sz && memcmp(ser, txt, sz) == 0;
+    lseek(fd, 0, SEEK_SET);
+    vec_read_fd(&v_rd, fd);
+    mat_read_fd(&m_rd, fd);
+    bool ok_rd = v_rd.d == v_s.d && m_rd.d1 == m.d1 && m_rd.d2 == m.d2 &&
+                 memcmp(m_rd.pyl->arr, m.pyl->arr + m.offset, m.size * sizeof(FLD_TYP)) == 0;
+    for (IND_TYP i = 0; ok_rd && i < v_s.d; i++)
+        ok_rd = *vec_at(&v_rd, i) == *vec_at(&v_s, i);
+    bool ok_eof = !vec_read_fd(&v_rd, fd) && vec_is_null(&v_rd);
+    // A header whose d1 * d2 * sizeof(FLD_TYP) wraps around to the size of an empty mat
+    const IND_TYP d_ovf[2] = {(IND_TYP)1 << 62, 4};
+    const size_t sz_ovf = sizeof(size_t) + sizeof(d_ovf);
+    lseek(fd, 0, SEEK_SET);
+    bool ok_ovf = ftruncate(fd, 0) == 0 && write(fd, &sz_ovf, sizeof(size_t)) == sizeof(size_t) &&
+                  write(fd, d_ovf, sizeof(d_ovf)) == sizeof(d_ovf);
+    lseek(fd, 0, SEEK_SET);
+    mat_destruct(&m_rd);
+    ok_ovf = ok_ovf && !mat_read_fd(&m_rd, fd) && mat_is_null(&m_rd);
+    close(fd);
+    printf("write_fd %ld + %ld bytes, same as serialize: %d, read back: %d, end of file: %d, overflowing dims: %d\n",
+           n_v, n_m, ok_ser, ok_rd, ok_eof, ok_ovf);
+    free(ser);
+    free(txt);
+    mat_destruct(&m_rd);
+
+    // O_DIRECT, data over several IO_CHUNK pieces
+    mat big = mat_NULL;
+    mat_construct(&big, 1500, 1000);
+    mat_fill_rnd(&big, rnd);
+    bool ok_dir = true;
+    fd = open(path, O_RDWR | O_TRUNC | O_DIRECT);
+    if (fd < 0)
+        puts("O_DIRECT not supported here, skipped");
+    else
+    {
+        IND_TYP n_w = mat_write_fd(fd, &big);
+        struct stat st;
+        fstat(fd, &st);
+        lseek(fd, 0, SEEK_SET);
+        ok_dir = n_w == (IND_TYP)mat_serial_size(&big) && st.st_size == n_w && mat_read_fd(&m_rd, fd) &&
+                 memcmp(m_rd.pyl->arr, big.pyl->arr, big.size * sizeof(FLD_TYP)) == 0 &&
+                 lseek(fd, 0, SEEK_CUR) == n_w;
+        close(fd);
+        printf("O_DIRECT mat %ldx%ld, %ld bytes: %d\n", big.d1, big.d2, n_w, ok_dir);
+    }
+    unlink(path);
+    assert(ok_ser && ok_rd && ok_eof && ok_ovf && ok_dir);
+
+    mat_destruct(&m);
+    mat_destruct(&m_rd);
+    mat_destruct(&big);
+    vec_destruct(&v);
+    vec_destruct(&v_s);
+    vec_destruct(&v_rd);
+    puts("------");
+}
+
+void mat_io_test(void)
+{
+    puts("+++ mat_io_test +++");
+
+    load_text_test();
+    load_text_large_test();
+    npy_test();
+    fd_test();
+
+    puts("^^^ mat_io_test ^^^");
+}
+
+void mat_io_bench(void)
+{
+    puts("+++ mat_io_bench +++");
+
+    const IND_TYP d1 = TXT_BENCH_ROWS, d2 = 16;
+    char path[32];
+    strcpy(path, "/tmp/lin_alg_io_XXXXXX");
+    const int fd = mkstemp(path);
+    assert(fd >= 0);
+    FILE *f = fdopen(fd, "w");
+    for (IND_TYP i = 0; i < d1; i++)
+        for (IND_TYP j = 0; j < d2; j++)
+            fprintf(f, (j + 1 != d2) ? "%.7g," : "%.7g\n", (double)rnd() * 1000);
+    const double bytes = ftell(f);
+    fclose(f);
+
+    mat m = mat_NULL;
+    mat_load_text(&m, path, ',', NULL); // warm page cache
+    mat_destruct(&m);
+    double t0 = omp_get_wtime();
+    mat_load_text(&m, path, ',', NULL);
+    double elp = omp_get_wtime() - t0;
+    printf("mat_load_text %ldx%ld, %.0f MB: %g s, %.2f GB/s (%d threads)\n", d1, d2, bytes * 1e-6, elp,
+           bytes / elp * 1e-9, omp_get_max_threads());
+
+    // Reference: sequential strtod over the file read into memory
+    f = fopen(path, "r");
+    char *txt = (char *)malloc(bytes + 1);
+    FLD_TYP *arr = (FLD_TYP *)malloc(d1 * d2 * sizeof(FLD_TYP));
+    t0 = omp_get_wtime();
+    size_t n_rd = fread(txt, 1, bytes, f);
+    txt[n_rd] = 0;
+    char *p = txt;
+    for (IND_TYP i = 0; i < d1 * d2; i++, p++) // past ',' or '\n'
+        arr[i] = strtod(p, &p);
+    double elp_ref = omp_get_wtime() - t0;
+    printf("fread + strtod loop: %g s, %.2f GB/s, speed-up: %.1f, same values: %s\n", elp_ref,
+           bytes / elp_ref * 1e-9, elp_ref / elp,
+           memcmp(arr, m.pyl->arr + m.offset, d1 * d2 * sizeof(FLD_TYP)) == 0 ? "yes" : "no");
+    fclose(f);
+
+    free(txt);
+    free(arr);
+    unlink(path);
+    mat_destruct(&m);
+
+    puts("^^^ mat_io_bench ^^^");
+}
@@ -0,0 +1,307 @@
+#include "mat_knn.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <tgmath.h>
+#include <omp.h>
+
+#include "vector_eng.h"
+
+#define MIN(x, y) (((x) <= (y)) ? (x) : (y))
+#define MAX(x, y) (((x) >= (y)) ? (x) : (y))
+
+static inline FLD_TYP *mat_arr(const mat *m)
+{
+    return m->pyl->arr + m->offset;
+}
+
+vec *mat_row_sqnorms(vec *result, const mat *m)
+{
+    assert(vec_is_valid(result));
+    assert(mat_is_valid(m));
+    assert(result->d == m->d1);
+
+    if (!vec_touch(result))
+        return NULL;
+    const FLD_TYP *m_arr = mat_arr(m);
+    FLD_TYP *r_arr = result->pyl->arr + result->offset;
+#pragma omp parallel for if (m->size >= PAR_MIN_SIZE)
+    for (IND_TYP i = 0; i < m->d1; i++)
+    {
+        const FLD_TYP *row = m_arr + i * m->d2;
+        FLD_TYP s = 0;
+#pragma omp simd reduction(+ : s)
+        for (IND_TYP j = 0; j < m->d2; j++)
+            s += row[j] * row[j];
+        r_arr[i * result->step] = s;
+    }
+    return result;
+}
+
+// sqn, or a fresh vec with the squared row norms of m in buf
+static const vec *cached_sqnorms(const vec *sqn, vec *buf, const mat *m)
+{
+    if (sqn)
+    {
+        assert(vec_is_valid(sqn));
+        assert(sqn->d == m->d1);
+        return sqn;
+    }
+    vec_construct(buf, m->d1);
+    if (vec_is_null(buf))
+        return NULL;
+    return mat_row_sqnorms(buf, m);
+}
+
+// result = alpha a b^T, then result[i][j] = f(result[i][j], a_sqn[i], b_sqn[j])
+static mat *pairwise(mat *result, const mat *a, const mat *b, const vec *a_sqn, const vec *b_sqn, bool cosine)
+{
+    assert(mat_is_valid(result));
+    assert(mat_is_valid(a));
+    assert(mat_is_valid(b));
+    assert(a->d2 == b->d2);
+    assert(result->d1 == a->d1 && result->d2 == b->d1);
+
+    if (!mat_touch(result))
+        return NULL;
+    vec a_buf = vec_NULL, b_buf = vec_NULL;
+    a_sqn = cached_sqnorms(a_sqn, &a_buf, a);
+    b_sqn = cached_sqnorms(b_sqn, &b_buf, b);
+    if (!a_sqn || !b_sqn)
+    {
+        vec_destruct(&a_buf);
+        vec_destruct(&b_buf);
+        return NULL;
+    }
+
+    GEMM(CblasRowMajor, CblasNoTrans, CblasTrans,
+         a->d1, b->d1, a->d2, cosine ? 1 : -2,
+         mat_arr(a), a->d2,
+         mat_arr(b), b->d2,
+         0, mat_arr(result), result->d2);
+
+    FLD_TYP *r_arr = mat_arr(result);
+    const FLD_TYP *an = a_sqn->pyl->arr + a_sqn->offset;
+    const FLD_TYP *bn = b_sqn->pyl->arr + b_sqn->offset;
+    const IND_TYP a_st = a_sqn->step, b_st = b_sqn->step, d2 = result->d2;
+#pragma omp parallel for if (result->size >= PAR_MIN_SIZE)
+    for (IND_TYP i = 0; i < result->d1; i++)
+    {
+        FLD_TYP *r_row = r_arr + i * d2;
+        const FLD_TYP an_i = an[i * a_st];
+        if (cosine)
+        {
+            const FLD_TYP a_inv = (an_i > 0) ? 1 / sqrt(an_i) : 0;
+#pragma omp simd
+            for (IND_TYP j = 0; j < d2; j++)
+            {
+                const FLD_TYP bn_j = bn[j * b_st];
+                r_row[j] *= a_inv * ((bn_j > 0) ? 1 / sqrt(bn_j) : 0);
+            }
+        }
+        else
+        {
+#pragma omp simd
+            for (IND_TYP j = 0; j < d2; j++)
+            {
+                // Rounding can make the distance of (nearly) equal rows negative.
+                const FLD_TYP d = r_row[j] + an_i + bn[j * b_st];
+                r_row[j] = (d > 0) ? d : 0;
+            }
+        }
+    }
+
+    vec_destruct(&a_buf);
+    vec_destruct(&b_buf);
+    return result;
+}
+
+mat *mat_pairwise_sqdist(mat *result, const mat *a, const mat *b, const vec *a_sqn, const vec *b_sqn)
+{
+    return pairwise(result, a, b, a_sqn, b_sqn, false);
+}
+
+mat *mat_pairwise_cosine(mat *result, const mat *a, const mat *b, const vec *a_sqn, const vec *b_sqn)
+{
+    return pairwise(result, a, b, a_sqn, b_sqn, true);
+}
+
+// Bounded max-heap of k (distance, index) pairs; the root is the farthest kept neighbour.
+static inline void heap_sift_down(FLD_TYP *dist, IND_TYP *idx, IND_TYP k, IND_TYP i)
+{
+    const FLD_TYP d = dist[i];
+    const IND_TYP x = idx[i];
+    for (;;)
+    {
+        IND_TYP c = 2 * i + 1;
+        if (c >= k)
+            break;
+        if (c + 1 < k && dist[c + 1] > dist[c])
+            c++;
+        if (dist[c] <= d)
+            break;
+        dist[i] = dist[c];
+        idx[i] = idx[c];
+        i = c;
+    }
+    dist[i] = d;
+    idx[i] = x;
+}
+
+static inline void heap_push(FLD_TYP *dist, IND_TYP *idx, IND_TYP k, FLD_TYP d, IND_TYP x)
+{
+    if (d < dist[0])
+    {
+        dist[0] = d;
+        idx[0] = x;
+        heap_sift_down(dist, idx, k, 0);
+    }
+}
+
+// Heap sort in place: ascending distances
+static inline void heap_sort(FLD_TYP *dist, IND_TYP *idx, IND_TYP k)
+{
+    for (IND_TYP n = k - 1; n > 0; n--)
+    {
+        const FLD_TYP d = dist[0];
+        const IND_TYP x = idx[0];
+        dist[0] = dist[n];
+        idx[0] = idx[n];
+        dist[n] = d;
+        idx[n] = x;
+        heap_sift_down(dist, idx, n, 0);
+    }
+}
+
+IND_TYP *mat_knn(IND_TYP *out_idx, mat *out_dist, const mat *query, const mat *base, const vec *base_sqn,
+                 IND_TYP k)
+{
+    assert(out_idx);
+    assert(mat_is_valid(query));
+    assert(mat_is_valid(base));
+    assert(query->d2 == base->d2);
+    assert(k > 0 && k <= base->d1);
+    assert(!out_dist || (mat_is_valid(out_dist) && out_dist->d1 == query->d1 && out_dist->d2 == k));
+
+    if (out_dist && !mat_touch(out_dist))
+        return NULL;
+    const IND_TYP n_q = query->d1, n_b = base->d1, d = query->d2;
+    vec q_buf = vec_NULL, b_buf = vec_NULL;
+    const vec *q_sqn = cached_sqnorms(NULL, &q_buf, query);
+    base_sqn = cached_sqnorms(base_sqn, &b_buf, base);
+
+    const IND_TYP n_qb = (n_q + KNN_BLK_Q - 1) / KNN_BLK_Q;
+    const IND_TYP n_bb = (n_b + KNN_BLK_B - 1) / KNN_BLK_B;
+    const bool par = query->size + base->size >= PAR_MIN_SIZE;
+    // Split the base blocks between threads when the query blocks alone cannot keep them busy.
+    const IND_TYP n_thr = par ? omp_get_max_threads() : 1;
+    const IND_TYP n_split = MIN(n_bb, MAX(1, (n_thr + n_qb - 1) / n_qb));
+
+    // Heaps of every (split, query row); split 0 heaps hold the final result
+    FLD_TYP *h_dist = (FLD_TYP *)malloc(n_split * n_q * k * sizeof(FLD_TYP));
+    IND_TYP *h_idx = (IND_TYP *)malloc(n_split * n_q * k * sizeof(IND_TYP));
+    assert(h_dist && h_idx);
+    if (!q_sqn || !base_sqn || !h_dist || !h_idx)
+    {
+        free((void *)h_dist);
+        free((void *)h_idx);
+        vec_destruct(&q_buf);
+        vec_destruct(&b_buf);
+        return NULL;
+    }
+
+    const FLD_TYP *q_arr = mat_arr(query);
+    const FLD_TYP *b_arr = mat_arr(base);
+    const FLD_TYP *qn = q_sqn->pyl->arr + q_sqn->offset;
+    const FLD_TYP *bn = base_sqn->pyl->arr + base_sqn->offset;
+    const IND_TYP bn_st = base_sqn->step;
+    bool ok = true;
+
+#pragma omp parallel if (par && n_qb * n_split > 1)
+    {
+        // Per-thread distance tile
+        FLD_TYP *tile = (FLD_TYP *)malloc(KNN_BLK_Q * KNN_BLK_B * sizeof(FLD_TYP));
+        assert(tile);
+        if (!tile)
+        {
+#pragma omp atomic write
+            ok = false;
+        }
+
+#pragma omp for collapse(2) schedule(dynamic)
+        for (IND_TYP qb = 0; qb < n_qb; qb++)
+            for (IND_TYP s = 0; s < n_split; s++)
+            {
+                if (!tile)
+                    continue;
+                const IND_TYP i_0 = qb * KNN_BLK_Q;
+                const IND_TYP n_r = MIN(KNN_BLK_Q, n_q - i_0);
+                FLD_TYP *hd = h_dist + (s * n_q + i_0) * k;
+                IND_TYP *hi = h_idx + (s * n_q + i_0) * k;
+                for (IND_TYP e = 0; e < n_r * k; e++)
+                {
+                    hd[e] = INFINITY;
+                    hi[e] = -1;
+                }
+
+                for (IND_TYP bb = s; bb < n_bb; bb += n_split)
+                {
+                    const IND_TYP j_0 = bb * KNN_BLK_B;
+                    const IND_TYP n_c = MIN(KNN_BLK_B, n_b - j_0);
+
+                    GEMM(CblasRowMajor, CblasNoTrans, CblasTrans,
+                         n_r, n_c, d, -2,
+                         q_arr + i_0 * d, d,
+                         b_arr + j_0 * d, d,
+                         0, tile, n_c);
+
+                    for (IND_TYP r = 0; r < n_r; r++)
+                    {
+                        FLD_TYP *t_r = tile + r * n_c;
+                        const FLD_TYP qn_r = qn[(i_0 + r) * q_sqn->step];
+#pragma omp simd
+                        for (IND_TYP c = 0; c < n_c; c++)
+                        {
+                            const FLD_TYP dst = t_r[c] + qn_r + bn[(j_0 + c) * bn_st];
+                            t_r[c] = (dst > 0) ? dst : 0;
+                        }
+                        FLD_TYP *hd_r = hd + r * k;
+                        IND_TYP *hi_r = hi + r * k;
+                        for (IND_TYP c = 0; c < n_c; c++)
+                            heap_push(hd_r, hi_r, k, t_r[c], j_0 + c);
+                    }
+                }
+            }
+
+        free((void *)tile);
+        // Every tile is allocated (or not) before the barrier of the loop above
+        bool ok_all;
+#pragma omp atomic read
+        ok_all = ok;
+
+        // Merge the splits into split 0, then sort
+#pragma omp for
+        for (IND_TYP i = 0; i < n_q; i++)
+        {
+            if (!ok_all)
+                continue;
+            FLD_TYP *hd = h_dist + i * k;
+            IND_TYP *hi = h_idx + i * k;
+            for (IND_TYP s = 1; s < n_split; s++)
+                for (IND_TYP e = 0; e < k; e++)
+                    heap_push(hd, hi, k, h_dist[(s * n_q + i) * k + e], h_idx[(s * n_q + i) * k + e]);
+            heap_sort(hd, hi, k);
+            for (IND_TYP e = 0; e < k; e++)
+                out_idx[i * k + e] = hi[e];
+            if (out_dist)
+                for (IND_TYP e = 0; e < k; e++)
+                    *mat_at(out_dist, i, e) = hd[e];
+        }
+    }
+
+    free((void *)h_dist);
+    free((void *)h_idx);
+    vec_destruct(&q_buf);
+    vec_destruct(&b_buf);
+    return ok ? out_idx : NULL;
+}
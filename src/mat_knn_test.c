@@ -0,0 +1,179 @@
+#include "mat_knn.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <tgmath.h>
+#include <omp.h>
+
+#ifndef KNN_BENCH_BASE
+#define KNN_BENCH_BASE (1 << 17)
+#endif
+
+static FLD_TYP rnd(void)
+{
+    return 2 * (rand() / (FLD_TYP)RAND_MAX) - 1;
+}
+
+static FLD_TYP sqdist_naive(const mat *a, IND_TYP i, const mat *b, IND_TYP j)
+{
+    FLD_TYP s = 0;
+    for (IND_TYP l = 0; l < a->d2; l++)
+    {
+        const FLD_TYP t = *mat_at(a, i, l) - *mat_at(b, j, l);
+        s += t * t;
+    }
+    return s;
+}
+
+static void pairwise_test(void)
+{
+    const IND_TYP n_a = 30, n_b = 20, d = 7;
+    mat a = mat_NULL, b = mat_NULL, sqd = mat_NULL, cs = mat_NULL;
+    mat_construct(&a, n_a, d);
+    mat_construct(&b, n_b, d);
+    mat_construct(&sqd, n_a, n_b);
+    mat_construct(&cs, n_a, n_b);
+    mat_fill_rnd(&a, rnd);
+    mat_fill_rnd(&b, rnd);
+    // A duplicate row has distance 0 and a zero row cosine 0.
+    for (IND_TYP l = 0; l < d; l++)
+    {
+        *mat_at(&a, 1, l) = *mat_at(&b, 2, l);
+        *mat_at(&b, 3, l) = 0;
+    }
+
+    mat_pairwise_sqdist(&sqd, &a, &b, NULL, NULL);
+    mat_pairwise_cosine(&cs, &a, &b, NULL, NULL);
+    FLT_TYP sqd_err = 0, cs_err = 0;
+    for (IND_TYP i = 0; i < n_a; i++)
+        for (IND_TYP j = 0; j < n_b; j++)
+        {
+            sqd_err = fmax(sqd_err, fabs(*mat_at(&sqd, i, j) - sqdist_naive(&a, i, &b, j)));
+            FLD_TYP dot = 0, na = 0, nb = 0;
+            for (IND_TYP l = 0; l < d; l++)
+            {
+                dot += *mat_at(&a, i, l) * *mat_at(&b, j, l);
+                na += *mat_at(&a, i, l) * *mat_at(&a, i, l);
+                nb += *mat_at(&b, j, l) * *mat_at(&b, j, l);
+            }
+            const FLD_TYP c = (na > 0 && nb > 0) ? dot / sqrt(na * nb) : 0;
+            cs_err = fmax(cs_err, fabs(*mat_at(&cs, i, j) - c));
+        }
+    printf("pairwise sqdist max err: %g, cosine max err: %g, duplicate row dist: %g\n",
+           sqd_err, cs_err, *mat_at(&sqd, 1, 2));
+    assert(sqd_err < 1E-4 && cs_err < 1E-5 && *mat_at(&sqd, 1, 2) >= 0);
+
+    mat_destruct(&a);
+    mat_destruct(&b);
+    mat_destruct(&sqd);
+    mat_destruct(&cs);
+    puts("------");
+}
+
+typedef struct dist_idx
+{
+    FLD_TYP d;
+    IND_TYP i;
+} dist_idx;
+
+static int dist_idx_cmp(const void *x, const void *y)
+{
+    const FLD_TYP dx = ((const dist_idx *)x)->d, dy = ((const dist_idx *)y)->d;
+    return (dx > dy) - (dx < dy);
+}
+
+// Checks mat_knn against a full sort for n_q queries
+static bool knn_check(IND_TYP n_q, IND_TYP n_b, IND_TYP d, IND_TYP k)
+{
+    mat q = mat_NULL, b = mat_NULL, dist = mat_NULL;
+    mat_construct(&q, n_q, d);
+    mat_construct(&b, n_b, d);
+    mat_construct(&dist, n_q, k);
+    mat_fill_rnd(&q, rnd);
+    mat_fill_rnd(&b, rnd);
+    IND_TYP *idx = (IND_TYP *)malloc(n_q * k * sizeof(IND_TYP));
+    dist_idx *all = (dist_idx *)malloc(n_b * sizeof(dist_idx));
+
+    mat_knn(idx, &dist, &q, &b, NULL, k);
+
+    FLT_TYP err = 0;
+    IND_TYP idx_miss = 0;
+    for (IND_TYP i = 0; i < n_q; i++)
+    {
+        for (IND_TYP j = 0; j < n_b; j++)
+            all[j] = (dist_idx){.d = sqdist_naive(&q, i, &b, j), .i = j};
+        qsort(all, n_b, sizeof(dist_idx), dist_idx_cmp);
+        for (IND_TYP e = 0; e < k; e++)
+        {
+            err = fmax(err, fabs(*mat_at(&dist, i, e) - all[e].d));
+            err = fmax(err, fabs(sqdist_naive(&q, i, &b, idx[i * k + e]) - all[e].d));
+            idx_miss += idx[i * k + e] != all[e].i;
+        }
+    }
+    printf("knn %ld queries, %ld base rows, k=%ld: max dist err: %g, index mismatches (ties): %ld\n",
+           n_q, n_b, k, err, idx_miss);
+
+    free(idx);
+    free(all);
+    mat_destruct(&q);
+    mat_destruct(&b);
+    mat_destruct(&dist);
+    return err < 1E-4;
+}
+
+static void knn_test(void)
+{
+    bool ok = knn_check(150, 1300, 9, 5);
+    // Few queries: the base blocks are split between threads
+    ok = knn_check(3, 5000, 16, 10) && ok;
+    ok = knn_check(10, 10, 4, 10) && ok;
+    printf("knn: %s\n", ok ? "ok" : "failed");
+    assert(ok);
+    puts("------");
+}
+
+void mat_knn_test(void)
+{
+    puts("+++ mat_knn_test +++");
+
+    pairwise_test();
+    knn_test();
+
+    puts("^^^ mat_knn_test ^^^");
+}
+
+void mat_knn_bench(void)
+{
+    puts("+++ mat_knn_bench +++");
+
+    const IND_TYP n_q = 1024, n_b = KNN_BENCH_BASE, d = 64, k = 10;
+    mat q = mat_NULL, b = mat_NULL;
+    vec b_sqn = vec_NULL;
+    mat_construct(&q, n_q, d);
+    mat_construct(&b, n_b, d);
+    vec_construct(&b_sqn, n_b);
+    mat_fill_rnd(&q, rnd);
+    mat_fill_rnd(&b, rnd);
+    mat_row_sqnorms(&b_sqn, &b);
+    IND_TYP *idx = (IND_TYP *)malloc(n_q * k * sizeof(IND_TYP));
+
+    for (IND_TYP nq = 1; nq <= n_q; nq *= 32)
+    {
+        mat q_v = mat_NULL;
+        mat_construct_prealloc(&q_v, q.pyl, 0, nq, d);
+        double t0 = omp_get_wtime();
+        mat_knn(idx, NULL, &q_v, &b, &b_sqn, k);
+        double elp = omp_get_wtime() - t0;
+        printf("knn %5ld queries x %ld base rows, d=%ld, k=%ld: %8.4f s, %8.1f queries/s, %6.1f GFLOP/s\n",
+               nq, n_b, d, k, elp, nq / elp, 2E-9 * nq * n_b * d / elp);
+        mat_destruct(&q_v);
+    }
+
+    free(idx);
+    mat_destruct(&q);
+    mat_destruct(&b);
+    vec_destruct(&b_sqn);
+
+    puts("^^^ mat_knn_bench ^^^");
+}
@@ -0,0 +1,246 @@
+#include "mat_ring.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "vec_mat.h"
+#include "vector_eng.h"
+
+mat_ring *mat_ring_construct(mat_ring *r, IND_TYP cap, IND_TYP d)
+{
+    assert(r);
+    assert(cap > 0);
+    assert(d > 0);
+
+    *r = mat_ring_NULL;
+    mat_construct(&r->buf, cap, d);
+    if (mat_is_null(&r->buf))
+        return NULL;
+    return r;
+}
+
+void mat_ring_destruct(mat_ring *r)
+{
+    if (r)
+    {
+        mat_destruct(&r->buf);
+        *r = mat_ring_NULL;
+    }
+}
+
+mat_ring *mat_ring_reset(mat_ring *r)
+{
+    assert(r);
+
+    r->head = 0;
+    r->n = 0;
+    return r;
+}
+
+// Non-owning views (no payload_share) of the window rows in order; returns their number
+static int segments(const mat_ring *r, mat seg[2])
+{
+    const IND_TYP cap = r->buf.d1, d = r->buf.d2;
+    const IND_TYP n0 = r->head + r->n <= cap ? r->n : cap - r->head;
+    int k = 0;
+    if (n0 > 0)
+        seg[k++] = (mat){.pyl = r->buf.pyl, .size = n0 * d, .d1 = n0, .d2 = d,
+                         .offset = r->buf.offset + r->head * d};
+    if (r->n > n0)
+        seg[k++] = (mat){.pyl = r->buf.pyl, .size = (r->n - n0) * d, .d1 = r->n - n0, .d2 = d,
+                         .offset = r->buf.offset};
+    return k;
+}
+
+// Writes the k <= cap rows of src at the tail of the window, dropping the oldest ones;
+// false if buf could not be given an own array
+static bool put_rows(mat_ring *r, const FLD_TYP *src, IND_TYP k)
+{
+    const IND_TYP cap = r->buf.d1, d = r->buf.d2;
+    if (!payload_own(r->buf.pyl))
+        return false;
+    IND_TYP t = (r->head + r->n) % cap;
+    while (k > 0)
+    {
+        // Up to the end of buf, then around
+        const IND_TYP k0 = k <= cap - t ? k : cap - t;
+        const IND_TYP i = r->buf.offset + t * d;
+        memmove(payload_at(r->buf.pyl, i), src, k0 * d * sizeof(FLD_TYP));
+        payload_mark(r->buf.pyl, i, i + k0 * d);
+        const IND_TYP drop = r->n + k0 > cap ? r->n + k0 - cap : 0;
+        r->head = (r->head + drop) % cap;
+        r->n += k0 - drop;
+        src += k0 * d;
+        k -= k0;
+        t = 0;
+    }
+    return true;
+}
+
+mat_ring *mat_ring_push(mat_ring *r, const vec *row)
+{
+    assert(r);
+    assert(mat_is_valid(&r->buf));
+    assert(vec_is_valid(row));
+    assert(row->d == r->buf.d2);
+
+    if (row->step == 1)
+        return put_rows(r, payload_at(row->pyl, row->offset), 1) ? r : NULL;
+    // Strided: element-wise into the slot of the new row
+    const IND_TYP cap = r->buf.d1, d = r->buf.d2;
+    if (!payload_own(r->buf.pyl))
+        return NULL;
+    const IND_TYP i = r->buf.offset + (r->head + r->n) % cap * d;
+    FLD_TYP *dst = payload_at(r->buf.pyl, i);
+    for (IND_TYP j = 0; j < d; j++)
+        dst[j] = *payload_at(row->pyl, row->offset + j * row->step);
+    payload_mark(r->buf.pyl, i, i + d);
+    if (r->n == cap)
+        r->head = (r->head + 1) % cap;
+    else
+        r->n++;
+    return r;
+}
+
+mat_ring *mat_ring_push_rows(mat_ring *r, const mat *blk)
+{
+    assert(r);
+    assert(mat_is_valid(&r->buf));
+    assert(mat_is_valid(blk));
+    assert(blk->d2 == r->buf.d2);
+    assert(blk->pyl != r->buf.pyl);
+
+    const IND_TYP cap = r->buf.d1;
+    const FLD_TYP *src = payload_at(blk->pyl, blk->offset);
+    IND_TYP k = blk->d1;
+    if (k > cap)
+    {
+        // Only the last cap rows stay
+        src += (k - cap) * blk->d2;
+        k = cap;
+    }
+    return put_rows(r, src, k) ? r : NULL;
+}
+
+vec *mat_ring_row_at(mat_ring *r, vec *row, IND_TYP i)
+{
+    assert(r);
+    assert(r->n > 0);
+
+    if (i < 0)
+        i += r->n;
+    assert(i >= 0 && i < r->n);
+    return mat_row_at(&r->buf, row, (r->head + i) % r->buf.d1);
+}
+
+int mat_ring_segments(const mat_ring *r, mat seg[2])
+{
+    assert(r);
+    assert(mat_is_valid(&r->buf));
+
+    mat s[2];
+    const int k = segments(r, s);
+    for (int i = 0; i < k; i++)
+    {
+        seg[i] = mat_NULL;
+        mat_construct_prealloc(seg + i, s[i].pyl, s[i].offset, s[i].d1, s[i].d2);
+    }
+    return k;
+}
+
+mat *mat_ring_window(mat *dst, const mat_ring *r)
+{
+    assert(mat_is_valid(dst));
+    assert(r);
+    assert(dst->d1 == r->n && dst->d2 == r->buf.d2);
+
+    mat s[2];
+    const int k = segments(r, s);
+    if (!mat_touch(dst))
+        return NULL;
+    FLD_TYP *out = payload_at(dst->pyl, dst->offset);
+    for (int i = 0; i < k; i++)
+    {
+        memcpy(out, payload_at(s[i].pyl, s[i].offset), s[i].size * sizeof(FLD_TYP));
+        out += s[i].size;
+    }
+    return dst;
+}
+
+vec *mat_ring_dot_vec(vec *result, const mat_ring *r, const vec *v_right)
+{
+    assert(vec_is_valid(result));
+    assert(r);
+    assert(vec_is_valid(v_right));
+    assert(v_right->d == r->buf.d2);
+    assert(result->d == r->n);
+
+    mat s[2];
+    const int k = segments(r, s);
+    if (!vec_touch(result))
+        return NULL;
+    IND_TYP i0 = 0;
+    for (int i = 0; i < k; i++)
+    {
+        GEMV(CblasRowMajor, CblasNoTrans, s[i].d1, s[i].d2, 1,
+             payload_at(s[i].pyl, s[i].offset), s[i].d2,
+             payload_at(v_right->pyl, v_right->offset), v_right->step, 0,
+             payload_at(result->pyl, result->offset + i0 * result->step), result->step);
+        i0 += s[i].d1;
+    }
+    return result;
+}
+
+vec *vec_dot_mat_ring(vec *result, const vec *v_left, const mat_ring *r)
+{
+    assert(vec_is_valid(result));
+    assert(vec_is_valid(v_left));
+    assert(r);
+    assert(v_left->d == r->n);
+    assert(result->d == r->buf.d2);
+
+    mat s[2];
+    const int k = segments(r, s);
+    if (!vec_touch(result))
+        return NULL;
+    // The second segment adds to the first
+    IND_TYP i0 = 0;
+    for (int i = 0; i < k; i++)
+    {
+        GEMV(CblasRowMajor, CblasTrans, s[i].d1, s[i].d2, 1,
+             payload_at(s[i].pyl, s[i].offset), s[i].d2,
+             payload_at(v_left->pyl, v_left->offset + i0 * v_left->step), v_left->step, i ? 1 : 0,
+             payload_at(result->pyl, result->offset), result->step);
+        i0 += s[i].d1;
+    }
+    return result;
+}
+
+vec *mat_ring_col_sum(vec *result, const mat_ring *r)
+{
+    assert(vec_is_valid(result));
+    assert(r);
+    assert(result->d == r->buf.d2);
+
+    mat s[2];
+    const int k = segments(r, s);
+    if (!vec_fill_zero(result))
+        return NULL;
+    FLD_TYP *out = payload_at(result->pyl, result->offset);
+    for (int i = 0; i < k; i++)
+        for (IND_TYP j = 0; j < s[i].d1; j++)
+            AXPY(s[i].d2, 1, payload_at(s[i].pyl, s[i].offset + j * s[i].d2), 1, out, result->step);
+    return result;
+}
+
+FLD_TYP mat_ring_sum(const mat_ring *r)
+{
+    assert(r);
+
+    mat s[2];
+    const int k = segments(r, s);
+    FLD_TYP sum = 0;
+    for (int i = 0; i < k; i++)
+        sum += mat_sum(s + i);
+    return sum;
+}
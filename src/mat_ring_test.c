@@ -0,0 +1,218 @@
+#include "mat_ring.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <tgmath.h>
+#include <omp.h>
+
+#include "vec_mat.h"
+
+#define TOL (sizeof(FLD_TYP) == 4 ? 1E-4 : 1E-12)
+
+#ifndef RING_BENCH_N
+#define RING_BENCH_N 4096
+#endif
+
+static FLD_TYP rnd(void)
+{
+    return 2 * (rand() / (FLD_TYP)RAND_MAX) - 1;
+}
+
+// The reference window: rows shifted up by one with memmove, the new row at the bottom
+static void shift_push(mat *w, IND_TYP *n, const vec *row)
+{
+    FLD_TYP *arr = payload_at(w->pyl, w->offset);
+    if (*n == w->d1)
+        memmove(arr, arr + w->d2, (w->size - w->d2) * sizeof(FLD_TYP));
+    else
+        (*n)++;
+    for (IND_TYP j = 0; j < w->d2; j++)
+        arr[(*n - 1) * w->d2 + j] = *vec_at(row, j);
+}
+
+// Max relative difference of the ring kernels from the ones on the reference window (n rows)
+static FLT_TYP ring_err(const mat_ring *r, const mat *w_ref, IND_TYP n, const vec *x, const vec *y)
+{
+    const IND_TYP d = w_ref->d2;
+    mat w = mat_NULL, win = mat_NULL;
+    vec a = vec_NULL, b = vec_NULL, y_n = vec_NULL;
+    mat_construct_prealloc(&w, w_ref->pyl, w_ref->offset, n, d);
+    mat_construct(&win, n, d);
+    mat_ring_window(&win, r);
+    FLT_TYP err = 0;
+    for (IND_TYP i = 0; i < win.size; i++)
+        err = fmax(err, fabs(win.pyl->arr[i] - w.pyl->arr[w.offset + i]));
+
+    vec_construct(&a, n);
+    vec_construct(&b, n);
+    mat_ring_dot_vec(&a, r, x);
+    mat_dot_vec(&b, &w, x);
+    vec_subfrom(&a, &b);
+    err = fmax(err, vec_norm_2(&a) / vec_norm_2(&b));
+    vec_destruct(&a);
+    vec_destruct(&b);
+
+    vec_construct_prealloc(&y_n, y->pyl, y->offset, n, y->step);
+    vec_construct(&a, d);
+    vec_construct(&b, d);
+    vec_dot_mat_ring(&a, &y_n, r);
+    vec_dot_mat(&b, &y_n, &w);
+    vec_subfrom(&a, &b);
+    err = fmax(err, vec_norm_2(&a) / vec_norm_2(&b));
+
+    mat_ring_col_sum(&a, r);
+    vec_fill_zero(&b);
+    for (IND_TYP i = 0; i < n; i++)
+        for (IND_TYP j = 0; j < d; j++)
+            *vec_at(&b, j) += *mat_at(&w, i, j);
+    vec_subfrom(&a, &b);
+    err = fmax(err, vec_norm_2(&a) / vec_norm_2(&b));
+    err = fmax(err, fabs(mat_ring_sum(r) - mat_sum(&w)) / (mat_norm_2(&w) * sqrt((FLT_TYP)w.size)));
+
+    vec_destruct(&a);
+    vec_destruct(&b);
+    vec_destruct(&y_n);
+    mat_destruct(&w);
+    mat_destruct(&win);
+    return err;
+}
+
+static void window_test(void)
+{
+    // Single pushes of contiguous and strided rows, block pushes longer and shorter than the window
+    const IND_TYP cap = 37, d = 11;
+    mat_ring r = mat_ring_NULL;
+    mat w_ref = mat_NULL, src = mat_NULL, blk = mat_NULL;
+    vec row = vec_NULL, x = vec_NULL, y = vec_NULL;
+    mat_ring_construct(&r, cap, d);
+    mat_construct(&w_ref, cap, d);
+    mat_construct(&src, 200, d);
+    mat_fill_rnd(&src, rnd);
+    vec_construct(&x, d);
+    vec_construct(&y, cap);
+    vec_fill_rnd(&x, rnd);
+    vec_fill_rnd(&y, rnd);
+    IND_TYP n = 0, next = 0;
+    FLT_TYP err = 0;
+    bool ok_n = true;
+    for (int k = 0; k < 120; k++)
+    {
+        mat_row_at(&src, &row, next++ % src.d1);
+        mat_ring_push(&r, &row);
+        shift_push(&w_ref, &n, &row);
+        ok_n = ok_n && r.n == n;
+        err = fmax(err, ring_err(&r, &w_ref, n, &x, &y));
+    }
+    const IND_TYP blk_sz[] = {5, 36, 37, 80, 1};
+    for (int k = 0; k < 5; k++)
+    {
+        mat_destruct(&blk);
+        mat_construct_prealloc(&blk, src.pyl, 0, blk_sz[k], d);
+        mat_ring_push_rows(&r, &blk);
+        for (IND_TYP i = 0; i < blk_sz[k]; i++)
+        {
+            mat_row_at(&blk, &row, i);
+            shift_push(&w_ref, &n, &row);
+        }
+        ok_n = ok_n && r.n == n;
+        err = fmax(err, ring_err(&r, &w_ref, n, &x, &y));
+    }
+    // A column of src: strided
+    vec col = vec_NULL, col_d = vec_NULL;
+    mat_column_at(&src, &col, 3);
+    vec_construct_prealloc(&col_d, col.pyl, col.offset, d, col.step);
+    mat_ring_push(&r, &col_d);
+    shift_push(&w_ref, &n, &col_d);
+    err = fmax(err, ring_err(&r, &w_ref, n, &x, &y));
+
+    mat_ring_row_at(&r, &row, -1);
+    bool ok_row = *vec_at(&row, 0) == *vec_at(&col_d, 0) && *vec_at(&row, d - 1) == *vec_at(&col_d, d - 1);
+    mat seg[2];
+    const int n_seg = mat_ring_segments(&r, seg);
+    bool ok_seg = n_seg == 2 && seg[0].d1 + seg[1].d1 == cap && seg[0].pyl == r.buf.pyl;
+    for (int i = 0; i < n_seg; i++)
+        mat_destruct(seg + i);
+
+    const bool ok = err < TOL;
+    printf("ring %ldx%ld: max rel err vs. shifted window %g (< %g: %d), sizes: %d, newest row: %d, segments: %d\n",
+           cap, d, err, TOL, ok, ok_n, ok_row, ok_seg);
+    assert(ok && ok_n && ok_row && ok_seg);
+
+    vec_destruct(&col);
+    vec_destruct(&col_d);
+    vec_destruct(&row);
+    vec_destruct(&x);
+    vec_destruct(&y);
+    mat_destruct(&blk);
+    mat_destruct(&src);
+    mat_destruct(&w_ref);
+    mat_ring_destruct(&r);
+    puts("------");
+}
+
+void mat_ring_test(void)
+{
+    puts("+++ mat_ring_test +++");
+
+    window_test();
+
+    puts("^^^ mat_ring_test ^^^");
+}
+
+void mat_ring_bench(void)
+{
+    puts("+++ mat_ring_bench +++");
+
+    // A detector scoring the last n samples after each new one: window @ x
+    const IND_TYP n = RING_BENCH_N, d = 64, steps = 2000;
+    mat_ring r = mat_ring_NULL;
+    mat w = mat_NULL, src = mat_NULL;
+    vec row = vec_NULL, x = vec_NULL, s = vec_NULL;
+    mat_ring_construct(&r, n, d);
+    mat_construct(&w, n, d);
+    mat_construct(&src, n + steps, d);
+    mat_fill_rnd(&src, rnd);
+    vec_construct(&x, d);
+    vec_construct(&s, n);
+    vec_fill_rnd(&x, rnd);
+    IND_TYP n_w = 0;
+    for (IND_TYP i = 0; i < n; i++)
+    {
+        mat_row_at(&src, &row, i);
+        mat_ring_push(&r, &row);
+        shift_push(&w, &n_w, &row);
+    }
+
+    double t_shift = 0, t_ring = 0, t_push = 0, t_move = 0;
+    for (IND_TYP k = 0; k < steps; k++)
+    {
+        mat_row_at(&src, &row, n + k);
+        double t0 = omp_get_wtime();
+        shift_push(&w, &n_w, &row);
+        const double t1 = omp_get_wtime();
+        mat_dot_vec(&s, &w, &x);
+        const double t2 = omp_get_wtime();
+        mat_ring_push(&r, &row);
+        const double t3 = omp_get_wtime();
+        mat_ring_dot_vec(&s, &r, &x);
+        const double t4 = omp_get_wtime();
+        t_move += t1 - t0;
+        t_shift += t2 - t0;
+        t_push += t3 - t2;
+        t_ring += t4 - t2;
+    }
+    printf("window %ldx%ld, %ld steps: memmove shift + mat_dot_vec %.2f us/step (shift %.2f us), "
+           "mat_ring_push + mat_ring_dot_vec %.2f us/step (push %.3f us)\n",
+           n, d, steps, t_shift / steps * 1e6, t_move / steps * 1e6, t_ring / steps * 1e6, t_push / steps * 1e6);
+
+    vec_destruct(&row);
+    vec_destruct(&x);
+    vec_destruct(&s);
+    mat_destruct(&w);
+    mat_destruct(&src);
+    mat_ring_destruct(&r);
+
+    puts("^^^ mat_ring_bench ^^^");
+}
@@ -0,0 +1,254 @@
+#include "mat_solve.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "vector_eng.h"
+
+#define MIN(x, y) (((x) <= (y)) ? (x) : (y))
+
+_Static_assert(sizeof(IND_TYP) == sizeof(MKL_INT), "pivot indices are passed to LAPACK as IND_TYP");
+
+static inline FLD_TYP *mat_arr(const mat *m)
+{
+    return m->pyl->arr + m->offset;
+}
+
+mat_lu *mat_lu_construct(mat_lu *f, mat *a)
+{
+    assert(f);
+    assert(mat_is_valid(a));
+    assert(a->d1 == a->d2);
+
+    *f = mat_lu_NULL;
+    if (!mat_touch(a))
+        return NULL;
+    f->piv = (IND_TYP *)malloc(a->d1 * sizeof(IND_TYP));
+    assert(f->piv);
+    if (!f->piv)
+        return NULL;
+    mat_construct_prealloc(&f->lu, a->pyl, a->offset, a->d1, a->d2);
+
+    lapack_int info = GETRF(LAPACK_ROW_MAJOR, a->d1, a->d2, mat_arr(a), a->d2, (MKL_INT *)f->piv);
+    if (info != 0)
+    {
+        mat_lu_destruct(f);
+        return NULL;
+    }
+    return f;
+}
+
+void mat_lu_destruct(mat_lu *f)
+{
+    if (f)
+    {
+        mat_destruct(&f->lu);
+        free((void *)f->piv);
+        *f = mat_lu_NULL;
+    }
+}
+
+mat *mat_lu_solve(const mat_lu *f, mat *b)
+{
+    assert(f);
+    assert(mat_is_valid(&f->lu));
+    assert(mat_is_valid(b));
+    assert(b->d1 == f->lu.d1);
+
+    if (!mat_touch(b))
+        return NULL;
+    lapack_int info = GETRS(LAPACK_ROW_MAJOR, 'N', f->lu.d1, b->d2,
+                            mat_arr(&f->lu), f->lu.d2, (const MKL_INT *)f->piv,
+                            mat_arr(b), b->d2);
+    return (info == 0) ? b : NULL;
+}
+
+mat_cholesky *mat_cholesky_construct(mat_cholesky *f, mat *a)
+{
+    assert(f);
+    assert(mat_is_valid(a));
+    assert(a->d1 == a->d2);
+
+    *f = mat_cholesky_NULL;
+    if (!mat_touch(a))
+        return NULL;
+    mat_construct_prealloc(&f->l, a->pyl, a->offset, a->d1, a->d2);
+
+    lapack_int info = POTRF(LAPACK_ROW_MAJOR, 'L', a->d1, mat_arr(a), a->d2);
+    if (info != 0)
+    {
+        mat_cholesky_destruct(f);
+        return NULL;
+    }
+    return f;
+}
+
+void mat_cholesky_destruct(mat_cholesky *f)
+{
+    if (f)
+    {
+        mat_destruct(&f->l);
+        *f = mat_cholesky_NULL;
+    }
+}
+
+mat *mat_cholesky_solve(const mat_cholesky *f, mat *b)
+{
+    assert(f);
+    assert(mat_is_valid(&f->l));
+    assert(mat_is_valid(b));
+    assert(b->d1 == f->l.d1);
+
+    if (!mat_touch(b))
+        return NULL;
+    lapack_int info = POTRS(LAPACK_ROW_MAJOR, 'L', f->l.d1, b->d2,
+                            mat_arr(&f->l), f->l.d2, mat_arr(b), b->d2);
+    return (info == 0) ? b : NULL;
+}
+
+mat_qr *mat_qr_construct(mat_qr *f, mat *a)
+{
+    assert(f);
+    assert(mat_is_valid(a));
+
+    *f = mat_qr_NULL;
+    if (!mat_touch(a))
+        return NULL;
+    f->tau = (FLD_TYP *)malloc(MIN(a->d1, a->d2) * sizeof(FLD_TYP));
+    assert(f->tau);
+    if (!f->tau)
+        return NULL;
+    mat_construct_prealloc(&f->qr, a->pyl, a->offset, a->d1, a->d2);
+
+    lapack_int info = GEQRF(LAPACK_ROW_MAJOR, a->d1, a->d2, mat_arr(a), a->d2, f->tau);
+    if (info != 0)
+    {
+        mat_qr_destruct(f);
+        return NULL;
+    }
+    return f;
+}
+
+void mat_qr_destruct(mat_qr *f)
+{
+    if (f)
+    {
+        mat_destruct(&f->qr);
+        free((void *)f->tau);
+        *f = mat_qr_NULL;
+    }
+}
+
+mat *mat_qr_solve(const mat_qr *f, mat *x, const mat *b)
+{
+    assert(f);
+    assert(mat_is_valid(&f->qr));
+    assert(mat_is_valid(x));
+    assert(mat_is_valid(b));
+    assert(f->qr.d1 >= f->qr.d2);
+    assert(b->d1 == f->qr.d1);
+    assert(x->d1 == f->qr.d2 && x->d2 == b->d2);
+
+    if (!mat_touch(x))
+        return NULL;
+    const IND_TYP m = f->qr.d1, n = f->qr.d2;
+
+    // c = Q^T b, then x = R^-1 c[:n]
+    mat c = mat_NULL;
+    mat_construct(&c, b->d1, b->d2);
+    if (mat_is_null(&c))
+        return NULL;
+    mat_assign(&c, b);
+    lapack_int info = ORMQR(LAPACK_ROW_MAJOR, 'L', 'T', m, c.d2, n,
+                            mat_arr(&f->qr), n, f->tau, mat_arr(&c), c.d2);
+    if (info == 0)
+    {
+        mat c_top = mat_NULL;
+        mat_construct_prealloc(&c_top, c.pyl, c.offset, n, c.d2);
+        mat_assign(x, &c_top);
+        mat_destruct(&c_top);
+        TRSM(CblasRowMajor, CblasLeft, CblasUpper, CblasNoTrans, CblasNonUnit,
+             n, x->d2, 1, mat_arr(&f->qr), n, mat_arr(x), x->d2);
+    }
+    mat_destruct(&c);
+
+    return (info == 0) ? x : NULL;
+}
+
+mat *mat_qr_q(const mat_qr *f, mat *q)
+{
+    assert(f);
+    assert(mat_is_valid(&f->qr));
+    assert(mat_is_valid(q));
+
+    if (!mat_touch(q))
+        return NULL;
+    const IND_TYP k = MIN(f->qr.d1, f->qr.d2);
+    assert(q->d1 == f->qr.d1 && q->d2 == k);
+
+    // Copy the first k columns of the Householder vectors, then expand them.
+    FLD_TYP *q_arr = mat_arr(q);
+    const FLD_TYP *f_arr = mat_arr(&f->qr);
+#pragma omp parallel for if (q->size >= PAR_MIN_SIZE)
+    for (IND_TYP i = 0; i < q->d1; i++)
+        for (IND_TYP j = 0; j < k; j++)
+            q_arr[i * k + j] = f_arr[i * f->qr.d2 + j];
+
+    lapack_int info = ORGQR(LAPACK_ROW_MAJOR, q->d1, k, k, q_arr, k, f->tau);
+    return (info == 0) ? q : NULL;
+}
+
+mat *mat_solve(mat *x, const mat *a, const mat *b)
+{
+    assert(mat_is_valid(x));
+    assert(mat_is_valid(a));
+    assert(mat_is_valid(b));
+    assert(a->d1 == a->d2);
+    assert(b->d1 == a->d1);
+    assert(x->d1 == b->d1 && x->d2 == b->d2);
+
+    if (!mat_touch(x))
+        return NULL;
+    mat a_cp = mat_NULL;
+    mat_construct(&a_cp, a->d1, a->d2);
+    if (mat_is_null(&a_cp))
+        return NULL;
+    mat_assign(&a_cp, a);
+    mat_assign(x, b);
+
+    mat_lu f;
+    mat *res = NULL;
+    if (mat_lu_construct(&f, &a_cp))
+        res = mat_lu_solve(&f, x);
+    mat_lu_destruct(&f);
+    mat_destruct(&a_cp);
+
+    return res;
+}
+
+mat *mat_lstsq(mat *x, const mat *a, const mat *b)
+{
+    assert(mat_is_valid(x));
+    assert(mat_is_valid(a));
+    assert(mat_is_valid(b));
+    assert(a->d1 >= a->d2);
+    assert(b->d1 == a->d1);
+    assert(x->d1 == a->d2 && x->d2 == b->d2);
+
+    if (!mat_touch(x))
+        return NULL;
+    mat a_cp = mat_NULL;
+    mat_construct(&a_cp, a->d1, a->d2);
+    if (mat_is_null(&a_cp))
+        return NULL;
+    mat_assign(&a_cp, a);
+
+    mat_qr f;
+    mat *res = NULL;
+    if (mat_qr_construct(&f, &a_cp))
+        res = mat_qr_solve(&f, x, b);
+    mat_qr_destruct(&f);
+    mat_destruct(&a_cp);
+
+    return res;
+}
@@ -0,0 +1,202 @@
+#include "mat_solve.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <omp.h>
+
+#ifndef SOLVE_BENCH_MAX_N
+#define SOLVE_BENCH_MAX_N 8192
+#endif
+
+static FLD_TYP rnd(void)
+{
+    return 2 * (rand() / (FLD_TYP)RAND_MAX) - 1;
+}
+
+// ||a @ x - b|| / ||b||
+static FLT_TYP residual(const mat *a, const mat *x, const mat *b)
+{
+    mat r = mat_NULL;
+    mat_construct(&r, b->d1, b->d2);
+    mat_dot(&r, a, x);
+    mat_subfrom(&r, b);
+    FLT_TYP res = mat_norm_2(&r) / mat_norm_2(b);
+    mat_destruct(&r);
+    return res;
+}
+
+// a = g @ g^T + n I : symmetric positive definite
+static mat *fill_spd(mat *a)
+{
+    mat g = mat_NULL;
+    mat g_t = mat_NULL;
+    mat_construct(&g, a->d1, a->d2);
+    mat_construct(&g_t, a->d2, a->d1);
+    mat_fill_rnd(&g, rnd);
+    mat_transpose(&g_t, &g);
+    mat_dot(a, &g, &g_t);
+    for (IND_TYP i = 0; i < a->d1; i++)
+        *mat_at(a, i, i) += a->d1;
+    mat_destruct(&g);
+    mat_destruct(&g_t);
+    return a;
+}
+
+static void solve_square_test(void)
+{
+    char buff[2048];
+    const IND_TYP n = 6, nrhs = 2;
+    mat a = mat_NULL, a_f = mat_NULL, b = mat_NULL, x = mat_NULL;
+    mat_construct(&a, n, n);
+    mat_construct(&a_f, n, n);
+    mat_construct(&b, n, nrhs);
+    mat_construct(&x, n, nrhs);
+    fill_spd(&a);
+    mat_fill_rnd(&b, rnd);
+
+    mat_solve(&x, &a, &b);
+    printf("x = a^-1 b:\n%s\n", mat_to_str(&x, buff));
+    printf("lu solve residual: %g\n", residual(&a, &x, &b));
+    assert(residual(&a, &x, &b) < 1E-4);
+
+    mat_assign(&a_f, &a);
+    mat_assign(&x, &b);
+    mat_cholesky ch;
+    mat_cholesky_construct(&ch, &a_f);
+    mat_cholesky_solve(&ch, &x);
+    mat_cholesky_destruct(&ch);
+    printf("cholesky solve residual: %g\n", residual(&a, &x, &b));
+    assert(residual(&a, &x, &b) < 1E-4);
+
+    // Not positive definite
+    mat_assign(&a_f, &a);
+    *mat_at(&a_f, 0, 0) = -1;
+    bool ok = mat_cholesky_construct(&ch, &a_f) != NULL;
+    printf("cholesky of not positive definite matrix: %s\n", ok ? "succeeded" : "failed");
+    assert(!ok);
+    mat_cholesky_destruct(&ch);
+
+    // Singular
+    mat_fill_zero(&a_f);
+    mat_lu lu;
+    ok = mat_lu_construct(&lu, &a_f) != NULL;
+    printf("lu of singular matrix: %s\n", ok ? "succeeded" : "failed");
+    assert(!ok);
+    mat_lu_destruct(&lu);
+
+    mat_destruct(&a);
+    mat_destruct(&a_f);
+    mat_destruct(&b);
+    mat_destruct(&x);
+    puts("------");
+}
+
+static void lstsq_test(void)
+{
+    const IND_TYP m = 20, n = 4, nrhs = 3;
+    mat a = mat_NULL, a_t = mat_NULL, b = mat_NULL, x = mat_NULL;
+    mat a_t_r = mat_NULL, r = mat_NULL, q = mat_NULL, q_t = mat_NULL, eye = mat_NULL;
+    mat_construct(&a, m, n);
+    mat_construct(&a_t, n, m);
+    mat_construct(&b, m, nrhs);
+    mat_construct(&x, n, nrhs);
+    mat_construct(&r, m, nrhs);
+    mat_construct(&a_t_r, n, nrhs);
+    mat_fill_rnd(&a, rnd);
+    mat_fill_rnd(&b, rnd);
+
+    mat_lstsq(&x, &a, &b);
+    // Normal equations: a^T (a x - b) = 0
+    mat_dot(&r, &a, &x);
+    mat_subfrom(&r, &b);
+    mat_transpose(&a_t, &a);
+    mat_dot(&a_t_r, &a_t, &r);
+    printf("lstsq ||a^T (a x - b)||: %g\n", mat_norm_2(&a_t_r));
+    assert(mat_norm_2(&a_t_r) < 1E-4);
+
+    // Q has orthonormal columns
+    mat_qr qr;
+    mat_assign(&r, &b);
+    mat_construct(&q, m, nrhs);
+    mat_construct(&q_t, nrhs, m);
+    mat_construct(&eye, nrhs, nrhs);
+    mat_qr_construct(&qr, &r);
+    mat_qr_q(&qr, &q);
+    mat_qr_destruct(&qr);
+    mat_transpose(&q_t, &q);
+    mat_dot(&eye, &q_t, &q);
+    for (IND_TYP i = 0; i < nrhs; i++)
+        *mat_at(&eye, i, i) -= 1;
+    printf("||q^T q - I||: %g\n", mat_norm_2(&eye));
+    assert(mat_norm_2(&eye) < 1E-5);
+
+    mat *all[] = {&a, &a_t, &b, &x, &a_t_r, &r, &q, &q_t, &eye};
+    for (int i = 0; i < 9; i++)
+        mat_destruct(all[i]);
+    puts("------");
+}
+
+void mat_solve_test(void)
+{
+    puts("+++ mat_solve_test +++");
+
+    solve_square_test();
+    lstsq_test();
+
+    puts("^^^ mat_solve_test ^^^");
+}
+
+void mat_solve_bench(void)
+{
+    puts("+++ mat_solve_bench +++");
+
+    const IND_TYP nrhs = 16;
+    for (IND_TYP n = 64; n <= SOLVE_BENCH_MAX_N; n *= 2)
+    {
+        mat a = mat_NULL, a_f = mat_NULL, b = mat_NULL, x = mat_NULL;
+        mat_construct(&a, n, n);
+        mat_construct(&a_f, n, n);
+        mat_construct(&b, n, nrhs);
+        mat_construct(&x, n, nrhs);
+        fill_spd(&a);
+        mat_fill_rnd(&b, rnd);
+        const double gflop = 1E-9 * n * n * n;
+
+        mat_assign(&a_f, &a);
+        mat_assign(&x, &b);
+        double t0 = omp_get_wtime();
+        mat_lu lu;
+        mat_lu_construct(&lu, &a_f);
+        mat_lu_solve(&lu, &x);
+        mat_lu_destruct(&lu);
+        double lu_elp = omp_get_wtime() - t0;
+
+        mat_assign(&a_f, &a);
+        mat_assign(&x, &b);
+        t0 = omp_get_wtime();
+        mat_cholesky ch;
+        mat_cholesky_construct(&ch, &a_f);
+        mat_cholesky_solve(&ch, &x);
+        mat_cholesky_destruct(&ch);
+        double ch_elp = omp_get_wtime() - t0;
+
+        mat_assign(&a_f, &a);
+        t0 = omp_get_wtime();
+        mat_qr qr;
+        mat_qr_construct(&qr, &a_f);
+        mat_qr_solve(&qr, &x, &b);
+        mat_qr_destruct(&qr);
+        double qr_elp = omp_get_wtime() - t0;
+
+        printf("n=%5ld LU: %8.4f s %6.1f GFLOP/s | Cholesky: %8.4f s %6.1f GFLOP/s | QR: %8.4f s %6.1f GFLOP/s\n",
+               n, lu_elp, 2 * gflop / 3 / lu_elp, ch_elp, gflop / 3 / ch_elp, qr_elp, 4 * gflop / 3 / qr_elp);
+
+        mat_destruct(&a);
+        mat_destruct(&a_f);
+        mat_destruct(&b);
+        mat_destruct(&x);
+    }
+
+    puts("^^^ mat_solve_bench ^^^");
+}
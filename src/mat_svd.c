@@ -0,0 +1,282 @@
+#include "mat_svd.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <tgmath.h>
+
+#include "vector_eng.h"
+#include "vec_mat.h"
+#include "mat_solve.h"
+
+#define MIN(x, y) (((x) <= (y)) ? (x) : (y))
+
+static inline FLD_TYP *mat_arr(const mat *m)
+{
+    return m->pyl->arr + m->offset;
+}
+
+// Uniform in [-1, 1), xorshift64*; fixed seed per thread so results are reproducible
+static _Thread_local uint64_t rnd_state;
+
+static FLD_TYP rnd_sketch(void)
+{
+    rnd_state ^= rnd_state >> 12;
+    rnd_state ^= rnd_state << 25;
+    rnd_state ^= rnd_state >> 27;
+    return (FLD_TYP)((rnd_state * 0x2545F4914F6CDD1DULL) >> 11) * (FLD_TYP)0x1p-52 - 1;
+}
+
+static const mat *whole_src(IND_TYP i, void *a)
+{
+    return (i == 0) ? (const mat *)a : NULL;
+}
+
+// cs += column sums of m
+static void add_col_sums(vec *cs, const mat *m)
+{
+    FLD_TYP *cs_arr = cs->pyl->arr + cs->offset;
+    const FLD_TYP *m_arr = mat_arr(m);
+    for (IND_TYP r = 0; r < m->d1; r++)
+    {
+        const FLD_TYP *row = m_arr + r * m->d2;
+#pragma omp simd
+        for (IND_TYP j = 0; j < m->d2; j++)
+            cs_arr[j * cs->step] += row[j];
+    }
+}
+
+// One pass over the blocks with t = a_b q (+ t_shift on every row, if not NULL):
+// out = sum_b a_b^T t (n x l), or with gram out = sum_b t^T t (l x l).
+// col_sum and t_sum (may be NULL) get the column sums of a and t.
+// t_buf is grown to the largest block; returns the number of rows, -1 on failure.
+static IND_TYP blk_pass(mat *out, bool gram, const mat *q, const vec *t_shift, vec *col_sum, vec *t_sum,
+                        mat_blk_src src, void *ctx, mat *t_buf)
+{
+    const IND_TYP l = q->d2;
+    mat_fill_zero(out);
+    if (col_sum)
+        vec_fill_zero(col_sum);
+    if (t_sum)
+        vec_fill_zero(t_sum);
+
+    IND_TYP m = 0;
+    const mat *blk;
+    for (IND_TYP i = 0; (blk = src(i, ctx)); i++)
+    {
+        assert(mat_is_valid(blk));
+        assert(blk->d2 == q->d1);
+        if (mat_is_null(t_buf) || (size_t)(blk->d1 * l) > t_buf->pyl->size)
+        {
+            mat_destruct(t_buf);
+            mat_construct(t_buf, blk->d1, l);
+            if (mat_is_null(t_buf))
+                return -1;
+        }
+        mat t = mat_NULL;
+        mat_construct_prealloc(&t, t_buf->pyl, 0, blk->d1, l);
+        mat_dot(&t, blk, q);
+        if (t_shift)
+            mat_addto_row_vec(&t, t_shift);
+        if (gram)
+            mat_update_gram(out, 1, &t);
+        else
+            mat_update_outer_batch(out, 1, blk, &t);
+        if (t_sum)
+            add_col_sums(t_sum, &t);
+        if (col_sum)
+            add_col_sums(col_sum, blk);
+        mat_destruct(&t);
+        m += blk->d1;
+    }
+    return m;
+}
+
+// Top k right singular vectors and values of the (centered if mean) block stream.
+// mean is n elements; NULL for no centering. Returns the number of rows, -1 on failure.
+static IND_TYP rsvd_core(vec *s, mat *vt, vec *mean, mat_blk_src src, void *ctx, IND_TYP n,
+                         IND_TYP k, IND_TYP oversample, IND_TYP power_iters)
+{
+    assert(src);
+    assert(n > 0);
+    assert(k > 0 && k <= n);
+    assert(oversample >= 0);
+    assert(power_iters >= 0);
+    assert(vec_is_valid(s) && s->d == k);
+    assert(mat_is_valid(vt) && vt->d1 == k && vt->d2 == n);
+    assert(!mean || (vec_is_valid(mean) && mean->d == n));
+
+    if (!vec_touch(s) || !mat_touch(vt) || (mean && !vec_touch(mean)))
+        return -1;
+    const IND_TYP l = MIN(k + oversample, n);
+    mat q = mat_NULL, g = mat_NULL, c = mat_NULL, v = mat_NULL, t_buf = mat_NULL;
+    vec qm = vec_NULL, t_sum = vec_NULL, lam = vec_NULL;
+    mat_construct(&q, n, l);
+    mat_construct(&g, n, l);
+    mat_construct(&c, l, l);
+    mat_construct(&v, n, l);
+    vec_construct(&qm, l);
+    vec_construct(&t_sum, l);
+    vec_construct(&lam, l);
+
+    IND_TYP m = -1;
+    if (mat_is_null(&q) || mat_is_null(&g) || mat_is_null(&c) || mat_is_null(&v) ||
+        vec_is_null(&qm) || vec_is_null(&t_sum) || vec_is_null(&lam))
+        goto end;
+
+    rnd_state = 0x9E3779B97F4A7C15ULL;
+    mat_fill_rnd(&q, rnd_sketch);
+
+    // Subspace iteration: q = orth(A^T A q), the first pass starting from the sketch.
+    // With centering, the first pass corrects A^T A q by the rank-one mean term; once the
+    // mean is known, a_b q is centered on the fly, which avoids the cancellation.
+    for (IND_TYP p = 0; p <= power_iters; p++)
+    {
+        const bool shift = mean && p > 0;
+        if (shift)
+        {
+            vec_dot_mat(&qm, mean, &q);
+            vec_scale(&qm, -1);
+        }
+        IND_TYP rows = blk_pass(&g, false, &q, shift ? &qm : NULL, (mean && p == 0) ? mean : NULL,
+                                shift ? &t_sum : NULL, src, ctx, &t_buf);
+        if (rows <= 0 || (p > 0 && rows != m))
+        {
+            m = -1;
+            goto end;
+        }
+        m = rows;
+        if (mean && p == 0)
+        {
+            vec_scale(mean, (FLD_TYP)1 / m);
+            // (A - 1 mean^T)^T (A - 1 mean^T) q = A^T A q - m mean (q^T mean)^T
+            vec_dot_mat(&qm, mean, &q);
+            mat_update_outer(&g, -m, mean, &qm);
+        }
+        else if (shift)
+            // (A - 1 mean^T)^T t = A^T t - mean (1^T t)
+            mat_update_outer(&g, -1, mean, &t_sum);
+        mat_qr f;
+        bool ok = mat_qr_construct(&f, &g) && mat_qr_q(&f, &q);
+        mat_qr_destruct(&f);
+        if (!ok)
+        {
+            m = -1;
+            goto end;
+        }
+    }
+
+    // Rayleigh-Ritz on span(q): c = (A q)^T (A q) = w diag(lam) w^T
+    if (mean)
+    {
+        vec_dot_mat(&qm, mean, &q);
+        vec_scale(&qm, -1);
+    }
+    if (blk_pass(&c, true, &q, mean ? &qm : NULL, NULL, NULL, src, ctx, &t_buf) != m)
+    {
+        m = -1;
+        goto end;
+    }
+    if (SYEVD(LAPACK_ROW_MAJOR, 'V', 'U', l, mat_arr(&c), l, lam.pyl->arr + lam.offset) != 0)
+    {
+        m = -1;
+        goto end;
+    }
+    mat_dot(&v, &q, &c);
+
+    // Eigenvalues are ascending; the top k come last.
+    for (IND_TYP i = 0; i < k; i++)
+    {
+        const IND_TYP j = l - 1 - i;
+        const FLD_TYP lam_j = *vec_at(&lam, j);
+        *vec_at(s, i) = (lam_j > 0) ? sqrt(lam_j) : 0;
+        FLD_TYP *vt_row = mat_at(vt, i, 0);
+        const FLD_TYP *v_arr = mat_arr(&v);
+        for (IND_TYP r = 0; r < n; r++)
+            vt_row[r] = v_arr[r * l + j];
+    }
+
+end:
+    mat_destruct(&q);
+    mat_destruct(&g);
+    mat_destruct(&c);
+    mat_destruct(&v);
+    mat_destruct(&t_buf);
+    vec_destruct(&qm);
+    vec_destruct(&t_sum);
+    vec_destruct(&lam);
+    return m;
+}
+
+mat *mat_rsvd(mat *u, vec *s, mat *vt, const mat *a, IND_TYP k, IND_TYP oversample, IND_TYP power_iters)
+{
+    assert(mat_is_valid(a));
+    assert(!u || (mat_is_valid(u) && u->d1 == a->d1 && u->d2 == k));
+
+    if (rsvd_core(s, vt, NULL, whole_src, (void *)a, a->d2, k, oversample, power_iters) < 0)
+        return NULL;
+    if (!u)
+        return vt;
+
+    // u = a vt^T diag(s)^-1
+    mat v = mat_NULL;
+    vec s_inv = vec_NULL;
+    mat_construct(&v, vt->d2, vt->d1);
+    vec_construct(&s_inv, k);
+    if (mat_is_null(&v) || vec_is_null(&s_inv))
+    {
+        mat_destruct(&v);
+        vec_destruct(&s_inv);
+        return NULL;
+    }
+    mat_transpose(&v, vt);
+    mat_dot(u, a, &v);
+    for (IND_TYP i = 0; i < k; i++)
+    {
+        const FLD_TYP s_i = *vec_at(s, i);
+        *vec_at(&s_inv, i) = (s_i > 0) ? 1 / s_i : 0;
+    }
+    mat_mulby_row_vec(u, &s_inv);
+    mat_destruct(&v);
+    vec_destruct(&s_inv);
+
+    return vt;
+}
+
+IND_TYP mat_rsvd_stream(vec *s, mat *vt, mat_blk_src src, void *ctx, IND_TYP n,
+                        IND_TYP k, IND_TYP oversample, IND_TYP power_iters)
+{
+    return rsvd_core(s, vt, NULL, src, ctx, n, k, oversample, power_iters);
+}
+
+IND_TYP mat_pca_stream(mat *comps, vec *var, vec *mean, mat_blk_src src, void *ctx, IND_TYP n,
+                       IND_TYP k, IND_TYP oversample, IND_TYP power_iters)
+{
+    vec mean_buf = vec_NULL;
+    if (!mean)
+    {
+        mean = vec_construct(&mean_buf, n);
+        if (vec_is_null(mean))
+            return -1;
+    }
+
+    IND_TYP m = rsvd_core(var, comps, mean, src, ctx, n, k, oversample, power_iters);
+    if (m > 0)
+    {
+        // Singular values to sample variances
+        vec_square(var, var);
+        vec_scale(var, (FLD_TYP)1 / ((m > 1) ? m - 1 : 1));
+    }
+    vec_destruct(&mean_buf);
+
+    return m;
+}
+
+mat *mat_pca(mat *comps, vec *var, vec *mean, const mat *a, IND_TYP k, IND_TYP oversample, IND_TYP power_iters)
+{
+    assert(mat_is_valid(a));
+
+    return (mat_pca_stream(comps, var, mean, whole_src, (void *)a, a->d2, k, oversample, power_iters) < 0)
+               ? NULL
+               : comps;
+}
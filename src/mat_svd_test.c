@@ -0,0 +1,244 @@
+#include "mat_svd.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <tgmath.h>
+#include <omp.h>
+
+#include "vec_mat.h"
+#include "mat_solve.h"
+
+#ifndef SVD_BENCH_ROWS
+#define SVD_BENCH_ROWS (1 << 20)
+#endif
+
+static FLD_TYP rnd(void)
+{
+    return 2 * (rand() / (FLD_TYP)RAND_MAX) - 1;
+}
+
+// q (d1 x d2, d1 >= d2) with random orthonormal columns
+static mat *fill_orth(mat *q)
+{
+    mat g = mat_NULL;
+    mat_construct(&g, q->d1, q->d2);
+    mat_fill_rnd(&g, rnd);
+    mat_qr f;
+    mat_qr_construct(&f, &g);
+    mat_qr_q(&f, q);
+    mat_qr_destruct(&f);
+    mat_destruct(&g);
+    return q;
+}
+
+// a = x diag(sigma) y^T with sigma_i = 2^-i * 100
+static mat *fill_low_rank(mat *a, IND_TYP r)
+{
+    mat x = mat_NULL, y = mat_NULL, y_t = mat_NULL;
+    vec sigma = vec_NULL;
+    mat_construct(&x, a->d1, r);
+    mat_construct(&y, a->d2, r);
+    mat_construct(&y_t, r, a->d2);
+    vec_construct(&sigma, r);
+    fill_orth(&x);
+    fill_orth(&y);
+    for (IND_TYP i = 0; i < r; i++)
+        *vec_at(&sigma, i) = 100 * pow(2, -(FLD_TYP)i);
+    mat_mulby_row_vec(&x, &sigma);
+    mat_transpose(&y_t, &y);
+    mat_dot(a, &x, &y_t);
+    mat_destruct(&x);
+    mat_destruct(&y);
+    mat_destruct(&y_t);
+    vec_destruct(&sigma);
+    return a;
+}
+
+// Row blocks of a resident mat, blk_rows each (the last one may be shorter)
+typedef struct blk_ctx
+{
+    mat *a;
+    IND_TYP blk_rows;
+    mat blk;
+} blk_ctx;
+
+static const mat *blk_src(IND_TYP i, void *ctx)
+{
+    blk_ctx *c = (blk_ctx *)ctx;
+    mat_destruct(&c->blk);
+    const IND_TYP start = i * c->blk_rows;
+    if (start >= c->a->d1)
+        return NULL;
+    const IND_TYP rows = (start + c->blk_rows <= c->a->d1) ? c->blk_rows : c->a->d1 - start;
+    return mat_construct_prealloc(&c->blk, c->a->pyl, c->a->offset + start * c->a->d2, rows, c->a->d2);
+}
+
+static void rsvd_test(void)
+{
+    const IND_TYP m = 1000, n = 60, r = 6, k = 4;
+    mat a = mat_NULL, u = mat_NULL, vt = mat_NULL, vt_s = mat_NULL, a_k = mat_NULL, us = mat_NULL;
+    vec s = vec_NULL, s_s = vec_NULL;
+    mat_construct(&a, m, n);
+    mat_construct(&u, m, k);
+    mat_construct(&vt, k, n);
+    mat_construct(&vt_s, k, n);
+    mat_construct(&a_k, m, n);
+    mat_construct(&us, m, k);
+    vec_construct(&s, k);
+    vec_construct(&s_s, k);
+    fill_low_rank(&a, r);
+
+    mat_rsvd(&u, &s, &vt, &a, k, 8, 1);
+    FLT_TYP s_err = 0;
+    for (IND_TYP i = 0; i < k; i++)
+        s_err = fmax(s_err, fabs(*vec_at(&s, i) - 100 * pow(2, -(FLD_TYP)i)) / *vec_at(&s, i));
+    printf("rsvd singular values max rel err: %g\n", s_err);
+    assert(s_err < 1E-3);
+
+    // ||a - u s vt|| equals the norm of the truncated tail
+    mat_assign(&us, &u);
+    mat_mulby_row_vec(&us, &s);
+    mat_dot(&a_k, &us, &vt);
+    mat_subfrom(&a_k, &a);
+    FLT_TYP tail = 0;
+    for (IND_TYP i = k; i < r; i++)
+        tail += pow(100 * pow(2, -(FLT_TYP)i), 2);
+    FLT_TYP rec_err = fabs(mat_norm_2(&a_k) - sqrt(tail)) / sqrt(tail);
+    printf("rsvd truncation error vs tail: %g\n", rec_err);
+    assert(rec_err < 1E-2);
+
+    // Streaming in uneven blocks gives the same result
+    blk_ctx ctx = {.a = &a, .blk_rows = 170, .blk = mat_NULL};
+    IND_TYP rows = mat_rsvd_stream(&s_s, &vt_s, blk_src, &ctx, n, k, 8, 1);
+    FLT_TYP st_err = 0;
+    for (IND_TYP i = 0; i < k; i++)
+    {
+        st_err = fmax(st_err, fabs(*vec_at(&s_s, i) - *vec_at(&s, i)) / *vec_at(&s, i));
+        FLD_TYP d = 0;
+        for (IND_TYP j = 0; j < n; j++)
+            d += *mat_at(&vt, i, j) * *mat_at(&vt_s, i, j);
+        st_err = fmax(st_err, 1 - fabs(d));
+    }
+    printf("rsvd stream rows: %ld, max diff to in-memory: %g\n", rows, st_err);
+    assert(rows == m && st_err < 1E-3);
+
+    mat *all_m[] = {&a, &u, &vt, &vt_s, &a_k, &us};
+    for (int i = 0; i < 6; i++)
+        mat_destruct(all_m[i]);
+    vec_destruct(&s);
+    vec_destruct(&s_s);
+    puts("------");
+}
+
+static void pca_test(void)
+{
+    const IND_TYP m = 800, n = 40, r = 5, k = 3;
+    mat a = mat_NULL, a_c = mat_NULL, comps = mat_NULL, vt = mat_NULL;
+    vec mean = vec_NULL, var = vec_NULL, s = vec_NULL, shift = vec_NULL;
+    mat_construct(&a, m, n);
+    mat_construct(&a_c, m, n);
+    mat_construct(&comps, k, n);
+    mat_construct(&vt, k, n);
+    vec_construct(&mean, n);
+    vec_construct(&var, k);
+    vec_construct(&s, k);
+    vec_construct(&shift, n);
+    fill_low_rank(&a_c, r);
+    // Center a_c explicitly, then shift it to get a
+    for (IND_TYP j = 0; j < n; j++)
+    {
+        FLD_TYP cm = 0;
+        for (IND_TYP i = 0; i < m; i++)
+            cm += *mat_at(&a_c, i, j);
+        *vec_at(&shift, j) = -cm / m;
+    }
+    mat_addto_row_vec(&a_c, &shift);
+    vec_fill_rnd(&shift, rnd);
+    vec_scale(&shift, 50);
+    mat_add_row_vec(&a, &a_c, &shift);
+
+    mat_pca(&comps, &var, &mean, &a, k, 8, 1);
+    mat_rsvd(NULL, &s, &vt, &a_c, k, 8, 1);
+
+    FLT_TYP mean_err = 0;
+    for (IND_TYP j = 0; j < n; j++)
+        mean_err = fmax(mean_err, fabs(*vec_at(&mean, j) - *vec_at(&shift, j)));
+    FLT_TYP var_err = 0, comp_err = 0;
+    for (IND_TYP i = 0; i < k; i++)
+    {
+        const FLD_TYP s_i = *vec_at(&s, i);
+        var_err = fmax(var_err, fabs(*vec_at(&var, i) - s_i * s_i / (m - 1)) / *vec_at(&var, i));
+        FLD_TYP d = 0;
+        for (IND_TYP j = 0; j < n; j++)
+            d += *mat_at(&comps, i, j) * *mat_at(&vt, i, j);
+        comp_err = fmax(comp_err, 1 - fabs(d));
+    }
+    printf("pca mean err: %g, variance rel err: %g, component err: %g\n", mean_err, var_err, comp_err);
+    assert(mean_err < 1E-3 && var_err < 1E-3 && comp_err < 1E-3);
+
+    mat *all_m[] = {&a, &a_c, &comps, &vt};
+    for (int i = 0; i < 4; i++)
+        mat_destruct(all_m[i]);
+    vec *all_v[] = {&mean, &var, &s, &shift};
+    for (int i = 0; i < 4; i++)
+        vec_destruct(all_v[i]);
+    puts("------");
+}
+
+void mat_svd_test(void)
+{
+    puts("+++ mat_svd_test +++");
+
+    rsvd_test();
+    pca_test();
+
+    puts("^^^ mat_svd_test ^^^");
+}
+
+// Cycles over a pool of resident blocks to emulate a long stream
+typedef struct pool_ctx
+{
+    mat *pool;
+    IND_TYP n_pool;
+    IND_TYP n_blk;
+} pool_ctx;
+
+static const mat *pool_src(IND_TYP i, void *ctx)
+{
+    pool_ctx *c = (pool_ctx *)ctx;
+    return (i < c->n_blk) ? &c->pool[i % c->n_pool] : NULL;
+}
+
+void mat_svd_bench(void)
+{
+    puts("+++ mat_svd_bench +++");
+
+    const IND_TYP n = 512, blk_rows = 8192, k = 16, oversample = 8, power_iters = 1;
+    mat pool[4];
+    for (int i = 0; i < 4; i++)
+    {
+        pool[i] = mat_NULL;
+        mat_construct(&pool[i], blk_rows, n);
+        mat_fill_rnd(&pool[i], rnd);
+    }
+    pool_ctx ctx = {.pool = pool, .n_pool = 4, .n_blk = SVD_BENCH_ROWS / blk_rows};
+    mat comps = mat_NULL;
+    vec var = vec_NULL;
+    mat_construct(&comps, k, n);
+    vec_construct(&var, k);
+
+    double t0 = omp_get_wtime();
+    IND_TYP rows = mat_pca_stream(&comps, &var, NULL, pool_src, &ctx, n, k, oversample, power_iters);
+    double elp = omp_get_wtime() - t0;
+    const IND_TYP passes = power_iters + 2;
+    printf("pca %ldx%ld k=%ld, %ld passes: %g s, %.3g rows/s (%.3g rows/s per pass)\n",
+           rows, n, k, passes, elp, rows / elp, passes * rows / elp);
+
+    for (int i = 0; i < 4; i++)
+        mat_destruct(&pool[i]);
+    mat_destruct(&comps);
+    vec_destruct(&var);
+
+    puts("^^^ mat_svd_bench ^^^");
+}
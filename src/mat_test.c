@@ -1,8 +1,10 @@
 #include "mat.h"
+#include "vec.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include <math.h>
 #include <assert.h>
 
 
@@ -99,6 +101,255 @@ void mat_dot_test(void)
     puts("------");
 }
 
+static FLD_TYP rnd(void)
+{
+    return 2 * (rand() / (FLD_TYP)RAND_MAX) - 1;
+}
+
+// softmax(scale * q @ k^T) @ v for one head, materializing the scores
+static mat *attention_naive(mat *out, const mat *q, const mat *k, const mat *v, FLD_TYP scale, bool causal)
+{
+    mat k_t = mat_NULL;
+    mat s = mat_NULL;
+    mat_construct(&k_t, k->d2, k->d1);
+    mat_construct(&s, q->d1, k->d1);
+    mat_transpose(&k_t, k);
+    mat_scale(mat_dot(&s, q, &k_t), scale);
+    for (IND_TYP i = 0; i < s.d1; i++)
+    {
+        FLD_TYP mx = -INFINITY, sum = 0;
+        for (IND_TYP j = 0; j < s.d2; j++)
+            if (!causal || j <= i + k->d1 - q->d1)
+                mx = fmax(mx, *mat_at(&s, i, j));
+        for (IND_TYP j = 0; j < s.d2; j++)
+        {
+            FLD_TYP *s_ij = mat_at(&s, i, j);
+            *s_ij = (!causal || j <= i + k->d1 - q->d1) ? exp(*s_ij - mx) : 0;
+            sum += *s_ij;
+        }
+        for (IND_TYP j = 0; j < s.d2; j++)
+            *mat_at(&s, i, j) /= sum;
+    }
+    mat_dot(out, &s, v);
+    mat_destruct(&k_t);
+    mat_destruct(&s);
+    return out;
+}
+
+void mat_attention_test(void)
+{
+    const IND_TYP l_q = 70, l_k = 150, d_k = 8, d_v = 5, n_heads = 2;
+    mat q = mat_NULL, k = mat_NULL, v = mat_NULL, out = mat_NULL;
+    mat q_h = mat_NULL, k_h = mat_NULL, v_h = mat_NULL, ref = mat_NULL;
+    mat_construct(&q, l_q, n_heads * d_k);
+    mat_construct(&k, l_k, n_heads * d_k);
+    mat_construct(&v, l_k, n_heads * d_v);
+    mat_construct(&out, l_q, n_heads * d_v);
+    mat_construct(&q_h, l_q, d_k);
+    mat_construct(&k_h, l_k, d_k);
+    mat_construct(&v_h, l_k, d_v);
+    mat_construct(&ref, l_q, d_v);
+    mat_fill_rnd(&q, rnd);
+    mat_fill_rnd(&k, rnd);
+    mat_fill_rnd(&v, rnd);
+    mat_scale(&q, 4);
+
+    for (int causal = 0; causal < 2; causal++)
+    {
+        mat_attention_heads(&out, &q, &k, &v, n_heads, 1 / sqrt(d_k), causal);
+        for (IND_TYP h = 0; h < n_heads; h++)
+        {
+            for (IND_TYP i = 0; i < l_q; i++)
+                for (IND_TYP c = 0; c < d_k; c++)
+                    *mat_at(&q_h, i, c) = *mat_at(&q, i, h * d_k + c);
+            for (IND_TYP j = 0; j < l_k; j++)
+            {
+                for (IND_TYP c = 0; c < d_k; c++)
+                    *mat_at(&k_h, j, c) = *mat_at(&k, j, h * d_k + c);
+                for (IND_TYP c = 0; c < d_v; c++)
+                    *mat_at(&v_h, j, c) = *mat_at(&v, j, h * d_v + c);
+            }
+            attention_naive(&ref, &q_h, &k_h, &v_h, 1 / sqrt(d_k), causal);
+            FLD_TYP err = 0;
+            for (IND_TYP i = 0; i < l_q; i++)
+                for (IND_TYP c = 0; c < d_v; c++)
+                    err = fmax(err, fabs(*mat_at(&ref, i, c) - *mat_at(&out, i, h * d_v + c)));
+            printf("attention causal=%d head %ld: max |tiled - naive|: %g\n", causal, h, err);
+            assert(err < 1E-5);
+        }
+    }
+
+    mat *all[] = {&q, &k, &v, &out, &q_h, &k_h, &v_h, &ref};
+    for (int a = 0; a < 8; a++)
+        mat_destruct(all[a]);
+    puts("------");
+}
+
+static FLD_TYP rnd_unit(void)
+{
+    return 2 * (rand() / (FLD_TYP)RAND_MAX) - 1;
+}
+
+void mat_is_close_test(void)
+{
+    const IND_TYP d1 = 1000, d2 = 1000;
+    const int reps = 20;
+    mat a = mat_NULL, b = mat_NULL;
+    mat_construct(&a, d1, d2);
+    mat_construct(&b, d1, d2);
+    mat_fill_rnd(&a, rnd_unit);
+    mat_assign(&b, &a);
+    *mat_at(&b, d1 - 1, d2 - 1) += 1E-2;
+
+    bool close = mat_is_close(&a, &b, 1E-4), all = mat_allclose(&a, &b, 1E-3, 0);
+    printf("mat_is_close: %d, mat_allclose(1E-3, 0): %d\n", close, all);
+    assert(close && !all);
+
+    clock_t start = clock();
+    for (int r = 0; r < reps; r++)
+        close = mat_is_close(&a, &b, 1E-4) && close;
+    double is_close_t = (clock() - start) / (double)CLOCKS_PER_SEC / reps;
+    start = clock();
+    for (int r = 0; r < reps; r++)
+        all = mat_allclose(&a, &a, 0, 0) && all;
+    double allclose_t = (clock() - start) / (double)CLOCKS_PER_SEC / reps;
+    printf("%ldx%ld mat_is_close: %g s, mat_allclose: %g s\n", d1, d2, is_close_t, allclose_t);
+
+    mat_destruct(&a);
+    mat_destruct(&b);
+    puts("------");
+}
+
+void mat_cow_test(void)
+{
+    const IND_TYP d1 = 1000, d2 = 1000;
+    mat a = mat_NULL, b = mat_NULL, c = mat_NULL, snap = mat_NULL, row = mat_NULL;
+    mat_construct(&a, d1, d2);
+    mat_fill_rnd(&a, rnd_unit);
+    mat_construct(&snap, d1, d2);
+    mat_assign(&snap, &a);
+
+    // A clone shares storage; the source keeps training, the clone keeps the snapshot
+    clock_t start = clock();
+    mat_clone(&b, &a);
+    double clone_t = (clock() - start) / (double)CLOCKS_PER_SEC;
+    const bool shared = b.pyl != a.pyl && b.pyl->arr == a.pyl->arr;
+    mat_construct_prealloc(&row, a.pyl, 3 * d2, 1, d2);
+    mat_scale(&a, 2);
+    const bool a_own = a.pyl->arr != b.pyl->arr && !a.pyl->cow_ref && *b.pyl->cow_ref == 1;
+    const bool b_snap = mat_allclose(&b, &snap, 0, 0);
+    const bool row_follows = *mat_at(&row, 0, 0) == 2 * *mat_at(&snap, 3, 0);
+    printf("mat_clone shared: %d, source owns after write: %d, clone kept: %d, view follows source: %d\n",
+           shared, a_own, b_snap, row_follows);
+    assert(shared && a_own && b_snap && row_follows);
+
+    // A clone of a clone; the clone writes, the others stay; destructed before the source
+    mat_clone(&c, &b);
+    mat_clone(&a, &b);
+    const bool three = *b.pyl->cow_ref == 3;
+    mat_f_addto(&c, 1);
+    *mat_touch(&a)->pyl->arr = 7;
+    const bool c_own = c.pyl->arr != b.pyl->arr && *mat_at(&c, 0, 0) == *mat_at(&snap, 0, 0) + 1;
+    const bool b_kept = mat_allclose(&b, &snap, 0, 0) && *mat_at(&a, 0, 0) == 7 && *b.pyl->cow_ref == 1;
+    mat_destruct(&c);
+    mat_destruct(&b);
+    const bool a_kept = *mat_at(&a, 0, 1) == *mat_at(&snap, 0, 1);
+    printf("three sharing: %d, clone write copies: %d, source kept: %d, last one left: %d\n", three, c_own,
+           b_kept, a_kept);
+    assert(three && c_own && b_kept && a_kept);
+
+    start = clock();
+    mat_assign(&snap, &a);
+    double assign_t = (clock() - start) / (double)CLOCKS_PER_SEC;
+    printf("%ldx%ld snapshot by mat_clone: %g s, by mat_assign: %g s\n", d1, d2, clone_t, assign_t);
+
+    // A strided vec clone keeps its view of the shared payload
+    vec v = vec_NULL, v_c = vec_NULL;
+    vec_construct_prealloc(&v, a.pyl, 5, 10, d2);
+    vec_clone(&v_c, &v);
+    const FLD_TYP x = *vec_at(&v, 1);
+    vec_fill(&v, 0);
+    const bool ok_vec = v_c.d == v.d && *vec_at(&v_c, 1) == x && x != 0 && *vec_at(&v, 1) == 0;
+    printf("vec_clone d=%ld, kept after vec_fill on the source: %d\n", v_c.d, ok_vec);
+    assert(ok_vec);
+
+    // Clones written and released on other threads while the source is written
+    mat w = mat_NULL;
+    mat_construct(&w, 64, 64);
+    mat_fill_zero(&w);
+    for (int r = 0; r < 200; r++)
+    {
+        mat s[8];
+        for (int k = 0; k < 8; k++)
+        {
+            s[k] = mat_NULL;
+            mat_clone(&s[k], &w);
+        }
+#pragma omp parallel for schedule(dynamic, 1)
+        for (int k = 0; k < 9; k++)
+        {
+            if (k == 8)
+                mat_f_addto(&w, 1);
+            else
+            {
+                if (k % 2)
+                    mat_f_addto(&s[k], -1);
+                mat_destruct(&s[k]);
+            }
+        }
+    }
+    const bool ok_thr = (!w.pyl->cow_ref || *w.pyl->cow_ref == 1) && *mat_at(&w, 0, 0) == 200 &&
+                        *mat_at(&w, 63, 63) == 200;
+    printf("clones released on other threads, source written 200 times: %g, %d\n", *mat_at(&w, 0, 0), ok_thr);
+    assert(ok_thr);
+
+    mat_destruct(&w);
+    vec_destruct(&v);
+    vec_destruct(&v_c);
+    mat_destruct(&row);
+    mat_destruct(&a);
+    mat_destruct(&snap);
+    puts("------");
+}
+
+void mat_append_rows_test(void)
+{
+    // A streaming collector: rows arrive in small batches
+    const IND_TYP d2 = 64, batch = 4, n_batch = 20000;
+    mat m = mat_NULL, rows = mat_NULL, first = mat_NULL;
+    mat_construct(&rows, batch, d2);
+    const FLD_TYP *arr = NULL;
+    int n_move = 0;
+    clock_t start = clock();
+    for (IND_TYP b = 0; b < n_batch; b++)
+    {
+        mat_fill_zero(&rows);
+        mat_f_addto(&rows, (FLD_TYP)b);
+        mat_append_rows(&m, &rows);
+        n_move += m.pyl->arr != arr;
+        arr = m.pyl->arr;
+        if (b == 0)
+            mat_construct_prealloc(&first, m.pyl, 0, batch, d2);
+    }
+    double append_t = (clock() - start) / (double)CLOCKS_PER_SEC;
+    const bool ok = m.d1 == batch * n_batch && m.d2 == d2 && *mat_at(&m, batch * n_batch - 1, d2 - 1) == n_batch - 1 &&
+                    *mat_at(&m, batch * 7, 3) == 7 && *mat_at(&first, batch - 1, 0) == 0 && first.pyl == m.pyl;
+    printf("mat_append_rows %ld x (%ldx%ld): %g s, %d reallocations, rows in order and view kept: %d\n", n_batch,
+           batch, d2, append_t, n_move, ok);
+    assert(ok && n_move <= 25);
+
+    // Appending m to itself doubles it
+    mat_append_rows(&m, &m);
+    const bool ok_self = m.d1 == 2 * batch * n_batch && *mat_at(&m, batch * n_batch + batch * 7, 3) == 7;
+    printf("self append: %d\n", ok_self);
+    assert(ok_self);
+
+    mat_destruct(&first);
+    mat_destruct(&rows);
+    mat_destruct(&m);
+    puts("------");
+}
+
 void mat_test(void)
 {
     puts("+++ mat_test +++");
@@ -109,5 +360,13 @@ void mat_test(void)
 
     mat_dot_test();
 
+    mat_attention_test();
+
+    mat_is_close_test();
+
+    mat_cow_test();
+
+    mat_append_rows_test();
+
     puts("^^^ mat_test ^^^");
 }
\ No newline at end of file
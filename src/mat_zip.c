@@ -0,0 +1,372 @@
+#include "mat_zip.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#define MIN(x, y) (((x) <= (y)) ? (x) : (y))
+
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_LOG 12
+// No match starts in the last LZ_TAIL bytes, no match reaches into the last LZ_LAST_LIT
+#define LZ_TAIL 12
+#define LZ_LAST_LIT 5
+
+_Static_assert(ZIP_CHUNK <= (1 << 16) && ZIP_CHUNK % sizeof(FLD_TYP) == 0, "ZIP_CHUNK");
+
+// Compressed bound of one chunk
+#define LZ_BOUND(n) ((n) + (n) / 255 + 16)
+
+static inline uint32_t rd32(const uint8_t *p)
+{
+    uint32_t x;
+    memcpy(&x, p, 4);
+    return x;
+}
+
+// Length continuation bytes of LZ4 sequences
+static inline uint8_t *put_len(uint8_t *op, size_t len)
+{
+    for (; len >= 255; len -= 255)
+        *op++ = 255;
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+// Compresses src[0..n) into dst (capacity LZ_BOUND(n)); returns the compressed size
+static size_t lz_encode(const uint8_t *src, size_t n, uint8_t *dst)
+{
+    uint16_t table[1 << LZ_HASH_LOG];
+    memset(table, 0, sizeof(table));
+    uint8_t *op = dst;
+    size_t ip = 1, anchor = 0;
+    const size_t limit = (n > LZ_TAIL) ? n - LZ_TAIL : 0;
+    while (ip < limit)
+    {
+        const uint32_t seq = rd32(src + ip);
+        const uint32_t h = (seq * 2654435761u) >> (32 - LZ_HASH_LOG);
+        const size_t ref = table[h];
+        table[h] = (uint16_t)ip;
+        if (rd32(src + ref) != seq || ref >= ip)
+        {
+            // Skips faster through incompressible data
+            ip += 1 + ((ip - anchor) >> 6);
+            continue;
+        }
+        size_t m_len = LZ_MIN_MATCH;
+        while (ip + m_len < n - LZ_LAST_LIT && src[ref + m_len] == src[ip + m_len])
+            m_len++;
+
+        const size_t lit = ip - anchor;
+        uint8_t *token = op++;
+        *token = (uint8_t)(MIN(lit, 15) << 4 | MIN(m_len - LZ_MIN_MATCH, 15));
+        if (lit >= 15)
+            op = put_len(op, lit - 15);
+        memcpy(op, src + anchor, lit);
+        op += lit;
+        const uint16_t off = (uint16_t)(ip - ref);
+        memcpy(op, &off, 2);
+        op += 2;
+        if (m_len - LZ_MIN_MATCH >= 15)
+            op = put_len(op, m_len - LZ_MIN_MATCH - 15);
+        ip += m_len;
+        anchor = ip;
+    }
+    // Last literals
+    const size_t lit = n - anchor;
+    *op++ = (uint8_t)(MIN(lit, 15) << 4);
+    if (lit >= 15)
+        op = put_len(op, lit - 15);
+    memcpy(op, src + anchor, lit);
+    return op + lit - dst;
+}
+
+// Decompresses src[0..n) into exactly out_n bytes at dst; false if malformed
+static bool lz_decode(const uint8_t *src, size_t n, uint8_t *dst, size_t out_n)
+{
+    size_t ip = 0, op = 0;
+    while (ip < n)
+    {
+        const uint8_t token = src[ip++];
+        size_t lit = token >> 4;
+        if (lit == 15)
+        {
+            uint8_t b = 255;
+            while (b == 255 && ip < n)
+                lit += b = src[ip++];
+        }
+        if (lit > n - ip || lit > out_n - op)
+            return false;
+        memcpy(dst + op, src + ip, lit);
+        ip += lit;
+        op += lit;
+        if (ip == n)
+            break;
+
+        if (n - ip < 2)
+            return false;
+        uint16_t off;
+        memcpy(&off, src + ip, 2);
+        ip += 2;
+        size_t m_len = (token & 15) + LZ_MIN_MATCH;
+        if ((token & 15) == 15)
+        {
+            uint8_t b = 255;
+            while (b == 255 && ip < n)
+                m_len += b = src[ip++];
+        }
+        if (off == 0 || off > op || m_len > out_n - op)
+            return false;
+        uint8_t *d = dst + op;
+        const uint8_t *s = d - off;
+        if (off >= m_len)
+            memcpy(d, s, m_len);
+        else
+            for (size_t i = 0; i < m_len; i++)
+                d[i] = s[i];
+        op += m_len;
+    }
+    return op == out_n;
+}
+
+// out = byte-shuffled arr[0], arr[step], ... (n elements)
+static void shuffle(uint8_t *out, const FLD_TYP *arr, IND_TYP step, size_t n)
+{
+    const size_t S = sizeof(FLD_TYP);
+    for (size_t i = 0; i < n; i++)
+    {
+        const uint8_t *e = (const uint8_t *)(arr + i * step);
+        for (size_t b = 0; b < S; b++)
+            out[b * n + i] = e[b];
+    }
+}
+
+static void unshuffle(FLD_TYP *arr, const uint8_t *in, size_t n)
+{
+    const size_t S = sizeof(FLD_TYP);
+    uint8_t *out = (uint8_t *)arr;
+    for (size_t b = 0; b < S; b++)
+        for (size_t i = 0; i < n; i++)
+            out[i * S + b] = in[b * n + i];
+}
+
+static inline size_t n_chunks(size_t n_elm)
+{
+    return (n_elm * sizeof(FLD_TYP) + ZIP_CHUNK - 1) / ZIP_CHUNK;
+}
+
+static size_t zip_bound(size_t hdr_len, size_t n_elm)
+{
+    const size_t n_chk = n_chunks(n_elm);
+    return hdr_len + sizeof(uint32_t) * (1 + n_chk) + n_chk * LZ_BOUND(ZIP_CHUNK);
+}
+
+/*
+ * Codes n elements at arr (stride step) after hdr_len bytes at out: chunk count, sizes, data.
+ * Chunks are coded in parallel at their worst-case slots, then moved down in order.
+ * Returns the end, NULL if a work buffer could not be allocated.
+ */
+static uint8_t *zip_data(uint8_t *out, size_t hdr_len, const FLD_TYP *arr, IND_TYP step, size_t n_elm)
+{
+    const uint32_t n_chk = (uint32_t)n_chunks(n_elm);
+    const size_t per_chk = ZIP_CHUNK / sizeof(FLD_TYP);
+    uint8_t *tbl = out + hdr_len;
+    uint8_t *data = tbl + sizeof(uint32_t) * (1 + n_chk);
+    memcpy(tbl, &n_chk, sizeof(uint32_t));
+    uint32_t *sizes = (uint32_t *)malloc(n_chk * sizeof(uint32_t));
+    assert(sizes);
+    if (!sizes)
+        return NULL;
+    bool ok = true;
+
+#pragma omp parallel if (n_elm >= PAR_MIN_SIZE)
+    {
+        uint8_t *shf = (uint8_t *)malloc(ZIP_CHUNK);
+        assert(shf);
+        if (!shf)
+        {
+#pragma omp atomic write
+            ok = false;
+        }
+#pragma omp for schedule(dynamic, 1)
+        for (uint32_t c = 0; c < n_chk; c++)
+        {
+            if (!shf)
+                continue;
+            const size_t n = MIN(per_chk, n_elm - c * per_chk), bytes = n * sizeof(FLD_TYP);
+            uint8_t *slot = data + c * LZ_BOUND(ZIP_CHUNK);
+            shuffle(shf, arr + c * per_chk * step, step, n);
+            const size_t z = lz_encode(shf, bytes, slot);
+            if (z < bytes)
+                sizes[c] = (uint32_t)z;
+            else
+            {
+                // Stored unshuffled
+                if (step == 1)
+                    memcpy(slot, arr + c * per_chk, bytes);
+                else
+                    for (size_t i = 0; i < n; i++)
+                        memcpy(slot + i * sizeof(FLD_TYP), arr + (c * per_chk + i) * step, sizeof(FLD_TYP));
+                sizes[c] = (uint32_t)bytes | ZIP_STORED;
+            }
+        }
+        free((void *)shf);
+    }
+    if (!ok)
+    {
+        free((void *)sizes);
+        return NULL;
+    }
+
+    uint8_t *op = data;
+    for (uint32_t c = 0; c < n_chk; c++)
+    {
+        const size_t z = sizes[c] & ~ZIP_STORED;
+        memmove(op, data + c * LZ_BOUND(ZIP_CHUNK), z);
+        op += z;
+    }
+    memcpy(tbl + sizeof(uint32_t), sizes, n_chk * sizeof(uint32_t));
+    free((void *)sizes);
+
+    const size_t sr_sz = op - out;
+    memcpy(out, &sr_sz, sizeof(size_t));
+    return op;
+}
+
+// Decodes the chunks after hdr_len bytes at in into the n_elm elements of arr; the end or NULL
+static const uint8_t *unzip_data(FLD_TYP *arr, size_t n_elm, const uint8_t *in, size_t hdr_len)
+{
+    size_t sr_sz;
+    uint32_t n_chk;
+    memcpy(&sr_sz, in, sizeof(size_t));
+    memcpy(&n_chk, in + hdr_len, sizeof(uint32_t));
+    if (n_chk != n_chunks(n_elm) || sr_sz < hdr_len + sizeof(uint32_t) * (1 + (size_t)n_chk))
+        return NULL;
+    const size_t per_chk = ZIP_CHUNK / sizeof(FLD_TYP);
+    size_t *offs = (size_t *)malloc((n_chk + 1) * sizeof(size_t));
+    assert(offs);
+    if (!offs)
+        return NULL;
+    offs[0] = hdr_len + sizeof(uint32_t) * (1 + (size_t)n_chk);
+    for (uint32_t c = 0; c < n_chk; c++)
+    {
+        uint32_t z;
+        memcpy(&z, in + hdr_len + sizeof(uint32_t) * (1 + c), sizeof(uint32_t));
+        offs[c + 1] = offs[c] + (z & ~ZIP_STORED);
+    }
+    bool ok = offs[n_chk] == sr_sz;
+
+#pragma omp parallel if (ok && n_elm >= PAR_MIN_SIZE)
+    {
+        uint8_t *shf = (uint8_t *)malloc(ZIP_CHUNK);
+        assert(shf);
+#pragma omp for schedule(dynamic, 1)
+        for (uint32_t c = 0; c < n_chk; c++)
+        {
+            bool ok_all;
+#pragma omp atomic read
+            ok_all = ok;
+            if (!ok_all)
+                continue;
+            const size_t n = MIN(per_chk, n_elm - c * per_chk), bytes = n * sizeof(FLD_TYP);
+            uint32_t z;
+            memcpy(&z, in + hdr_len + sizeof(uint32_t) * (1 + c), sizeof(uint32_t));
+            const uint8_t *src = in + offs[c];
+            bool ok_c;
+            if (z & ZIP_STORED)
+            {
+                ok_c = (z & ~ZIP_STORED) == bytes;
+                if (ok_c)
+                    memcpy(arr + c * per_chk, src, bytes);
+            }
+            else
+            {
+                ok_c = shf && lz_decode(src, z, shf, bytes);
+                if (ok_c)
+                    unshuffle(arr + c * per_chk, shf, n);
+            }
+            if (!ok_c)
+            {
+#pragma omp atomic write
+                ok = false;
+            }
+        }
+        free((void *)shf);
+    }
+
+    free((void *)offs);
+    return ok ? in + sr_sz : NULL;
+}
+
+#define VEC_HDR (sizeof(size_t) + sizeof(IND_TYP))
+#define MAT_HDR (sizeof(size_t) + 2 * sizeof(IND_TYP))
+
+size_t vec_serial_zip_bound(const vec *v)
+{
+    assert(vec_is_valid(v));
+
+    return zip_bound(VEC_HDR, v->d);
+}
+
+size_t mat_serial_zip_bound(const mat *m)
+{
+    assert(mat_is_valid(m));
+
+    return zip_bound(MAT_HDR, m->size);
+}
+
+uint8_t *vec_serialize_zip(const vec *v, uint8_t *byte_arr)
+{
+    assert(vec_is_valid(v));
+    assert(byte_arr);
+
+    memcpy(byte_arr + sizeof(size_t), &v->d, sizeof(IND_TYP));
+    return zip_data(byte_arr, VEC_HDR, v->pyl->arr + v->offset, v->step, v->d);
+}
+
+uint8_t *mat_serialize_zip(const mat *m, uint8_t *byte_arr)
+{
+    assert(mat_is_valid(m));
+    assert(byte_arr);
+
+    memcpy(byte_arr + sizeof(size_t), &m->d1, sizeof(IND_TYP));
+    memcpy(byte_arr + sizeof(size_t) + sizeof(IND_TYP), &m->d2, sizeof(IND_TYP));
+    return zip_data(byte_arr, MAT_HDR, m->pyl->arr + m->offset, 1, m->size);
+}
+
+const uint8_t *vec_deserialize_zip(vec *v, const uint8_t *byte_arr)
+{
+    assert(v);
+    assert(byte_arr);
+
+    *v = vec_NULL;
+    IND_TYP d;
+    memcpy(&d, byte_arr + sizeof(size_t), sizeof(IND_TYP));
+    if (d <= 0 || (size_t)d > SIZE_MAX / sizeof(FLD_TYP) || !vec_construct(v, d) || vec_is_null(v))
+        return NULL;
+    const uint8_t *end = unzip_data(v->pyl->arr + v->offset, d, byte_arr, VEC_HDR);
+    if (!end)
+        vec_destruct(v);
+    return end;
+}
+
+const uint8_t *mat_deserialize_zip(mat *m, const uint8_t *byte_arr)
+{
+    assert(m);
+    assert(byte_arr);
+
+    *m = mat_NULL;
+    IND_TYP d1, d2;
+    memcpy(&d1, byte_arr + sizeof(size_t), sizeof(IND_TYP));
+    memcpy(&d2, byte_arr + sizeof(size_t) + sizeof(IND_TYP), sizeof(IND_TYP));
+    // d1, d2 from the header: d1 * d2 elements bounded before mat_construct
+    if (d1 <= 0 || d2 <= 0 || d2 > INT64_MAX / d1 || (size_t)(d1 * d2) > SIZE_MAX / sizeof(FLD_TYP) ||
+        !mat_construct(m, d1, d2) || mat_is_null(m))
+        return NULL;
+    const uint8_t *end = unzip_data(m->pyl->arr + m->offset, m->size, byte_arr, MAT_HDR);
+    if (!end)
+        mat_destruct(m);
+    return end;
+}
@@ -0,0 +1,318 @@
+#include "optim.h"
+
+#include <assert.h>
+#include <tgmath.h>
+
+typedef struct adam_coef
+{
+    FLD_TYP b_1, b_2;   // moment decay rates
+    FLD_TYP c_1, c_2;   // 1 - b_1, 1 - b_2
+    FLD_TYP step;       // lr / (1 - beta_1^t)
+    FLD_TYP inv_sqbc_2; // 1 / sqrt(1 - beta_2^t)
+    FLD_TYP eps;
+    FLD_TYP l2;    // coupled (Adam) weight decay
+    FLD_TYP decay; // decoupled (AdamW) parameter decay factor
+} adam_coef;
+
+static adam_coef *adam_coef_set(adam_coef *c, const optim_adam *hp, IND_TYP t, bool decoupled)
+{
+    assert(hp);
+    assert(t >= 1);
+    assert(hp->beta_1 >= 0 && hp->beta_1 < 1);
+    assert(hp->beta_2 >= 0 && hp->beta_2 < 1);
+
+    c->b_1 = hp->beta_1;
+    c->b_2 = hp->beta_2;
+    c->c_1 = 1 - hp->beta_1;
+    c->c_2 = 1 - hp->beta_2;
+    c->step = hp->lr / (1 - pow(hp->beta_1, (FLD_TYP)t));
+    c->inv_sqbc_2 = 1 / sqrt(1 - pow(hp->beta_2, (FLD_TYP)t));
+    c->eps = hp->eps;
+    c->l2 = decoupled ? 0 : hp->weight_decay;
+    c->decay = decoupled ? 1 - hp->lr * hp->weight_decay : 1;
+    return c;
+}
+
+static inline void sgd_kernel(IND_TYP n,
+                              FLD_TYP *p, IND_TYP p_s,
+                              FLD_TYP *v, IND_TYP v_s,
+                              const FLD_TYP *g, IND_TYP g_s,
+                              FLD_TYP lr, FLD_TYP mu, bool par)
+{
+#pragma omp parallel for simd if (par)
+    for (IND_TYP i = 0; i < n; i++)
+    {
+        FLD_TYP vi = mu * v[i * v_s] + g[i * g_s];
+        v[i * v_s] = vi;
+        p[i * p_s] -= lr * vi;
+    }
+}
+
+static inline void adam_kernel(IND_TYP n,
+                               FLD_TYP *p, IND_TYP p_s,
+                               FLD_TYP *m_1, IND_TYP m_1_s,
+                               FLD_TYP *m_2, IND_TYP m_2_s,
+                               const FLD_TYP *g, IND_TYP g_s,
+                               const adam_coef *c, bool par)
+{
+    const adam_coef k = *c;
+#pragma omp parallel for simd if (par)
+    for (IND_TYP i = 0; i < n; i++)
+    {
+        FLD_TYP pi = p[i * p_s];
+        FLD_TYP gi = g[i * g_s] + k.l2 * pi;
+        FLD_TYP mi = k.b_1 * m_1[i * m_1_s] + k.c_1 * gi;
+        FLD_TYP vi = k.b_2 * m_2[i * m_2_s] + k.c_2 * gi * gi;
+        m_1[i * m_1_s] = mi;
+        m_2[i * m_2_s] = vi;
+        p[i * p_s] = k.decay * pi - k.step * mi / (sqrt(vi) * k.inv_sqbc_2 + k.eps);
+    }
+}
+
+static vec *sgd_vec(vec *param, vec *velocity, const vec *grad, FLD_TYP lr, FLD_TYP mu, bool par)
+{
+    assert(vec_is_valid(param));
+    assert(vec_is_valid(velocity));
+    assert(vec_is_valid(grad));
+    assert(param->d == velocity->d && param->d == grad->d);
+
+    if (!vec_touch(param) || !vec_touch(velocity))
+        return NULL;
+    FLD_TYP *p = param->pyl->arr + param->offset;
+    FLD_TYP *v = velocity->pyl->arr + velocity->offset;
+    const FLD_TYP *g = grad->pyl->arr + grad->offset;
+
+    // Constant unit steps let the compiler emit packed loads and stores.
+    if (param->step == 1 && velocity->step == 1 && grad->step == 1)
+        sgd_kernel(param->d, p, 1, v, 1, g, 1, lr, mu, par);
+    else
+        sgd_kernel(param->d, p, param->step, v, velocity->step, g, grad->step, lr, mu, par);
+
+    return param;
+}
+
+static mat *sgd_mat(mat *param, mat *velocity, const mat *grad, FLD_TYP lr, FLD_TYP mu, bool par)
+{
+    assert(mat_is_valid(param));
+    assert(mat_is_valid(velocity));
+    assert(mat_is_valid(grad));
+    assert(param->size == velocity->size && param->size == grad->size);
+
+    if (!mat_touch(param) || !mat_touch(velocity))
+        return NULL;
+    sgd_kernel(param->size,
+               param->pyl->arr + param->offset, 1,
+               velocity->pyl->arr + velocity->offset, 1,
+               grad->pyl->arr + grad->offset, 1,
+               lr, mu, par);
+
+    return param;
+}
+
+static vec *adam_vec(vec *param, vec *m_1, vec *m_2, const vec *grad, const adam_coef *c, bool par)
+{
+    assert(vec_is_valid(param));
+    assert(vec_is_valid(m_1));
+    assert(vec_is_valid(m_2));
+    assert(vec_is_valid(grad));
+    assert(param->d == m_1->d && param->d == m_2->d && param->d == grad->d);
+
+    if (!vec_touch(param) || !vec_touch(m_1) || !vec_touch(m_2))
+        return NULL;
+    FLD_TYP *p = param->pyl->arr + param->offset;
+    FLD_TYP *a = m_1->pyl->arr + m_1->offset;
+    FLD_TYP *b = m_2->pyl->arr + m_2->offset;
+    const FLD_TYP *g = grad->pyl->arr + grad->offset;
+
+    if (param->step == 1 && m_1->step == 1 && m_2->step == 1 && grad->step == 1)
+        adam_kernel(param->d, p, 1, a, 1, b, 1, g, 1, c, par);
+    else
+        adam_kernel(param->d, p, param->step, a, m_1->step, b, m_2->step, g, grad->step, c, par);
+
+    return param;
+}
+
+static mat *adam_mat(mat *param, mat *m_1, mat *m_2, const mat *grad, const adam_coef *c, bool par)
+{
+    assert(mat_is_valid(param));
+    assert(mat_is_valid(m_1));
+    assert(mat_is_valid(m_2));
+    assert(mat_is_valid(grad));
+    assert(param->size == m_1->size && param->size == m_2->size && param->size == grad->size);
+
+    if (!mat_touch(param) || !mat_touch(m_1) || !mat_touch(m_2))
+        return NULL;
+    adam_kernel(param->size,
+                param->pyl->arr + param->offset, 1,
+                m_1->pyl->arr + m_1->offset, 1,
+                m_2->pyl->arr + m_2->offset, 1,
+                grad->pyl->arr + grad->offset, 1,
+                c, par);
+
+    return param;
+}
+
+vec *vec_sgd_momentum(vec *param, vec *velocity, const vec *grad, FLD_TYP lr, FLD_TYP momentum)
+{
+    return sgd_vec(param, velocity, grad, lr, momentum, param->d >= PAR_MIN_SIZE);
+}
+
+mat *mat_sgd_momentum(mat *param, mat *velocity, const mat *grad, FLD_TYP lr, FLD_TYP momentum)
+{
+    return sgd_mat(param, velocity, grad, lr, momentum, param->size >= PAR_MIN_SIZE);
+}
+
+/*
+ * Large tensors are updated one after the other, each by all threads;
+ * the small ones are then distributed over the threads, one tensor per task.
+ */
+
+// Gives the payloads of n tensors own arrays (payload_own) one after the other: tensors of a
+// multi step may view one payload, whose copy-on-write count the parallel loop must not race on
+static bool own_vecs(vec *vs[], IND_TYP n)
+{
+    for (IND_TYP k = 0; k < n; k++)
+        if (!payload_own(vs[k]->pyl))
+            return false;
+    return true;
+}
+
+static bool own_mats(mat *ms[], IND_TYP n)
+{
+    for (IND_TYP k = 0; k < n; k++)
+        if (!payload_own(ms[k]->pyl))
+            return false;
+    return true;
+}
+
+bool vec_sgd_momentum_multi(vec *params[], vec *velocities[], const vec *grads[], IND_TYP n,
+                            FLD_TYP lr, FLD_TYP momentum)
+{
+    assert(params && velocities && grads);
+
+    if (!own_vecs(params, n) || !own_vecs(velocities, n))
+        return false;
+
+    for (IND_TYP k = 0; k < n; k++)
+        if (params[k]->d >= PAR_MIN_SIZE)
+            sgd_vec(params[k], velocities[k], grads[k], lr, momentum, true);
+#pragma omp parallel for schedule(dynamic)
+    for (IND_TYP k = 0; k < n; k++)
+        if (params[k]->d < PAR_MIN_SIZE)
+            sgd_vec(params[k], velocities[k], grads[k], lr, momentum, false);
+    return true;
+}
+
+bool mat_sgd_momentum_multi(mat *params[], mat *velocities[], const mat *grads[], IND_TYP n,
+                            FLD_TYP lr, FLD_TYP momentum)
+{
+    assert(params && velocities && grads);
+
+    if (!own_mats(params, n) || !own_mats(velocities, n))
+        return false;
+
+    for (IND_TYP k = 0; k < n; k++)
+        if (params[k]->size >= PAR_MIN_SIZE)
+            sgd_mat(params[k], velocities[k], grads[k], lr, momentum, true);
+#pragma omp parallel for schedule(dynamic)
+    for (IND_TYP k = 0; k < n; k++)
+        if (params[k]->size < PAR_MIN_SIZE)
+            sgd_mat(params[k], velocities[k], grads[k], lr, momentum, false);
+    return true;
+}
+
+static bool adam_vec_multi(vec *params[], vec *m_1s[], vec *m_2s[], const vec *grads[], IND_TYP n,
+                           const adam_coef *c)
+{
+    assert(params && m_1s && m_2s && grads);
+
+    if (!own_vecs(params, n) || !own_vecs(m_1s, n) || !own_vecs(m_2s, n))
+        return false;
+
+    for (IND_TYP k = 0; k < n; k++)
+        if (params[k]->d >= PAR_MIN_SIZE)
+            adam_vec(params[k], m_1s[k], m_2s[k], grads[k], c, true);
+#pragma omp parallel for schedule(dynamic)
+    for (IND_TYP k = 0; k < n; k++)
+        if (params[k]->d < PAR_MIN_SIZE)
+            adam_vec(params[k], m_1s[k], m_2s[k], grads[k], c, false);
+    return true;
+}
+
+static bool adam_mat_multi(mat *params[], mat *m_1s[], mat *m_2s[], const mat *grads[], IND_TYP n,
+                           const adam_coef *c)
+{
+    assert(params && m_1s && m_2s && grads);
+
+    if (!own_mats(params, n) || !own_mats(m_1s, n) || !own_mats(m_2s, n))
+        return false;
+
+    for (IND_TYP k = 0; k < n; k++)
+        if (params[k]->size >= PAR_MIN_SIZE)
+            adam_mat(params[k], m_1s[k], m_2s[k], grads[k], c, true);
+#pragma omp parallel for schedule(dynamic)
+    for (IND_TYP k = 0; k < n; k++)
+        if (params[k]->size < PAR_MIN_SIZE)
+            adam_mat(params[k], m_1s[k], m_2s[k], grads[k], c, false);
+    return true;
+}
+
+vec *vec_adam(vec *param, vec *m_1, vec *m_2, const vec *grad, const optim_adam *hp, IND_TYP t)
+{
+    adam_coef c;
+    adam_coef_set(&c, hp, t, false);
+    return adam_vec(param, m_1, m_2, grad, &c, param->d >= PAR_MIN_SIZE);
+}
+
+mat *mat_adam(mat *param, mat *m_1, mat *m_2, const mat *grad, const optim_adam *hp, IND_TYP t)
+{
+    adam_coef c;
+    adam_coef_set(&c, hp, t, false);
+    return adam_mat(param, m_1, m_2, grad, &c, param->size >= PAR_MIN_SIZE);
+}
+
+bool vec_adam_multi(vec *params[], vec *m_1s[], vec *m_2s[], const vec *grads[], IND_TYP n,
+                    const optim_adam *hp, IND_TYP t)
+{
+    adam_coef c;
+    adam_coef_set(&c, hp, t, false);
+    return adam_vec_multi(params, m_1s, m_2s, grads, n, &c);
+}
+
+bool mat_adam_multi(mat *params[], mat *m_1s[], mat *m_2s[], const mat *grads[], IND_TYP n,
+                    const optim_adam *hp, IND_TYP t)
+{
+    adam_coef c;
+    adam_coef_set(&c, hp, t, false);
+    return adam_mat_multi(params, m_1s, m_2s, grads, n, &c);
+}
+
+vec *vec_adamw(vec *param, vec *m_1, vec *m_2, const vec *grad, const optim_adam *hp, IND_TYP t)
+{
+    adam_coef c;
+    adam_coef_set(&c, hp, t, true);
+    return adam_vec(param, m_1, m_2, grad, &c, param->d >= PAR_MIN_SIZE);
+}
+
+mat *mat_adamw(mat *param, mat *m_1, mat *m_2, const mat *grad, const optim_adam *hp, IND_TYP t)
+{
+    adam_coef c;
+    adam_coef_set(&c, hp, t, true);
+    return adam_mat(param, m_1, m_2, grad, &c, param->size >= PAR_MIN_SIZE);
+}
+
+bool vec_adamw_multi(vec *params[], vec *m_1s[], vec *m_2s[], const vec *grads[], IND_TYP n,
+                     const optim_adam *hp, IND_TYP t)
+{
+    adam_coef c;
+    adam_coef_set(&c, hp, t, true);
+    return adam_vec_multi(params, m_1s, m_2s, grads, n, &c);
+}
+
+bool mat_adamw_multi(mat *params[], mat *m_1s[], mat *m_2s[], const mat *grads[], IND_TYP n,
+                     const optim_adam *hp, IND_TYP t)
+{
+    adam_coef c;
+    adam_coef_set(&c, hp, t, true);
+    return adam_mat_multi(params, m_1s, m_2s, grads, n, &c);
+}
@@ -0,0 +1,207 @@
+#include "optim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <assert.h>
+
+static FLD_TYP rnd(void)
+{
+    return 2 * (rand() / (FLD_TYP)RAND_MAX) - 1;
+}
+
+// Unfused Adam step composed of the element-wise vec kernels
+static vec *adam_ref(vec *p, vec *m_1, vec *m_2, const vec *g, const optim_adam *hp, IND_TYP t, bool decoupled)
+{
+    vec tmp = vec_NULL;
+    vec g2 = vec_NULL;
+    vec_construct(&tmp, p->d);
+    vec_construct(&g2, p->d);
+
+    vec_assign(&g2, g);
+    if (decoupled)
+        vec_scale(p, 1 - hp->lr * hp->weight_decay);
+    else
+        vec_update(&g2, hp->weight_decay, p);
+    vec_scale(m_1, hp->beta_1);
+    vec_update(m_1, 1 - hp->beta_1, &g2);
+    vec_square(&tmp, &g2);
+    vec_scale(m_2, hp->beta_2);
+    vec_update(m_2, 1 - hp->beta_2, &tmp);
+    vec_sqrt(&tmp, m_2);
+    vec_scale(&tmp, 1 / sqrt(1 - pow(hp->beta_2, t)));
+    vec_f_addto(&tmp, hp->eps);
+    vec_div(&tmp, m_1, &tmp);
+    vec_update(p, -hp->lr / (1 - pow(hp->beta_1, t)), &tmp);
+
+    vec_destruct(&tmp);
+    vec_destruct(&g2);
+    return p;
+}
+
+static void adam_test(bool decoupled)
+{
+    const IND_TYP d = 37;
+    optim_adam hp = optim_ADAM_DEFAULT;
+    hp.lr = 0.01;
+    hp.weight_decay = 0.1;
+
+    vec p = vec_NULL, m_1 = vec_NULL, m_2 = vec_NULL, g = vec_NULL;
+    vec p_r = vec_NULL, m_1_r = vec_NULL, m_2_r = vec_NULL;
+    vec_construct(&p, d);
+    vec_construct(&m_1, d);
+    vec_construct(&m_2, d);
+    vec_construct(&g, d);
+    vec_construct(&p_r, d);
+    vec_construct(&m_1_r, d);
+    vec_construct(&m_2_r, d);
+    vec_fill_rnd(&p, rnd);
+    vec_assign(&p_r, &p);
+    vec_fill_zero(&m_1);
+    vec_fill_zero(&m_2);
+    vec_fill_zero(&m_1_r);
+    vec_fill_zero(&m_2_r);
+
+    for (IND_TYP t = 1; t <= 10; t++)
+    {
+        vec_fill_rnd(&g, rnd);
+        if (decoupled)
+            vec_adamw(&p, &m_1, &m_2, &g, &hp, t);
+        else
+            vec_adam(&p, &m_1, &m_2, &g, &hp, t);
+        adam_ref(&p_r, &m_1_r, &m_2_r, &g, &hp, t, decoupled);
+    }
+    printf("%s: fused vs unfused param close: %d\n", decoupled ? "adamw" : "adam",
+           vec_is_close(&p, &p_r, 1E-5));
+    assert(vec_is_close(&p, &p_r, 1E-5));
+    assert(vec_is_close(&m_2, &m_2_r, 1E-5));
+
+    vec_destruct(&p);
+    vec_destruct(&m_1);
+    vec_destruct(&m_2);
+    vec_destruct(&g);
+    vec_destruct(&p_r);
+    vec_destruct(&m_1_r);
+    vec_destruct(&m_2_r);
+}
+
+static void sgd_momentum_test(void)
+{
+    char buff[1024];
+    vec p = vec_NULL, v = vec_NULL, g = vec_NULL;
+    vec_construct(&p, 4);
+    vec_construct(&v, 4);
+    vec_construct(&g, 4);
+    vec_copy_arr(&p, (FLD_TYP[]){1, 2, 3, 4});
+    vec_fill_zero(&v);
+    vec_copy_arr(&g, (FLD_TYP[]){1, -1, 0.5, -0.5});
+
+    vec_sgd_momentum(&p, &v, &g, 0.1, 0.9);
+    vec_sgd_momentum(&p, &v, &g, 0.1, 0.9);
+    printf("sgd-momentum 2 steps: p: %s", vec_to_str(&p, buff));
+    printf(" v: %s\n", vec_to_str(&v, buff));
+    assert(fabs(*vec_at(&v, 0) - 1.9) < 1E-5);
+    assert(fabs(*vec_at(&p, 0) - 0.71) < 1E-5);
+
+    vec_destruct(&p);
+    vec_destruct(&v);
+    vec_destruct(&g);
+}
+
+static void multi_test(void)
+{
+    const IND_TYP n = 3;
+    optim_adam hp = optim_ADAM_DEFAULT;
+    mat p[3], m_1[3], m_2[3], g[3], p_1[3], m_1_1[3], m_2_1[3];
+    mat *pp[3], *pm_1[3], *pm_2[3];
+    const mat *pg[3];
+    for (IND_TYP k = 0; k < n; k++)
+    {
+        mat *all[] = {&p[k], &m_1[k], &m_2[k], &g[k], &p_1[k], &m_1_1[k], &m_2_1[k]};
+        for (int a = 0; a < 7; a++)
+        {
+            *all[a] = mat_NULL;
+            mat_construct(all[a], k + 2, 3);
+            mat_fill_zero(all[a]);
+        }
+        mat_fill_rnd(&p[k], rnd);
+        mat_fill_rnd(&g[k], rnd);
+        mat_assign(&p_1[k], &p[k]);
+        pp[k] = &p[k];
+        pm_1[k] = &m_1[k];
+        pm_2[k] = &m_2[k];
+        pg[k] = &g[k];
+    }
+
+    mat_adamw_multi(pp, pm_1, pm_2, pg, n, &hp, 1);
+    for (IND_TYP k = 0; k < n; k++)
+    {
+        mat_adamw(&p_1[k], &m_1_1[k], &m_2_1[k], &g[k], &hp, 1);
+        assert(mat_is_close(&p[k], &p_1[k], 1E-6));
+    }
+    puts("mat_adamw_multi matches mat_adamw");
+
+    for (IND_TYP k = 0; k < n; k++)
+    {
+        mat *all[] = {&p[k], &m_1[k], &m_2[k], &g[k], &p_1[k], &m_1_1[k], &m_2_1[k]};
+        for (int a = 0; a < 7; a++)
+            mat_destruct(all[a]);
+    }
+}
+
+static void snapshot_multi_test(void)
+{
+    // Params viewing one flat payload, with a copy-on-write snapshot of it taken before the step
+    const IND_TYP n = 4;
+    mat flat = mat_NULL, snap = mat_NULL, ref = mat_NULL;
+    mat p[4], v[4], g[4];
+    mat *pp[4], *pv[4];
+    const mat *pg[4];
+    mat_construct(&flat, 2 * n, 3);
+    mat_fill_rnd(&flat, rnd);
+    for (IND_TYP k = 0; k < n; k++)
+    {
+        p[k] = v[k] = g[k] = mat_NULL;
+        mat_construct_prealloc(&p[k], flat.pyl, 6 * k, 2, 3);
+        mat_construct(&v[k], 2, 3);
+        mat_fill_zero(&v[k]);
+        mat_construct(&g[k], 2, 3);
+        mat_fill_rnd(&g[k], rnd);
+        pp[k] = &p[k];
+        pv[k] = &v[k];
+        pg[k] = &g[k];
+    }
+    mat_construct(&ref, flat.d1, flat.d2);
+    mat_assign(&ref, &flat);
+    mat_clone(&snap, &flat);
+
+    const bool ok_step = mat_sgd_momentum_multi(pp, pv, pg, n, 0.1, 0.9);
+    const bool ok_snap = mat_allclose(&snap, &ref, 0, 0);
+    const bool ok_own = !flat.pyl->cow_ref && flat.pyl->arr != snap.pyl->arr && !mat_allclose(&flat, &ref, 0, 0);
+    printf("multi step on views of a snapshotted payload: %d, snapshot kept: %d, own array: %d\n", ok_step, ok_snap,
+           ok_own);
+    assert(ok_step && ok_snap && ok_own);
+
+    for (IND_TYP k = 0; k < n; k++)
+    {
+        mat_destruct(&p[k]);
+        mat_destruct(&v[k]);
+        mat_destruct(&g[k]);
+    }
+    mat_destruct(&flat);
+    mat_destruct(&snap);
+    mat_destruct(&ref);
+}
+
+void optim_test(void)
+{
+    puts("+++ optim_test +++");
+
+    sgd_momentum_test();
+    adam_test(false);
+    adam_test(true);
+    multi_test();
+    snapshot_multi_test();
+
+    puts("^^^ optim_test ^^^");
+}
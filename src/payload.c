@@ -1,13 +1,20 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "payload.h"
 
 #include <assert.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include "log.h"
 
 #define MIN(x, y) ((x) <= (y) ? (x) : (y))
 
+static void set_bits(uint64_t *bits, size_t b0, size_t b1, bool on);
+
 payload *payload_construct(payload *pyl, size_t size)
 {
     assert(pyl);
@@ -22,6 +29,7 @@ payload *payload_construct(payload *pyl, size_t size)
     }
 
     pyl->size = size;
+    pyl->cap = size;
     pyl->arr = (FLD_TYP *)aligned_alloc(64, size * sizeof(FLD_TYP));
     assert(pyl->arr);
     if (!pyl->arr)
@@ -31,18 +39,42 @@ payload *payload_construct(payload *pyl, size_t size)
     }
     pyl->ref_count = 1;
     pyl->flags = payload_FLG_RESIZABLE | payload_FLG_SHRINKABLE;
+    pyl->dirty = NULL;
+    pyl->blk_shift = 0;
+    pyl->cow_ref = NULL;
 
     return pyl;
 }
 
+// Frees (or unmaps) an array of size elements as the payload flags say
+static void arr_free(FLD_TYP *arr, size_t size, uint32_t flags)
+{
+    if (flags & payload_FLG_MMAP)
+    {
+        // The mapping starts at the page of arr
+        const uintptr_t pg = (uintptr_t)sysconf(_SC_PAGESIZE);
+        const uintptr_t base = (uintptr_t)arr & ~(pg - 1);
+        munmap((void *)base, (uintptr_t)arr - base + size * sizeof(FLD_TYP));
+    }
+    else if (!(flags & payload_FLG_PREALLOC))
+        free((void *)arr);
+}
+
 static void payload_destruct(payload *pyl)
 {
     assert(payload_is_valid(pyl));
 
     if (!pyl || !pyl->arr)
         return;
-    if (!(pyl->flags & payload_FLG_PREALLOC))
-        free((void *)pyl->arr);
+    free(pyl->dirty);
+    if (pyl->cow_ref && __atomic_sub_fetch(pyl->cow_ref, 1, __ATOMIC_ACQ_REL) > 0)
+    {
+        // Others still hold arr
+        *pyl = payload_NULL;
+        return;
+    }
+    free(pyl->cow_ref);
+    arr_free(pyl->arr, pyl->size, pyl->flags);
     *pyl = payload_NULL;
 }
 
@@ -78,13 +110,105 @@ payload *payload_prealloc(payload *pyl, FLD_TYP *arr, size_t size)
     }
 
     pyl->size = size;
+    pyl->cap = size;
     pyl->arr = arr;
     pyl->ref_count = 1;
     pyl->flags = payload_FLG_PREALLOC;
+    pyl->dirty = NULL;
+    pyl->blk_shift = 0;
+    pyl->cow_ref = NULL;
+
+    return pyl;
+}
+
+payload *payload_map(int fd, size_t offset, size_t size)
+{
+    assert(fd >= 0);
+    assert(offset % sizeof(FLD_TYP) == 0);
+    assert(size > 0);
+
+    const size_t pg = (size_t)sysconf(_SC_PAGESIZE);
+    const size_t map_off = offset & ~(pg - 1), lead = offset - map_off;
+    const size_t len = lead + size * sizeof(FLD_TYP);
+    char *base = (char *)mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, map_off);
+    if (base == MAP_FAILED)
+        return NULL;
+    payload *pyl = (payload *)calloc(1, sizeof(payload));
+    assert(pyl);
+    if (!pyl)
+    {
+        munmap(base, len);
+        return NULL;
+    }
+    payload_prealloc(pyl, (FLD_TYP *)(base + lead), size);
+    pyl->flags |= payload_FLG_NEW | payload_FLG_MMAP;
+    return pyl;
+}
+
+payload *payload_cow(payload *src)
+{
+    assert(payload_is_valid(src));
 
+    payload *pyl = (payload *)calloc(1, sizeof(payload));
+    assert(pyl);
+    if (!pyl)
+        return NULL;
+    if (!src->cow_ref)
+    {
+        src->cow_ref = (int *)malloc(sizeof(int));
+        assert(src->cow_ref);
+        if (!src->cow_ref)
+        {
+            free((void *)pyl);
+            return NULL;
+        }
+        *src->cow_ref = 1;
+    }
+    __atomic_fetch_add(src->cow_ref, 1, __ATOMIC_RELAXED);
+    *pyl = payload_NULL;
+    pyl->arr = src->arr;
+    pyl->size = src->size;
+    pyl->cap = src->size;
+    pyl->ref_count = 1;
+    // Freed the same way as src by whichever is last; resizing asks for an own copy first
+    pyl->flags = payload_FLG_NEW | (src->flags & (payload_FLG_PREALLOC | payload_FLG_MMAP | payload_FLG_RESIZABLE));
+    if (pyl->flags & payload_FLG_RESIZABLE)
+        pyl->flags |= payload_FLG_SHRINKABLE;
+    pyl->cow_ref = src->cow_ref;
     return pyl;
 }
 
+bool payload_own(payload *pyl)
+{
+    assert(payload_is_valid(pyl));
+
+    if (!pyl->cow_ref)
+        return true;
+    // Only holders add to the count, so at 1 no other one can appear
+    if (__atomic_load_n(pyl->cow_ref, __ATOMIC_ACQUIRE) == 1)
+    {
+        free(pyl->cow_ref);
+        pyl->cow_ref = NULL;
+        return true;
+    }
+    FLD_TYP *arr = (FLD_TYP *)aligned_alloc(64, pyl->size * sizeof(FLD_TYP));
+    assert(arr);
+    if (!arr)
+        return false;
+    memcpy(arr, pyl->arr, pyl->size * sizeof(FLD_TYP));
+    if (__atomic_sub_fetch(pyl->cow_ref, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        // The others let go during the copy: the old array is the last to go
+        free(pyl->cow_ref);
+        arr_free(pyl->arr, pyl->size, pyl->flags);
+    }
+    pyl->cow_ref = NULL;
+    pyl->arr = arr;
+    pyl->cap = pyl->size;
+    pyl->flags &= ~(payload_FLG_PREALLOC | payload_FLG_MMAP);
+    return true;
+}
+
 payload *payload_share(payload *pyl)
 {
     assert(payload_is_valid(pyl));
@@ -117,6 +241,31 @@ void payload_release(payload *pyl)
     }
 }
 
+// Moves arr to a new aligned array of cap elements (>= size)
+static bool payload_realloc(payload *pyl, size_t cap)
+{
+    FLD_TYP *arr = (FLD_TYP *)aligned_alloc(64, cap * sizeof(FLD_TYP));
+    assert(arr);
+    if (!arr)
+        return false;
+    memcpy(arr, pyl->arr, pyl->size * sizeof(FLD_TYP));
+    free((void *)pyl->arr);
+    pyl->arr = arr;
+    pyl->cap = cap;
+    return true;
+}
+
+payload *payload_reserve(payload *pyl, size_t cap)
+{
+    assert(payload_is_valid(pyl));
+
+    if (!pyl->arr || !(pyl->flags & payload_FLG_RESIZABLE) || !payload_own(pyl))
+        return NULL;
+    if (cap > pyl->cap && !payload_realloc(pyl, cap))
+        return NULL;
+    return pyl;
+}
+
 payload *payload_resize(payload *pyl, size_t new_size)
 {
     assert(payload_is_valid(pyl));
@@ -124,16 +273,31 @@ payload *payload_resize(payload *pyl, size_t new_size)
     if (new_size == pyl->size)
         return pyl;
     else if (!pyl->arr ||
+             new_size == 0 ||
              !(pyl->flags & payload_FLG_RESIZABLE) ||
              (new_size < pyl->size && !(pyl->flags & payload_FLG_SHRINKABLE)))
         return NULL;
+    if (!payload_own(pyl))
+        return NULL;
 
-    void *ptr = NULL;
-    ptr = realloc(pyl->arr, new_size);
-    assert(ptr);
-    if (!ptr)
+    const size_t old_blk = pyl->dirty ? payload_n_blk(pyl) : 0;
+    const size_t n_blk = pyl->dirty ? ((new_size - 1) >> pyl->blk_shift) + 1 : 0;
+    if (n_blk > old_blk)
+    {
+        // Blocks past the old end start clean (the bitmap keeps its words on shrinking)
+        const size_t old_words = (old_blk + 63) / 64, words = (n_blk + 63) / 64;
+        if (words > old_words)
+        {
+            uint64_t *dirty = (uint64_t *)realloc(pyl->dirty, words * sizeof(uint64_t));
+            assert(dirty);
+            if (!dirty)
+                return NULL;
+            pyl->dirty = dirty;
+        }
+        set_bits(pyl->dirty, old_blk, n_blk - 1, false);
+    }
+    if (new_size > pyl->cap && !payload_realloc(pyl, new_size > 2 * pyl->cap ? new_size : 2 * pyl->cap))
         return NULL;
-    pyl->arr = (FLD_TYP *)ptr;
     pyl->size = new_size;
     return pyl;
 }
@@ -173,3 +337,81 @@ size_t payload_clear_value(payload *trg, size_t offset, size_t end)
 
     return size;
 }
+
+bool payload_track(payload *pyl, size_t blk_bytes)
+{
+    assert(payload_is_valid(pyl));
+    assert(blk_bytes >= sizeof(FLD_TYP) && (blk_bytes & (blk_bytes - 1)) == 0);
+
+    if (!payload_is_valid(pyl) || blk_bytes < sizeof(FLD_TYP) || (blk_bytes & (blk_bytes - 1)))
+        return false;
+    unsigned shift = 0;
+    while (((size_t)sizeof(FLD_TYP) << shift) < blk_bytes)
+        shift++;
+    if (pyl->dirty)
+        return pyl->blk_shift == shift;
+    pyl->blk_shift = shift;
+    pyl->dirty = (uint64_t *)calloc((payload_n_blk(pyl) + 63) / 64, sizeof(uint64_t));
+    assert(pyl->dirty);
+    return pyl->dirty != NULL;
+}
+
+void payload_untrack(payload *pyl)
+{
+    assert(payload_is_valid(pyl));
+
+    free(pyl->dirty);
+    pyl->dirty = NULL;
+    pyl->blk_shift = 0;
+}
+
+// Sets (on) or clears bits [b0, b1]; atomic, so kernels running on separate threads may mark
+// tensors sharing a payload
+static void set_bits(uint64_t *bits, size_t b0, size_t b1, bool on)
+{
+    const size_t w0 = b0 >> 6, w1 = b1 >> 6;
+    const uint64_t m0 = ~(uint64_t)0 << (b0 & 63), m1 = ~(uint64_t)0 >> (63 - (b1 & 63));
+    for (size_t w = w0; w <= w1; w++)
+    {
+        uint64_t msk = ~(uint64_t)0;
+        if (w == w0)
+            msk &= m0;
+        if (w == w1)
+            msk &= m1;
+        if (on)
+            __atomic_fetch_or(bits + w, msk, __ATOMIC_RELAXED);
+        else
+            __atomic_fetch_and(bits + w, ~msk, __ATOMIC_RELAXED);
+    }
+}
+
+void payload_mark_range(payload *pyl, size_t begin, size_t end)
+{
+    assert(pyl->dirty);
+    assert(begin < end && end <= pyl->size);
+
+    set_bits(pyl->dirty, begin >> pyl->blk_shift, (end - 1) >> pyl->blk_shift, true);
+}
+
+void payload_clean(payload *pyl, size_t begin, size_t end)
+{
+    assert(payload_is_valid(pyl));
+
+    end = MIN(end, pyl->size);
+    if (!pyl->dirty || begin >= end)
+        return;
+    set_bits(pyl->dirty, begin >> pyl->blk_shift, (end - 1) >> pyl->blk_shift, false);
+}
+
+size_t payload_n_dirty(const payload *pyl)
+{
+    assert(payload_is_valid(pyl));
+
+    if (!pyl->dirty)
+        return 0;
+    size_t n = 0;
+    const size_t words = (payload_n_blk(pyl) + 63) / 64;
+    for (size_t w = 0; w < words; w++)
+        n += (size_t)__builtin_popcountll(pyl->dirty[w]);
+    return n;
+}
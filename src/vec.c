@@ -3,7 +3,10 @@
 #include <string.h>
 #include <stdio.h>
 #include <assert.h>
+#include <tgmath.h>
+#include <stdint.h>
 
+#include "fmt.h"
 #include "vector_eng.h"
 
 bool vec_is_null(const vec *v)
@@ -77,6 +80,23 @@ vec *vec_construct_prealloc(vec *v, payload *pyl, IND_TYP offset, IND_TYP d, IND
     return v;
 }
 
+vec *vec_inl_construct(vec_inl *s, IND_TYP d)
+{
+    assert(s);
+    assert(d > 0 && d <= VEC_INL_MAX);
+
+    s->v = vec_NULL;
+    if (d <= 0 || d > VEC_INL_MAX)
+        return &s->v;
+    // Not NEW: released to ref count 0, the payload is left in place
+    payload_prealloc(&s->pyl, s->buf, d);
+    s->v.pyl = &s->pyl;
+    s->v.d = d;
+    s->v.offset = 0;
+    s->v.step = 1;
+    return &s->v;
+}
+
 vec *vec_reform(vec *v, IND_TYP offset, IND_TYP d, IND_TYP step)
 {
     assert(vec_is_valid(v));
@@ -165,6 +185,25 @@ vec *vec_new_view(const vec *src, IND_TYP start, IND_TYP stop, IND_TYP step)
     return vec_view(new_v, src, start, stop, step);
 }
 
+vec *vec_clone(vec *dst, const vec *src)
+{
+    assert(dst);
+    assert(vec_is_valid(src));
+
+    payload *pyl = payload_cow(src->pyl);
+    payload_release(dst->pyl);
+    if (!pyl)
+    {
+        *dst = vec_NULL;
+        return dst;
+    }
+    dst->pyl = pyl;
+    dst->d = src->d;
+    dst->offset = src->offset;
+    dst->step = src->step;
+    return dst;
+}
+
 void vec_del(vec *v)
 {
     assert(vec_is_valid(v));
@@ -180,17 +219,75 @@ vec *vec_copy_arr(vec *v, const FLD_TYP arr[])
     assert(vec_is_valid(v));
     assert(arr);
 
+    if (!vec_touch(v))
+        return NULL;
     COPY(v->d, arr, 1, payload_at(v->pyl, v->offset), v->step);
 
     return v;
 }
 
+// Grows v, at the end of its payload, by n elements; returns the index of the first new one
+// in the payload, -1 on failure
+static IND_TYP vec_grow(vec *v, IND_TYP n)
+{
+    assert(v);
+    assert(n > 0);
+
+    if (vec_is_null(v))
+    {
+        vec_construct(v, n);
+        return vec_is_null(v) ? -1 : 0;
+    }
+    assert(vec_is_valid(v));
+    assert(v->step == 1 || v->d == 1);
+    assert((size_t)(v->offset + v->d) == v->pyl->size);
+    if ((v->step != 1 && v->d != 1) || (size_t)(v->offset + v->d) != v->pyl->size)
+        return -1;
+
+    const IND_TYP i = v->offset + v->d;
+    if (!payload_resize(v->pyl, i + n))
+        return -1;
+    v->d += n;
+    v->step = 1;
+    payload_mark(v->pyl, i, i + n);
+    return i;
+}
+
+vec *vec_push_back(vec *v, FLD_TYP x)
+{
+    const IND_TYP i = vec_grow(v, 1);
+    if (i < 0)
+        return NULL;
+    *payload_at(v->pyl, i) = x;
+    return v;
+}
+
+vec *vec_append(vec *v, const vec *src)
+{
+    assert(vec_is_valid(src));
+
+    // src may be v: its elements are read after the growth, from the moved payload
+    const vec s = *src;
+    const IND_TYP i = vec_grow(v, s.d);
+    if (i < 0)
+        return NULL;
+    FLD_TYP *dst = payload_at(v->pyl, i);
+    if (s.step > 0)
+        COPY(s.d, payload_at(s.pyl, s.offset), s.step, dst, 1);
+    else
+        for (IND_TYP j = 0; j < s.d; j++)
+            dst[j] = *payload_at(s.pyl, s.offset + j * s.step);
+    return v;
+}
+
 vec *vec_assign(vec *dst, const vec *src)
 {
     assert(vec_is_valid(dst));
     assert(vec_is_valid(src));
     assert(dst->d == src->d);
 
+    if (!vec_touch(dst))
+        return NULL;
     COPY(dst->d,
          payload_at(src->pyl, src->offset), src->step,
          payload_at(dst->pyl, dst->offset), dst->step);
@@ -203,6 +300,8 @@ vec *vec_fill_rnd(vec *v, FLD_TYP (*rnd)(void))
     assert(vec_is_valid(v));
     assert(rnd);
 
+    if (!vec_touch(v))
+        return NULL;
     for (IND_TYP j = 0; j < v->d; j++)
     {
         IND_TYP i = v->offset + j * v->step;
@@ -216,6 +315,8 @@ vec *vec_fill_gen(vec *v, FLD_TYP (*gen)(const void *), const void *param)
     assert(vec_is_valid(v));
     assert(gen);
 
+    if (!vec_touch(v))
+        return NULL;
     for (IND_TYP j = 0; j < v->d; j++)
     {
         IND_TYP i = v->offset + j * v->step;
@@ -248,6 +349,8 @@ vec *vec_fill(vec *v, FLD_TYP value)
 {
     assert(vec_is_valid(v));
 
+    if (!vec_touch(v))
+        return NULL;
     COPY(v->d, &value, 0, payload_at(v->pyl, v->offset), v->step);
 
     return v;
@@ -257,6 +360,8 @@ vec *vec_fill_zero(vec *v)
 {
     assert(vec_is_valid(v));
 
+    if (!vec_touch(v))
+        return NULL;
     if (v->step == 1)
         memset(payload_at(v->pyl, v->offset), 0, v->d * sizeof(FLD_TYP));
     else
@@ -269,15 +374,7 @@ char *vec_to_str(const vec *v, char *v_str)
 {
     assert(vec_is_valid(v));
 
-    char buff[64] = {0};
-    strcpy(v_str, "[");
-    for (IND_TYP j = 0; j < v->d; j++)
-    {
-        IND_TYP i = v->offset + j * v->step;
-        sprintf(buff, (j + 1 != v->d) ? "%g," : "%g", *payload_at(v->pyl, i));
-        strcat(v_str, buff);
-    }
-    strcat(v_str, "]");
+    vec_to_strn(v, v_str, SIZE_MAX, &fmt_spec_DEFAULT);
     return v_str;
 }
 
@@ -288,6 +385,8 @@ vec *vec_add(vec *result, const vec *v_left, const vec *v_right)
     assert(vec_is_valid(v_right));
     assert(v_left->d == v_right->d && v_left->d == result->d);
 
+    if (!vec_touch(result))
+        return NULL;
     VADDI(result->d,
           payload_at(v_left->pyl, v_left->offset), v_left->step,
           payload_at(v_right->pyl, v_right->offset), v_right->step,
@@ -303,6 +402,8 @@ vec *vec_sub(vec *result, const vec *v_left, const vec *v_right)
     assert(vec_is_valid(v_right));
     assert(v_left->d == v_right->d && v_left->d == result->d);
 
+    if (!vec_touch(result))
+        return NULL;
     VSUBI(result->d,
           payload_at(v_left->pyl, v_left->offset), v_left->step,
           payload_at(v_right->pyl, v_right->offset), v_right->step,
@@ -318,6 +419,8 @@ vec *vec_mul(vec *result, const vec *v_left, const vec *v_right)
     assert(vec_is_valid(v_right));
     assert(v_left->d == v_right->d && v_left->d == result->d);
 
+    if (!vec_touch(result))
+        return NULL;
     VMULI(result->d,
           payload_at(v_left->pyl, v_left->offset), v_left->step,
           payload_at(v_right->pyl, v_right->offset), v_right->step,
@@ -333,6 +436,8 @@ vec *vec_div(vec *result, const vec *v_left, const vec *v_right)
     assert(vec_is_valid(v_right));
     assert(v_left->d == v_right->d && v_left->d == result->d);
 
+    if (!vec_touch(result))
+        return NULL;
     VDIVI(result->d,
           payload_at(v_left->pyl, v_left->offset), v_left->step,
           payload_at(v_right->pyl, v_right->offset), v_right->step,
@@ -347,6 +452,8 @@ vec *vec_sclmul(vec *result, const vec *v, FLD_TYP alpha)
     assert(vec_is_valid(v));
     assert(v->d == result->d);
 
+    if (!vec_touch(result))
+        return NULL;
     VMULI(v->d,
           payload_at(v->pyl, v->offset), v->step,
           &alpha, 0,
@@ -359,6 +466,8 @@ vec *vec_f_addto(vec *v, FLD_TYP f)
 {
     assert(vec_is_valid(v));
 
+    if (!vec_touch(v))
+        return NULL;
     AXPY(v->d, 1,
          &f, 0,
          payload_at(v->pyl, v->offset), v->step);
@@ -372,6 +481,8 @@ vec *vec_f_sub(vec *result, FLD_TYP f, const vec *v_right)
     assert(vec_is_valid(v_right));
     assert(v_right->d == result->d);
 
+    if (!vec_touch(result))
+        return NULL;
     VSUBI(result->d,
           &f, 0,
           payload_at(v_right->pyl, v_right->offset), v_right->step,
@@ -384,6 +495,8 @@ vec *vec_scale(vec *v, FLD_TYP scale)
 {
     assert(vec_is_valid(v));
 
+    if (!vec_touch(v))
+        return NULL;
     SCAL(v->d, scale,
          payload_at(v->pyl, v->offset), v->step);
 
@@ -396,6 +509,8 @@ vec *vec_update(vec *v_dst, FLD_TYP alpha, const vec *v_right)
     assert(vec_is_valid(v_right));
     assert(v_dst->d == v_right->d);
 
+    if (!vec_touch(v_dst))
+        return NULL;
     AXPY(v_dst->d, alpha,
          payload_at(v_right->pyl, v_right->offset), v_right->step,
          payload_at(v_dst->pyl, v_dst->offset), v_dst->step);
@@ -409,6 +524,8 @@ vec *vec_exp(vec *result, const vec *v)
     assert(vec_is_valid(v));
     assert(v->d == result->d);
 
+    if (!vec_touch(result))
+        return NULL;
     VEXPI(result->d,
           payload_at(v->pyl, v->offset), v->step,
           payload_at(result->pyl, result->offset), result->step);
@@ -416,12 +533,29 @@ vec *vec_exp(vec *result, const vec *v)
     return result;
 }
 
+vec *vec_ln(vec *result, const vec *v)
+{
+    assert(vec_is_valid(result));
+    assert(vec_is_valid(v));
+    assert(v->d == result->d);
+
+    if (!vec_touch(result))
+        return NULL;
+    VLNI(result->d,
+         payload_at(v->pyl, v->offset), v->step,
+         payload_at(result->pyl, result->offset), result->step);
+
+    return result;
+}
+
 vec *vec_log2(vec *result, const vec *v)
 {
     assert(vec_is_valid(result));
     assert(vec_is_valid(v));
     assert(v->d == result->d);
 
+    if (!vec_touch(result))
+        return NULL;
     VLOG2I(result->d,
            payload_at(v->pyl, v->offset), v->step,
            payload_at(result->pyl, result->offset), result->step);
@@ -435,6 +569,8 @@ vec *vec_inv(vec *result, const vec *v)
     assert(vec_is_valid(v));
     assert(v->d == result->d);
 
+    if (!vec_touch(result))
+        return NULL;
     VINVI(result->d,
           payload_at(v->pyl, v->offset), v->step,
           payload_at(result->pyl, result->offset), result->step);
@@ -448,6 +584,8 @@ vec *vec_sqrt(vec *result, const vec *v)
     assert(vec_is_valid(v));
     assert(v->d == result->d);
 
+    if (!vec_touch(result))
+        return NULL;
     VSQRTI(result->d,
            payload_at(v->pyl, v->offset), v->step,
            payload_at(result->pyl, result->offset), result->step);
@@ -461,6 +599,8 @@ vec *vec_square(vec *result, const vec *v)
     assert(vec_is_valid(v));
     assert(v->d == result->d);
 
+    if (!vec_touch(result))
+        return NULL;
     VSQRI(result->d,
           payload_at(v->pyl, v->offset), v->step,
           payload_at(result->pyl, result->offset), result->step);
@@ -474,6 +614,8 @@ vec *vec_tanh(vec *result, const vec *v)
     assert(vec_is_valid(v));
     assert(v->d == result->d);
 
+    if (!vec_touch(result))
+        return NULL;
     VTANHI(result->d,
            payload_at(v->pyl, v->offset), v->step,
            payload_at(result->pyl, result->offset), result->step);
@@ -499,6 +641,8 @@ vec *vec_relu(vec *result, const vec *v)
     assert(vec_is_valid(v));
     assert(v->d == result->d);
 
+    if (!vec_touch(result))
+        return NULL;
     FLD_TYP zero = 0;
     VFMAXI(v->d,
            payload_at(v->pyl, v->offset), v->step,
@@ -569,6 +713,8 @@ vec *vec_addto(vec *v_dst, const vec *v_right)
     assert(vec_is_valid(v_right));
     assert(v_dst->d == v_right->d);
 
+    if (!vec_touch(v_dst))
+        return NULL;
     AXPY(v_dst->d, 1,
          payload_at(v_right->pyl, v_right->offset), v_right->step,
          payload_at(v_dst->pyl, v_dst->offset), v_dst->step);
@@ -582,6 +728,8 @@ vec *vec_subfrom(vec *v_dst, const vec *v_right)
     assert(vec_is_valid(v_right));
     assert(v_dst->d == v_right->d);
 
+    if (!vec_touch(v_dst))
+        return NULL;
     AXPY(v_dst->d, -1,
          payload_at(v_right->pyl, v_right->offset), v_right->step,
          payload_at(v_dst->pyl, v_dst->offset), v_dst->step);
@@ -594,6 +742,8 @@ vec *vec_mulby(vec *v_dst, const vec *v_right)
     assert(vec_is_valid(v_dst));
     assert(vec_is_valid(v_right));
 
+    if (!vec_touch(v_dst))
+        return NULL;
     return vec_mul(v_dst, v_dst, v_right);
 }
 
@@ -627,6 +777,8 @@ vec *vec_sign(vec *result, const vec *v)
     assert(vec_is_valid(v));
     assert(v->d == result->d);
 
+    if (!vec_touch(result))
+        return NULL;
     FLD_TYP one = 1;
     VCOPYSIGNI(v->d,
                &one, 0,
@@ -642,6 +794,8 @@ vec *vec_theta(vec *result, const vec *v)
     assert(vec_is_valid(v));
     assert(v->d == result->d);
 
+    if (!vec_touch(result))
+        return NULL;
     FLD_TYP half = 0.5;
     VCOPYSIGNI(v->d,
                &half, 0,
@@ -663,28 +817,174 @@ FLD_TYP vec_dot(const vec *v_1, const vec *v_2)
                payload_at(v_2->pyl, v_2->offset), v_2->step);
 }
 
+vec *vec_axpby(vec *v_dst, FLD_TYP alpha, const vec *v_right, FLD_TYP beta)
+{
+    assert(vec_is_valid(v_dst));
+    assert(vec_is_valid(v_right));
+    assert(v_dst->d == v_right->d);
+
+    if (!vec_touch(v_dst))
+        return NULL;
+    AXPBY(v_dst->d, alpha,
+          payload_at(v_right->pyl, v_right->offset), v_right->step, beta,
+          payload_at(v_dst->pyl, v_dst->offset), v_dst->step);
+
+    return v_dst;
+}
+
+static inline FLD_TYP update_dot_kernel(IND_TYP d, FLD_TYP *y, IND_TYP y_s, FLD_TYP alpha,
+                                        const FLD_TYP *x, IND_TYP x_s, const FLD_TYP *z, IND_TYP z_s)
+{
+    FLD_TYP dot = 0;
+#pragma omp parallel for simd reduction(+ : dot) if (d >= PAR_MIN_SIZE)
+    for (IND_TYP i = 0; i < d; i++)
+    {
+        FLD_TYP y_i = y[i * y_s] + alpha * x[i * x_s];
+        y[i * y_s] = y_i;
+        dot += y_i * (z ? z[i * z_s] : y_i);
+    }
+    return dot;
+}
+
+FLD_TYP vec_update_dot(vec *v_dst, FLD_TYP alpha, const vec *v_right, const vec *v_dot)
+{
+    assert(vec_is_valid(v_dst));
+    assert(vec_is_valid(v_right));
+    assert(vec_is_valid(v_dot));
+    assert(v_dst->d == v_right->d && v_dst->d == v_dot->d);
+
+    if (!vec_touch(v_dst))
+        return NAN;
+    FLD_TYP *y = payload_at(v_dst->pyl, v_dst->offset);
+    const FLD_TYP *x = payload_at(v_right->pyl, v_right->offset);
+    const FLD_TYP *z = payload_at(v_dot->pyl, v_dot->offset);
+    // Dotting with itself uses the updated value kept in register.
+    if (z == y && v_dot->step == v_dst->step)
+        z = NULL;
+
+    if (v_dst->step == 1 && v_right->step == 1 && v_dot->step == 1)
+        return z ? update_dot_kernel(v_dst->d, y, 1, alpha, x, 1, z, 1)
+                 : update_dot_kernel(v_dst->d, y, 1, alpha, x, 1, NULL, 1);
+    return update_dot_kernel(v_dst->d, y, v_dst->step, alpha, x, v_right->step, z, v_dot->step);
+}
+
+static inline void dot_pair_kernel(IND_TYP d, const FLD_TYP *v, IND_TYP v_s,
+                                   const FLD_TYP *a, IND_TYP a_s, const FLD_TYP *b, IND_TYP b_s,
+                                   FLD_TYP *dot_1, FLD_TYP *dot_2)
+{
+    FLD_TYP s_1 = 0, s_2 = 0;
+#pragma omp parallel for simd reduction(+ : s_1, s_2) if (d >= PAR_MIN_SIZE)
+    for (IND_TYP i = 0; i < d; i++)
+    {
+        FLD_TYP v_i = v[i * v_s];
+        s_1 += v_i * a[i * a_s];
+        s_2 += v_i * b[i * b_s];
+    }
+    *dot_1 = s_1;
+    *dot_2 = s_2;
+}
+
+void vec_dot_pair(const vec *v, const vec *v_1, const vec *v_2, FLD_TYP *dot_1, FLD_TYP *dot_2)
+{
+    assert(vec_is_valid(v));
+    assert(vec_is_valid(v_1));
+    assert(vec_is_valid(v_2));
+    assert(v->d == v_1->d && v->d == v_2->d);
+    assert(dot_1 && dot_2);
+
+    const FLD_TYP *x = payload_at(v->pyl, v->offset);
+    const FLD_TYP *a = payload_at(v_1->pyl, v_1->offset);
+    const FLD_TYP *b = payload_at(v_2->pyl, v_2->offset);
+
+    if (v->step == 1 && v_1->step == 1 && v_2->step == 1)
+        dot_pair_kernel(v->d, x, 1, a, 1, b, 1, dot_1, dot_2);
+    else
+        dot_pair_kernel(v->d, x, v->step, a, v_1->step, b, v_2->step, dot_1, dot_2);
+}
+
+// One read of each operand: sums of (a - b)^2, a^2 and b^2
+static inline void close_kernel(IND_TYP d, const FLD_TYP *a, IND_TYP a_s, const FLD_TYP *b, IND_TYP b_s,
+                                FLD_TYP *d_2, FLD_TYP *a_2, FLD_TYP *b_2)
+{
+    FLD_TYP s_d = 0, s_a = 0, s_b = 0;
+#pragma omp parallel for simd reduction(+ : s_d, s_a, s_b) if (d >= PAR_MIN_SIZE)
+    for (IND_TYP i = 0; i < d; i++)
+    {
+        const FLD_TYP a_i = a[i * a_s], b_i = b[i * b_s];
+        s_d += (a_i - b_i) * (a_i - b_i);
+        s_a += a_i * a_i;
+        s_b += b_i * b_i;
+    }
+    *d_2 = s_d;
+    *a_2 = s_a;
+    *b_2 = s_b;
+}
+
 bool vec_is_close(const vec *v_1, const vec *v_2, FLD_TYP eps)
 {
+    assert(vec_is_valid(v_1));
     assert(vec_is_valid(v_2));
     assert(v_1->d == v_2->d);
     assert(eps > 0);
 
-    FLD_TYP nrm_ratio = vec_norm_2(v_1);
-    nrm_ratio += vec_norm_2(v_2);
-    if (nrm_ratio == 0)
+    const FLD_TYP *a = payload_at(v_1->pyl, v_1->offset);
+    const FLD_TYP *b = payload_at(v_2->pyl, v_2->offset);
+    FLD_TYP d_2, a_2, b_2;
+    if (v_1->step == 1 && v_2->step == 1)
+        close_kernel(v_1->d, a, 1, b, 1, &d_2, &a_2, &b_2);
+    else
+        close_kernel(v_1->d, a, v_1->step, b, v_2->step, &d_2, &a_2, &b_2);
+
+    // 2 ||v_1 - v_2|| / (||v_1|| + ||v_2||) < eps
+    const FLD_TYP nrm_sum = sqrt(a_2) + sqrt(b_2);
+    if (nrm_sum == 0)
         return true;
-    vec result = vec_NULL;
-    vec_construct(&result, v_1->d);
-    vec_sub(&result, v_1, v_2);
-    nrm_ratio = 2 * vec_norm_2(&result) / nrm_ratio;
-    vec_destruct(&result);
-    return nrm_ratio < eps;
+    return 2 * sqrt(d_2) < eps * nrm_sum;
+}
+
+// Elements checked between early exits
+#define ALLCLOSE_CHUNK 1024
+
+static inline bool allclose_kernel(IND_TYP d, const FLD_TYP *a, IND_TYP a_s, const FLD_TYP *b, IND_TYP b_s,
+                                   FLD_TYP atol, FLD_TYP rtol)
+{
+    for (IND_TYP c_0 = 0; c_0 < d; c_0 += ALLCLOSE_CHUNK)
+    {
+        const IND_TYP c_1 = (c_0 + ALLCLOSE_CHUNK < d) ? c_0 + ALLCLOSE_CHUNK : d;
+        IND_TYP n_far = 0;
+#pragma omp simd reduction(+ : n_far)
+        for (IND_TYP i = c_0; i < c_1; i++)
+        {
+            const FLD_TYP a_i = a[i * a_s], b_i = b[i * b_s];
+            // Negated so that NaNs count as far
+            n_far += !(fabs(a_i - b_i) <= atol + rtol * fabs(b_i));
+        }
+        if (n_far)
+            return false;
+    }
+    return true;
+}
+
+bool vec_allclose(const vec *v_1, const vec *v_2, FLD_TYP atol, FLD_TYP rtol)
+{
+    assert(vec_is_valid(v_1));
+    assert(vec_is_valid(v_2));
+    assert(v_1->d == v_2->d);
+    assert(atol >= 0 && rtol >= 0);
+
+    const FLD_TYP *a = payload_at(v_1->pyl, v_1->offset);
+    const FLD_TYP *b = payload_at(v_2->pyl, v_2->offset);
+    if (v_1->step == 1 && v_2->step == 1)
+        return allclose_kernel(v_1->d, a, 1, b, 1, atol, rtol);
+    return allclose_kernel(v_1->d, a, v_1->step, b, v_2->step, atol, rtol);
 }
 
 vec *vec_apply(vec *v, FLD_TYP (*map)(FLD_TYP))
 {
     assert(vec_is_valid(v));
 
+    if (!vec_touch(v))
+        return NULL;
     for (IND_TYP j = 0; j < v->d; j++)
     {
         IND_TYP i = v->offset + j * v->step;
@@ -1,6 +1,9 @@
 #include "vec_mat.h"
 
 #include <assert.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <tgmath.h>
 
 #include "vector_eng.h"
 
@@ -13,6 +16,8 @@ vec *mat_dot_vec(vec *target, const mat *ml, const vec *vr)
     assert(target->d == ml->d1);
     assert(target->pyl->arr + target->offset != vr->pyl->arr + vr->offset);
 
+    if (!vec_touch(target))
+        return NULL;
     GEMV(CblasRowMajor, CblasNoTrans, ml->d1, ml->d2, 1,
          ml->pyl->arr + ml->offset, ml->d2,
          vr->pyl->arr + vr->offset, vr->step, 0,
@@ -30,6 +35,8 @@ vec *vec_dot_mat(vec *target, const vec *vl, const mat *mr)
     assert(target->d == mr->d2);
     assert(target->pyl->arr + target->offset != vl->pyl->arr + vl->offset);
 
+    if (!vec_touch(target))
+        return NULL;
     GEMV(CblasRowMajor, CblasTrans, mr->d1, mr->d2, 1,
          mr->pyl->arr + mr->offset, mr->d2,
          vl->pyl->arr + vl->offset, vl->step, 0,
@@ -45,6 +52,8 @@ mat *vec_outer(mat *target, const vec *v_left, const vec *v_right)
     assert(vec_is_valid(v_right));
     assert(target->d1 == v_left->d && target->d2 == v_right->d);
 
+    if (!mat_touch(target))
+        return NULL;
     mat_fill_zero(target);
     GER(CblasRowMajor, v_left->d, v_right->d, 1,
         v_left->pyl->arr + v_left->offset, v_left->step,
@@ -61,6 +70,8 @@ mat *mat_update_outer(mat *target, FLD_TYP alpha, const vec *v_left, const vec *
     assert(vec_is_valid(v_right));
     assert(target->d1 == v_left->d && target->d2 == v_right->d);
 
+    if (!mat_touch(target))
+        return NULL;
     GER(CblasRowMajor, v_left->d, v_right->d, alpha,
         v_left->pyl->arr + v_left->offset, v_left->step,
         v_right->pyl->arr + v_right->offset, v_right->step,
@@ -69,6 +80,50 @@ mat *mat_update_outer(mat *target, FLD_TYP alpha, const vec *v_left, const vec *
     return target;
 }
 
+mat *mat_update_outer_batch(mat *target, FLD_TYP alpha, const mat *m_left, const mat *m_right)
+{
+    assert(mat_is_valid(target));
+    assert(mat_is_valid(m_left));
+    assert(mat_is_valid(m_right));
+    assert(m_left->d1 == m_right->d1);
+    assert(target->d1 == m_left->d2 && target->d2 == m_right->d2);
+
+    if (!mat_touch(target))
+        return NULL;
+    GEMM(CblasRowMajor, CblasTrans, CblasNoTrans,
+         m_left->d2, m_right->d2, m_left->d1, alpha,
+         m_left->pyl->arr + m_left->offset, m_left->d2,
+         m_right->pyl->arr + m_right->offset, m_right->d2,
+         1, target->pyl->arr + target->offset, target->d2);
+
+    return target;
+}
+
+mat *mat_update_gram(mat *target, FLD_TYP alpha, const mat *m)
+{
+    assert(mat_is_valid(target));
+    assert(mat_is_valid(m));
+    assert(target->d1 == m->d2 && target->d2 == m->d2);
+
+    if (!mat_touch(target))
+        return NULL;
+    const IND_TYP n = m->d2;
+    FLD_TYP *t_arr = target->pyl->arr + target->offset;
+
+    SYRK(CblasRowMajor, CblasUpper, CblasTrans,
+         n, m->d1, alpha,
+         m->pyl->arr + m->offset, n,
+         1, t_arr, n);
+
+    // SYRK only touches the upper triangle; mirror it to the lower one.
+#pragma omp parallel for if (target->size >= PAR_MIN_SIZE)
+    for (IND_TYP i = 1; i < n; i++)
+        for (IND_TYP j = 0; j < i; j++)
+            t_arr[i * n + j] = t_arr[j * n + i];
+
+    return target;
+}
+
 vec *mat_row_at(mat *m, vec *row, IND_TYP i)
 {
     assert(mat_is_valid(m));
@@ -98,3 +153,366 @@ vec *mat_column_at(mat *m, vec *col, IND_TYP j)
     col->d = m->d1;
     return col;
 }
+
+
+static mat *row_broadcast(mat *result, const mat *m, const vec *v, bool mul)
+{
+    assert(mat_is_valid(result));
+    assert(mat_is_valid(m));
+    assert(vec_is_valid(v));
+    assert(result->d1 == m->d1 && result->d2 == m->d2);
+    assert(v->d == m->d2);
+
+    if (!mat_touch(result))
+        return NULL;
+    FLD_TYP *r_arr = result->pyl->arr + result->offset;
+    const FLD_TYP *m_arr = m->pyl->arr + m->offset;
+    const FLD_TYP *v_arr = v->pyl->arr + v->offset;
+    const IND_TYP d2 = m->d2;
+    const IND_TYP step = v->step;
+
+#pragma omp parallel for if (m->size >= PAR_MIN_SIZE)
+    for (IND_TYP i = 0; i < m->d1; i++)
+    {
+        FLD_TYP *r_row = r_arr + i * d2;
+        const FLD_TYP *m_row = m_arr + i * d2;
+        if (mul)
+        {
+#pragma omp simd
+            for (IND_TYP j = 0; j < d2; j++)
+                r_row[j] = m_row[j] * v_arr[j * step];
+        }
+        else
+        {
+#pragma omp simd
+            for (IND_TYP j = 0; j < d2; j++)
+                r_row[j] = m_row[j] + v_arr[j * step];
+        }
+    }
+
+    return result;
+}
+
+static mat *col_broadcast(mat *result, const mat *m, const vec *v, bool mul)
+{
+    assert(mat_is_valid(result));
+    assert(mat_is_valid(m));
+    assert(vec_is_valid(v));
+    assert(result->d1 == m->d1 && result->d2 == m->d2);
+    assert(v->d == m->d1);
+
+    if (!mat_touch(result))
+        return NULL;
+    FLD_TYP *r_arr = result->pyl->arr + result->offset;
+    const FLD_TYP *m_arr = m->pyl->arr + m->offset;
+    const FLD_TYP *v_arr = v->pyl->arr + v->offset;
+    const IND_TYP d2 = m->d2;
+
+#pragma omp parallel for if (m->size >= PAR_MIN_SIZE)
+    for (IND_TYP i = 0; i < m->d1; i++)
+    {
+        FLD_TYP *r_row = r_arr + i * d2;
+        const FLD_TYP *m_row = m_arr + i * d2;
+        const FLD_TYP f = v_arr[i * v->step];
+        if (mul)
+        {
+#pragma omp simd
+            for (IND_TYP j = 0; j < d2; j++)
+                r_row[j] = m_row[j] * f;
+        }
+        else
+        {
+#pragma omp simd
+            for (IND_TYP j = 0; j < d2; j++)
+                r_row[j] = m_row[j] + f;
+        }
+    }
+
+    return result;
+}
+
+mat *mat_add_row_vec(mat *result, const mat *m, const vec *v)
+{
+    return row_broadcast(result, m, v, false);
+}
+
+mat *mat_mul_row_vec(mat *result, const mat *m, const vec *v)
+{
+    return row_broadcast(result, m, v, true);
+}
+
+mat *mat_add_col_vec(mat *result, const mat *m, const vec *v)
+{
+    return col_broadcast(result, m, v, false);
+}
+
+mat *mat_mul_col_vec(mat *result, const mat *m, const vec *v)
+{
+    return col_broadcast(result, m, v, true);
+}
+
+mat *mat_addto_row_vec(mat *m, const vec *v)
+{
+    return row_broadcast(m, m, v, false);
+}
+
+mat *mat_mulby_row_vec(mat *m, const vec *v)
+{
+    return row_broadcast(m, m, v, true);
+}
+
+mat *mat_addto_col_vec(mat *m, const vec *v)
+{
+    return col_broadcast(m, m, v, false);
+}
+
+mat *mat_mulby_col_vec(mat *m, const vec *v)
+{
+    return col_broadcast(m, m, v, true);
+}
+
+FLD_TYP mat_softmax_xent(vec *loss, mat *grad, const mat *logits, const mat *labels)
+{
+    assert(mat_is_valid(logits));
+    assert(mat_is_valid(labels));
+    assert(labels->d1 == logits->d1 && labels->d2 == logits->d2);
+    assert(!loss || (vec_is_valid(loss) && loss->d == logits->d1));
+    assert(!grad || (mat_is_valid(grad) && grad->d1 == logits->d1 && grad->d2 == logits->d2));
+
+    if ((loss && !vec_touch(loss)) || (grad && !mat_touch(grad)))
+        return NAN;
+    const IND_TYP d2 = logits->d2;
+    const FLD_TYP *z_arr = logits->pyl->arr + logits->offset;
+    const FLD_TYP *y_arr = labels->pyl->arr + labels->offset;
+    FLD_TYP *g_arr = grad ? grad->pyl->arr + grad->offset : NULL;
+    double total = 0;
+
+    // Each row is read from memory once; the later passes over it hit the cache.
+#pragma omp parallel for reduction(+ : total) if (logits->size >= PAR_MIN_SIZE)
+    for (IND_TYP i = 0; i < logits->d1; i++)
+    {
+        const FLD_TYP *z = z_arr + i * d2;
+        const FLD_TYP *y = y_arr + i * d2;
+
+        FLD_TYP z_max = z[0];
+        for (IND_TYP j = 1; j < d2; j++)
+            z_max = (z[j] > z_max) ? z[j] : z_max;
+
+        FLD_TYP s = 0, y_z = 0, y_sum = 0;
+        if (g_arr)
+        {
+            FLD_TYP *g = g_arr + i * d2;
+#pragma omp simd reduction(+ : s, y_z, y_sum)
+            for (IND_TYP j = 0; j < d2; j++)
+            {
+                FLD_TYP e = exp(z[j] - z_max);
+                s += e;
+                y_z += y[j] * (z[j] - z_max);
+                y_sum += y[j];
+                g[j] = e;
+            }
+            const FLD_TYP p_scale = y_sum / s;
+#pragma omp simd
+            for (IND_TYP j = 0; j < d2; j++)
+                g[j] = g[j] * p_scale - y[j];
+        }
+        else
+        {
+#pragma omp simd reduction(+ : s, y_z, y_sum)
+            for (IND_TYP j = 0; j < d2; j++)
+            {
+                s += exp(z[j] - z_max);
+                y_z += y[j] * (z[j] - z_max);
+                y_sum += y[j];
+            }
+        }
+
+        // -sum_j y_j (z_j - lse) with lse = z_max + log(s)
+        FLD_TYP l = y_sum * log(s) - y_z;
+        if (loss)
+            loss->pyl->arr[loss->offset + i * loss->step] = l;
+        total += l;
+    }
+
+    return (FLD_TYP)(total / logits->d1);
+}
+
+/*
+ * Row normalization kernels. Each row is visited twice: once for its statistics
+ * and once to normalize it, which finds the row still in cache.
+ * A NULL gain or bias is replaced by a 1 or 0 with step 0.
+ */
+
+static const FLD_TYP one = 1;
+static const FLD_TYP zero = 0;
+
+static inline const FLD_TYP *opt_arr(const vec *v, const FLD_TYP *dflt, IND_TYP *step)
+{
+    *step = v ? v->step : 0;
+    return v ? v->pyl->arr + v->offset : dflt;
+}
+
+static mat *norm_rows(mat *result, const mat *m, const vec *gain, const vec *bias, FLD_TYP eps,
+                      vec *mean, vec *rstd, bool center)
+{
+    assert(mat_is_valid(result));
+    assert(mat_is_valid(m));
+    assert(result->d1 == m->d1 && result->d2 == m->d2);
+    assert(!gain || (vec_is_valid(gain) && gain->d == m->d2));
+    assert(!bias || (vec_is_valid(bias) && bias->d == m->d2));
+    assert(!mean || (vec_is_valid(mean) && mean->d == m->d1));
+    assert(!rstd || (vec_is_valid(rstd) && rstd->d == m->d1));
+    assert(eps >= 0);
+
+    if (!mat_touch(result) || (mean && !vec_touch(mean)) || (rstd && !vec_touch(rstd)))
+        return NULL;
+    const IND_TYP d2 = m->d2;
+    IND_TYP g_s, b_s;
+    const FLD_TYP *g_arr = opt_arr(gain, &one, &g_s);
+    const FLD_TYP *b_arr = opt_arr(bias, &zero, &b_s);
+    const FLD_TYP *m_arr = m->pyl->arr + m->offset;
+    FLD_TYP *r_arr = result->pyl->arr + result->offset;
+
+#pragma omp parallel for if (m->size >= PAR_MIN_SIZE)
+    for (IND_TYP i = 0; i < m->d1; i++)
+    {
+        const FLD_TYP *x = m_arr + i * d2;
+        FLD_TYP *r = r_arr + i * d2;
+
+        // Sums are shifted by x[0] to avoid cancellation in the variance.
+        const FLD_TYP k = center ? x[0] : 0;
+        FLD_TYP s = 0, s2 = 0;
+#pragma omp simd reduction(+ : s, s2)
+        for (IND_TYP j = 0; j < d2; j++)
+        {
+            FLD_TYP xs = x[j] - k;
+            s += xs;
+            s2 += xs * xs;
+        }
+        const FLD_TYP mu = center ? k + s / d2 : 0;
+        FLD_TYP var = center ? (s2 - s * s / d2) / d2 : s2 / d2;
+        var = (var > 0) ? var : 0;
+        const FLD_TYP rs = 1 / sqrt(var + eps);
+
+#pragma omp simd
+        for (IND_TYP j = 0; j < d2; j++)
+            r[j] = (x[j] - mu) * rs * g_arr[j * g_s] + b_arr[j * b_s];
+
+        if (mean)
+            mean->pyl->arr[mean->offset + i * mean->step] = mu;
+        if (rstd)
+            rstd->pyl->arr[rstd->offset + i * rstd->step] = rs;
+    }
+
+    return result;
+}
+
+static mat *norm_rows_backward(mat *d_m, vec *d_gain, vec *d_bias, const mat *d_result,
+                               const mat *m, const vec *gain, const vec *mean, const vec *rstd,
+                               bool center)
+{
+    assert(mat_is_valid(d_m));
+    assert(mat_is_valid(d_result));
+    assert(mat_is_valid(m));
+    assert(d_m->d1 == m->d1 && d_m->d2 == m->d2);
+    assert(d_result->d1 == m->d1 && d_result->d2 == m->d2);
+    assert(!gain || (vec_is_valid(gain) && gain->d == m->d2));
+    assert(!d_gain || (vec_is_valid(d_gain) && d_gain->d == m->d2));
+    assert(!d_bias || (vec_is_valid(d_bias) && d_bias->d == m->d2));
+    assert(!center || (vec_is_valid(mean) && mean->d == m->d1));
+    assert(vec_is_valid(rstd) && rstd->d == m->d1);
+
+    if (!mat_touch(d_m) || (d_gain && !vec_touch(d_gain)) || (d_bias && !vec_touch(d_bias)))
+        return NULL;
+    const IND_TYP d2 = m->d2;
+    IND_TYP g_s;
+    const FLD_TYP *g_arr = opt_arr(gain, &one, &g_s);
+    const FLD_TYP *x_arr = m->pyl->arr + m->offset;
+    const FLD_TYP *dy_arr = d_result->pyl->arr + d_result->offset;
+    FLD_TYP *dx_arr = d_m->pyl->arr + d_m->offset;
+
+    // Per-column sums of dy * x_hat and dy, reduced over the threads
+    const bool acc = d_gain || d_bias;
+    FLD_TYP *dg_acc = (FLD_TYP *)calloc(2 * d2, sizeof(FLD_TYP));
+    assert(dg_acc);
+    if (!dg_acc)
+        return NULL;
+    FLD_TYP *db_acc = dg_acc + d2;
+
+#pragma omp parallel for reduction(+ : dg_acc[:d2], db_acc[:d2]) if (m->size >= PAR_MIN_SIZE)
+    for (IND_TYP i = 0; i < m->d1; i++)
+    {
+        const FLD_TYP *x = x_arr + i * d2;
+        const FLD_TYP *dy = dy_arr + i * d2;
+        FLD_TYP *dx = dx_arr + i * d2;
+        const FLD_TYP mu = center ? mean->pyl->arr[mean->offset + i * mean->step] : 0;
+        const FLD_TYP rs = rstd->pyl->arr[rstd->offset + i * rstd->step];
+
+        FLD_TYP s_dxh = 0, s_dxh_xh = 0;
+#pragma omp simd reduction(+ : s_dxh, s_dxh_xh)
+        for (IND_TYP j = 0; j < d2; j++)
+        {
+            FLD_TYP xh = (x[j] - mu) * rs;
+            FLD_TYP dxh = dy[j] * g_arr[j * g_s];
+            s_dxh += dxh;
+            s_dxh_xh += dxh * xh;
+        }
+        const FLD_TYP c_1 = center ? s_dxh / d2 : 0;
+        const FLD_TYP c_2 = s_dxh_xh / d2;
+
+        if (acc)
+        {
+#pragma omp simd
+            for (IND_TYP j = 0; j < d2; j++)
+            {
+                FLD_TYP xh = (x[j] - mu) * rs;
+                dg_acc[j] += dy[j] * xh;
+                db_acc[j] += dy[j];
+                dx[j] = rs * (dy[j] * g_arr[j * g_s] - c_1 - xh * c_2);
+            }
+        }
+        else
+        {
+#pragma omp simd
+            for (IND_TYP j = 0; j < d2; j++)
+            {
+                FLD_TYP xh = (x[j] - mu) * rs;
+                dx[j] = rs * (dy[j] * g_arr[j * g_s] - c_1 - xh * c_2);
+            }
+        }
+    }
+
+    for (IND_TYP j = 0; acc && j < d2; j++)
+    {
+        if (d_gain)
+            d_gain->pyl->arr[d_gain->offset + j * d_gain->step] = dg_acc[j];
+        if (d_bias)
+            d_bias->pyl->arr[d_bias->offset + j * d_bias->step] = db_acc[j];
+    }
+    free((void *)dg_acc);
+
+    return d_m;
+}
+
+mat *mat_layernorm_rows(mat *result, const mat *m, const vec *gain, const vec *bias, FLD_TYP eps,
+                        vec *mean, vec *rstd)
+{
+    return norm_rows(result, m, gain, bias, eps, mean, rstd, true);
+}
+
+mat *mat_layernorm_rows_backward(mat *d_m, vec *d_gain, vec *d_bias, const mat *d_result,
+                                 const mat *m, const vec *gain, const vec *mean, const vec *rstd)
+{
+    return norm_rows_backward(d_m, d_gain, d_bias, d_result, m, gain, mean, rstd, true);
+}
+
+mat *mat_rmsnorm_rows(mat *result, const mat *m, const vec *gain, FLD_TYP eps, vec *rstd)
+{
+    return norm_rows(result, m, gain, NULL, eps, NULL, rstd, false);
+}
+
+mat *mat_rmsnorm_rows_backward(mat *d_m, vec *d_gain, const mat *d_result,
+                               const mat *m, const vec *gain, const vec *rstd)
+{
+    return norm_rows_backward(d_m, d_gain, NULL, d_result, m, gain, NULL, rstd, false);
+}
\ No newline at end of file
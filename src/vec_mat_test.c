@@ -1,7 +1,293 @@
 #include "vec_mat.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <omp.h>
+#include <math.h>
+#include <assert.h>
 
+static FLD_TYP rnd(void)
+{
+    return 2 * (rand() / (FLD_TYP)RAND_MAX) - 1;
+}
+
+// target += alpha * sum_b left[b] (*) right[b] with one GER per row pair
+static mat *update_outer_looped(mat *target, FLD_TYP alpha, mat *left, mat *right)
+{
+    vec l = vec_NULL;
+    vec r = vec_NULL;
+    for (IND_TYP b = 0; b < left->d1; b++)
+        mat_update_outer(target, alpha, mat_row_at(left, &l, b), mat_row_at(right, &r, b));
+    vec_destruct(&l);
+    vec_destruct(&r);
+    return target;
+}
+
+static void outer_batch_test(void)
+{
+    char buff[1024];
+    mat x = mat_NULL;
+    mat y = mat_NULL;
+    mat t = mat_NULL;
+    mat ref = mat_NULL;
+    mat g = mat_NULL;
+    mat g_ref = mat_NULL;
+
+    mat_construct(&x, 5, 3);
+    mat_construct(&y, 5, 4);
+    mat_construct(&t, 3, 4);
+    mat_construct(&ref, 3, 4);
+    mat_construct(&g, 3, 3);
+    mat_construct(&g_ref, 3, 3);
+    mat_fill_rnd(&x, rnd);
+    mat_fill_rnd(&y, rnd);
+    mat_fill_zero(&t);
+    mat_fill_zero(&ref);
+    mat_fill_zero(&g);
+    mat_fill_zero(&g_ref);
+
+    mat_update_outer_batch(&t, 0.5, &x, &y);
+    update_outer_looped(&ref, 0.5, &x, &y);
+    printf("t += 0.5 x^T@y:\n%s\n", mat_to_str(&t, buff));
+    assert(mat_is_close(&t, &ref, 1E-5));
+
+    mat_update_gram(&g, 2, &x);
+    update_outer_looped(&g_ref, 2, &x, &x);
+    printf("g += 2 x^T@x:\n%s\n", mat_to_str(&g, buff));
+    assert(mat_is_close(&g, &g_ref, 1E-5));
+
+    mat_destruct(&x);
+    mat_destruct(&y);
+    mat_destruct(&t);
+    mat_destruct(&ref);
+    mat_destruct(&g);
+    mat_destruct(&g_ref);
+    puts("------");
+}
+
+static void broadcast_test(void)
+{
+    char buff[1024];
+    mat m = mat_NULL;
+    mat r = mat_NULL;
+    mat ref = mat_NULL;
+    vec vr = vec_NULL;
+    vec vc = vec_NULL;
+    vec row = vec_NULL;
+    vec col = vec_NULL;
+
+    mat_construct(&m, 3, 4);
+    mat_construct(&r, 3, 4);
+    mat_construct(&ref, 3, 4);
+    vec_construct(&vr, 4);
+    vec_construct(&vc, 3);
+    for (int i = 0; i < 12; i++)
+        m.pyl->arr[i] = i + 1;
+    vec_copy_arr(&vr, (FLD_TYP[]){1, -1, 2, -2});
+    vec_copy_arr(&vc, (FLD_TYP[]){10, 20, 30});
+
+    printf("m:\n%s\n", mat_to_str(&m, buff));
+    printf("m + vr (rows):\n%s\n", mat_to_str(mat_add_row_vec(&r, &m, &vr), buff));
+    mat_assign(&ref, &m);
+    for (IND_TYP i = 0; i < ref.d1; i++)
+        vec_addto(mat_row_at(&ref, &row, i), &vr);
+    assert(mat_is_close(&r, &ref, 1E-6));
+
+    printf("m * vr (rows):\n%s\n", mat_to_str(mat_mul_row_vec(&r, &m, &vr), buff));
+    mat_assign(&ref, &m);
+    for (IND_TYP i = 0; i < ref.d1; i++)
+        vec_mulby(mat_row_at(&ref, &row, i), &vr);
+    assert(mat_is_close(&r, &ref, 1E-6));
+
+    printf("m + vc (cols):\n%s\n", mat_to_str(mat_add_col_vec(&r, &m, &vc), buff));
+    mat_assign(&ref, &m);
+    for (IND_TYP j = 0; j < ref.d2; j++)
+        vec_addto(mat_column_at(&ref, &col, j), &vc);
+    assert(mat_is_close(&r, &ref, 1E-6));
+
+    printf("m * vc (cols):\n%s\n", mat_to_str(mat_mul_col_vec(&r, &m, &vc), buff));
+    mat_assign(&ref, &m);
+    for (IND_TYP j = 0; j < ref.d2; j++)
+        vec_mulby(mat_column_at(&ref, &col, j), &vc);
+    assert(mat_is_close(&r, &ref, 1E-6));
+
+    mat_assign(&r, &m);
+    mat_mulby_col_vec(mat_addto_row_vec(&r, &vr), &vc);
+    printf("(m + vr) * vc in-place:\n%s\n", mat_to_str(&r, buff));
+
+    vec_destruct(&row);
+    vec_destruct(&col);
+    vec_destruct(&vr);
+    vec_destruct(&vc);
+    mat_destruct(&m);
+    mat_destruct(&r);
+    mat_destruct(&ref);
+    puts("------");
+}
+
+
+static void softmax_xent_test(void)
+{
+    char buff[1024];
+    mat z = mat_NULL;
+    mat y = mat_NULL;
+    mat g = mat_NULL;
+    vec loss = vec_NULL;
+    vec p = vec_NULL;
+    vec z_row = vec_NULL;
+    vec y_row = vec_NULL;
+    vec g_row = vec_NULL;
+
+    mat_construct(&z, 3, 4);
+    mat_construct(&y, 3, 4);
+    mat_construct(&g, 3, 4);
+    vec_construct(&loss, 3);
+    vec_construct(&p, 4);
+    mat_fill_rnd(&z, rnd);
+    mat_fill_zero(&y);
+    *mat_at(&y, 0, 1) = 1;
+    *mat_at(&y, 1, 3) = 1;
+    *mat_at(&y, 2, 0) = 1;
+
+    FLD_TYP mean = mat_softmax_xent(&loss, &g, &z, &y);
+    printf("logits:\n%s\n", mat_to_str(&z, buff));
+    printf("xent loss: %s mean: %g\n", vec_to_str(&loss, buff), mean);
+    printf("xent grad:\n%s\n", mat_to_str(&g, buff));
+
+    // Unfused reference: softmax, ln, dot with the one-hot target, subtraction
+    FLD_TYP ref_mean = 0;
+    for (IND_TYP i = 0; i < z.d1; i++)
+    {
+        mat_row_at(&z, &z_row, i);
+        mat_row_at(&y, &y_row, i);
+        mat_row_at(&g, &g_row, i);
+        vec_softmax(&p, &z_row);
+        vec_sub(&p, &p, &y_row);
+        assert(vec_is_close(&p, &g_row, 1E-5));
+        vec_softmax(&p, &z_row);
+        vec_ln(&p, &p);
+        FLD_TYP l = -vec_dot(&y_row, &p);
+        assert(fabs(l - *vec_at(&loss, i)) < 1E-5);
+        ref_mean += l / z.d1;
+    }
+    assert(fabs(ref_mean - mean) < 1E-5);
+
+    // Large logits do not overflow
+    mat_scale(&z, 1000);
+    mean = mat_softmax_xent(NULL, &z, &z, &y);
+    printf("xent of 1000 * logits: %g, in-place grad:\n%s\n", mean, mat_to_str(&z, buff));
+    assert(isfinite(mean));
+
+    vec_destruct(&z_row);
+    vec_destruct(&y_row);
+    vec_destruct(&g_row);
+    vec_destruct(&p);
+    vec_destruct(&loss);
+    mat_destruct(&z);
+    mat_destruct(&y);
+    mat_destruct(&g);
+    puts("------");
+}
+
+// sum(w * layernorm_rows(m)) or sum(w * rmsnorm_rows(m))
+static FLD_TYP norm_loss(const mat *m, const mat *w, const vec *gain, const vec *bias, bool rms)
+{
+    mat y = mat_NULL;
+    mat_construct(&y, m->d1, m->d2);
+    if (rms)
+        mat_rmsnorm_rows(&y, m, gain, 1E-5, NULL);
+    else
+        mat_layernorm_rows(&y, m, gain, bias, 1E-5, NULL, NULL);
+    mat_mulby(&y, w);
+    FLD_TYP l = mat_sum(&y);
+    mat_destruct(&y);
+    return l;
+}
+
+static void norm_rows_test(bool rms)
+{
+    char buff[1024];
+    const FLD_TYP h = 1E-2;
+    mat x = mat_NULL, y = mat_NULL, w = mat_NULL, dx = mat_NULL;
+    vec gain = vec_NULL, bias = vec_NULL, d_gain = vec_NULL, d_bias = vec_NULL;
+    vec mean = vec_NULL, rstd = vec_NULL, row = vec_NULL, ref = vec_NULL;
+
+    mat_construct(&x, 3, 5);
+    mat_construct(&y, 3, 5);
+    mat_construct(&w, 3, 5);
+    mat_construct(&dx, 3, 5);
+    vec_construct(&gain, 5);
+    vec_construct(&bias, 5);
+    vec_construct(&d_gain, 5);
+    vec_construct(&d_bias, 5);
+    vec_construct(&mean, 3);
+    vec_construct(&rstd, 3);
+    vec_construct(&ref, 5);
+    mat_fill_rnd(&x, rnd);
+    mat_f_addto(&x, 3);
+    mat_fill_rnd(&w, rnd);
+    vec_fill_rnd(&gain, rnd);
+    vec_fill_rnd(&bias, rnd);
+
+    if (rms)
+        mat_rmsnorm_rows(&y, &x, &gain, 1E-5, &rstd);
+    else
+        mat_layernorm_rows(&y, &x, &gain, &bias, 1E-5, &mean, &rstd);
+    printf("%s rows:\n%s\n", rms ? "rmsnorm" : "layernorm", mat_to_str(&y, buff));
+
+    // Unfused reference on each row
+    for (IND_TYP i = 0; i < x.d1; i++)
+    {
+        vec_assign(&ref, mat_row_at(&x, &row, i));
+        if (!rms)
+            vec_f_addto(&ref, -vec_sum(&ref) / ref.d);
+        vec_scale(&ref, 1 / sqrt(vec_dot(&ref, &ref) / ref.d + 1E-5));
+        vec_mulby(&ref, &gain);
+        if (!rms)
+            vec_addto(&ref, &bias);
+        assert(vec_is_close(&ref, mat_row_at(&y, &row, i), 1E-4));
+    }
+
+    // Backward against central differences of sum(w * y)
+    FLD_TYP err = 0;
+    if (rms)
+        mat_rmsnorm_rows_backward(&dx, &d_gain, &w, &x, &gain, &rstd);
+    else
+        mat_layernorm_rows_backward(&dx, &d_gain, &d_bias, &w, &x, &gain, &mean, &rstd);
+    for (IND_TYP k = 0; k < x.size; k++)
+    {
+        FLD_TYP x_k = x.pyl->arr[k];
+        x.pyl->arr[k] = x_k + h;
+        FLD_TYP l_p = norm_loss(&x, &w, &gain, &bias, rms);
+        x.pyl->arr[k] = x_k - h;
+        FLD_TYP l_m = norm_loss(&x, &w, &gain, &bias, rms);
+        x.pyl->arr[k] = x_k;
+        err = fmax(err, fabs((l_p - l_m) / (2 * h) - dx.pyl->arr[k]));
+    }
+    for (IND_TYP j = 0; j < gain.d; j++)
+    {
+        FLD_TYP g_j = *vec_at(&gain, j);
+        *vec_at(&gain, j) = g_j + h;
+        FLD_TYP l_p = norm_loss(&x, &w, &gain, &bias, rms);
+        *vec_at(&gain, j) = g_j - h;
+        FLD_TYP l_m = norm_loss(&x, &w, &gain, &bias, rms);
+        *vec_at(&gain, j) = g_j;
+        err = fmax(err, fabs((l_p - l_m) / (2 * h) - *vec_at(&d_gain, j)));
+    }
+    printf("d_gain: %s\n", vec_to_str(&d_gain, buff));
+    printf("max |backward - finite difference|: %g\n", err);
+    assert(err < 2E-2);
+
+    vec *all_v[] = {&gain, &bias, &d_gain, &d_bias, &mean, &rstd, &row, &ref};
+    for (int a = 0; a < 8; a++)
+        vec_destruct(all_v[a]);
+    mat_destruct(&x);
+    mat_destruct(&y);
+    mat_destruct(&w);
+    mat_destruct(&dx);
+    puts("------");
+}
 
 void vec_mat_test(void)
 {
@@ -71,7 +357,70 @@ void vec_mat_test(void)
     payload_release(&pyl_l);
     payload_release(&pyl_r);
 
+    broadcast_test();
+    outer_batch_test();
+    softmax_xent_test();
+    norm_rows_test(false);
+    norm_rows_test(true);
 
     puts("^^^ vec_mat_test ^^^");
 
-}
\ No newline at end of file
+}
+
+void vec_mat_bench(void)
+{
+    puts("+++ vec_mat_bench +++");
+
+    const IND_TYP batch = 64, d_l = 1024, d_r = 1024;
+    const int reps = 10;
+    mat x = mat_NULL;
+    mat y = mat_NULL;
+    mat t_ger = mat_NULL;
+    mat t_gemm = mat_NULL;
+    mat t_syrk = mat_NULL;
+    mat_construct(&x, batch, d_l);
+    mat_construct(&y, batch, d_r);
+    mat_construct(&t_ger, d_l, d_r);
+    mat_construct(&t_gemm, d_l, d_r);
+    mat_construct(&t_syrk, d_l, d_l);
+    mat_fill_rnd(&x, rnd);
+    mat_fill_rnd(&y, rnd);
+    mat_fill_zero(&t_ger);
+    mat_fill_zero(&t_gemm);
+    mat_fill_zero(&t_syrk);
+
+    double t0 = omp_get_wtime();
+    for (int r = 0; r < reps; r++)
+        update_outer_looped(&t_ger, 1, &x, &y);
+    double ger_elp = omp_get_wtime() - t0;
+    t0 = omp_get_wtime();
+    for (int r = 0; r < reps; r++)
+        mat_update_outer_batch(&t_gemm, 1, &x, &y);
+    double gemm_elp = omp_get_wtime() - t0;
+    printf("B=%ld %ldx%ld: looped GER: %g s, batch GEMM: %g s, speed-up: %g\n",
+           batch, d_l, d_r, ger_elp, gemm_elp, ger_elp / gemm_elp);
+    if (!mat_is_close(&t_ger, &t_gemm, 1E-4))
+        puts("looped GER and batch GEMM results differ!");
+
+    mat_fill_zero(&t_ger);
+    t0 = omp_get_wtime();
+    for (int r = 0; r < reps; r++)
+        update_outer_looped(&t_ger, 1, &x, &x);
+    ger_elp = omp_get_wtime() - t0;
+    t0 = omp_get_wtime();
+    for (int r = 0; r < reps; r++)
+        mat_update_gram(&t_syrk, 1, &x);
+    double syrk_elp = omp_get_wtime() - t0;
+    printf("B=%ld %ldx%ld: looped GER: %g s, gram SYRK: %g s, speed-up: %g\n",
+           batch, d_l, d_l, ger_elp, syrk_elp, ger_elp / syrk_elp);
+    if (!mat_is_close(&t_ger, &t_syrk, 1E-4))
+        puts("looped GER and gram SYRK results differ!");
+
+    mat_destruct(&x);
+    mat_destruct(&y);
+    mat_destruct(&t_ger);
+    mat_destruct(&t_gemm);
+    mat_destruct(&t_syrk);
+
+    puts("^^^ vec_mat_bench ^^^");
+}
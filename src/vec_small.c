@@ -0,0 +1,115 @@
+#include "vec_small.h"
+
+#include <assert.h>
+
+// Pointer to row k of the N x n soa
+#define SOA_ROW(m, k) ((m)->pyl->arr + (m)->offset + (k) * (m)->d2)
+
+// Loops j over the n vectors of a batch; SOA_FOR_SIMD where the body is unit-stride in j
+#define SOA_FOR _Pragma("omp parallel for if (n >= PAR_MIN_SIZE)") for (IND_TYP j = 0; j < n; j++)
+#define SOA_FOR_SIMD _Pragma("omp parallel for simd if (n >= PAR_MIN_SIZE)") for (IND_TYP j = 0; j < n; j++)
+
+#define VEC_SOA_DEF(N)                                                                     \
+    mat *vec##N##_soa_pack(mat *soa, const vec##N *arr)                                    \
+    {                                                                                      \
+        assert(mat_is_valid(soa));                                                         \
+        assert(soa->d1 == N);                                                              \
+        assert(arr);                                                                       \
+                                                                                           \
+        const IND_TYP n = soa->d2;                                                         \
+        if (!mat_touch(soa))                                                               \
+            return NULL;                                                                   \
+        SOA_FOR                                                                            \
+            for (int k = 0; k < N; k++)                                                    \
+                SOA_ROW(soa, k)[j] = arr[j].e[k];                                          \
+        return soa;                                                                        \
+    }                                                                                      \
+                                                                                           \
+    vec##N *vec##N##_soa_unpack(vec##N *arr, const mat *soa)                               \
+    {                                                                                      \
+        assert(mat_is_valid(soa));                                                         \
+        assert(soa->d1 == N);                                                              \
+        assert(arr);                                                                       \
+                                                                                           \
+        const IND_TYP n = soa->d2;                                                         \
+        SOA_FOR                                                                            \
+            for (int k = 0; k < N; k++)                                                    \
+                arr[j].e[k] = SOA_ROW(soa, k)[j];                                          \
+        return arr;                                                                        \
+    }                                                                                      \
+                                                                                           \
+    vec *vec##N##_soa_dot(vec *result, const mat *a, const mat *b)                         \
+    {                                                                                      \
+        assert(vec_is_valid(result));                                                      \
+        assert(mat_is_valid(a) && mat_is_valid(b));                                        \
+        assert(a->d1 == N && b->d1 == N && a->d2 == b->d2);                                \
+        assert(result->d == a->d2);                                                        \
+                                                                                           \
+        const IND_TYP n = a->d2;                                                           \
+        if (!vec_touch(result))                                                            \
+            return NULL;                                                                   \
+        FLD_TYP *out = result->pyl->arr + result->offset;                                  \
+        const IND_TYP st = result->step;                                                   \
+        SOA_FOR_SIMD                                                                       \
+        {                                                                                  \
+            FLD_TYP s = 0;                                                                 \
+            for (int k = 0; k < N; k++)                                                    \
+                s += SOA_ROW(a, k)[j] * SOA_ROW(b, k)[j];                                  \
+            out[j * st] = s;                                                               \
+        }                                                                                  \
+        return result;                                                                     \
+    }                                                                                      \
+                                                                                           \
+    mat *mat##N##_soa_mul_vec(mat *result, mat##N m, const mat *v)                         \
+    {                                                                                      \
+        assert(mat_is_valid(result));                                                      \
+        assert(mat_is_valid(v));                                                           \
+        assert(v->d1 == N && result->d1 == N && result->d2 == v->d2);                      \
+                                                                                           \
+        const IND_TYP n = v->d2;                                                           \
+        if (!mat_touch(result))                                                            \
+            return NULL;                                                                   \
+        SOA_FOR_SIMD                                                                       \
+        {                                                                                  \
+            FLD_TYP x[N];                                                                  \
+            for (int k = 0; k < N; k++)                                                    \
+                x[k] = SOA_ROW(v, k)[j];                                                   \
+            for (int i = 0; i < N; i++)                                                    \
+            {                                                                              \
+                FLD_TYP s = 0;                                                             \
+                for (int k = 0; k < N; k++)                                                \
+                    s += m.e[i][k] * x[k];                                                 \
+                SOA_ROW(result, i)[j] = s;                                                 \
+            }                                                                              \
+        }                                                                                  \
+        return result;                                                                     \
+    }
+
+VEC_SOA_DEF(2)
+VEC_SOA_DEF(3)
+VEC_SOA_DEF(4)
+
+mat *vec3_soa_cross(mat *result, const mat *a, const mat *b)
+{
+    assert(mat_is_valid(result));
+    assert(mat_is_valid(a) && mat_is_valid(b));
+    assert(a->d1 == 3 && b->d1 == 3 && result->d1 == 3);
+    assert(a->d2 == b->d2 && result->d2 == a->d2);
+
+    const IND_TYP n = a->d2;
+    if (!mat_touch(result))
+        return NULL;
+    const FLD_TYP *a0 = SOA_ROW(a, 0), *a1 = SOA_ROW(a, 1), *a2 = SOA_ROW(a, 2);
+    const FLD_TYP *b0 = SOA_ROW(b, 0), *b1 = SOA_ROW(b, 1), *b2 = SOA_ROW(b, 2);
+    FLD_TYP *r0 = SOA_ROW(result, 0), *r1 = SOA_ROW(result, 1), *r2 = SOA_ROW(result, 2);
+    SOA_FOR_SIMD
+    {
+        const FLD_TYP x = a1[j] * b2[j] - a2[j] * b1[j];
+        const FLD_TYP y = a2[j] * b0[j] - a0[j] * b2[j];
+        const FLD_TYP z = a0[j] * b1[j] - a1[j] * b0[j];
+        r0[j] = x;
+        r1[j] = y;
+        r2[j] = z;
+    }
+    return result;
+}
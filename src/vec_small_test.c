@@ -0,0 +1,236 @@
+#include "vec_small.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <tgmath.h>
+#include <omp.h>
+
+#include "vec_mat.h"
+
+#define TOL (sizeof(FLD_TYP) == 4 ? 1E-4 : 1E-12)
+
+#ifndef SMALL_BENCH_N
+#define SMALL_BENCH_N 1000000
+#endif
+
+static FLD_TYP rnd(void)
+{
+    return 2 * (rand() / (FLD_TYP)RAND_MAX) - 1;
+}
+
+static mat4 mat4_rnd(void)
+{
+    mat4 m;
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++)
+            m.e[i][j] = rnd() + (i == j ? 4 : 0);
+    return m;
+}
+
+static FLT_TYP mat4_max_diff(mat4 a, mat4 b)
+{
+    FLT_TYP d = 0;
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++)
+            d = fmax(d, fabs(a.e[i][j] - b.e[i][j]));
+    return d;
+}
+
+static void ops_test(void)
+{
+    // Against the vec / mat kernels
+    mat4 a = mat4_rnd(), b = mat4_rnd();
+    vec4 x = {{rnd(), rnd(), rnd(), rnd()}};
+    mat ma = mat_NULL, mb = mat_NULL, mc = mat_NULL;
+    vec vx = vec_NULL, vy = vec_NULL;
+    mat_construct(&ma, 4, 4);
+    mat_construct(&mb, 4, 4);
+    mat_construct(&mc, 4, 4);
+    vec_construct(&vx, 4);
+    vec_construct(&vy, 4);
+    mat4_to_mat(&ma, a);
+    mat4_to_mat(&mb, b);
+    vec4_to_vec(&vx, x);
+    mat_dot(&mc, &ma, &mb);
+    mat_dot_vec(&vy, &ma, &vx);
+    FLT_TYP err = mat4_max_diff(mat4_mul(a, b), mat4_from_mat(&mc));
+    const vec4 y = mat4_mul_vec(a, x);
+    err = fmax(err, vec4_norm(vec4_sub(y, vec4_from_vec(&vy))));
+    err = fmax(err, fabs(vec4_dot(x, y) - vec_dot(&vx, &vy)));
+    err = fmax(err, mat4_max_diff(mat4_transpose(mat4_transpose(a)), a));
+
+    mat4 inv = mat4_eye();
+    const bool ok_inv = mat4_inv(&inv, a);
+    if (ok_inv)
+        err = fmax(err, mat4_max_diff(mat4_mul(a, inv), mat4_eye()));
+    mat3 s = {{{1, 2, 3}, {2, 4, 6}, {0, 1, 1}}}, s_inv = mat3_eye();
+    const bool ok_sing = !mat3_inv(&s_inv, s) && s_inv.e[0][0] == 1;
+    mat2 r = {{{0, -1}, {1, 0}}}, r_inv = mat2_eye();
+    const bool ok_rot = mat2_inv(&r_inv, r);
+    if (ok_rot)
+        err = fmax(err, fabs(r_inv.e[0][1] - 1) + fabs(r_inv.e[1][0] + 1));
+
+    // cross is orthogonal to both; |a x b| = |a| |b| sin
+    const vec3 u = {{1, 2, 3}}, v = {{-2, 0.5, 4}}, w = vec3_cross(u, v);
+    err = fmax(err, fabs(vec3_dot(w, u)) + fabs(vec3_dot(w, v)));
+    const FLD_TYP c = vec3_dot(u, v) / (vec3_norm(u) * vec3_norm(v));
+    err = fmax(err, fabs(vec3_norm(w) - vec3_norm(u) * vec3_norm(v) * sqrt(1 - c * c)) / vec3_norm(w));
+    vec16 p = vec16_fill(2), q = vec16_axpy(3, p, vec16_fill(1));
+    const bool ok_16 = vec16_dot(p, q) == 16 * 14 && _Alignof(vec16) <= 16 && _Alignof(vec4) >= 4 * sizeof(float);
+
+    const bool ok = err < TOL;
+    printf("small ops vs. vec / mat kernels: max err %g (< %g: %d), inverse: %d %d, singular rejected: %d, "
+           "vec16: %d\n",
+           err, TOL, ok, ok_inv, ok_rot, ok_sing, ok_16);
+    assert(ok && ok_inv && ok_rot && ok_sing && ok_16);
+
+    mat_destruct(&ma);
+    mat_destruct(&mb);
+    mat_destruct(&mc);
+    vec_destruct(&vx);
+    vec_destruct(&vy);
+    puts("------");
+}
+
+static void soa_test(void)
+{
+    const IND_TYP n = 1001;
+    vec3 *a = (vec3 *)malloc(n * sizeof(vec3)), *b = (vec3 *)malloc(n * sizeof(vec3));
+    vec3 *c = (vec3 *)malloc(n * sizeof(vec3));
+    for (IND_TYP j = 0; j < n; j++)
+    {
+        a[j] = (vec3){{rnd(), rnd(), rnd()}};
+        b[j] = (vec3){{rnd(), rnd(), rnd()}};
+    }
+    mat sa = mat_NULL, sb = mat_NULL;
+    vec d = vec_NULL;
+    mat_construct(&sa, 3, n);
+    mat_construct(&sb, 3, n);
+    vec_construct(&d, n);
+    vec3_soa_pack(&sa, a);
+    vec3_soa_pack(&sb, b);
+    vec3_soa_dot(&d, &sa, &sb);
+    // In place: sa = sa x sb, then m @ sa
+    vec3_soa_cross(&sa, &sa, &sb);
+    mat3 m = {{{1, 2, 0}, {0, 1, -1}, {3, 0, 1}}};
+    mat3_soa_mul_vec(&sa, m, &sa);
+    vec3_soa_unpack(c, &sa);
+    FLT_TYP err = 0;
+    for (IND_TYP j = 0; j < n; j++)
+    {
+        err = fmax(err, fabs(*vec_at(&d, j) - vec3_dot(a[j], b[j])));
+        err = fmax(err, vec3_norm(vec3_sub(c[j], mat3_mul_vec(m, vec3_cross(a[j], b[j])))));
+    }
+    const bool ok = err < TOL;
+    printf("SoA of %ld vec3: dot, cross, mul_vec max err %g (< %g: %d)\n", n, err, TOL, ok);
+    assert(ok);
+
+    free(a);
+    free(b);
+    free(c);
+    vec_destruct(&d);
+    mat_destruct(&sa);
+    mat_destruct(&sb);
+    puts("------");
+}
+
+void vec_small_test(void)
+{
+    puts("+++ vec_small_test +++");
+
+    ops_test();
+    soa_test();
+
+    puts("^^^ vec_small_test ^^^");
+}
+
+void vec_small_bench(void)
+{
+    puts("+++ vec_small_bench +++");
+
+    // Transforming n points by 4x4 matrices, and n 3-vector dots: small types vs. vec / mat
+    const IND_TYP n = SMALL_BENCH_N, n_vm = n / 100;
+    mat4 *ms = (mat4 *)malloc(n * sizeof(mat4));
+    vec4 *ps = (vec4 *)malloc(n * sizeof(vec4));
+    for (IND_TYP j = 0; j < n; j++)
+    {
+        ms[j] = mat4_rnd();
+        ps[j] = (vec4){{rnd(), rnd(), rnd(), 1}};
+    }
+    double t0 = omp_get_wtime();
+    vec4 acc = vec4_fill(0);
+    for (IND_TYP j = 0; j < n; j++)
+        acc = vec4_add(acc, mat4_mul_vec(mat4_mul(ms[j], ms[(j + 1) % n]), ps[j]));
+    const double t_small = (omp_get_wtime() - t0) / n;
+
+    mat a = mat_NULL, b = mat_NULL, c = mat_NULL;
+    vec p = vec_NULL, q = vec_NULL, s = vec_NULL;
+    mat_construct(&a, 4, 4);
+    mat_construct(&b, 4, 4);
+    mat_construct(&c, 4, 4);
+    vec_construct(&p, 4);
+    vec_construct(&q, 4);
+    vec_construct(&s, 4);
+    vec_fill_zero(&s);
+    t0 = omp_get_wtime();
+    for (IND_TYP j = 0; j < n_vm; j++)
+    {
+        mat4_to_mat(&a, ms[j]);
+        mat4_to_mat(&b, ms[j + 1]);
+        vec4_to_vec(&p, ps[j]);
+        mat_dot(&c, &a, &b);
+        mat_dot_vec(&q, &c, &p);
+        vec_addto(&s, &q);
+    }
+    const double t_vm = (omp_get_wtime() - t0) / n_vm;
+    printf("mat4 @ mat4 @ vec4: small types %.1f ns, vec / mat %.1f ns (x%.0f), check %g %g\n", t_small * 1e9,
+           t_vm * 1e9, t_vm / t_small, acc.e[0], *vec_at(&s, 0));
+
+    // SoA dot and cross of n vec3
+    vec3 *u = (vec3 *)malloc(n * sizeof(vec3)), *v = (vec3 *)malloc(n * sizeof(vec3));
+    for (IND_TYP j = 0; j < n; j++)
+    {
+        u[j] = (vec3){{rnd(), rnd(), rnd()}};
+        v[j] = (vec3){{rnd(), rnd(), rnd()}};
+    }
+    mat su = mat_NULL, sv = mat_NULL, sw = mat_NULL;
+    vec d = vec_NULL;
+    mat_construct(&su, 3, n);
+    mat_construct(&sv, 3, n);
+    mat_construct(&sw, 3, n);
+    vec_construct(&d, n);
+    vec3_soa_pack(&su, u);
+    vec3_soa_pack(&sv, v);
+    // Once untimed: first touch of sw and d
+    vec3_soa_cross(&sw, &su, &sv);
+    vec3_soa_dot(&d, &sw, &su);
+    t0 = omp_get_wtime();
+    vec3_soa_cross(&sw, &su, &sv);
+    vec3_soa_dot(&d, &sw, &su);
+    const double t_soa = (omp_get_wtime() - t0) / n;
+    t0 = omp_get_wtime();
+    FLD_TYP sum = 0;
+    for (IND_TYP j = 0; j < n; j++)
+        sum += vec3_dot(vec3_cross(u[j], v[j]), u[j]);
+    const double t_aos = (omp_get_wtime() - t0) / n;
+    printf("vec3 cross + dot: SoA %.2f ns, by value %.2f ns per vector (%d threads), check %g\n", t_soa * 1e9,
+           t_aos * 1e9, omp_get_max_threads(), sum);
+
+    free(ms);
+    free(ps);
+    free(u);
+    free(v);
+    vec_destruct(&d);
+    mat_destruct(&su);
+    mat_destruct(&sv);
+    mat_destruct(&sw);
+    mat_destruct(&a);
+    mat_destruct(&b);
+    mat_destruct(&c);
+    vec_destruct(&p);
+    vec_destruct(&q);
+    vec_destruct(&s);
+
+    puts("^^^ vec_small_bench ^^^");
+}
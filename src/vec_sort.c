@@ -0,0 +1,233 @@
+#include "vec_sort.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <tgmath.h>
+#include <omp.h>
+
+#define MIN(x, y) (((x) <= (y)) ? (x) : (y))
+#define MAX(x, y) (((x) >= (y)) ? (x) : (y))
+
+typedef struct val_idx
+{
+    FLD_TYP v;
+    IND_TYP i;
+} val_idx;
+
+// a comes before b in top-k order: larger value, then smaller index
+static inline bool before(val_idx a, val_idx b)
+{
+    return a.v > b.v || (a.v == b.v && a.i < b.i);
+}
+
+static int cmp_desc(const void *x, const void *y)
+{
+    const val_idx a = *(const val_idx *)x, b = *(const val_idx *)y;
+    return before(b, a) - before(a, b);
+}
+
+static int cmp_asc(const void *x, const void *y)
+{
+    const val_idx a = *(const val_idx *)x, b = *(const val_idx *)y;
+    return (a.v > b.v || (a.v == b.v && a.i > b.i)) - (a.v < b.v || (a.v == b.v && a.i < b.i));
+}
+
+static inline void swap(val_idx *a, val_idx *b)
+{
+    const val_idx t = *a;
+    *a = *b;
+    *b = t;
+}
+
+// Quickselect: moves the k first (in top-k order) of p[0..n) to p[0..k), p[k - 1] the k-th
+static void select_top(val_idx *p, IND_TYP n, IND_TYP k)
+{
+    IND_TYP lo = 0, hi = n - 1;
+    while (lo < hi)
+    {
+        const IND_TYP mid = lo + (hi - lo) / 2;
+        if (before(p[mid], p[lo]))
+            swap(&p[mid], &p[lo]);
+        if (before(p[hi], p[lo]))
+            swap(&p[hi], &p[lo]);
+        if (before(p[hi], p[mid]))
+            swap(&p[hi], &p[mid]);
+        const val_idx pivot = p[mid];
+
+        IND_TYP i = lo, j = hi;
+        while (i <= j)
+        {
+            while (before(p[i], pivot))
+                i++;
+            while (before(pivot, p[j]))
+                j--;
+            if (i <= j)
+                swap(&p[i++], &p[j--]);
+        }
+        if (k - 1 <= j)
+            hi = j;
+        else if (k - 1 >= i)
+            lo = i;
+        else
+            break;
+    }
+}
+
+// Candidate buffer length for top k of n
+static inline IND_TYP buf_len(IND_TYP n, IND_TYP k)
+{
+    return MIN(n, MAX(4 * k, TOPK_CHUNK) + TOPK_CHUNK);
+}
+
+// Top k of arr[0], arr[step], ... (n elements) into buf[0..k), unordered; indices start at
+// i_0. buf holds buf_len(n, k) elements.
+static void topk_kernel(val_idx *buf, const FLD_TYP *arr, IND_TYP step, IND_TYP n, IND_TYP k, IND_TYP i_0)
+{
+    const IND_TYP cap = buf_len(n, k);
+    FLD_TYP thr = -INFINITY;
+    IND_TYP cnt = 0;
+    for (IND_TYP c_0 = 0; c_0 < n; c_0 += TOPK_CHUNK)
+    {
+        const IND_TYP c_1 = MIN(n, c_0 + TOPK_CHUNK);
+        if (cnt >= k)
+        {
+            // Later elements lose ties, so a chunk not above the threshold is skipped.
+            FLD_TYP mx = -INFINITY;
+            if (step == 1)
+            {
+#pragma omp simd reduction(max : mx)
+                for (IND_TYP i = c_0; i < c_1; i++)
+                    mx = MAX(mx, arr[i]);
+            }
+            else
+            {
+#pragma omp simd reduction(max : mx)
+                for (IND_TYP i = c_0; i < c_1; i++)
+                    mx = MAX(mx, arr[i * step]);
+            }
+            if (mx <= thr)
+                continue;
+        }
+        for (IND_TYP i = c_0; i < c_1; i++)
+        {
+            const FLD_TYP x = arr[i * step];
+            if (cnt < k || x > thr)
+                buf[cnt++] = (val_idx){.v = x, .i = i_0 + i};
+        }
+        if (cnt + TOPK_CHUNK > cap && cnt > k)
+        {
+            select_top(buf, cnt, k);
+            cnt = k;
+            thr = buf[k - 1].v;
+        }
+    }
+    select_top(buf, cnt, k);
+}
+
+static void write_out(FLD_TYP *val, IND_TYP val_step, IND_TYP *idx, val_idx *buf, IND_TYP k)
+{
+    qsort(buf, k, sizeof(val_idx), cmp_desc);
+    for (IND_TYP e = 0; e < k; e++)
+        val[e * val_step] = buf[e].v;
+    if (idx)
+        for (IND_TYP e = 0; e < k; e++)
+            idx[e] = buf[e].i;
+}
+
+vec *vec_topk(vec *values, IND_TYP idx[], const vec *v, IND_TYP k)
+{
+    assert(vec_is_valid(values));
+    assert(vec_is_valid(v));
+    assert(k > 0 && k <= v->d);
+    assert(values->d == k);
+
+    if (!vec_touch(values))
+        return NULL;
+    const IND_TYP n = v->d;
+    const FLD_TYP *arr = v->pyl->arr + v->offset;
+    // Parts of at least PAR_MIN_SIZE elements, each reduced to k candidates
+    const IND_TYP n_part = (n >= 2 * PAR_MIN_SIZE && k < PAR_MIN_SIZE) ? MIN(omp_get_max_threads(), n / PAR_MIN_SIZE)
+                                                                          : 1;
+    const IND_TYP part = (n + n_part - 1) / n_part;
+    const IND_TYP p_len = buf_len(part, k);
+    val_idx *buf = (val_idx *)malloc((n_part * p_len + n_part * k) * sizeof(val_idx));
+    assert(buf);
+    if (!buf)
+        return NULL;
+    val_idx *cand = buf + n_part * p_len;
+
+#pragma omp parallel for if (n_part > 1)
+    for (IND_TYP p = 0; p < n_part; p++)
+    {
+        const IND_TYP i_0 = p * part, n_p = MIN(part, n - i_0);
+        const IND_TYP k_p = MIN(k, n_p);
+        topk_kernel(buf + p * p_len, arr + i_0 * v->step, v->step, n_p, k_p, i_0);
+        for (IND_TYP e = 0; e < k; e++)
+            cand[p * k + e] = (e < k_p) ? buf[p * p_len + e] : (val_idx){.v = -INFINITY, .i = n};
+    }
+    if (n_part > 1)
+        select_top(cand, n_part * k, k);
+    else
+        cand = buf;
+    write_out(values->pyl->arr + values->offset, values->step, idx, cand, k);
+
+    free((void *)buf);
+    return values;
+}
+
+mat *mat_topk_rows(mat *values, IND_TYP idx[], const mat *m, IND_TYP k)
+{
+    assert(mat_is_valid(values));
+    assert(mat_is_valid(m));
+    assert(k > 0 && k <= m->d2);
+    assert(values->d1 == m->d1 && values->d2 == k);
+
+    if (!mat_touch(values))
+        return NULL;
+    const FLD_TYP *m_arr = m->pyl->arr + m->offset;
+    FLD_TYP *v_arr = values->pyl->arr + values->offset;
+    const IND_TYP len = buf_len(m->d2, k);
+    bool ok = true;
+
+#pragma omp parallel if (m->d1 > 1 && m->size >= PAR_MIN_SIZE)
+    {
+        val_idx *buf = (val_idx *)malloc(len * sizeof(val_idx));
+        assert(buf);
+        if (!buf)
+        {
+#pragma omp atomic write
+            ok = false;
+        }
+#pragma omp for schedule(static)
+        for (IND_TYP r = 0; r < m->d1; r++)
+        {
+            if (!buf)
+                continue;
+            topk_kernel(buf, m_arr + r * m->d2, 1, m->d2, k, 0);
+            write_out(v_arr + r * k, 1, idx ? idx + r * k : NULL, buf, k);
+        }
+        free((void *)buf);
+    }
+
+    return ok ? values : NULL;
+}
+
+IND_TYP *vec_argsort(IND_TYP idx[], const vec *v, bool descending)
+{
+    assert(idx);
+    assert(vec_is_valid(v));
+
+    val_idx *buf = (val_idx *)malloc(v->d * sizeof(val_idx));
+    assert(buf);
+    if (!buf)
+        return NULL;
+    const FLD_TYP *arr = v->pyl->arr + v->offset;
+    for (IND_TYP i = 0; i < v->d; i++)
+        buf[i] = (val_idx){.v = arr[i * v->step], .i = i};
+    qsort(buf, v->d, sizeof(val_idx), descending ? cmp_desc : cmp_asc);
+    for (IND_TYP i = 0; i < v->d; i++)
+        idx[i] = buf[i].i;
+
+    free((void *)buf);
+    return idx;
+}
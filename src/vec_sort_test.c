@@ -0,0 +1,194 @@
+#include "vec_sort.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <omp.h>
+
+#ifndef SORT_BENCH_N
+#define SORT_BENCH_N (1 << 22)
+#endif
+
+// Integers in [0, 64) make plenty of ties
+static FLD_TYP rnd_int(void)
+{
+    return rand() % 64;
+}
+
+static FLD_TYP rnd(void)
+{
+    return 2 * (rand() / (FLD_TYP)RAND_MAX) - 1;
+}
+
+// Checks values and idx of top k of v against its stable descending argsort
+static bool topk_check(const vec *v, IND_TYP k)
+{
+    vec val = vec_NULL;
+    vec_construct(&val, k);
+    IND_TYP *idx = (IND_TYP *)malloc(k * sizeof(IND_TYP));
+    IND_TYP *ord = (IND_TYP *)malloc(v->d * sizeof(IND_TYP));
+    vec_topk(&val, idx, v, k);
+    vec_argsort(ord, v, true);
+    bool ok = true;
+    for (IND_TYP e = 0; e < k; e++)
+        ok = ok && idx[e] == ord[e] && *vec_at(&val, e) == *vec_at(v, ord[e]);
+    free(idx);
+    free(ord);
+    vec_destruct(&val);
+    return ok;
+}
+
+static void argsort_test(void)
+{
+    char buff[1024];
+    const FLD_TYP arr[] = {3, 1, 2, 3, 0, 2};
+    const IND_TYP n = sizeof(arr) / sizeof(arr[0]);
+    vec v = vec_NULL;
+    vec_construct(&v, n);
+    vec_copy_arr(&v, arr);
+    IND_TYP idx[6];
+    printf("v: %s\n", vec_to_str(&v, buff));
+
+    vec_argsort(idx, &v, false);
+    printf("argsort ascending: ");
+    for (IND_TYP i = 0; i < n; i++)
+        printf("%ld ", idx[i]);
+    puts("");
+    const IND_TYP asc[] = {4, 1, 2, 5, 0, 3};
+    bool ok = true;
+    for (IND_TYP i = 0; i < n; i++)
+        ok = ok && idx[i] == asc[i];
+
+    vec_argsort(idx, &v, true);
+    printf("argsort descending: ");
+    for (IND_TYP i = 0; i < n; i++)
+        printf("%ld ", idx[i]);
+    puts("");
+    const IND_TYP desc[] = {0, 3, 2, 5, 1, 4};
+    for (IND_TYP i = 0; i < n; i++)
+        ok = ok && idx[i] == desc[i];
+    assert(ok);
+
+    vec_destruct(&v);
+    puts("------");
+}
+
+static void topk_test(void)
+{
+    const IND_TYP n = 3000, n_large = 200000;
+    vec v = vec_NULL, v_s = vec_NULL, v_l = vec_NULL;
+    vec_construct(&v, n);
+    vec_construct(&v_l, n_large);
+    vec_fill_rnd(&v, rnd_int);
+    vec_fill_rnd(&v_l, rnd);
+    vec_view(&v_s, &v, n - 1, 0, -3);
+
+    bool ok = true;
+    const IND_TYP ks[] = {1, 7, 100, 3000};
+    for (int i = 0; i < 4; i++)
+    {
+        bool ok_k = topk_check(&v, ks[i]);
+        printf("vec_topk n=%ld k=%ld with ties: %s\n", n, ks[i], ok_k ? "ok" : "failed");
+        ok = ok && ok_k;
+    }
+    bool ok_s = topk_check(&v_s, 50);
+    printf("vec_topk strided view d=%ld step=%ld k=50: %s\n", v_s.d, v_s.step, ok_s ? "ok" : "failed");
+    bool ok_l = topk_check(&v_l, 20);
+    printf("vec_topk n=%ld k=20 (split between threads): %s\n", n_large, ok_l ? "ok" : "failed");
+    ok = ok && ok_s && ok_l;
+
+    // Rows against vec_topk
+    const IND_TYP d1 = 40, d2 = 500, k = 9;
+    mat m = mat_NULL, val = mat_NULL;
+    vec row = vec_NULL, row_val = vec_NULL;
+    mat_construct(&m, d1, d2);
+    mat_construct(&val, d1, k);
+    vec_construct(&row_val, k);
+    mat_fill_rnd(&m, rnd_int);
+    IND_TYP *idx = (IND_TYP *)malloc(d1 * k * sizeof(IND_TYP));
+    IND_TYP row_idx[9];
+    mat_topk_rows(&val, idx, &m, k);
+    bool ok_r = true;
+    for (IND_TYP r = 0; r < d1; r++)
+    {
+        vec_construct_prealloc(&row, m.pyl, m.offset + r * d2, d2, 1);
+        vec_topk(&row_val, row_idx, &row, k);
+        for (IND_TYP e = 0; e < k; e++)
+            ok_r = ok_r && idx[r * k + e] == row_idx[e] && *mat_at(&val, r, e) == *vec_at(&row_val, e);
+    }
+    printf("mat_topk_rows %ldx%ld k=%ld: %s\n", d1, d2, k, ok_r ? "ok" : "failed");
+    assert(ok && ok_r);
+
+    free(idx);
+    mat_destruct(&m);
+    mat_destruct(&val);
+    vec_destruct(&row);
+    vec_destruct(&row_val);
+    vec_destruct(&v);
+    vec_destruct(&v_s);
+    vec_destruct(&v_l);
+    puts("------");
+}
+
+void vec_sort_test(void)
+{
+    puts("+++ vec_sort_test +++");
+
+    argsort_test();
+    topk_test();
+
+    puts("^^^ vec_sort_test ^^^");
+}
+
+void vec_sort_bench(void)
+{
+    puts("+++ vec_sort_bench +++");
+
+    const IND_TYP n = SORT_BENCH_N;
+    vec v = vec_NULL, val = vec_NULL;
+    vec_construct(&v, n);
+    vec_fill_rnd(&v, rnd);
+    IND_TYP *idx = (IND_TYP *)malloc(n * sizeof(IND_TYP));
+
+    double t0 = omp_get_wtime();
+    vec_argsort(idx, &v, true);
+    double sort_elp = omp_get_wtime() - t0;
+    printf("vec_argsort n=%ld: %g s\n", n, sort_elp);
+    for (IND_TYP k = 1; k <= 10000; k *= 10)
+    {
+        vec_construct(&val, k);
+        t0 = omp_get_wtime();
+        vec_topk(&val, idx, &v, k);
+        double elp = omp_get_wtime() - t0;
+        printf("vec_topk n=%ld k=%5ld: %g s, speed-up over full sort: %.1f\n", n, k, elp, sort_elp / elp);
+        vec_destruct(&val);
+    }
+
+    // Rows: batched against one full sort per row
+    const IND_TYP d1 = 1024, d2 = 8192, k = 16;
+    mat m = mat_NULL, m_val = mat_NULL;
+    vec row = vec_NULL;
+    mat_construct(&m, d1, d2);
+    mat_construct(&m_val, d1, k);
+    mat_fill_rnd(&m, rnd);
+    t0 = omp_get_wtime();
+    for (IND_TYP r = 0; r < d1; r++)
+    {
+        vec_construct_prealloc(&row, m.pyl, m.offset + r * d2, d2, 1);
+        vec_argsort(idx, &row, true);
+    }
+    sort_elp = omp_get_wtime() - t0;
+    t0 = omp_get_wtime();
+    mat_topk_rows(&m_val, idx, &m, k);
+    double elp = omp_get_wtime() - t0;
+    printf("%ldx%ld rows, k=%ld: argsort per row: %g s, mat_topk_rows: %g s, speed-up: %.1f\n",
+           d1, d2, k, sort_elp, elp, sort_elp / elp);
+
+    free(idx);
+    vec_destruct(&v);
+    vec_destruct(&row);
+    mat_destruct(&m);
+    mat_destruct(&m_val);
+
+    puts("^^^ vec_sort_bench ^^^");
+}
@@ -2,7 +2,11 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <time.h>
+#include <math.h>
+#include <assert.h>
+#include <omp.h>
 
 #include "vector_eng.h"
 
@@ -130,6 +134,100 @@ void fill_vec_test(void)
 
 }
 
+static void is_close_test(void)
+{
+    payload pyl;
+    payload_prealloc(&pyl, (FLD_TYP[]){1, 0, 2, 0, 3, 0}, 6);
+    vec a = vec_NULL, b = vec_NULL;
+    vec_construct(&a, 3);
+    vec_copy_arr(&a, (FLD_TYP[]){1, 2, 3.001});
+    vec_construct_prealloc(&b, &pyl, 0, 3, 2);
+
+    bool c_1 = vec_is_close(&a, &b, 1E-3), c_2 = vec_is_close(&a, &b, 1E-4);
+    bool ac_1 = vec_allclose(&a, &b, 0, 1E-3), ac_2 = vec_allclose(&a, &b, 1E-4, 1E-4);
+    printf("is_close(1E-3): %d, is_close(1E-4): %d, allclose(0, 1E-3): %d, allclose(1E-4, 1E-4): %d\n",
+           c_1, c_2, ac_1, ac_2);
+    assert(c_1 && !c_2 && ac_1 && !ac_2);
+    *vec_at(&a, 0) = NAN;
+    bool ac_nan = vec_allclose(&a, &b, 1, 1);
+    printf("allclose with NaN: %d\n", ac_nan);
+    assert(!ac_nan);
+
+    vec_destruct(&a);
+    vec_destruct(&b);
+    puts("--------");
+}
+
+static void push_back_test(void)
+{
+    const IND_TYP n = 1000000;
+    vec v = vec_NULL, head = vec_NULL, rev = vec_NULL;
+    const FLD_TYP *arr = NULL;
+    int n_move = 0;
+    bool aligned = true;
+    clock_t start = clock();
+    for (IND_TYP i = 0; i < n; i++)
+    {
+        vec_push_back(&v, (FLD_TYP)i);
+        if (v.pyl->arr != arr)
+        {
+            arr = v.pyl->arr;
+            n_move++;
+            aligned = aligned && (uintptr_t)arr % 64 == 0;
+        }
+        if (i == 9)
+            vec_view(&head, &v, 0, 10, 1);
+    }
+    double push_t = (clock() - start) / (double)CLOCKS_PER_SEC;
+    bool ok_push = v.d == n && *vec_at(&v, n - 1) == n - 1 && *vec_at(&head, 9) == 9 && head.pyl == v.pyl;
+    printf("vec_push_back %ld: %g s, %d reallocations, aligned: %d, in order and view kept: %d\n", n, push_t,
+           n_move, aligned, ok_push);
+    assert(ok_push && aligned && n_move <= 25);
+
+    // Appending a reversed view of the head, then v to itself
+    vec_construct_prealloc(&rev, v.pyl, 9, 10, -1);
+    vec_append(&v, &rev);
+    vec_append(&v, &v);
+    const bool ok_app = v.d == 2 * (n + 10) && *vec_at(&v, n) == 9 && *vec_at(&v, n + 9) == 0 &&
+                        *vec_at(&v, n + 10) == 0 && *vec_at(&v, -1) == 0 && *vec_at(&v, -10) == 9;
+    printf("vec_append reversed view and self: %d\n", ok_app);
+    assert(ok_app);
+
+    vec_destruct(&rev);
+    vec_destruct(&head);
+    vec_destruct(&v);
+    puts("--------");
+}
+
+static void inline_test(void)
+{
+    const IND_TYP d = 7;
+    vec_inl s, t;
+    vec *a = vec_inl_construct(&s, d), *b = vec_inl_construct(&t, d);
+    vec h = vec_NULL, w = vec_NULL;
+    vec_construct(&h, d);
+    for (IND_TYP i = 0; i < d; i++)
+        *vec_at(a, i) = (FLD_TYP)i;
+    vec_fill(b, 2);
+    vec_add(&h, a, b);
+    vec_scale(b, 0.5f);
+    const bool ok_ops = vec_dot(a, b) == 21 && *vec_at(&h, d - 1) == 8 && a->pyl->arr == s.buf;
+    // A view shares the inline payload; destructed, nothing is freed
+    vec_view(&w, a, 1, d, 2);
+    vec_fill(&w, -1);
+    const bool ok_view = w.pyl == &s.pyl && s.pyl.ref_count == 2 && *vec_at(a, 3) == -1 && *vec_at(a, 2) == 2;
+    vec_destruct(&w);
+    vec_destruct(a);
+    const bool ok_null = vec_is_null(&s.v) && vec_is_valid(vec_inl_construct(&s, VEC_INL_MAX));
+    printf("inline vec d=%ld: ops: %d, view: %d, destructed and reconstructed: %d\n", d, ok_ops, ok_view, ok_null);
+    assert(ok_ops && ok_view && ok_null);
+
+    vec_destruct(&s.v);
+    vec_destruct(b);
+    vec_destruct(&h);
+    puts("--------");
+}
+
 void vec_test(void)
 {
     puts("+++ vec_test +++");
@@ -185,7 +283,68 @@ void vec_test(void)
     // fill_vec_test();
     
     relu_test();
+    is_close_test();
     sigmoid_test();
+    push_back_test();
+    inline_test();
 
     puts("^^^ vec_test ^^^");
-}
\ No newline at end of file
+}
+
+void vec_bench(void)
+{
+    puts("+++ vec_bench +++");
+
+    // Short vecs: construct, fill, dot, destruct on the heap and inline
+    const int reps = 1000000;
+    for (IND_TYP d = 4; d <= VEC_INL_MAX; d *= 2)
+    {
+        vec b = vec_NULL;
+        vec_construct(&b, d);
+        vec_fill(&b, 1);
+        FLD_TYP sum = 0;
+        double t0 = omp_get_wtime();
+        for (int r = 0; r < reps; r++)
+        {
+            vec a = vec_NULL;
+            vec_construct(&a, d);
+            vec_fill(&a, (FLD_TYP)(r & 7));
+            sum += vec_dot(&a, &b);
+            vec_destruct(&a);
+        }
+        const double t_heap = (omp_get_wtime() - t0) / reps;
+        t0 = omp_get_wtime();
+        for (int r = 0; r < reps; r++)
+        {
+            vec_inl s;
+            vec *a = vec_inl_construct(&s, d);
+            vec_fill(a, (FLD_TYP)(r & 7));
+            sum -= vec_dot(a, &b);
+            vec_destruct(a);
+        }
+        const double t_inl = (omp_get_wtime() - t0) / reps;
+        // The op alone, on constructed vecs
+        vec_inl s;
+        vec h = vec_NULL;
+        vec *a = vec_inl_construct(&s, d);
+        vec_construct(&h, d);
+        vec_fill(a, 1);
+        vec_fill(&h, 1);
+        t0 = omp_get_wtime();
+        for (int r = 0; r < reps; r++)
+            sum += vec_dot(&h, &b);
+        const double t_op_heap = (omp_get_wtime() - t0) / reps;
+        t0 = omp_get_wtime();
+        for (int r = 0; r < reps; r++)
+            sum -= vec_dot(a, &b);
+        const double t_op_inl = (omp_get_wtime() - t0) / reps;
+        printf("d=%2ld: construct+fill+dot+destruct heap %.1f ns, inline %.1f ns; dot alone heap %.1f ns, inline %.1f "
+               "ns (check %g)\n",
+               d, t_heap * 1e9, t_inl * 1e9, t_op_heap * 1e9, t_op_inl * 1e9, sum);
+        vec_destruct(a);
+        vec_destruct(&h);
+        vec_destruct(&b);
+    }
+
+    puts("^^^ vec_bench ^^^");
+}